@@ -0,0 +1,246 @@
+/*
+ * Body proxy benchmark (see BODY_PROXY in physics.h): builds a scene of static
+ * tiles and shapes plus many actors made of several tiles and shapes each,
+ * once with body proxies off and once with them on, and times
+ *
+ *	move	moving every actor once with body_set_pos(), which is what
+ *		updates the quad trees when bodies move;
+ *	tiles	world_lookup_tiles() for screen sized areas, as when drawing;
+ *	shapes	world_lookup_shapes() for small areas, as in collision checks.
+ *
+ * Lookups must find the same tiles and shapes either way.
+ *
+ *	proxy_bench [num_actors] [steps]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "game2d.h"
+#include "log.h"
+#include "physics.h"
+#include "utlist.h"
+#include "world.h"
+#include "globals.h"
+
+#define WORLD_SIZE		8192	/* Scene is spread over this square. */
+#define NUM_STATIC_TILES	10000
+#define NUM_STATIC_SHAPES	1000
+#define ACTOR_TILES		12	/* 3 x 4 grid of 16 pixel tiles. */
+#define ACTOR_SHAPES		3
+#define NUM_LOOKUPS		1000
+
+extern Config config;
+
+static QTreeObject	*result[TILES_MAX];
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static vect_f
+random_pos(void)
+{
+	vect_f pos;
+
+	pos.x = rand() % WORLD_SIZE - WORLD_SIZE / 2;
+	pos.y = rand() % WORLD_SIZE - WORLD_SIZE / 2;
+	return pos;
+}
+
+static void
+add_box(Body *body, int l, int b, int r, int t, uint group)
+{
+	Shape *s;
+
+	s = shape_new();
+	s->shape_type = SHAPE_RECTANGLE;
+	bb_init(&s->shape.rect, l, b, r, t);
+	s->group = group;
+	s->body = body;
+	DL_APPEND(body->shapes, s);
+	shape_add_tree(s);
+}
+
+/*
+ * Static tiles and shapes, and [num_actors] actors. Actor bodies are returned
+ * in [actors].
+ */
+static World *
+build_scene(SpriteList *sprites, Body **actors, uint num_actors)
+{
+	World *world;
+	Body *body;
+	Tile *tile;
+	vect_f pos;
+	vect_i tile_pos, tile_size;
+	uint i, j, group;
+
+	srand(1);
+	world = world_new("Proxy bench", 10, 12);
+	group = world_get_group(world, "Bench")->id;
+
+	body = &world->static_body;
+	for (i = 0; i < NUM_STATIC_TILES; i++) {
+		pos = random_pos();
+		tile_pos.x = pos.x;
+		tile_pos.y = pos.y;
+		tile_size.x = tile_size.y = 32 + rand() % 33;
+		tile = tile_new(body, tile_pos, tile_size, sprites, 0.0);
+		tile_add_tree(tile);
+	}
+	for (i = 0; i < NUM_STATIC_SHAPES; i++) {
+		pos = random_pos();
+		add_box(body, pos.x, pos.y, pos.x + 16 + rand() % 240,
+		    pos.y + 16, group);
+	}
+
+	tile_size.x = tile_size.y = 16;
+	for (i = 0; i < num_actors; i++) {
+		body = body_new(world, random_pos(), 0);
+		for (j = 0; j < ACTOR_TILES; j++) {
+			tile_pos.x = (j % 3) * 16 - 24;
+			tile_pos.y = (j / 3) * 16;
+			tile = tile_new(body, tile_pos, tile_size, sprites,
+			    1.0);
+			tile_add_tree(tile);
+		}
+		add_box(body, -16, 0, 16, 48, group);		/* Body. */
+		add_box(body, -24, 0, 24, 8, group);		/* Feet. */
+		add_box(body, -8, 48, 8, 64, group);		/* Head. */
+		actors[i] = body;
+	}
+	return world;
+}
+
+/*
+ * Count lookup results that really overlap [bb]: loose trees also return
+ * some candidates that only come close.
+ */
+static uint
+count_overlaps(const BB *bb, uint num_results)
+{
+	uint i, n;
+
+	n = 0;
+	for (i = 0; i < num_results; i++) {
+		if (bb_overlap(bb, &result[i]->bb))
+			n++;
+	}
+	return n;
+}
+
+static int
+run(int proxies, uint num_actors, uint steps, uint *found)
+{
+	static Body *actors[TILES_MAX / ACTOR_TILES];
+	SpriteList sprites;
+	TexFrag frame = {0.0, 1.0, 1.0, 0.0};
+	World *world;
+	BB bb;
+	vect_f pos;
+	double t_move, t_tiles, t_shapes, t;
+	uint i, s, num_results;
+
+	memset(&sprites, 0, sizeof(sprites));
+	sprites.objtype = OBJTYPE_SPRITELIST;
+	sprites.num_frames = 1;
+	sprites.frames = &frame;
+
+	config.body_proxies = proxies;
+	world = build_scene(&sprites, actors, num_actors);
+
+	/* Every actor takes a small step in a random direction. */
+	t_move = 0.0;
+	for (s = 0; s < steps; s++) {
+		t = now_ns();
+		for (i = 0; i < num_actors; i++) {
+			pos = actors[i]->pos;
+			pos.x += rand() % 9 - 4;
+			pos.y += rand() % 9 - 4;
+			body_set_pos(actors[i], pos);
+		}
+		t_move += now_ns() - t;
+	}
+
+	/* Screen sized tile lookups. */
+	found[0] = 0;
+	t_tiles = 0.0;
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		pos = random_pos();
+		bb_init(&bb, pos.x, pos.y, pos.x + 640, pos.y + 480);
+		t = now_ns();
+		if (world_lookup_tiles(world, &bb, result, TILES_MAX,
+		    &num_results) != 0) {
+			fprintf(stderr, "Too many tiles found.\n");
+			return 1;
+		}
+		t_tiles += now_ns() - t;
+		found[0] += count_overlaps(&bb, num_results);
+	}
+
+	/* Small shape lookups. */
+	found[1] = 0;
+	t_shapes = 0.0;
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		pos = random_pos();
+		bb_init(&bb, pos.x, pos.y, pos.x + 64, pos.y + 64);
+		t = now_ns();
+		if (world_lookup_shapes(world, &bb, result, TILES_MAX,
+		    &num_results) != 0) {
+			fprintf(stderr, "Too many shapes found.\n");
+			return 1;
+		}
+		t_shapes += now_ns() - t;
+		found[1] += count_overlaps(&bb, num_results);
+	}
+
+	printf("%-8s %10.1f %10.2f %10.2f\n", proxies ? "on" : "off",
+	    t_move / steps / 1e3, t_tiles / NUM_LOOKUPS / 1e3,
+	    t_shapes / NUM_LOOKUPS / 1e3);
+
+	world_free(world);
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint num_actors, steps, found_off[2], found_on[2];
+
+	num_actors = argc > 1 ? (uint)atoi(argv[1]) : 800;
+	steps = argc > 2 ? (uint)atoi(argv[2]) : 200;
+	if (num_actors * ACTOR_TILES + NUM_STATIC_TILES > TILES_MAX) {
+		fprintf(stderr, "At most %u actors.\n",
+		    (TILES_MAX - NUM_STATIC_TILES) / ACTOR_TILES);
+		return 1;
+	}
+
+	log_open(NULL);
+	setup_memory();
+	config.loose_trees = 1;		/* As in config.lua. */
+
+	printf("%u static tiles, %u static shapes, %u actors of %u tiles and "
+	    "%u shapes\n", NUM_STATIC_TILES, NUM_STATIC_SHAPES, num_actors,
+	    ACTOR_TILES, ACTOR_SHAPES);
+	printf("%-8s %10s %10s %10s\n", "proxies", "move us", "tiles us",
+	    "shapes us");
+	if (run(0, num_actors, steps, found_off) ||
+	    run(1, num_actors, steps, found_on))
+		return 1;
+	if (found_off[0] != found_on[0] || found_off[1] != found_on[1]) {
+		fprintf(stderr, "Lookups differ: %u/%u tiles, %u/%u shapes.\n",
+		    found_off[0], found_on[0], found_off[1], found_on[1]);
+		return 1;
+	}
+	printf("move: per step, all actors; lookups: per call\n");
+	return 0;
+}
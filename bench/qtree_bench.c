@@ -0,0 +1,242 @@
+/*
+ * Quad tree build microbenchmark: times putting the same random objects into a
+ * tree one at a time with qtree_add() and all at once with qtree_build(), for
+ * both regular and loose trees, and checks that lookups then find the same
+ * objects in either tree.
+ *
+ *	qtree_bench [num_objects] [rounds]
+ *
+ * Without arguments, 20000 and 50000 objects are tried.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "mem.h"
+#include "qtree.h"
+
+#define TREE_LEVELS	12	/* As the game world. */
+#define WORLD_SIZE	16384	/* Objects are spread over this square. */
+#define NUM_LOOKUPS	1000
+
+mem_pool mp_treenode, mp_treeobjptr;
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Random boxes about the size of tiles, from 8 to 256 pixels on a side.
+ */
+static void
+fill_boxes(BB *bb, uint n)
+{
+	int x, y;
+	uint i;
+
+	srand(1);
+	for (i = 0; i < n; i++) {
+		x = rand() % WORLD_SIZE - WORLD_SIZE / 2;
+		y = rand() % WORLD_SIZE - WORLD_SIZE / 2;
+		bb_init(&bb[i], x, y, x + 8 + rand() % 249,
+		    y + 8 + rand() % 249);
+	}
+}
+
+/*
+ * Fresh tree objects for boxes [bb].
+ */
+static void
+init_objects(QTreeObject *obj, QTreeObject **ptrs, const BB *bb, uint n)
+{
+	uint i;
+
+	for (i = 0; i < n; i++) {
+		qtree_obj_init(&obj[i], &obj[i]);
+		obj[i].bb = bb[i];
+		ptrs[i] = &obj[i];
+	}
+}
+
+/*
+ * Best time per round, in nanoseconds, to fill a tree with [n] objects, one by
+ * one or (if [batch] is set) with one qtree_build() call.
+ */
+static double
+time_fill(QTreeObject *obj, QTreeObject **ptrs, const BB *bb, uint n,
+    int loose, int batch, uint rounds)
+{
+	QTree tree;
+	double t, best;
+	uint i, r;
+
+	best = HUGE_VAL;
+	for (r = 0; r < rounds; r++) {
+		init_objects(obj, ptrs, bb, n);
+		qtree_init(&tree, TREE_LEVELS, loose);
+		t = now_ns();
+		if (batch) {
+			qtree_build(&tree, ptrs, n);
+		} else {
+			for (i = 0; i < n; i++)
+				qtree_add(&tree, ptrs[i]);
+		}
+		t = now_ns() - t;
+		qtree_destroy(&tree);
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+static int
+ptr_cmp(const void *a, const void *b)
+{
+	const QTreeObject *pa = *(QTreeObject * const *)a;
+	const QTreeObject *pb = *(QTreeObject * const *)b;
+
+	return (pa > pb) - (pa < pb);
+}
+
+/*
+ * Look up one object set from two trees, compare results. The two trees hold
+ * separate objects for the same boxes, so results are mapped to indices first.
+ */
+static int
+lookup_same(const QTree *a, const QTreeObject *obj_a, const QTree *b,
+    const QTreeObject *obj_b, const BB *bb, QTreeObject **res_a,
+    QTreeObject **res_b, uint max)
+{
+	uint i, num_a, num_b;
+
+	memset(res_a, 0, max * sizeof(QTreeObject *));
+	memset(res_b, 0, max * sizeof(QTreeObject *));
+	if (qtree_lookup(a, bb, res_a, max, &num_a) != 0 ||
+	    qtree_lookup(b, bb, res_b, max, &num_b) != 0 || num_a != num_b)
+		return 0;
+	for (i = 0; i < num_a; i++) {
+		res_b[i] = (QTreeObject *)obj_a + (res_b[i] - obj_b);
+	}
+	qsort(res_a, num_a, sizeof(QTreeObject *), ptr_cmp);
+	qsort(res_b, num_a, sizeof(QTreeObject *), ptr_cmp);
+	return memcmp(res_a, res_b, num_a * sizeof(QTreeObject *)) == 0;
+}
+
+/*
+ * Fill one tree each way and check that random lookups agree.
+ */
+static int
+check_same(const BB *bb, uint n, int loose)
+{
+	QTree added, built;
+	QTreeObject *obj_a, *obj_b, **ptrs, **res_a, **res_b;
+	BB query;
+	uint i;
+	int x, y, same;
+
+	obj_a = malloc(n * sizeof(QTreeObject));
+	obj_b = malloc(n * sizeof(QTreeObject));
+	ptrs = malloc(n * sizeof(QTreeObject *));
+	res_a = malloc(n * sizeof(QTreeObject *));
+	res_b = malloc(n * sizeof(QTreeObject *));
+	if (obj_a == NULL || obj_b == NULL || ptrs == NULL || res_a == NULL ||
+	    res_b == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+
+	qtree_init(&added, TREE_LEVELS, loose);
+	init_objects(obj_a, ptrs, bb, n);
+	for (i = 0; i < n; i++)
+		qtree_add(&added, ptrs[i]);
+	qtree_init(&built, TREE_LEVELS, loose);
+	init_objects(obj_b, ptrs, bb, n);
+	qtree_build(&built, ptrs, n);
+
+	same = 1;
+	for (i = 0; i < NUM_LOOKUPS && same; i++) {
+		x = rand() % WORLD_SIZE - WORLD_SIZE / 2;
+		y = rand() % WORLD_SIZE - WORLD_SIZE / 2;
+		bb_init(&query, x, y, x + 1 + rand() % 1024,
+		    y + 1 + rand() % 768);
+		same = lookup_same(&added, obj_a, &built, obj_b, &query,
+		    res_a, res_b, n);
+	}
+
+	qtree_destroy(&added);
+	qtree_destroy(&built);
+	free(obj_a);
+	free(obj_b);
+	free(ptrs);
+	free(res_a);
+	free(res_b);
+	return same;
+}
+
+static int
+run(uint n, uint rounds)
+{
+	QTreeObject *obj, **ptrs;
+	BB *bb;
+	double t_add, t_build;
+	int loose;
+
+	bb = malloc(n * sizeof(BB));
+	obj = malloc(n * sizeof(QTreeObject));
+	ptrs = malloc(n * sizeof(QTreeObject *));
+	if (bb == NULL || obj == NULL || ptrs == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+	fill_boxes(bb, n);
+
+	printf("%u objects, best of %u rounds\n", n, rounds);
+	for (loose = 0; loose <= 1; loose++) {
+		if (!check_same(bb, n, loose)) {
+			fprintf(stderr, "%s tree: qtree_add() and qtree_build() "
+			    "lookups differ.\n", loose ? "Loose" : "Regular");
+			return 1;
+		}
+		t_add = time_fill(obj, ptrs, bb, n, loose, 0, rounds);
+		t_build = time_fill(obj, ptrs, bb, n, loose, 1, rounds);
+		printf("%-8s add %8.3f ms  build %8.3f ms  %5.2fx\n",
+		    loose ? "loose" : "regular", t_add / 1e6, t_build / 1e6,
+		    t_add / t_build);
+	}
+
+	free(bb);
+	free(obj);
+	free(ptrs);
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint n, max_n, rounds;
+
+	n = argc > 1 ? (uint)atoi(argv[1]) : 0;
+	rounds = argc > 2 ? (uint)atoi(argv[2]) : 20;
+	max_n = n ? n : 50000;
+
+	/* Room for two trees at once (see check_same()), an object in up to
+	   four nodes of a regular tree. */
+	log_open(NULL);
+	mem_pool_init(&mp_treenode, sizeof(QTreeNode), 4 * max_n,
+	    "Quad tree node pool");
+	mem_pool_init(&mp_treeobjptr, sizeof(QTreeObjectPtr), 8 * max_n,
+	    "Quad tree object pointer pool");
+
+	if (n)
+		return run(n, rounds);
+	return run(20000, rounds) || run(50000, rounds);
+}
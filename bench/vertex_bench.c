@@ -0,0 +1,231 @@
+/*
+ * Vertex generation microbenchmark: times vertex_gen() (SIMD kernel, if the
+ * build has one) against the scalar kernel and against the per-corner code
+ * that drawing used before render records (see gen_baseline()), all on the
+ * same random tiles, and checks that they produce the same vertices.
+ *
+ *	vertex_bench [num_tiles] [rounds]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "geometry.h"
+#include "vertex.h"
+
+void		vertex_gen_scalar(const RenderTile *rt, RenderVertex *v, uint n);
+const char	*vertex_kernel_name_scalar(void);
+
+typedef void (*gen_func)(const RenderTile *rt, RenderVertex *v, uint n);
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Corners as the old draw_sprite() computed them: a vect_f per corner, each
+ * rotated on its own with vect_f_rotate() (double sine and cosine per call),
+ * then moved to body position with vect_f_add(). Texture coordinates come
+ * from one of four branches, one per flip combination. What draw_sprite()
+ * passed to glTexCoord2f() and glVertex2f() goes into [v] instead.
+ */
+static void
+gen_baseline(const RenderTile *rt, RenderVertex *v, uint n)
+{
+	TexFrag tf;
+	vect_f BL, BR, TR, TL;
+	uint i;
+	int c;
+
+	for (i = 0; i < n; i++, rt++, v += 4) {
+		tf = rt->texfrag;
+
+		/* Corner positions. */
+		BL = vect_f_new(rt->rel_pos.x, rt->rel_pos.y);
+		BR = vect_f_new(rt->rel_pos.x + rt->size.x, rt->rel_pos.y);
+		TR = vect_f_new(rt->rel_pos.x + rt->size.x,
+		    rt->rel_pos.y + rt->size.y);
+		TL = vect_f_new(rt->rel_pos.x, rt->rel_pos.y + rt->size.y);
+
+		if (rt->angle != 0.0) {
+			BL = vect_f_rotate(&BL, rt->angle);
+			BR = vect_f_rotate(&BR, rt->angle);
+			TR = vect_f_rotate(&TR, rt->angle);
+			TL = vect_f_rotate(&TL, rt->angle);
+		}
+
+		/* Translate to object position. */
+		BL = vect_f_add(BL, rt->pos);
+		BR = vect_f_add(BR, rt->pos);
+		TR = vect_f_add(TR, rt->pos);
+		TL = vect_f_add(TL, rt->pos);
+
+		if (rt->flags & TILE_FLIP_X) {
+			if (rt->flags & TILE_FLIP_Y) {
+				v[0].u = tf.r; v[0].v = tf.t;
+				v[1].u = tf.l; v[1].v = tf.t;
+				v[2].u = tf.l; v[2].v = tf.b;
+				v[3].u = tf.r; v[3].v = tf.b;
+			} else {
+				v[0].u = tf.r; v[0].v = tf.b;
+				v[1].u = tf.l; v[1].v = tf.b;
+				v[2].u = tf.l; v[2].v = tf.t;
+				v[3].u = tf.r; v[3].v = tf.t;
+			}
+		} else {
+			if (rt->flags & TILE_FLIP_Y) {
+				v[0].u = tf.l; v[0].v = tf.t;
+				v[1].u = tf.r; v[1].v = tf.t;
+				v[2].u = tf.r; v[2].v = tf.b;
+				v[3].u = tf.l; v[3].v = tf.b;
+			} else {
+				v[0].u = tf.l; v[0].v = tf.b;
+				v[1].u = tf.r; v[1].v = tf.b;
+				v[2].u = tf.r; v[2].v = tf.t;
+				v[3].u = tf.l; v[3].v = tf.t;
+			}
+		}
+		v[0].x = BL.x; v[0].y = BL.y;
+		v[1].x = BR.x; v[1].y = BR.y;
+		v[2].x = TR.x; v[2].y = TR.y;
+		v[3].x = TL.x; v[3].y = TL.y;
+		for (c = 0; c < 4; c++)
+			v[c].color = rt->color;
+	}
+}
+
+/*
+ * Random tiles: about a quarter rotated, flips evenly spread.
+ */
+static void
+fill_tiles(RenderTile *rt, uint n)
+{
+	uint i;
+
+	srand(1);
+	for (i = 0; i < n; i++, rt++) {
+		memset(rt, 0, sizeof(*rt));
+		rt->flags = rand() % 4;
+		rt->color = rand();
+		rt->texfrag.l = (rand() % 512) / 1024.0;
+		rt->texfrag.r = rt->texfrag.l + (1 + rand() % 256) / 1024.0;
+		rt->texfrag.t = (rand() % 512) / 1024.0;
+		rt->texfrag.b = rt->texfrag.t + (1 + rand() % 256) / 1024.0;
+		rt->pos.x = (rand() % 20000) / 10.0 - 1000.0;
+		rt->pos.y = (rand() % 20000) / 10.0 - 1000.0;
+		rt->rel_pos.x = rand() % 64 - 32;
+		rt->rel_pos.y = rand() % 64 - 32;
+		rt->size.x = 1 + rand() % 128;
+		rt->size.y = 1 + rand() % 128;
+		if (rand() % 4 == 0)
+			rt->angle = (rand() % 6283) / 1000.0;
+	}
+}
+
+/*
+ * Best time per round, in nanoseconds.
+ */
+static double
+time_kernel(gen_func gen, const RenderTile *rt, RenderVertex *v, uint n,
+    uint rounds)
+{
+	double t, best;
+	uint i;
+
+	gen(rt, v, n);	/* Warm up. */
+	best = HUGE_VAL;
+	for (i = 0; i < rounds; i++) {
+		t = now_ns();
+		gen(rt, v, n);
+		t = now_ns() - t;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+/*
+ * Compare vertices against reference ones. Texture coordinates and color
+ * must match exactly; returns the largest difference in position, or a
+ * negative value if something else differs.
+ */
+static double
+compare(const RenderVertex *v, const RenderVertex *ref, uint n)
+{
+	double diff, max_diff;
+	uint i;
+
+	max_diff = 0.0;
+	for (i = 0; i < 4 * n; i++) {
+		if (v[i].u != ref[i].u || v[i].v != ref[i].v ||
+		    v[i].color != ref[i].color) {
+			fprintf(stderr, "Vertex %u: texture coordinates or "
+			    "color differ.\n", i);
+			return -1.0;
+		}
+		diff = fabs(v[i].x - ref[i].x);
+		if (diff > max_diff)
+			max_diff = diff;
+		diff = fabs(v[i].y - ref[i].y);
+		if (diff > max_diff)
+			max_diff = diff;
+	}
+	return max_diff;
+}
+
+int
+main(int argc, char *argv[])
+{
+	RenderTile *tiles;
+	RenderVertex *v_base, *v_scalar, *v_simd;
+	double t_base, t_scalar, t_simd, diff_scalar, diff_simd;
+	uint n, rounds;
+
+	n = argc > 1 ? (uint)atoi(argv[1]) : 50000;
+	rounds = argc > 2 ? (uint)atoi(argv[2]) : 200;
+
+	tiles = malloc(n * sizeof(RenderTile));
+	v_base = malloc(4 * n * sizeof(RenderVertex));
+	v_scalar = malloc(4 * n * sizeof(RenderVertex));
+	v_simd = malloc(4 * n * sizeof(RenderVertex));
+	if (tiles == NULL || v_base == NULL || v_scalar == NULL ||
+	    v_simd == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+	fill_tiles(tiles, n);
+
+	t_base = time_kernel(gen_baseline, tiles, v_base, n, rounds);
+	t_scalar = time_kernel(vertex_gen_scalar, tiles, v_scalar, n, rounds);
+	t_simd = time_kernel(vertex_gen, tiles, v_simd, n, rounds);
+
+	/* Baseline computes in double precision, so it is the reference. */
+	diff_scalar = compare(v_scalar, v_base, n);
+	diff_simd = compare(v_simd, v_base, n);
+	if (diff_scalar < 0.0 || diff_simd < 0.0)
+		return 1;
+
+	printf("%u tiles, best of %u rounds\n", n, rounds);
+	printf("%-8s %8.3f ms  %6.2f ns/tile\n", "baseline", t_base / 1e6,
+	    t_base / n);
+	printf("%-8s %8.3f ms  %6.2f ns/tile  %5.2fx  max diff %g px\n",
+	    vertex_kernel_name_scalar(), t_scalar / 1e6, t_scalar / n,
+	    t_base / t_scalar, diff_scalar);
+	printf("%-8s %8.3f ms  %6.2f ns/tile  %5.2fx  max diff %g px\n",
+	    vertex_kernel_name(), t_simd / 1e6, t_simd / n, t_base / t_simd,
+	    diff_simd);
+
+	free(tiles);
+	free(v_base);
+	free(v_scalar);
+	free(v_simd);
+	return 0;
+}
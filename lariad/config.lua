@@ -11,17 +11,59 @@ Cfg = {
 	windowWidth	= 800,
 	windowHeight	= 480,
 	screenBPP	= 0,		-- 0 = current bits per pixel.
+	interpolate	= false,	-- Draw bodies between world steps.
+	pixelSnap	= true,		-- Round interpolated positions.
+	renderThreads	= 0,		-- Extra threads preparing vertices.
+	renderThread	= false,	-- Step worlds and run scripts on a
+					-- thread of their own, draw on another.
+	integerScale	= false,	-- Pixel-perfect scaling, letterboxed.
+	lowRes		= false,	-- Draw at screen size, then magnify.
+	sharpBilinear	= false,	-- Magnify low-res output smoothly.
 	
 	-- Sound.
 	channels	= 16,		-- Number of mixing channels.
 	frequency	= 22050,	-- Use 44100 for 44.1KHz (CD audio).
 	chunksize	= 512,		-- Less is slower but more accurate.
 	stereo		= true,		-- Mono or stereo output.
+	soundCacheSize	= 16384,	-- Decoded sound budget in kilobytes.
+
+	-- Lua garbage collection.
+	gcFrameTime	= 16,		-- Collect between frames, within this
+					-- frame time (ms). 0 = let Lua decide.
+	gcPause		= 250,		-- Heap growth (%) before next cycle.
+	gcStepMul	= 200,		-- Collector step size (%).
+
+	-- World.
+	looseTrees	= true,		-- Keep each tile and shape in a single
+					-- quad tree node (cheaper updates).
+	bodyProxies	= true,		-- Moving bodies enter quad trees as one
+					-- box around all their tiles/shapes.
 
 	-- Debug things.
 	forceNative	= true,
 	gameSpeed	= 0,		-- Negative values slow the game down,
 					-- positive values speed it up.
+	cookedRooms	= true,		-- Load cooked rooms (*.room) if they
+					-- are up to date.
+	cookRooms	= false,	-- Rebuild cooked rooms from edit files.
+	streamRooms	= false,	-- Create cooked room scenery only
+					-- around cameras.
+	streamCellSize	= 512,		-- Streaming cell size for cooking (px).
+	streamMargin	= 256,		-- Load cells this close to view (px).
+	streamUnloadMargin = 1024,	-- Unload cells farther than this (px).
+	streamBudget	= 2,		-- Frame time for loading cells (ms).
+	scriptCache	= false,	-- Save compiled scripts (*.luac, next to
+					-- the scripts; keep off in source trees).
+	scriptStats	= false,	-- Print script loading times per room.
+	profile		= false,	-- Time step functions, timers, etc.
+	profileSampling	= 0,		-- Also sample Lua stack every N
+					-- instructions (0 = don't).
+	profileReport	= "profile.txt",	-- Written on exit.
+	profileStacks	= "profile.folded",	-- For flamegraph.pl.
+	trace		= false,	-- Record frame timeline from start.
+	traceEvents	= 65536,	-- Timeline events kept (newest).
+	traceKey	= eapi.KEY_F11,	-- Start recording, then dump timeline.
+	traceFile	= "trace.json",	-- For chrome://tracing.
 
 	keyLeft  = { eapi.KEY_LEFT, eapi.JOY_BUTTON_15, eapi.JOY_AXIS0_MINUS },
 	keyRight = { eapi.KEY_RIGHT, eapi.JOY_BUTTON_13, eapi.JOY_AXIS0_PLUS },
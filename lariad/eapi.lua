@@ -79,6 +79,23 @@ function eapi.SetStepFunc(objectPtr, stepFunc, afterStepFunc)
 	eapi.__SetStepFunc(objectPtr, stepFuncID, afterStepFuncID)
 end
 
+--[[ Set function to call when a cell of a streamed room (see LoadRoomBlob)
+	has been created, and before it is destroyed:
+
+		func(world, cellX, cellY, loaded)
+
+	It can be used to keep script state that goes with parts of the room.
+	If func is nil, the current stream function is unset. ]]--
+function eapi.SetStreamFunc(world, func)
+	local funcID = 0
+	if func then
+		assert(type(func) == "function",
+		    "func: function expected, got "..type(func))
+		funcID = GenID(func, world).ID
+	end
+	idToObjectMap[eapi.__SetStreamFunc(world, funcID)] = nil
+end
+
 --[[ Register a timer function to be called at a specified time.
 
 	obj	World or Body object. Body timers are called only when the
@@ -120,6 +137,13 @@ function eapi.__CallFunc(funcID, remove, ...)
 	func(...)
 end
 
+--[[ Function registered under funcID, or nil (used by the engine profiler to
+	find out which function a callback is). ]]--
+function eapi.__GetFunc(funcID)
+	local callback = idToObjectMap[funcID]
+	return callback and callback.func
+end
+
 function eapi.Destroy(something)
 	local idTable = ownerToIdMap[something]
 	if idTable then
@@ -157,7 +181,11 @@ end
 			groupNameA can be the same as groupNameB. In that case,
 			shapes within the same group will collide.
 	func		Callback function that will handle collisions between
-			pairs of shapes from the two groups.
+			pairs of shapes from the two groups. It is called as
+			func(world, shapeA, shapeB, resolve, normal, depth),
+			where moving shapeA by normal * depth separates the
+			shapes (resolve is the older bounding box version of
+			the same).
 			Pass in the boolean value 'false' to remove collision
 			handler for a particular pair. In this case priority
 			must be nil.
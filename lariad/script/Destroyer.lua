@@ -704,7 +704,7 @@ end
 
 local function Place(player, position, flipH)
 	if not(game.GetState().playerHidden) then
-		eapi.SetPos(player.body, position)
+		eapi.SetPos(player.body, position, true)
 		player.direction = flipH
 		if flipH then
 			eapi.SetAttributes(player.tile, {flip={true, false}})
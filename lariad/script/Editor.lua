@@ -293,6 +293,30 @@ local function FormatBox(box, offset)
 	       ",b="..box.b+offset.y..",t="..box.t+offset.y.."}"
 end
 
+-- Format a user function call the way it is written into edit files.
+local function FormatCall(name, args, offset)
+	local argStr = ""
+	local comma = ""
+	local last = 0
+	for i, v in pairs(args) do
+		local str = nil
+		for j = last + 1, i - 1, 1 do
+			argStr = argStr..",nil"
+		end
+		if vector.Check(v) then
+			str = FormatPoint(v, offset)
+		elseif IsBox(v) then
+			str = FormatBox(v, offset)
+		else
+			str = game.FormatValue(v)
+		end
+		argStr = argStr..comma..str
+		comma = ","
+		last = i
+	end
+	return "exports."..name..".func("..argStr..")\n"
+end
+
 local function SaveFile(key, keyDown)
 	if not keyDown then
 		return
@@ -306,29 +330,7 @@ local function SaveFile(key, keyDown)
 		return
 	end
 	for editorShape, userObj in pairs(scene) do
-		local name = userObj.name
-		local args = userObj.args
-		local offset = userObj.offset
-		local argStr = ""
-		local comma = ""
-		local last = 0
-		for i, v in pairs(args) do
-			local str = nil
-			for j = last + 1, i - 1, 1 do
-				argStr = argStr..",nil"
-			end
-			if vector.Check(v) then
-				str = FormatPoint(v, offset)
-			elseif IsBox(v) then
-				str = FormatBox(v, offset)
-			else
-				str = game.FormatValue(v)
-			end
-			argStr = argStr..comma..str
-			comma = ","
-			last = i
-		end
-		f:write("exports."..name..".func("..argStr..")\n")
+		f:write(FormatCall(userObj.name, userObj.args, userObj.offset))
 	end
 	f:close()
 
@@ -595,7 +597,7 @@ local function CycleCameras(key, keyDown)
 end
 
 local function PlacePlayer()
-	eapi.SetPos(mainPC.body, camera.data.mousePos)
+	eapi.SetPos(mainPC.body, camera.data.mousePos, true)
 end
 
 local function Show()
@@ -635,6 +637,113 @@ local function Show()
 	CycleCameras(nil, true)
 end
 
+-- Functions that scenery may call and still be cooked. Their effect on tiles
+-- and shapes is captured by the room file (random numbers are frozen at the
+-- time of cooking). Calling any other eapi function, or creating tiles and
+-- shapes on some other body than the static one, means the call is left in
+-- the residual script and run every time the room is entered.
+local cookSafe = {
+	NewTile=true, NewShape=true, NewSpriteList=true,
+	TextureToSpriteList=true, SetSpriteList=true, GetStaticBody=true,
+	GetPos=true, GetSize=true, GetTime=true, GetAttributes=true,
+	SetAttributes=true, SetFrame=true, SetFrameLoop=true,
+	SetFrameClamp=true, SetFrameLast=true, Animate=true,
+	StopAnimation=true, Random=true, Log=true,
+}
+
+--[[
+	Run edit script and split its user function calls in two: static
+	scenery goes into a cooked room file (see eapi.LoadRoomBlob), the rest
+	into a residual Lua script.
+
+	User functions whose tiles or shapes are referred to later (e.g., by
+	step functions) must not be cooked; set cook=false in their exports
+	entry.
+--]]
+local function Cook(filename, roomFile, restFile, world)
+	local staticBody = eapi.GetStaticBody(world)
+	local tiles = {}
+	local shapes = {}
+	local rest = {}
+	local call = nil	-- Call that is being executed.
+
+	-- Watch eapi use while user functions are running.
+	local real = {}
+	for name, func in pairs(eapi) do
+		if type(func) == "function" then
+			real[name] = func
+			eapi[name] = function(...)
+				if call and not cookSafe[name] then
+					call.dynamic = true
+				end
+				return func(...)
+			end
+		end
+	end
+	eapi.NewTile = function(body, ...)
+		local tile = real.NewTile(body, ...)
+		if call then
+			if body == staticBody then
+				table.insert(call.tiles, tile)
+			else
+				call.dynamic = true
+			end
+		end
+		return tile
+	end
+	eapi.NewShape = function(body, ...)
+		local shape = real.NewShape(body, ...)
+		if call then
+			if body == staticBody then
+				table.insert(call.shapes, shape)
+			else
+				call.dynamic = true
+			end
+		end
+		return shape
+	end
+
+	for name, attr in pairs(exports) do
+		attr.userFunc = attr.func
+		attr.func = function(...)
+			call = { tiles={}, shapes={}, dynamic=(attr.cook == false) }
+			attr.userFunc(...)
+			if call.dynamic then
+				table.insert(rest, FormatCall(name, {...}, {x=0,y=0}))
+			else
+				for _, tile in ipairs(call.tiles) do
+					table.insert(tiles, tile)
+				end
+				for _, shape in ipairs(call.shapes) do
+					table.insert(shapes, shape)
+				end
+			end
+			call = nil
+		end
+	end
+
+	dofile(filename)
+
+	for name, func in pairs(real) do
+		eapi[name] = func
+	end
+	for name, attr in pairs(exports) do
+		attr.func = attr.userFunc
+	end
+
+	local f = io.open(restFile, "w")
+	if not f or not eapi.SaveRoomBlob(world, roomFile, tiles, shapes,
+					      Cfg.streamCellSize) then
+		eapi.Log("[Editor] Could not cook '"..filename.."'.")
+		if f then f:close() end
+		return
+	end
+	f:write(table.concat(rest))
+	f:close()
+	eapi.Log("[Editor] Cooked '"..filename.."': "..#tiles.." tiles, "..
+		 #shapes.." shapes, "..#rest.." residual calls.")
+end
+
 local function Parse(filename, world, _exports)
 	camera = { }
 	camera.ptr = nil
@@ -650,8 +759,25 @@ local function Parse(filename, world, _exports)
 	end
 
 	if not Cfg.loadEditor then
-		-- Editing not requested; simply execute the file.
-		if fileExists then
+		-- Editing not requested. Use cooked room if it's up to date,
+		-- otherwise simply execute the file.
+		local roomFile = string.gsub(filename, "%.lua$", ".room")
+		local restFile = string.gsub(filename, "%.lua$", ".rest.lua")
+
+		-- Room file also goes stale when scripts that define user
+		-- functions (or anything those call) change.
+		local sources = { filename }
+		for script in pairs(loadedScripts) do
+			table.insert(sources, script)
+		end
+
+		if fileExists and Cfg.cookRooms then
+			Cook(filename, roomFile, restFile, world)
+		elseif Cfg.cookedRooms and
+		       eapi.LoadRoomBlob(world, roomFile, sources,
+					 Cfg.streamRooms) then
+			dofile(restFile)
+		elseif fileExists then
 			dofile(filename)
 		end
 		return
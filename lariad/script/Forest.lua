@@ -455,7 +455,7 @@ if game.GetState().spaceShipLandedOn == "Forest" then
 		game.GetState().boulderCutscene = true
 		
 		local tile = PutBoulder(vector.Add(start, { x=-200, y=-2 }))
-		eapi.SetPos(camera.ptr, vector.Add(start, { x=100, y=88 }))
+		eapi.SetPos(camera.ptr, vector.Add(start, { x=100, y=88 }), true)
 
 		local function BackToPlayer()
 			util.CameraTracking.call(mainPC)
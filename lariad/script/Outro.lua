@@ -41,7 +41,7 @@ local function Credits()
 end
 
 local function Start()
-	eapi.SetPos(mainPC.body, { x = 2700, y = 200 })
+	eapi.SetPos(mainPC.body, { x = 2700, y = 200 }, true)
 	eapi.AddTimer(staticBody, 5.0, Credits)
 end
 
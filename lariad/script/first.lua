@@ -3,6 +3,19 @@
 	What happens next is then entirely up to this script.
 ]]--
 
+-- Remember every script that is loaded. Cooked rooms (see Editor.lua) are out
+-- of date once any script that could have contributed to them changes.
+loadedScripts = { ["script/first.lua"]=true }
+do
+	local RealDofile = dofile
+	function dofile(filename)
+		if filename then
+			loadedScripts[filename] = true
+		end
+		return RealDofile(filename)
+	end
+end
+
 dofile("config.lua")
 dofile("script/util.lua")
 if util.FileExists("setup.lua") then
@@ -555,7 +555,7 @@ local function CreateCamera(world, obj, boundary, SomeFunction)
 		if type(track) == "userdata" then
 			eapi.SetPos(camera.ptr, eapi.GetPos(track))
 		elseif track and first then
-			eapi.SetPos(camera.ptr, GetTargetPosition())
+			eapi.SetPos(camera.ptr, GetTargetPosition(), true)
 			first = false
 		elseif track then
 			local target = GetTargetPosition()
@@ -731,7 +731,7 @@ local function ParticleEmitter(origin, life, avgInterval, configure)
 	local emitter = { }
 	local function NewParticle()
 		if emitter.active then
-			eapi.SetPos(body, origin())
+			eapi.SetPos(body, origin(), true)
 			local particle = eapi.NewBody(gameWorld, origin())
 			eapi.SetAttributes(particle, { sleep = false })
 			local function ParticleRipper()
@@ -849,8 +849,25 @@ local function PlayMusic(fileName, volume)
 	ContinueMusic(fileName, volume)
 end
 
+-- Print what script loading for a room cost, compared to compiling
+-- everything from source. [before] is GetScriptStats() from before.
+local function ReportScriptStats(roomName, before)
+	local after = eapi.GetScriptStats()
+	local ms = function(key) return 1000 * (after[key] - before[key]) end
+	print(string.format("%s: %d scripts compiled (%.1f ms), "
+			    .. "%d cached (%d from disk, %.1f ms), "
+			    .. "%.1f ms of compiling saved", roomName,
+			    after.compiled - before.compiled,
+			    ms("compileTime"),
+			    after.memoryHits + after.diskHits
+			    - before.memoryHits - before.diskHits,
+			    after.diskHits - before.diskHits,
+			    ms("loadTime"), ms("savedTime")))
+end
+
 -- Wipe engine-side and client-side state and execute a script file.
 local function GoTo(roomName, TransitionFunc, disableESCAPE, fadeEffect)
+	local scriptStats = Cfg.scriptStats and eapi.GetScriptStats()
 	eapi.SwitchFramebuffer()
 	eapi.Clear()			-- Clear state.
 
@@ -859,7 +876,7 @@ local function GoTo(roomName, TransitionFunc, disableESCAPE, fadeEffect)
 	dialogBoxShowing = false
 	
 	-- Create game world with 5 millisecond step.
-	gameWorld = eapi.NewWorld("Game", 5, 16)
+	gameWorld = eapi.NewWorld("Game", 5, 12)
 
 	defaultFontset = LoadFont("image/default-font.png", {8,16})
 	if Cfg.loadEditor then
@@ -882,6 +899,9 @@ local function GoTo(roomName, TransitionFunc, disableESCAPE, fadeEffect)
 	
 	dofile("script/" .. roomName .. ".lua")
 	dofile("script/ProgressBar.lua")
+	if scriptStats then
+		ReportScriptStats(roomName, scriptStats)
+	end
 
 	if not(music == continueMusic) then
 		StopMusic()
@@ -1047,14 +1067,7 @@ local function LerpColors(a, b, q)
 end
 
 local function PreloadSound(file)
-	if type(file) == "table" then
-		for _, str in pairs(file) do
-			PreloadSound(str)
-		end
-	else
-		handle = eapi.PlaySound(gameWorld, file, 0, 0)
-		eapi.FadeSound(handle, 0)
-	end
+	eapi.PrefetchSound(file)
 end
 
 local function AnimateTable(tiles, type, fps, start)
@@ -8,17 +8,34 @@
 #include "mem.h"
 #include "physics.h"
 #include "uthash.h"
+#include "utlist.h"
 
 static mem_pool mp_sound, mp_music;
 
-/* Determines how long unused sounds stay in memory. */
-#define SOUND_HISTORY   3
+/* Determines how long unused music stays in memory. */
 #define MUSIC_HISTORY   5
 
-typedef struct {
+/*
+ * Decoded sound samples are cached. Total size of cached samples is kept
+ * within a budget (config "soundCacheSize") by evicting least recently used
+ * sounds that are not playing. Sounds can be decoded ahead of time on a
+ * background thread (audio_prefetch()).
+ */
+enum {
+        SOUND_QUEUED,           /* Waiting for (or being decoded by) worker. */
+        SOUND_DECODED,          /* Worker is done, main thread not told yet. */
+        SOUND_READY             /* Sample can be played. */
+};
+
+typedef struct Sound_t {
         Mix_Chunk       *sample;
         char            name[100];      /* name = hash key. */
-        int             usage;          /* Determines how long ago sound was last used. */
+        int             state;          /* Queued, decoded, or ready. */
+        uint            bytes;          /* Decoded sample size. */
+        uint32_t        load_ms;        /* Time it took to load & decode. */
+        uint            plays;          /* Number of times played. */
+        struct Sound_t  *prev, *next;   /* LRU list, most recent first. */
+        struct Sound_t  *queue_next;    /* Prefetch queue/decoded list. */
         UT_hash_handle  hh;             /* Makes this struct hashable. */
 } Sound;
 
@@ -30,6 +47,17 @@ typedef struct {
 } Music;
 
 static Sound    *sound_hash;    /* Keep recently used sounds samples here. */
+static Sound    *sound_lru;     /* Same sounds, most recently used first. */
+static AudioStats stats;        /* Cache size and hit/miss counters. */
+
+/* Prefetch worker and its queues. */
+static SDL_Thread *prefetch_thread;
+static SDL_mutex  *prefetch_lock;       /* Protects everything below. */
+static SDL_cond   *prefetch_cond;       /* Signaled when queue is not empty. */
+static SDL_cond   *decoded_cond;        /* Signaled when a sound is decoded. */
+static Sound      *prefetch_queue, *prefetch_queue_tail;
+static Sound      *decoded_list;
+static int        prefetch_quit;
 static Music    *music_hash;    /* Keep recently used music here. */
 
 static int      have_audio;     /* True if audio init was successful. */
@@ -37,6 +65,7 @@ static int      have_audio;     /* True if audio init was successful. */
 /* Output audio frequency (samples/sec) and chunksize (bytes/sample). */
 static int      frequency;
 static int      chunksize;
+static int      stereo;         /* Output has two channels (panning works). */
 
 static uint     sound_id_gen;   /* Generate sound IDs incrementally. */
 static int      num_channels;   /* Number of sound mixing channels. */
@@ -63,15 +92,197 @@ static struct {
         uint32_t start_time;    /* When channel playback was started. */
         uint32_t duration;      /* Sound duration in ms. */
         
+        int     priority;       /* Higher priority sounds are stolen last. */
+        int     volume;         /* Current volume. */
+        
         Body    *source;        /* Body that is producing the sound. */
         Body    *listener;      /* Body that "hears" the sound. */
         float   dist_maxvol;    /* Play sound at max volume when listener is this close to source. */
         float   dist_silence;   /* Volume drops off to zero when listener is this far from source. */
+        int     pan;            /* Pan by horizontal offset from listener. */
+        int     right;          /* Current right channel panning (0..254). */
+        vect_f  source_pos;     /* Positions volume was last computed for. */
+        vect_f  listener_pos;
 } channels[16];
 
+/*
+ * Channels that have a panning effect registered. Kept apart from [channels]
+ * since that is cleared from the channel_finished() callback, where we may not
+ * call mixer functions to unregister the effect.
+ */
+static int      panned[16];
+
+/* Panning is centered at this value (left = 254 - right). */
+#define PAN_CENTER      127
+
+/*
+ * Free resources held within Sound structure, then free the structure memory
+ * itself.
+ */
+static void
+sound_free(Sound *snd)
+{
+        log_msg("Deleting sound `%s`.", snd->name);
+        if (snd->sample != NULL)
+                Mix_FreeChunk(snd->sample);
+        memset(snd, 0, sizeof(*snd));
+
+        mp_free(&mp_sound, snd);
+}
+
+/*
+ * Return true if sound is playing on any channel.
+ */
+static int
+sound_playing(Sound *snd)
+{
+        for (int i = 0; i < num_channels; i++) {
+                if (channels[i].snd == snd)
+                        return 1;
+        }
+        return 0;
+}
+
+/*
+ * Evict least recently used sounds until the cache fits into its budget.
+ * Sounds that are playing or still being decoded are skipped, and so is
+ * [keep].
+ */
+static void
+sound_evict(Sound *keep)
+{
+        Sound *snd, *prev;
+
+        if (sound_lru == NULL)
+                return;
+        for (snd = sound_lru->prev; stats.bytes > stats.budget; snd = prev) {
+                prev = (snd == sound_lru) ? NULL : snd->prev;
+                if (snd != keep && snd->state == SOUND_READY &&
+                    !sound_playing(snd)) {
+                        stats.bytes -= snd->bytes;
+                        stats.evictions++;
+                        HASH_DEL(sound_hash, snd);
+                        DL_DELETE(sound_lru, snd);
+                        sound_free(snd);
+                }
+                if (prev == NULL)
+                        break;
+        }
+}
+
+/*
+ * Move sound to the front of LRU list.
+ */
+static void
+sound_touch(Sound *snd)
+{
+        if (sound_lru == snd)
+                return;
+        DL_DELETE(sound_lru, snd);
+        DL_PREPEND(sound_lru, snd);
+}
+
+/*
+ * Decode sound file. Safe to call from the prefetch thread: only touches the
+ * sample and timing fields.
+ */
+static void
+sound_decode(Sound *snd)
+{
+        uint32_t start = SDL_GetTicks();
+        snd->sample = Mix_LoadWAV(snd->name);
+        snd->load_ms = SDL_GetTicks() - start;
+}
+
+/*
+ * Account for a freshly decoded sound: it's ready to be played now.
+ */
+static void
+sound_ready(Sound *snd)
+{
+        if (snd->sample == NULL)
+                fatal_error("Could not load sound `%s`.", snd->name);
+        snd->state = SOUND_READY;
+        snd->bytes = snd->sample->alen;
+        stats.bytes += snd->bytes;
+        stats.load_ms += snd->load_ms;
+        log_msg("Loaded `%s` into sound memory (%u KB, %u ms).", snd->name,
+            snd->bytes / 1024, snd->load_ms);
+        sound_evict(snd);
+}
+
+/*
+ * Pick up sounds that the prefetch thread has finished decoding.
+ */
+void
+audio_collect_prefetched(void)
+{
+        Sound *snd, *next;
+
+        if (prefetch_lock == NULL)
+                return;
+        SDL_mutexP(prefetch_lock);
+        snd = decoded_list;
+        decoded_list = NULL;
+        SDL_mutexV(prefetch_lock);
+        
+        for (; snd != NULL; snd = next) {
+                next = snd->queue_next;
+                snd->queue_next = NULL;
+                sound_ready(snd);
+        }
+}
+
+static int
+prefetch_main(void *unused)
+{
+        Sound *snd;
+
+        UNUSED(unused);
+        for (;;) {
+                SDL_mutexP(prefetch_lock);
+                while (prefetch_queue == NULL && !prefetch_quit)
+                        SDL_CondWait(prefetch_cond, prefetch_lock);
+                if (prefetch_quit) {
+                        SDL_mutexV(prefetch_lock);
+                        break;
+                }
+                snd = prefetch_queue;
+                prefetch_queue = snd->queue_next;
+                SDL_mutexV(prefetch_lock);
+                
+                sound_decode(snd);
+                
+                SDL_mutexP(prefetch_lock);
+                snd->state = SOUND_DECODED;
+                snd->queue_next = decoded_list;
+                decoded_list = snd;
+                SDL_CondBroadcast(decoded_cond);
+                SDL_mutexV(prefetch_lock);
+        }
+        return 0;
+}
+
+/*
+ * Create a new sound structure and add it to hash and LRU list.
+ */
+static Sound *
+sound_create(const char *name)
+{
+        Sound *snd = mp_alloc(&mp_sound);
+        memset(snd, 0, sizeof(*snd));
+        assert(strlen(name) < sizeof(snd->name));
+        strcpy(snd->name, name);
+        
+        /* Add to global hash which is indexed by name. */
+        HASH_ADD_STR(sound_hash, name, snd);
+        DL_PREPEND(sound_lru, snd);
+        return snd;
+}
+
 /*
  * Look up sound object by name in the global hash. If it's not there,
- * create a new sound.
+ * create a new sound. If it's being prefetched, wait until it's decoded.
  *
  * name         Sound filename.
  */
@@ -82,30 +293,84 @@ sound_lookup_or_create(const char *name)
         Sound *snd;
         HASH_FIND_STR(sound_hash, name, snd);
         if (snd != NULL) {
-                /* Reset usage counter and return sound. */
-                snd->usage = SOUND_HISTORY;
+                if (snd->state != SOUND_READY) {
+                        /* Still in prefetch thread: wait for it. */
+                        stats.misses++;
+                        SDL_mutexP(prefetch_lock);
+                        while (snd->state == SOUND_QUEUED)
+                                SDL_CondWait(decoded_cond, prefetch_lock);
+                        SDL_mutexV(prefetch_lock);
+                        audio_collect_prefetched();
+                } else {
+                        stats.hits++;
+                }
+                sound_touch(snd);
                 return snd;
         }
         
-        /* A new sound. */
-        snd = mp_alloc(&mp_sound);
-        memset(snd, 0, sizeof(*snd));
-        assert(strlen(name) < sizeof(snd->name));
-        strcpy(snd->name, name);
-        
-        log_msg("Loading `%s` into sound memory.", name);
-        snd->sample = Mix_LoadWAV(name);
-        if (snd->sample == NULL)
-                fatal_error("Could not load sound: %s.", Mix_GetError());
-        
-        /* Mark as recently used. */
-        snd->usage = SOUND_HISTORY;
-        
-        /* Add to global hash which is indexed by name. */
-        HASH_ADD_STR(sound_hash, name, snd);
+        /* A new sound: decode it right here. */
+        stats.misses++;
+        snd = sound_create(name);
+        sound_decode(snd);
+        sound_ready(snd);
         return snd;
 }
 
+/*
+ * Start decoding sound in background, so that it's ready by the time it is
+ * played.
+ */
+void
+audio_prefetch(const char *name)
+{
+        Sound *snd;
+
+        assert(have_audio);
+        assert(name && *name);
+        
+        HASH_FIND_STR(sound_hash, name, snd);
+        if (snd != NULL) {
+                sound_touch(snd);
+                return;
+        }
+        snd = sound_create(name);
+        snd->state = SOUND_QUEUED;
+        
+        SDL_mutexP(prefetch_lock);
+        if (prefetch_queue == NULL)
+                prefetch_queue = snd;
+        else
+                prefetch_queue_tail->queue_next = snd;
+        prefetch_queue_tail = snd;
+        SDL_CondSignal(prefetch_cond);
+        SDL_mutexV(prefetch_lock);
+}
+
+/*
+ * Fill in sound cache statistics.
+ */
+void
+audio_get_stats(AudioStats *result)
+{
+        *result = stats;
+        result->num_sounds = HASH_COUNT(sound_hash);
+}
+
+/*
+ * Call func for each cached sound, most recently used first.
+ */
+void
+audio_foreach_sound(audio_sound_func func, void *arg)
+{
+        Sound *snd;
+
+        DL_FOREACH(sound_lru, snd) {
+                if (snd->state == SOUND_READY)
+                        func(snd->name, snd->bytes, snd->load_ms, snd->plays,
+                            arg);
+        }
+}
+
 /*
  * Look up music object by name in the global hash. If it's not there,
  * create new music.
@@ -143,20 +408,6 @@ music_lookup_or_create(const char *name)
         return music;
 }
 
-/*
- * Free resources held within Sound structure, then free the structure memory
- * itself.
- */
-static void
-sound_free(Sound *snd)
-{
-        log_msg("Deleting sound `%s`.", snd->name);
-        Mix_FreeChunk(snd->sample);
-        memset(snd, 0, sizeof(*snd));
-
-        mp_free(&mp_sound, snd);
-}
-
 /*
  * Free resources held within Music structure, then free the structure memory
  * itself.
@@ -171,21 +422,6 @@ music_free(Music *music)
         mp_free(&mp_music, music);
 }
 
-/*
- * Free memory of those sounds that have not been used in a while.
- */
-void
-audio_free_unused()
-{
-        Sound *snd, *snd_tmp;
-        HASH_ITER(hh, sound_hash, snd, snd_tmp) {
-                if (--snd->usage < 1) {
-                        HASH_DEL(sound_hash, snd);
-                        sound_free(snd);
-                }
-        }
-}
-
 /*
  * Remove music from memory that has not been played recently.
  */
@@ -238,9 +474,52 @@ audio_resume_group(uintptr_t group)
         }
 }
 
+/*
+ * Find a free channel. If there are none, steal the least important one:
+ * lowest priority first, then quietest, then the one closest to finishing.
+ * Channels looping forever are not stolen.
+ */
+static int
+pick_channel(int priority, uint32_t now)
+{
+        int ch = -1, least_timeleft = 0;
+        for (int i = 0; i < num_channels; i++) {
+                if (channels[i].snd == NULL)
+                        return i;
+                if (channels[i].forever)
+                        continue;
+                
+                uint32_t start_time = channels[i].start_time;
+                uint32_t duration = channels[i].duration;
+                int timeleft = (start_time + duration) - now;
+                if (ch == -1 ||
+                    channels[i].priority < channels[ch].priority ||
+                    (channels[i].priority == channels[ch].priority &&
+                     (channels[i].volume < channels[ch].volume ||
+                      (channels[i].volume == channels[ch].volume &&
+                       timeleft < least_timeleft)))) {
+                        ch = i;
+                        least_timeleft = timeleft;
+                }
+        }
+        if (ch == -1)
+                fatal_error("Out of audio channels. Please increase number of "
+                            "mixer channels in configuration file.");
+        if (channels[ch].priority > priority)
+                log_warn("Stealing channel from a higher priority sound.");
+        Mix_HaltChannel(ch);
+        return ch;
+}
+
+/*
+ * Play sound.
+ *
+ * priority     When no channels are free, lower priority sounds are stopped
+ *              first to make room.
+ */
 void
 audio_play(const char *name, uintptr_t group, int volume, int loops, int fade_in,
-           uint *sound_id, int *channel)
+           int priority, uint *sound_id, int *channel)
 {
         assert(have_audio);
         assert(name && *name && fade_in >= 0 && loops >= -1);
@@ -248,62 +527,20 @@ audio_play(const char *name, uintptr_t group, int volume, int loops, int fade_in
         
         /* Load sound. */
         Sound *snd = sound_lookup_or_create(name);
+        snd->plays++;
         
         /* Present time. */
         uint32_t now = SDL_GetTicks();
         
-        /* Find a free channel. */
-        int ch = -1;
-        for (int i = 0; i < num_channels; i++) {
-                if (channels[i].snd == NULL) {
-                        ch = i;
-                        break;
-                }
-        }
-        if (ch == -1) {
-                /*
-                 * No free channels were found. Find a channel which has the
-                 * same sound playing on it, and (in case there are multiple)
-                 * has the least amount of time left for playback.
-                 */
-                int oldest_ch = -1;
-                int least_timeleft;
-                for (int i = 0; i < num_channels; i++) {
-                        if (channels[i].snd != snd || channels[i].forever)
-                                continue;
-                        
-                        uint32_t start_time = channels[i].start_time;
-                        uint32_t duration = channels[i].duration;
-                        int timeleft = (start_time + duration) - now;
-                        if (oldest_ch == -1 || timeleft < least_timeleft) {
-                                oldest_ch = i;
-                                least_timeleft = timeleft;
-                        }
-                }
-                if (oldest_ch != -1) {
-                        ch = oldest_ch;
-                        Mix_HaltChannel(ch);
-                } else {
-                        /*
-                         * Still no luck.. kill the first channel that's not
-                         * looping forever.
-                         */
-                        for (int i = 0; i < num_channels; i++) {
-                                if (!channels[i].forever) {
-                                        Mix_HaltChannel(i);
-                                        ch = i;
-                                        break;
-                                }
-                        }
-                        if (ch == -1)
-                                fatal_error("Out of audio channels. Please "
-                                            "increase number of mixer channels "
-                                            "in configuration file.");
-                }
-        }
+        /* Find a free channel or steal one. */
+        int ch = pick_channel(priority, now);
         
-        /* Set requested volume. */
+        /* Set requested volume, and undo panning of the previous sound. */
         Mix_Volume(ch, volume);
+        if (panned[ch]) {
+                Mix_SetPanning(ch, 255, 255);
+                panned[ch] = 0;
+        }
 
         int rc = (fade_in > 0) ?
             Mix_FadeInChannelTimed(ch, snd->sample, loops, fade_in, -1) :
@@ -322,6 +559,8 @@ audio_play(const char *name, uintptr_t group, int volume, int loops, int fade_in
         channels[ch].duration = 1000 * snd->sample->alen / chunksize / frequency;
         channels[ch].callback_id = 0;   /* No callback yet. */
         channels[ch].forever = (loops == -1);
+        channels[ch].priority = priority;
+        channels[ch].volume = volume;
         
         /* Return sound ID and channel. */
         *sound_id = channels[ch].sound_id;
@@ -330,6 +569,19 @@ audio_play(const char *name, uintptr_t group, int volume, int loops, int fade_in
         return;
 }
 
+/*
+ * Volume (0..1) at which sound is heard, given distance from source.
+ */
+static float
+distance_gain(float dist, float dist_maxvol, float dist_silence)
+{
+        if (dist <= dist_maxvol)
+                return 1.0;
+        if (dist >= dist_silence)
+                return 0.0;
+        return 1.0 - (dist - dist_maxvol) / (dist_silence - dist_maxvol);
+}
+
 static void
 calculate_bound_volume(int ch)
 {
@@ -345,6 +597,14 @@ calculate_bound_volume(int ch)
                 return;
         }
         
+        /* Nothing to do if neither body has moved. */
+        if (channels[ch].volume >= 0 &&
+            vect_f_equal(source->pos, channels[ch].source_pos) &&
+            vect_f_equal(listener->pos, channels[ch].listener_pos))
+                return;
+        channels[ch].source_pos = source->pos;
+        channels[ch].listener_pos = listener->pos;
+        
         /* Distance from source to listener. */
         vect_f pos_diff = {
                 listener->pos.x - source->pos.x,
@@ -352,33 +612,51 @@ calculate_bound_volume(int ch)
         };
         float dist = sqrtf((pos_diff.x * pos_diff.x) + (pos_diff.y * pos_diff.y));
         
-        /* See if we're within max volume distance. */
-        float dist_maxvol = channels[ch].dist_maxvol;
-        if (dist <= dist_maxvol) {
-                Mix_Volume(ch, MIX_MAX_VOLUME);
-                return;
+        /* Linear volume calculation. */
+        float dist_silence = channels[ch].dist_silence;
+        float gain = distance_gain(dist, channels[ch].dist_maxvol, dist_silence);
+        assert(gain >= 0.0 && gain <= 1.0);
+        int volume = round(gain * MIX_MAX_VOLUME);
+        if (volume != channels[ch].volume) {
+                Mix_Volume(ch, volume);
+                channels[ch].volume = volume;
         }
         
-        /* See if we're further than silence distance. */
-        float dist_silence = channels[ch].dist_silence;
-        if (dist >= dist_silence) {
-                Mix_Volume(ch, 0);
+        /* Pan by horizontal offset: fully to one side at silence distance. */
+        if (!stereo || !channels[ch].pan)
                 return;
+        float offset = -pos_diff.x / dist_silence;
+        offset = (offset < -1.0) ? -1.0 : (offset > 1.0) ? 1.0 : offset;
+        int right = PAN_CENTER + round(offset * PAN_CENTER);
+        if (right != channels[ch].right) {
+                Mix_SetPanning(ch, 2 * PAN_CENTER - right, right);
+                channels[ch].right = right;
+                panned[ch] = 1;
         }
-        
-        /* Linear volume calculation. */
-        float volume = 1.0 - (dist - dist_maxvol) / (dist_silence - dist_maxvol);
-        assert(volume >= 0.0 && volume <= 1.0);
-        Mix_Volume(ch, volume * MIX_MAX_VOLUME);
+}
+
+/*
+ * True if listener is too far from source to hear anything.
+ */
+static int
+out_of_range(Body *source, Body *listener, float dist_silence)
+{
+        float dx = listener->pos.x - source->pos.x;
+        float dy = listener->pos.y - source->pos.y;
+        return dx * dx + dy * dy >= dist_silence * dist_silence;
 }
 
 /*
  * Bind channel volume to two bodies. Volume is then a function of the distance
- * between these two bodies.
+ * between these two bodies. If [pan] is true, sound is also panned according
+ * to horizontal offset of source from listener.
+ *
+ * A sound that is not looped forever and is out of hearing range is stopped
+ * right away, so that it does not hold on to its channel.
  */
 void
 audio_bind_volume(int ch, uint sound_id, Body *source, Body *listener,
-                  float dist_maxvol, float dist_silence)
+                  float dist_maxvol, float dist_silence, int pan)
 {
         assert(have_audio);
         assert(ch >= 0 && ch < num_channels && sound_id > 0);
@@ -388,18 +666,48 @@ audio_bind_volume(int ch, uint sound_id, Body *source, Body *listener,
         /* If sound has finished or sound IDs do not match, ignore. */
         if (channels[ch].snd == NULL || channels[ch].sound_id != sound_id)
                 return;
+        if (!channels[ch].forever &&
+            out_of_range(source, listener, dist_silence)) {
+                Mix_HaltChannel(ch);
+                return;
+        }
         
         channels[ch].source = source;
         channels[ch].listener = listener;
         channels[ch].dist_maxvol = dist_maxvol;
         channels[ch].dist_silence = dist_silence;
+        channels[ch].pan = pan;
+        channels[ch].right = PAN_CENTER;
         
         /* Start off with the correct volume. */
+        channels[ch].volume = -1;
         calculate_bound_volume(ch);
 }
 
 /*
- * Adjust volume on those channels that are bound to bodies.
+ * Play a sound emitted by source body and heard by listener body (see
+ * audio_bind_volume()). Sounds that are not looped forever and are out of
+ * hearing range are not played at all, so they don't take up a channel. In
+ * that case zero is returned, nonzero otherwise.
+ */
+int
+audio_play_at(const char *name, uintptr_t group, int loops, int priority,
+              Body *source, Body *listener, float dist_maxvol,
+              float dist_silence, int pan, uint *sound_id, int *channel)
+{
+        assert(source && listener);
+        
+        if (loops != -1 && out_of_range(source, listener, dist_silence))
+                return 0;
+        audio_play(name, group, 0, loops, 0, priority, sound_id, channel);
+        audio_bind_volume(*channel, *sound_id, source, listener, dist_maxvol,
+                          dist_silence, pan);
+        return 1;
+}
+
+/*
+ * Adjust volume and panning on those channels that are bound to bodies. Call
+ * this after worlds have been stepped: mixer is only told about changes.
  */
 void
 audio_adjust_volume()
@@ -424,6 +732,7 @@ audio_set_volume(int ch, uint sound_id, int volume)
                 return;
 
         Mix_Volume(ch, volume);
+        channels[ch].volume = volume;
 }
 
 void
@@ -623,6 +932,7 @@ audio_init()
                 Mix_Quit();
                 return (have_audio = 0);
         }
+        stereo = (output_channels == 2);
         const char *format_str, *output_str;
         switch (format) {
                 case AUDIO_U8: format_str = "U8"; break;
@@ -667,6 +977,18 @@ audio_init()
         mem_pool_init(&mp_sound, sizeof(Sound), 100, "Sound");
         mem_pool_init(&mp_music, sizeof(Music), 10, "Music");
         
+        /* Sound cache budget is given in kilobytes. */
+        stats.budget = GET_CFG("soundCacheSize", cfg_get_int, 16384) * 1024;
+        
+        /* Start prefetch thread. */
+        prefetch_lock = SDL_CreateMutex();
+        prefetch_cond = SDL_CreateCond();
+        decoded_cond = SDL_CreateCond();
+        prefetch_thread = SDL_CreateThread(prefetch_main, NULL);
+        if (prefetch_thread == NULL)
+                fatal_error("Could not create sound prefetch thread: %s",
+                    SDL_GetError());
+        
         return (have_audio = 1);
 }
 
@@ -676,6 +998,17 @@ audio_close()
         if (!have_audio)
                 return;
         
+        /* Stop prefetch thread. */
+        SDL_mutexP(prefetch_lock);
+        prefetch_quit = 1;
+        SDL_CondSignal(prefetch_cond);
+        SDL_mutexV(prefetch_lock);
+        SDL_WaitThread(prefetch_thread, NULL);
+        SDL_DestroyCond(decoded_cond);
+        SDL_DestroyCond(prefetch_cond);
+        SDL_DestroyMutex(prefetch_lock);
+        prefetch_lock = NULL;
+        
         Mix_CloseAudio();
         Mix_Quit();
         
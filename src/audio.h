@@ -6,18 +6,40 @@
 #include "physics.h"
 #include "uthash.h"
 
+/* Sound cache statistics. */
+typedef struct {
+        uint    bytes;          /* Size of decoded samples in cache. */
+        uint    budget;         /* Cache size limit. */
+        uint    num_sounds;     /* Number of cached sounds. */
+        uint    hits;           /* Sound was ready when played. */
+        uint    misses;         /* Sound had to be loaded (or waited for). */
+        uint    evictions;      /* Sounds dropped to stay within budget. */
+        uint32_t load_ms;       /* Total time spent decoding. */
+} AudioStats;
+
+typedef void (*audio_sound_func)(const char *name, uint bytes,
+                                 uint32_t load_ms, uint plays, void *arg);
+
 /* Control audio interface. */
 int     audio_init();
 void    audio_close();
-void    audio_free_unused();
 void    audio_adjust_volume();
 
+/* Sound cache. */
+void    audio_prefetch(const char *name);
+void    audio_collect_prefetched(void);
+void    audio_get_stats(AudioStats *result);
+void    audio_foreach_sound(audio_sound_func func, void *arg);
+
 /* Manage sounds. */
 void    audio_play(const char *name, uintptr_t group, int volume, int loops, int fade_in,
-                   uint *sound_id, int *channel);
+                   int priority, uint *sound_id, int *channel);
+int     audio_play_at(const char *name, uintptr_t group, int loops, int priority,
+                      Body *source, Body *listener, float dist_maxvol,
+                      float dist_silence, int pan, uint *sound_id, int *channel);
 void    audio_set_volume(int channel, uint sound_id, int volume);
 void    audio_bind_volume(int ch, uint sound_id, Body *source, Body *listener,
-                          float dist_maxvol, float dist_silence);
+                          float dist_maxvol, float dist_silence, int pan);
 void    audio_fadeout(int channel, uint sound_id, int fade_time);
 void    audio_stop(int channel, uint sound_id);
 
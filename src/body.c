@@ -2,17 +2,21 @@
 #include <lua.h>
 #include <math.h>
 #include <stdlib.h>
+#include "config.h"
 #include "game2d.h"
 #include "log.h"
 #include "lua_util.h"
 #include "misc.h"
 #include "physics.h"
+#include "prof.h"
 #include "world.h"
 #include "utlist.h"
 
 void
 body_init(Body *body, World *world, vect_f pos, uint flags)
 {
+	extern Config config;
+	
 	assert(body != NULL && world != NULL);
 
 	body->objtype = OBJTYPE_BODY;
@@ -29,13 +33,24 @@ body_init(Body *body, World *world, vect_f pos, uint flags)
 	body->tiles = NULL;
 	body->shapes = NULL;
 	body->flags = flags;
+	
+	/* Special bodies (static body in particular) tend to have lots of
+	   tiles and shapes spread all over the world, and they seldom move.
+	   Proxies would only get in the way of lookups there. */
+	if (config.body_proxies && !(flags & BODY_SPECIAL))
+		body->flags |= BODY_PROXY;
+	qtree_obj_init(&body->tile_proxy, body);
+	qtree_obj_init(&body->shape_proxy, body);
 
 	body->step_func_id = 0;
 	body->afterstep_func_id = 0;
 	memset(body->timers, 0, sizeof(Timer) * BODY_TIMERS_MAX);
 
 	body->parent = NULL;
-	memset(body->children, 0, sizeof(Body *) * BODY_CHILDREN_MAX);
+	body->children = NULL;
+	body->sibling_prev = body->sibling_next = NULL;
+	body->link_offset = (vect_f) { x:0, y:0 };
+	body->path_bind = -1;
 	
 	/* Add body to world. */
 	world_add_body(world, body);
@@ -52,24 +67,30 @@ body_alloc()
 void
 body_destroy(Body *body)
 {
-	int i;
-
+	Tile *tile;
+	Shape *s;
+	
 	assert(body != NULL);
 
-	if (body->parent != NULL) {
-		/* Remove body from its parent's child list. */
-		for (i = 0; i < BODY_CHILDREN_MAX; i++) {
-			if (body->parent->children[i] == body) {
-				body->parent->children[i] = NULL;
-				break;
-			}
-		}
-		body->parent = NULL;	/* Unset parent link. */
-	}
-	/* Unlink children. */
-	for (i = 0; i < BODY_CHILDREN_MAX; i++) {
-		if (body->children[i] != NULL)
-			body->children[i]->parent = NULL;
+	/* Remove body from its parent's child list, then unlink children. */
+	body_unlink(body);
+	while (body->children != NULL)
+		body_unlink(body->children);
+	
+	/* Stop moving along path. */
+	if (body->path_bind >= 0)
+		world_unbind_path(body->world, body);
+	
+	/* Take proxies out of trees at once, instead of shrinking them with
+	   every tile and shape freed below. */
+	if (body->flags & BODY_PROXY) {
+		body->flags &= ~BODY_PROXY;
+		for (tile = body->tiles; tile != NULL; tile = tile->next)
+			tile->flags &= ~TILE_PROXIED;
+		for (s = body->shapes; s != NULL; s = s->next)
+			s->flags &= ~SHAPE_PROXIED;
+		body_update_tile_proxy(body);
+		body_update_shape_proxy(body);
 	}
 
 	/* Free owned tiles. */
@@ -152,7 +173,8 @@ body_step(Body *body, lua_State *L, void *script_ptr)
 	
 	/* Call Lua step function. */
 	/* Stack: ... __CallFunc func_id false worldPtr bodyPtr */
-	if (lua_pcall(L, 4, 0, errfunc_index)) {
+	if (prof_pcall(L, 4, errfunc_index, PROF_STEP,
+	    body->step_func_id)) {
 		log_err("[Lua] %s", lua_tostring(L, -1));
 		abort();
 	}
@@ -186,12 +208,101 @@ body_afterstep(Body *body, lua_State *L, void *script_ptr)
 	
 	/* Call Lua step function. */
 	/* Stack: ... __CallFunc func_id false worldPtr bodyPtr */
-	if (lua_pcall(L, 4, 0, errfunc_index)) {
+	if (prof_pcall(L, 4, errfunc_index, PROF_AFTERSTEP,
+	    body->afterstep_func_id)) {
 		log_err("[Lua] %s", lua_tostring(L, -1));
 		abort();
 	}
 }
 
+/*
+ * Move proxy object to [bb] within [tree]. NULL [bb] means the proxy stands
+ * for nothing, and leaves the tree.
+ */
+static void
+update_proxy(QTree *tree, QTreeObject *proxy, const BB *bb)
+{
+	if (bb == NULL) {
+		if (proxy->stored)
+			qtree_remove(tree, proxy);
+		return;
+	}
+	if (!proxy->stored) {
+		proxy->bb = *bb;
+		qtree_add(tree, proxy);
+		return;
+	}
+	if (proxy->bb.l == bb->l && proxy->bb.b == bb->b &&
+	    proxy->bb.r == bb->r && proxy->bb.t == bb->t)
+		return;		/* Same place. */
+	proxy->bb = *bb;
+	qtree_update(tree, proxy);
+}
+
+/*
+ * Grow [bb] to include [add]. If [*empty] is set, [bb] is replaced instead.
+ */
+static void
+bb_merge(BB *bb, const BB *add, int *empty)
+{
+	if (*empty) {
+		*bb = *add;
+		*empty = 0;
+		return;
+	}
+	bb->l = MIN2(bb->l, add->l);
+	bb->b = MIN2(bb->b, add->b);
+	bb->r = MAX2(bb->r, add->r);
+	bb->t = MAX2(bb->t, add->t);
+}
+
+/*
+ * Recompute bounding boxes of body's proxied tiles (see BODY_PROXY), and move
+ * tile proxy to cover all of them.
+ */
+void
+body_update_tile_proxy(Body *body)
+{
+	int empty;
+	BB bb;
+	Tile *tile;
+	
+	assert(body != NULL);
+	
+	empty = 1;
+	for (tile = body->tiles; tile != NULL; tile = tile->next) {
+		if (!(tile->flags & TILE_PROXIED))
+			continue;
+		tile_bb_at(tile, body->pos, &tile->go.bb);
+		bb_merge(&bb, &tile->go.bb, &empty);
+	}
+	update_proxy(&body->world->tile_tree, &body->tile_proxy,
+	    empty ? NULL : &bb);
+}
+
+/*
+ * Same as body_update_tile_proxy(), but for shapes.
+ */
+void
+body_update_shape_proxy(Body *body)
+{
+	int empty;
+	BB bb;
+	Shape *s;
+	
+	assert(body != NULL);
+	
+	empty = 1;
+	for (s = body->shapes; s != NULL; s = s->next) {
+		if (!(s->flags & SHAPE_PROXIED))
+			continue;
+		shape_bb_at(s, body->pos, &s->go.bb);
+		bb_merge(&bb, &s->go.bb, &empty);
+	}
+	update_proxy(&body->world->shape_tree, &body->shape_proxy,
+	    empty ? NULL : &bb);
+}
+
 /*
  * Remove all tiles and shapes (that belong to this body) from the quad tree,
  * then re-add them. Call this function whenever body's position changes.
@@ -204,6 +315,12 @@ body_update_tree(Body *body)
 
 	assert(body != NULL);
 	
+	if (body->flags & BODY_PROXY) {
+		body_update_tile_proxy(body);
+		body_update_shape_proxy(body);
+		return;
+	}
+	
 	/* Update tiles. */
 	for (tile = body->tiles; tile != NULL; tile = tile->next) {
 		if (!tile->go.stored)
@@ -238,6 +355,146 @@ body_set_pos(Body *body, vect_f pos)
 	body_update_tree(body);
 }
 
+/*
+ * Move body to [pos] without passing through the positions in between: it is
+ * drawn there right away instead of sliding over from where it was, and a
+ * BODY_FAST body is not swept along the way. Following children jump with it.
+ */
+void
+body_teleport(Body *body, vect_f pos)
+{
+	Body *child;
+	
+	assert(body != NULL);
+	body_set_pos(body, pos);
+	body->prevstep_pos = body->pos;
+	body->prevframe_pos = body->pos;
+	for (child = body->children; child != NULL;
+	    child = child->sibling_next) {
+		if (child->flags & BODY_FOLLOW)
+			body_teleport(child, vect_f_add(body->pos,
+			    child->link_offset));
+	}
+}
+
+/*
+ * Position at which body should be drawn. Without interpolation this is just
+ * the rounded current position. Otherwise it is interpolated between previous
+ * step position and current position using world's render_alpha, and rounded
+ * only if pixel snapping is enabled.
+ */
+vect_f
+body_render_pos(const Body *body)
+{
+	extern Config config;
+	vect_f pos;
+	
+	assert(body != NULL && body->world != NULL);
+	if (!config.interpolate)
+		return vect_f_round(body->pos);
+	
+	pos = vect_f_sub(body->pos, body->prevstep_pos);
+	pos = vect_f_add(body->prevstep_pos,
+	    vect_f_scale(pos, body->world->render_alpha));
+	return config.pixel_snap ? vect_f_round(pos) : pos;
+}
+
+/*
+ * Attach child to parent. Child is appended to the end of parent's child list,
+ * so children keep the order in which they were linked.
+ *
+ * child	Body that will be linked to parent. If it already has a parent,
+ *		it is unlinked from it first.
+ * parent	Parent body.
+ * follow	If true, the current offset between child and parent is stored
+ *		and child is moved along with parent in body_update_children().
+ */
+void
+body_link(Body *child, Body *parent, int follow)
+{
+	Body *tail;
+
+	assert(child != NULL && parent != NULL && child != parent);
+	
+	if (child->parent != parent) {
+		body_unlink(child);
+		
+		/* Append child to parent's list. */
+		child->parent = parent;
+		child->sibling_next = NULL;
+		if (parent->children == NULL) {
+			child->sibling_prev = child;
+			parent->children = child;
+		} else {
+			tail = parent->children->sibling_prev;
+			tail->sibling_next = child;
+			child->sibling_prev = tail;
+			parent->children->sibling_prev = child;
+		}
+	}
+	
+	if (follow) {
+		child->flags |= BODY_FOLLOW;
+		child->link_offset = vect_f_sub(child->pos, parent->pos);
+	} else {
+		child->flags &= ~BODY_FOLLOW;
+	}
+}
+
+/*
+ * Detach body from its parent. Does nothing if body has no parent.
+ */
+void
+body_unlink(Body *child)
+{
+	Body *parent;
+
+	assert(child != NULL);
+	parent = child->parent;
+	if (parent == NULL)
+		return;
+	
+	assert(parent->children != NULL);
+	if (child->sibling_prev == child) {
+		/* Only child. */
+		parent->children = NULL;
+	} else if (child == parent->children) {
+		/* First child: new head inherits tail pointer. */
+		child->sibling_next->sibling_prev = child->sibling_prev;
+		parent->children = child->sibling_next;
+	} else {
+		child->sibling_prev->sibling_next = child->sibling_next;
+		if (child->sibling_next != NULL)
+			child->sibling_next->sibling_prev = child->sibling_prev;
+		else
+			parent->children->sibling_prev = child->sibling_prev;
+	}
+	child->parent = NULL;
+	child->sibling_prev = child->sibling_next = NULL;
+	child->flags &= ~BODY_FOLLOW;
+}
+
+/*
+ * Move following children (those linked with BODY_FOLLOW flag) so that they
+ * keep their offset from parent. Descends into grandchildren as well, so it is
+ * enough to call this once for each hierarchy root.
+ */
+void
+body_update_children(Body *parent)
+{
+	Body *child;
+
+	assert(parent != NULL);
+	for (child = parent->children; child != NULL;
+	    child = child->sibling_next) {
+		if (child->flags & BODY_FOLLOW)
+			body_set_pos(child, vect_f_add(parent->pos,
+			    child->link_offset));
+		if (child->children != NULL)
+			body_update_children(child);
+	}
+}
+
 Timer *
 body_add_timer(Body *body, double when, int func_id)
 {
@@ -297,7 +554,8 @@ body_run_timers(Body *body, lua_State *L)
 		
 		/* Call Lua timer function. */
 		/* Stack: ... __CallFunc func_id true */
-		if (lua_pcall(L, 2, 0, errfunc_index)) {
+		if (prof_pcall(L, 2, errfunc_index, PROF_TIMER,
+		    runnable[i].func_id)) {
 			log_err("[Lua] %s", lua_tostring(L, -1));
 			abort();
 		}
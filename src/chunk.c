@@ -0,0 +1,293 @@
+#include <sys/stat.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "chunk.h"
+#include "log.h"
+#include "mem.h"
+#include "misc.h"
+#include "uthash.h"
+
+/*
+ * Compiled chunk kept in memory.
+ */
+typedef struct {
+	char		name[CHUNK_NAME_MAX];	/* Source file name = hash key. */
+	int64_t		mtime;			/* Source modification time. */
+	uint32_t	size;			/* Source size. */
+	char		*code;			/* Compiled chunk. */
+	uint		code_size;
+	uint64_t	compile_ns;		/* Time it took to compile. */
+	UT_hash_handle	hh;
+} Chunk;
+
+/* lua_dump() output buffer. */
+typedef struct {
+	char	*data;
+	uint	size, max_size;
+} DumpBuffer;
+
+static Chunk		*chunk_hash;
+static ChunkStats	 stats;
+static int		 use_files;	/* Read and write compiled files? */
+
+void
+chunk_init(int files)
+{
+	use_files = files;
+}
+
+void
+chunk_cleanup(void)
+{
+	Chunk *chunk, *tmp;
+
+	HASH_ITER(hh, chunk_hash, chunk, tmp) {
+		HASH_DEL(chunk_hash, chunk);
+		mem_free(chunk->code);
+		mem_free(chunk);
+	}
+	memset(&stats, 0, sizeof(stats));
+}
+
+void
+chunk_get_stats(ChunkStats *result)
+{
+	*result = stats;
+}
+
+/*
+ * Load compiled chunk from memory (same as luaL_loadbuffer()).
+ */
+static int
+load_code(lua_State *L, const char *filename, const char *code, uint size)
+{
+	int status;
+
+	lua_pushfstring(L, "@%s", filename);
+	status = luaL_loadbuffer(L, code, size, lua_tostring(L, -1));
+	lua_remove(L, -2);
+	return status;
+}
+
+static int
+dump_writer(lua_State *L, const void *p, size_t size, void *arg)
+{
+	DumpBuffer *buf = arg;
+
+	(void)L;
+	if (buf->size + size > buf->max_size) {
+		buf->max_size = MAX2(buf->max_size * 2, buf->size + size);
+		mem_realloc((void **)&buf->data, buf->max_size,
+		    "Compiled chunk");
+	}
+	memcpy(buf->data + buf->size, p, size);
+	buf->size += size;
+	return 0;
+}
+
+/*
+ * Read compiled chunk file of [filename]. Returns NULL if there's none, or if
+ * it does not belong to the current version of source.
+ */
+static char *
+read_compiled(const char *filename, const struct stat *st, ChunkHeader *hdr)
+{
+	char cname[CHUNK_NAME_MAX + 1], *code;
+	FILE *f;
+
+	snprintf(cname, sizeof(cname), "%sc", filename);
+	if ((f = fopen(cname, "rb")) == NULL)
+		return NULL;
+	if (fread(hdr, sizeof(*hdr), 1, f) != 1 ||
+	    memcmp(hdr->magic, CHUNK_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->mtime != (int64_t)st->st_mtime ||
+	    hdr->size != (uint32_t)st->st_size || hdr->code_size == 0) {
+		fclose(f);
+		return NULL;
+	}
+	code = mem_alloc(hdr->code_size, "Compiled chunk");
+	if (fread(code, hdr->code_size, 1, f) != 1 || fgetc(f) != EOF) {
+		mem_free(code);
+		fclose(f);
+		return NULL;	/* Truncated or overlong. */
+	}
+	fclose(f);
+	return code;
+}
+
+/*
+ * Save compiled chunk next to its source. Failure is not an error: the cache
+ * may well live on a read-only medium.
+ */
+static void
+write_compiled(const Chunk *chunk)
+{
+	static int warned;
+	char cname[CHUNK_NAME_MAX + 1];
+	ChunkHeader hdr;
+	FILE *f;
+	int ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CHUNK_MAGIC, sizeof(hdr.magic));
+	hdr.mtime = chunk->mtime;
+	hdr.size = chunk->size;
+	hdr.code_size = chunk->code_size;
+	hdr.compile_us = chunk->compile_ns / 1000;
+
+	snprintf(cname, sizeof(cname), "%sc", chunk->name);
+	if ((f = fopen(cname, "wb")) != NULL) {
+		ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+		    fwrite(chunk->code, chunk->code_size, 1, f) == 1;
+		ok = (fclose(f) == 0) && ok;
+		if (ok)
+			return;
+		remove(cname);
+	}
+	if (!warned) {
+		log_warn("Could not save compiled script %s.", cname);
+		warned = 1;
+	}
+}
+
+/*
+ * Add compiled chunk to memory cache, replacing the one that is there.
+ */
+static Chunk *
+add_chunk(const char *filename, const struct stat *st, char *code, uint size,
+    uint64_t compile_ns)
+{
+	Chunk *chunk;
+
+	HASH_FIND_STR(chunk_hash, filename, chunk);
+	if (chunk != NULL) {
+		HASH_DEL(chunk_hash, chunk);
+		stats.bytes -= chunk->code_size;
+		mem_free(chunk->code);
+	} else {
+		chunk = mem_alloc(sizeof(Chunk), "Chunk");
+		strcpy(chunk->name, filename);
+	}
+	chunk->mtime = st->st_mtime;
+	chunk->size = st->st_size;
+	chunk->code = code;
+	chunk->code_size = size;
+	chunk->compile_ns = compile_ns;
+	HASH_ADD_STR(chunk_hash, name, chunk);
+	stats.bytes += size;
+	return chunk;
+}
+
+/*
+ * Load a Lua file as a chunk, without running it. Same as luaL_loadfile(), but
+ * through compiled chunk cache.
+ */
+int
+chunk_loadfile(lua_State *L, const char *filename)
+{
+	int status;
+	uint64_t start, elapsed;
+	struct stat st;
+	Chunk *chunk;
+	ChunkHeader hdr;
+	DumpBuffer buf;
+	char *code;
+
+	/* Standard input, names too long to cache, and files that can't be
+	   opened (let Lua produce the error message). */
+	if (filename == NULL || strlen(filename) >= CHUNK_NAME_MAX ||
+	    stat(filename, &st) != 0)
+		return luaL_loadfile(L, filename);
+
+	/* Memory. */
+	start = time_ns();
+	HASH_FIND_STR(chunk_hash, filename, chunk);
+	if (chunk != NULL && chunk->mtime == (int64_t)st.st_mtime &&
+	    chunk->size == (uint32_t)st.st_size) {
+		if (load_code(L, filename, chunk->code, chunk->code_size) == 0) {
+			stats.memory_hits++;
+			stats.load_ns += time_ns() - start;
+			stats.saved_ns += chunk->compile_ns;
+			return 0;
+		}
+		lua_pop(L, 1);	/* Error message; fall back to the file. */
+	}
+
+	/* Compiled file. */
+	if (use_files && (code = read_compiled(filename, &st, &hdr)) != NULL) {
+		if (load_code(L, filename, code, hdr.code_size) == 0) {
+			add_chunk(filename, &st, code, hdr.code_size,
+			    hdr.compile_us * (uint64_t)1000);
+			stats.disk_hits++;
+			stats.load_ns += time_ns() - start;
+			stats.saved_ns += hdr.compile_us * (uint64_t)1000;
+			return 0;
+		}
+		lua_pop(L, 1);	/* Compiled by some other Lua build. */
+		mem_free(code);
+	}
+
+	/* Source. */
+	start = time_ns();
+	if ((status = luaL_loadfile(L, filename)) != 0)
+		return status;
+	elapsed = time_ns() - start;
+	stats.compiled++;
+	stats.compile_ns += elapsed;
+
+	memset(&buf, 0, sizeof(buf));
+	if (lua_dump(L, dump_writer, &buf) != 0 || buf.size == 0) {
+		if (buf.data != NULL)
+			mem_free(buf.data);
+		return 0;	/* Loaded, just not cached. */
+	}
+	chunk = add_chunk(filename, &st, buf.data, buf.size, elapsed);
+	if (use_files)
+		write_compiled(chunk);
+	return 0;
+}
+
+/*
+ * Replacement for Lua's dofile().
+ */
+static int
+chunk_dofile(lua_State *L)
+{
+	const char *filename;
+	int n;
+
+	filename = luaL_optstring(L, 1, NULL);
+	n = lua_gettop(L);
+	if (chunk_loadfile(L, filename) != 0)
+		lua_error(L);
+	lua_call(L, 0, LUA_MULTRET);
+	return lua_gettop(L) - n;
+}
+
+/*
+ * Replacement for Lua's loadfile().
+ */
+static int
+chunk_loadfile_lua(lua_State *L)
+{
+	const char *filename;
+
+	filename = luaL_optstring(L, 1, NULL);
+	if (chunk_loadfile(L, filename) == 0)
+		return 1;
+	lua_pushnil(L);
+	lua_insert(L, -2);	/* nil, error message */
+	return 2;
+}
+
+/*
+ * Make Lua's dofile() and loadfile() go through chunk cache.
+ */
+void
+chunk_register(lua_State *L)
+{
+	lua_register(L, "dofile", chunk_dofile);
+	lua_register(L, "loadfile", chunk_loadfile_lua);
+}
@@ -0,0 +1,52 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <lua.h>
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Compiled Lua chunk cache.
+ *
+ * Scripts are loaded over and over again: every room change runs the room
+ * script, which in turn runs the shared object scripts. chunk_loadfile() works
+ * like luaL_loadfile(), but keeps the compiled form (lua_dump() output) of
+ * every script in memory, so that loading it again only has to undump it.
+ * Optionally, compiled chunks are also saved next to their source (with a "c"
+ * appended to the name, e.g., "script/Forest.luac"), so that the next session
+ * can skip the compiler as well.
+ *
+ * Cached chunks are keyed by file name, and are used only as long as source
+ * modification time and size stay the same.
+ */
+
+#define CHUNK_MAGIC	"LRDC"
+#define CHUNK_NAME_MAX	128	/* Longer names are not cached. */
+
+/* Header of a compiled chunk file. The chunk itself follows. */
+typedef struct {
+	char		magic[4];	/* = CHUNK_MAGIC */
+	int64_t		mtime;		/* Source modification time. */
+	uint32_t	size;		/* Source size. */
+	uint32_t	code_size;	/* Compiled chunk size. */
+	uint32_t	compile_us;	/* Time it took to compile source. */
+} ChunkHeader;
+
+/* Chunk cache statistics. */
+typedef struct {
+	uint		compiled;	/* Chunks compiled from source. */
+	uint		memory_hits;	/* Chunks found in memory. */
+	uint		disk_hits;	/* Chunks read from compiled files. */
+	uint		bytes;		/* Size of chunks kept in memory. */
+	uint64_t	compile_ns;	/* Time spent compiling. */
+	uint64_t	load_ns;	/* Time spent loading cached chunks. */
+	uint64_t	saved_ns;	/* Compile time that cache hits avoided. */
+} ChunkStats;
+
+void	chunk_init(int use_files);
+void	chunk_cleanup(void);
+int	chunk_loadfile(lua_State *L, const char *filename);
+void	chunk_register(lua_State *L);
+void	chunk_get_stats(ChunkStats *result);
+
+#endif /* CHUNK_H */
@@ -0,0 +1,134 @@
+#include <assert.h>
+#include <math.h>
+#include "collide.h"
+
+/*
+ * Center of a circle shape, given its bounding box.
+ */
+vect_f
+circle_center(const BB *bb)
+{
+	vect_f center = {(bb->l + bb->r) / 2.0, (bb->b + bb->t) / 2.0};
+	return center;
+}
+
+static int
+circle_circle(const BB *a_bb, double ra, const BB *b_bb, double rb,
+    Contact *contact)
+{
+	vect_f d;
+	double dist;
+	
+	d = vect_f_sub(circle_center(a_bb), circle_center(b_bb));
+	dist = sqrt(vect_f_dot(d, d));
+	if (dist > ra + rb)
+		return 0;
+	
+	contact->depth = ra + rb - dist;
+	if (dist > 0.0) {
+		contact->normal = vect_f_scale(d, 1.0 / dist);
+	} else {
+		/* Concentric; any direction will do. */
+		contact->normal.x = 0.0;
+		contact->normal.y = 1.0;
+	}
+	return 1;
+}
+
+/*
+ * Circle A against rectangle B.
+ */
+static int
+circle_rect(const BB *a_bb, double r, const BB *b, Contact *contact)
+{
+	vect_f c, closest, d;
+	double dist, to_l, to_r, to_b, to_t, min_x, min_y;
+	
+	c = circle_center(a_bb);
+	closest.x = (c.x < b->l) ? b->l : (c.x > b->r) ? b->r : c.x;
+	closest.y = (c.y < b->b) ? b->b : (c.y > b->t) ? b->t : c.y;
+	d = vect_f_sub(c, closest);
+	
+	/* Center outside rectangle: push away from the closest point. This is
+	   what tells corners apart from bounding box overlap. */
+	if (d.x != 0.0 || d.y != 0.0) {
+		dist = sqrt(vect_f_dot(d, d));
+		if (dist > r)
+			return 0;
+		contact->normal = vect_f_scale(d, 1.0 / dist);
+		contact->depth = r - dist;
+		return 1;
+	}
+	
+	/* Center inside: push out through the nearest edge. */
+	to_l = c.x - b->l;
+	to_r = b->r - c.x;
+	to_b = c.y - b->b;
+	to_t = b->t - c.y;
+	min_x = MIN2(to_l, to_r);
+	min_y = MIN2(to_b, to_t);
+	if (min_x < min_y) {
+		contact->normal.x = (to_l < to_r) ? -1.0 : 1.0;
+		contact->normal.y = 0.0;
+		contact->depth = min_x + r;
+	} else {
+		contact->normal.x = 0.0;
+		contact->normal.y = (to_b < to_t) ? -1.0 : 1.0;
+		contact->depth = min_y + r;
+	}
+	return 1;
+}
+
+/*
+ * Rectangle A against rectangle B: separate along the axis of least overlap.
+ */
+static int
+rect_rect(const BB *a, const BB *b, Contact *contact)
+{
+	double over_x, over_y;
+	
+	over_x = MIN2(a->r, b->r) - MAX2(a->l, b->l);
+	over_y = MIN2(a->t, b->t) - MAX2(a->b, b->b);
+	if (over_x < 0.0 || over_y < 0.0)
+		return 0;
+	
+	if (over_x < over_y) {
+		contact->normal.x = (a->l + a->r < b->l + b->r) ? -1.0 : 1.0;
+		contact->normal.y = 0.0;
+		contact->depth = over_x;
+	} else {
+		contact->normal.x = 0.0;
+		contact->normal.y = (a->b + a->t < b->b + b->t) ? -1.0 : 1.0;
+		contact->depth = over_y;
+	}
+	return 1;
+}
+
+/*
+ * Test shapes A and B (with bounding boxes [a_bb] and [b_bb], i.e., where they
+ * are or would be in the world) against each other. Returns 1 and fills
+ * [contact] if they overlap or touch, 0 otherwise.
+ */
+int
+collide_shapes(const Shape *a, const BB *a_bb, const Shape *b, const BB *b_bb,
+    Contact *contact)
+{
+	assert(a != NULL && a_bb != NULL && b != NULL && b_bb != NULL);
+	assert(contact != NULL);
+	
+	if (a->shape_type == SHAPE_CIRCLE) {
+		if (b->shape_type == SHAPE_CIRCLE)
+			return circle_circle(a_bb, a->shape.circle.radius,
+			    b_bb, b->shape.circle.radius, contact);
+		return circle_rect(a_bb, a->shape.circle.radius, b_bb,
+		    contact);
+	}
+	if (b->shape_type == SHAPE_CIRCLE) {
+		/* Rectangle vs circle: the same, from circle's side. */
+		if (!circle_rect(b_bb, b->shape.circle.radius, a_bb, contact))
+			return 0;
+		contact->normal = vect_f_neg(contact->normal);
+		return 1;
+	}
+	return rect_rect(a_bb, b_bb, contact);
+}
@@ -0,0 +1,27 @@
+#ifndef COLLIDE_H
+#define COLLIDE_H
+
+#include "geometry.h"
+#include "physics.h"
+
+/*
+ * Narrow phase collision: exact tests between pairs of shapes (circle-circle,
+ * circle-rectangle, rectangle-rectangle). Broad phase (quad tree lookup) only
+ * finds shapes whose bounding boxes are near each other; these routines decide
+ * whether they really touch, and how to separate them.
+ */
+
+/*
+ * Contact between shapes A and B. Moving A by normal * depth separates the
+ * two shapes (leaves them touching).
+ */
+typedef struct {
+	vect_f	normal;		/* Unit vector pointing from B towards A. */
+	double	depth;		/* Penetration depth (zero if only touching). */
+} Contact;
+
+vect_f	circle_center(const BB *bb);
+int	collide_shapes(const Shape *a, const BB *a_bb, const Shape *b,
+	    const BB *b_bb, Contact *contact);
+
+#endif /* COLLIDE_H */
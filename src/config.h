@@ -22,6 +22,37 @@ typedef struct {
 	float	w_t, w_b, w_l, w_r;
 	uint	screen_bpp;
 	int	force_native;
+	int	interpolate;	/* Draw bodies between previous and current
+				   step positions. */
+	int	pixel_snap;	/* Round interpolated positions to pixels. */
+	int	render_threads;	/* Worker threads for render preparation. */
+	int	render_thread;	/* Step worlds and run scripts on a thread of
+				   their own, draw on the main one. */
+	int	integer_scale;	/* Scale screen to window by whole factors. */
+	int	low_res;	/* Always draw at screen size, then magnify. */
+	int	sharp_bilinear;	/* Magnify low-res target: integer factor with
+				   nearest, rest with linear filtering. */
+	int	loose_trees;	/* World quad trees are loose (see qtree.h). */
+	int	body_proxies;	/* Bodies enter quad trees as a whole (see
+				   BODY_PROXY in physics.h). */
+	int	script_cache;	/* Save compiled scripts (see chunk.h). */
+	int	gc_pause;	/* Lua collector pause and step multiplier */
+	int	gc_stepmul;	/*   (see luagc.h). */
+	uint	gc_frame_ms;	/* Frame time budget for Lua collector (0 =
+				   collect whenever Lua sees fit). */
+	int	profile;	/* Profile script callbacks (see prof.h). */
+	uint	profile_sampling; /* Sample Lua stack every so many
+				   instructions (0 = don't). */
+	String	profile_report;	/* Profiler output files ("" = none). */
+	String	profile_stacks;
+	int	trace;		/* Record frame timeline from start. */
+	uint	trace_events;	/* Timeline ring buffer size (see trace.h). */
+	uint	trace_key;	/* Key that starts recording/dumps timeline. */
+	String	trace_file;	/* Timeline file written by trace key. */
+	uint	stream_margin;	/* Load streamed room cells this close to what
+				   cameras see (see stream.h). */
+	uint	stream_unload_margin; /* Unload cells farther than this. */
+	uint	stream_budget_ms; /* Frame time budget for loading cells. */
 } Config;
 
 void	cfg_read(const char *filename);
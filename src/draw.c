@@ -10,142 +10,89 @@
 #include "misc.h"
 #include "physics.h"
 #include "matrix.h"
+#include "render.h"
 
 uint bound_texture = (uint) -1;
 static uint blend_func = 0;
 
-static inline void draw_sprite(Tile *tile, const Camera *cam) {
-	TexFrag texfrag;
-	vect_f BL, BR, TR, TL;
+/*
+ * Draw tiles of a render view. Vertices are fed to OpenGL as vertex arrays,
+ * one glDrawArrays() call per run of tiles that share texture and blending
+ * function.
+ */
+void
+draw_render_view(const RenderView *view)
+{
+	const RenderTile *rt;
+	GLsizei stride;
+	uint i, first, n;
 
-	SpriteList *sprite_list = tile->sprite_list;
+	n = view->num_tiles;
+	if (n == 0)
+		return;
 
-	vect_i size = tile->size;
-	vect_i rel_pos = tile->pos;
+	stride = sizeof(RenderVertex);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glTexCoordPointer(2, GL_FLOAT, stride, &view->verts[0].u);
+	glColorPointer(4, GL_UNSIGNED_BYTE, stride, &view->verts[0].color);
+	glVertexPointer(2, GL_FLOAT, stride, &view->verts[0].x);
 
-	vect_f obj_pos = vect_f_round(tile->body->pos);
-	vect_f obj_prevpos = vect_f_round(tile->body->prevframe_pos);
-	vect_f cam_prevpos = vect_f_round(cam->body.prevframe_pos);
-		    
-	assert(sprite_list != NULL);
-	assert(sprite_list->frames != NULL
-	       && sprite_list->num_frames > 0
-	       && tile->frame_index < sprite_list->num_frames);
-	assert((size.x > 0.0 && size.y > 0.0) 
-	    || (size.x < 0.0 && size.y < 0.0));
+	for (i = first = 0; i <= n; i++) {
+		rt = &view->tiles[i];
+		if (i < n && bound_texture == rt->tex_id &&
+		    blend_func == (rt->flags & TILE_MULTIPLY))
+			continue;
 
-	/* Switch texture and blending function if necessary. */
-	if (bound_texture != sprite_list->tex->id ||
-	    blend_func != (tile->flags & TILE_MULTIPLY)) {
-		glEnd();
+		/* State changes (or we're done): draw what we have so far. */
+		if (i > first)
+			glDrawArrays(GL_QUADS, first * 4, (i - first) * 4);
+		if (i == n)
+			break;
+		first = i;
 		
 		/* Switch texture if it differs from currently selected one. */
-		if (bound_texture != sprite_list->tex->id) {
-			glBindTexture(GL_TEXTURE_2D, sprite_list->tex->id);
+		if (bound_texture != rt->tex_id) {
+			glBindTexture(GL_TEXTURE_2D, rt->tex_id);
 			glTexEnvf(GL_TEXTURE_ENV,
 				  GL_TEXTURE_ENV_MODE,
 				  GL_MODULATE);
-			bound_texture = sprite_list->tex->id;
+			bound_texture = rt->tex_id;
 		}
 		
 		/* Switch blending if it differs from the current one. */
-		if (blend_func != (tile->flags & TILE_MULTIPLY)) {
-			if (tile->flags & TILE_MULTIPLY)
+		if (blend_func != (rt->flags & TILE_MULTIPLY)) {
+			if (rt->flags & TILE_MULTIPLY)
 				glBlendFunc(GL_ZERO, GL_SRC_COLOR);
 			else
 				glBlendFunc(GL_SRC_ALPHA,
 					    GL_ONE_MINUS_SRC_ALPHA);
-			blend_func = (tile->flags & TILE_MULTIPLY);
+			blend_func = (rt->flags & TILE_MULTIPLY);
 		}
-		glBegin(GL_QUADS);
 	}
 
-	texfrag = sprite_list->frames[tile->frame_index];
-	assert(texfrag.r > texfrag.l && texfrag.b > texfrag.t);
-
-	if (size.x < 0.0) { /* If size is negative, use sprite size. */
-		size.x = round((texfrag.r - texfrag.l)*sprite_list->tex->pow_w);
-		size.y = round((texfrag.b - texfrag.t)*sprite_list->tex->pow_h);
-	}
-
-	/* Subtract camera position from object position. */
-	obj_pos = vect_f_sub(obj_pos, vect_f_round(cam->body.pos));
-	obj_prevpos = vect_f_sub(obj_prevpos, cam_prevpos);
-
-	/* Corner positions. */
-	BL = vect_f_new(rel_pos.x, rel_pos.y);
-	BR = vect_f_new(rel_pos.x + size.x, rel_pos.y);
-	TR = vect_f_new(rel_pos.x + size.x, rel_pos.y + size.y);
-	TL = vect_f_new(rel_pos.x, rel_pos.y + size.y);
-
-	if (tile->angle != 0.0) {
-	    BL = vect_f_rotate(&BL, tile->angle);
-	    BR = vect_f_rotate(&BR, tile->angle);
-	    TR = vect_f_rotate(&TR, tile->angle);
-	    TL = vect_f_rotate(&TL, tile->angle);
-	}
-
-	/* Translate to object position. */
-	BL = vect_f_add(BL, obj_pos);
-	BR = vect_f_add(BR, obj_pos);
-	TR = vect_f_add(TR, obj_pos);
-	TL = vect_f_add(TL, obj_pos);
-
-	if (tile->flags & TILE_FLIP_X) {
-		if (tile->flags & TILE_FLIP_Y) {
-			glTexCoord2f(texfrag.r, texfrag.t);
-			glVertex2f(BL.x, BL.y);
-			glTexCoord2f(texfrag.l, texfrag.t);
-			glVertex2f(BR.x, BR.y);
-			glTexCoord2f(texfrag.l, texfrag.b);
-			glVertex2f(TR.x, TR.y);
-			glTexCoord2f(texfrag.r, texfrag.b);
-			glVertex2f(TL.x, TL.y);
-		} else {
-			glTexCoord2f(texfrag.r, texfrag.b);
-			glVertex2f(BL.x, BL.y);
-			glTexCoord2f(texfrag.l, texfrag.b);
-			glVertex2f(BR.x, BR.y);
-			glTexCoord2f(texfrag.l, texfrag.t);
-			glVertex2f(TR.x, TR.y);
-			glTexCoord2f(texfrag.r, texfrag.t);
-			glVertex2f(TL.x, TL.y);
-		}
-	} else {
-		if (tile->flags & TILE_FLIP_Y) {
-			glTexCoord2f(texfrag.l, texfrag.t);
-			glVertex2f(BL.x, BL.y);
-			glTexCoord2f(texfrag.r, texfrag.t);
-			glVertex2f(BR.x, BR.y);
-			glTexCoord2f(texfrag.r, texfrag.b);
-			glVertex2f(TR.x, TR.y);
-			glTexCoord2f(texfrag.l, texfrag.b);
-			glVertex2f(TL.x, TL.y);
-		} else {
-			glTexCoord2f(texfrag.l, texfrag.b);
-			glVertex2f(BL.x, BL.y);
-			glTexCoord2f(texfrag.r, texfrag.b);
-			glVertex2f(BR.x, BR.y);
-			glTexCoord2f(texfrag.r, texfrag.t);
-			glVertex2f(TR.x, TR.y);
-			glTexCoord2f(texfrag.l, texfrag.t);
-			glVertex2f(TL.x, TL.y);
-		}
-	}
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	
+	/* Current color is undefined after using a color array. */
+	glColor4f(1.0, 1.0, 1.0, 1.0);
 }
 
 void
-draw_quad(Camera *cam, BB *bb_arg, float color[4])
+draw_quad(vect_f cam_pos, const BB *bb_arg, const float color[4])
 {
 	BB bb;
 
 	glDisable(GL_TEXTURE_2D);
 
 	bb = *bb_arg;
-	bb.l -= round(cam->body.pos.x);
-	bb.r -= round(cam->body.pos.x);
-	bb.b -= round(cam->body.pos.y);
-	bb.t -= round(cam->body.pos.y);
+	cam_pos = vect_f_round(cam_pos);
+	bb.l -= cam_pos.x;
+	bb.r -= cam_pos.x;
+	bb.b -= cam_pos.y;
+	bb.t -= cam_pos.y;
 	
 	glColor4fv(color);
 	glBegin(GL_QUADS);
@@ -264,23 +211,6 @@ draw_shape(const Shape *s)
 	glPopMatrix();
 }
 
-void
-draw_tile(const Camera *cam, Tile *tile)
-{
-	assert(cam != NULL && tile != NULL && tile->body != NULL);
-	
-	/* Calculate current frame index (for animating tiles). */
-	tile_update_frameindex(tile);
-	
-	if (tile->hidden) return;
-
-	/* Set tile color. */
-	glColor4ubv((uchar *)&tile->color);
-
-	/* If there are no attachments, draw the sprite and bail out. */
-	draw_sprite(tile, cam);
-}
-
 void
 draw_BB(const BB *bb)
 {
@@ -3,15 +3,16 @@
 
 #include "game2d.h"
 #include "physics.h"
+#include "render.h"
 
 void	draw_qtree(const QTree *tree);
 void	draw_point(vect_f p);
 void	draw_shape(const Shape *s);
 void	draw_axes();
 void	draw_BB(const BB *bb);
-void	draw_quad(Camera *cam, BB *bb, float color[4]);
+void	draw_quad(vect_f cam_pos, const BB *bb, const float color[4]);
 void	draw_text();
 
-void	draw_tile(const Camera *cam, Tile *t);
+void	draw_render_view(const RenderView *view);
 
 #endif /* DRAW_H */
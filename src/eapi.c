@@ -1,14 +1,21 @@
+#include <sys/stat.h>
 #include <assert.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include <math.h>
 #include "audio.h"
+#include "chunk.h"
 #include "config.h"
 #include "console.h"
 #include "game2d.h"
+#include "glcall.h"
 #include "log.h"
 #include "lua_util.h"
+#include "luagc.h"
 #include "misc.h"
+#include "room.h"
+#include "stream.h"
+#include "trace.h"
 #include "world.h"
 #include "utlist.h"
 
@@ -175,11 +182,9 @@ SetKeyBindings(lua_State *L)
 static int
 __Collide(lua_State *L)
 {
-	extern mem_pool mp_group;
 	const char *nameA, *nameB;
 	World *world;
 	Group *groupA, *groupB;
-	Handler *handler;
 	int func_id, priority;
 	
 	L_numarg_check(L, 5);
@@ -199,38 +204,16 @@ __Collide(lua_State *L)
 	func_id = lua_tonumber(L, 4);
 	priority = lua_tonumber(L, 5);
 	
-	/* Find group structures. */
-	HASH_FIND_STR(world->groups, nameA, groupA);
-	HASH_FIND_STR(world->groups, nameB, groupB);
-	
-	/* Create group A if it doesn't exist. */
-	if (groupA == NULL) {
-		groupA = mp_alloc(&mp_group);
-		L_assert(L, strlen(nameA) < WORLD_GROUPNAME_LENGTH,
-		    "Group name '%s' is too long", nameA);
-		strcpy(groupA->name, nameA);
-		groupA->id = world->next_group_id++;
-		L_assert(L, groupA->id < WORLD_HANDLERS_MAX, "Too many shape "
-		    "groups (%i).", groupA->id);
-		HASH_ADD_STR(world->groups, name, groupA);
-	}
-	
-	/* Create group B if it doesn't exist. */
-	if (groupB == NULL) {
-		groupB = mp_alloc(&mp_group);
-		L_assert(L, strlen(nameB) < WORLD_GROUPNAME_LENGTH,
-		    "Group name '%s' is too long", nameB);
-		strcpy(groupB->name, nameB);
-		groupB->id = world->next_group_id++;
-		L_assert(L, groupB->id < WORLD_HANDLERS_MAX, "Too many shape "
-		    "groups (%i).", groupB->id);
-		HASH_ADD_STR(world->groups, name, groupB);
-	}
-	
-	/* Get referenced handler; set handler functino ID and priority. */
-	handler = &world->collision_map[groupA->id][groupB->id];
-	handler->func_id = func_id;
-	handler->priority = priority;
+	/* Find group structures (create them if they don't exist). */
+	L_assert(L, strlen(nameA) < WORLD_GROUPNAME_LENGTH,
+	    "Group name '%s' is too long", nameA);
+	L_assert(L, strlen(nameB) < WORLD_GROUPNAME_LENGTH,
+	    "Group name '%s' is too long", nameB);
+	groupA = world_get_group(world, nameA);
+	groupB = world_get_group(world, nameB);
+	
+	/* Set handler function ID and priority. */
+	world_set_handler(world, groupA->id, groupB->id, func_id, priority);
 	
 	return 0;
 }
@@ -436,7 +419,7 @@ NewParallax(lua_State *L)
 /*
  * __Destroy(...)
  *
- * ...		Accepted objects: Body, Shape, Tile, World.
+ * ...		Accepted objects: Body, Shape, Tile, World, Path.
  *
  * Free any resources owned by objects. Passing an object into API routines
  * after it has been destroyed will result in assertion failures saying it is of
@@ -462,11 +445,17 @@ __Destroy(lua_State *L)
 			break;
 		}
 		case OBJTYPE_SHAPE: {
-			shape_free(lua_touserdata(L, i));
+			Shape *s = lua_touserdata(L, i);
+			if (s->flags & SHAPE_STREAMED)
+				stream_forget(s);
+			shape_free(s);
 			break;
 		}
 		case OBJTYPE_TILE: {
-			tile_free(lua_touserdata(L, i));
+			Tile *t = lua_touserdata(L, i);
+			if (t->flags & TILE_STREAMED)
+				stream_forget(t);
+			tile_free(t);
 			break;
 		}
 		case OBJTYPE_WORLD: {
@@ -482,6 +471,13 @@ __Destroy(lua_State *L)
 			world_clear(world);
 			break;
 		}
+		case OBJTYPE_PATH: {
+			Path *path = lua_touserdata(L, i);
+			L_assert(L, path->refcount == 0, "Path has bodies bound "
+			    "to it.");
+			path_free(path);
+			break;
+		}
 		default:
 			L_objtype_error(L, *objtype);
 		}
@@ -570,25 +566,162 @@ NewCamera(lua_State *L)
 }
 
 /*
- * NewPath(interpType, open, outside, motion) -> path object
+ * NewPath(points, interpType, closed, outside, motion, tension) -> path
+ *
+ * points	List of position vectors: {{x1, y1}, {x2, y2}, ...}. At least
+ *		two are needed for the path to go anywhere.
+ * interpType	eapi.PATH_LINEAR, eapi.PATH_CUBIC (Catmull-Rom), or
+ *		eapi.PATH_HERMITE. Default is PATH_LINEAR.
+ * closed	If true, last point is connected back to the first one.
+ * outside	What happens once time value leaves its base range:
+ *		eapi.PATH_LOOP (default), eapi.PATH_CLAMP, eapi.PATH_REVERSE.
+ * motion	eapi.PATH_NORMAL (time goes 0..1, default), eapi.PATH_PIECEWISE
+ *		(time goes 0..N, one unit per segment), or eapi.PATH_CONSTANT
+ *		(time goes 0..1 at constant speed along the curve).
+ * tension	Hermite tangent tension: 0 (default) is the same as Catmull-Rom,
+ *		1 gives a curve with no tangents at the points.
+ *
+ * See src/path.h for details. Paths are not owned by worlds; Destroy() them
+ * once no bodies are bound to them anymore.
  */
 static int
 NewPath(lua_State *L)
 {
-	UNUSED(L);
+	Path *path;
+	int n, i, num_points, interp, closed, outside, motion;
+
+	n = lua_gettop(L);
+	L_assert(L, n >= 1 && n <= 6, "Incorrect number of arguments.");
+	luaL_checktype(L, 1, LUA_TTABLE);
+	interp = lua_isnoneornil(L, 2) ? PATH_LINEAR : lua_tointeger(L, 2);
+	closed = lua_toboolean(L, 3);
+	outside = lua_isnoneornil(L, 4) ? PATH_LOOP : lua_tointeger(L, 4);
+	motion = lua_isnoneornil(L, 5) ? PATH_NORMAL : lua_tointeger(L, 5);
+	L_assert(L, interp == PATH_LINEAR || interp == PATH_CUBIC ||
+	    interp == PATH_HERMITE, "Invalid interpolation type (%i).", interp);
+	L_assert(L, outside == PATH_LOOP || outside == PATH_CLAMP ||
+	    outside == PATH_REVERSE, "Invalid outside type (%i).", outside);
+	L_assert(L, motion == PATH_NORMAL || motion == PATH_PIECEWISE ||
+	    motion == PATH_CONSTANT, "Invalid motion type (%i).", motion);
+
+	path = path_new(interp, closed, outside, motion);
+	num_points = lua_objlen(L, 1);
+	for (i = 1; i <= num_points; i++) {
+		L_getlistitem(L, 1, i);
+		path_add(path, L_getstk_vect_f(L, -1));
+		lua_pop(L, 1);
+	}
+	if (!lua_isnoneornil(L, 6)) {
+		luaL_checktype(L, 6, LUA_TNUMBER);
+		path_set_tension(path, lua_tonumber(L, 6));
+	}
+
+	lua_pushlightuserdata(L, path);
+	return 1;
+}
+
+/*
+ * GetPathLength(path) -> length
+ *
+ * Length of path in pixels (for curved paths, a close approximation).
+ */
+static int
+GetPathLength(lua_State *L)
+{
+	Path *path;
+
+	L_numarg_check(L, 1);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	path = lua_touserdata(L, 1);
+	L_assert_objtype(L, path, OBJTYPE_PATH);
+
+	lua_pushnumber(L, path_length(path));
 	return 1;
 }
 
 /*
- * BindToPath(object, path, startPos, speed)
+ * BindToPath(body, path, startPos, speed)
+ *
+ * body		Body to move along path.
+ * path		Path as returned by NewPath(). nil stops body where it is.
+ * startPos	Time value to start at (see motion in NewPath()). Default is 0.
+ * speed	How much time value increases per second. Default is 1. With
+ *		PATH_CONSTANT motion, pixels per second is speed times
+ *		GetPathLength(path).
+ *
+ * Each world step, after step functions have run, body is placed at the point
+ * that the path gives for its current time value. Children that follow it (see
+ * Link()) come along. Bodies on the same path are positioned together.
  */
 static int
 BindToPath(lua_State *L)
 {
-	UNUSED(L);
+	Body *body;
+	Path *path;
+	float start, speed;
+
+	L_assert(L, lua_gettop(L) >= 2 && lua_gettop(L) <= 4,
+	    "Incorrect number of arguments.");
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	body = lua_touserdata(L, 1);
+	L_assert_objtype(L, body, OBJTYPE_BODY);
+	L_assert(L, !(body->flags & BODY_SPECIAL), "Special body.");
+
+	if (lua_isnil(L, 2)) {
+		if (body->path_bind >= 0)
+			world_unbind_path(body->world, body);
+		return 0;
+	}
+	luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+	path = lua_touserdata(L, 2);
+	L_assert_objtype(L, path, OBJTYPE_PATH);
+	start = lua_isnoneornil(L, 3) ? 0.0 : luaL_checknumber(L, 3);
+	speed = lua_isnoneornil(L, 4) ? 1.0 : luaL_checknumber(L, 4);
+
+	world_bind_path(body->world, body, path, start, speed);
 	return 0;
 }
 
+/*
+ * The window and what is drawn belong to the GL thread (see glcall.h). These
+ * run there.
+ */
+static void
+show_cursor(void *arg)
+{
+	SDL_ShowCursor(*(int *)arg);
+}
+
+static void
+switch_framebuffer_call(void *unused)
+{
+	extern void switch_framebuffer(void);
+	UNUSED(unused);
+	switch_framebuffer();
+}
+
+static void
+fade_framebuffer_call(void *arg)
+{
+	extern void fade_to_other_framebuffer(int);
+	fade_to_other_framebuffer(*(int *)arg);
+}
+
+static void
+screen_fade_call(void *arg)
+{
+	extern void set_screen_fade(const float color[4]);
+	set_screen_fade(arg);
+}
+
+static void
+reset_screen_call(void *unused)
+{
+	UNUSED(unused);
+	glClearColor(0.0, 0.0, 0.0, 0.0);	/* Reset clear color. */
+	SDL_ShowCursor(SDL_DISABLE);		/* Hide cursor. */
+}
+
 /*
  * ShowCursor()
  *
@@ -597,21 +730,25 @@ BindToPath(lua_State *L)
 static int
 ShowCursorFunc(lua_State *L)
 {
+	int toggle = SDL_ENABLE;
+
 	L_numarg_check(L, 0);
-	SDL_ShowCursor(SDL_ENABLE);
+	glcall_post(show_cursor, &toggle, sizeof(toggle));
 	return 0;
 }
 
 /*
- * ShowCursor()
+ * HideCursor()
  *
- * Show default mouse cursor.
+ * Hide mouse cursor.
  */
 static int
 HideCursor(lua_State *L)
 {
+	int toggle = SDL_DISABLE;
+
 	L_numarg_check(L, 0);
-	SDL_ShowCursor(SDL_DISABLE);
+	glcall_post(show_cursor, &toggle, sizeof(toggle));
 	return 0;
 }
 
@@ -623,9 +760,8 @@ HideCursor(lua_State *L)
 static int
 SwitchFramebuffer(lua_State *L)
 {
-	extern void switch_framebuffer(void);
 	L_numarg_check(L, 0);
-	switch_framebuffer();
+	glcall_post(switch_framebuffer_call, NULL, 0);
 	return 0;
 }
 
@@ -637,10 +773,32 @@ SwitchFramebuffer(lua_State *L)
 static int
 FadeFramebuffer(lua_State *L)
 {
-	extern void fade_to_other_framebuffer(int);
+	int transition;
+
 	L_numarg_check(L, 1);
 	luaL_checktype(L, 1, LUA_TNUMBER);
-	fade_to_other_framebuffer(lua_tonumber(L, 1));
+	transition = lua_tonumber(L, 1);
+	glcall_post(fade_framebuffer_call, &transition, sizeof(transition));
+	return 0;
+}
+
+/*
+ * SetScreenFade(color)
+ *
+ * color	Color: {r=?, g=?, b=?, a=?}.
+ *
+ * Blend the whole screen toward color; alpha is the amount (0 = no fade, 1 =
+ * solid color).
+ */
+static int
+SetScreenFade(lua_State *L)
+{
+	float color[4];
+
+	L_numarg_check(L, 1);
+	luaL_checktype(L, 1, LUA_TTABLE);
+	L_getstk_color(L, 1, color);
+	glcall_post(screen_fade_call, color, sizeof(color));
 	return 0;
 }
 
@@ -649,9 +807,10 @@ FadeFramebuffer(lua_State *L)
  *
  * name			String parameter: choose a unique name for this world.
  * stepDuration		Duration of each world step in milliseconds.
- * quadTreeDepth	Number of levels in the quad tree that partitions space.
- *			Shouldn't be more than 20. A good idea is to start with
- *			10, then increase if necessary.
+ * quadTreeDepth	Initial number of levels in the quad trees that partition
+ *			space (at most 20). Trees grow as objects are placed
+ *			further out, and shrink back to this size when they're
+ *			gone, so pick something that covers a typical room.
  *
  * Create a new world and return its pointer. World is the topmost
  * data structure (see world.h).
@@ -951,7 +1110,7 @@ set_shape_attr(lua_State *L)
  *
  * body		Body object as returned by NewBody().
  * attributes	Table of body attributes:
- * 			{sleep=?}.
+ * 			{sleep=?, fast=?}.
  *		It's OK to omit some or all of the attributes.
  *------------------------------------------------------------------------------
  * Attribute descriptions:
@@ -960,6 +1119,11 @@ set_shape_attr(lua_State *L)
  *		camera vicinity. A sleeping body will not have its step, timer,
  *		collision functions executed, so it will consume less resources.
  *		Use for optimization if necessary.
+ * fast		Boolean value. If true, body's shapes are swept from previous
+ *		step position to the current one, and body is stopped at the
+ *		first shape it would otherwise pass through (continuous
+ *		collision). Use for projectiles and other bodies that move more
+ *		than their own size in one step.
  */
 static int
 set_body_attr(lua_State *L)
@@ -974,6 +1138,13 @@ set_body_attr(lua_State *L)
 		else
 			body->flags &= ~BODY_SLEEP;
 	}
+	lua_getfield(L, 2, "fast");
+	if (!lua_isnil(L, -1)) {
+		if (lua_toboolean(L, -1))
+			body->flags |= BODY_FAST;
+		else
+			body->flags &= ~BODY_FAST;
+	}
 	return 0;
 }
 
@@ -1041,7 +1212,7 @@ set_tile_attr(lua_State *L)
 	lua_getfield(L, 2, "size");
 	if (!lua_isnil(L, -1)) {
 		tile->size = L_getstk_vect_i(L, -1);
-		if (tile->go.stored)
+		if (tile_in_tree(tile))
 			tile_update_tree(tile);
 	}
 	lua_getfield(L, 2, "color");
@@ -1500,8 +1671,6 @@ GetBodyCount(lua_State *L)
 static int
 NewShape(lua_State *L)
 {
-	extern mem_pool mp_group;
-	BB *bb;
 	Shape *s;
 	Body *body;
 	World *world;
@@ -1545,23 +1714,12 @@ NewShape(lua_State *L)
 	s->body = body;
 	DL_APPEND(body->shapes, s);	/* Add to body's shape list. */
 
-	/* Extract collision group name and find corresponding group. */
+	/* Extract collision group name and find corresponding group (create
+	   it if it doesn't exist yet). */
 	name = lua_tostring(L, 4);
-	HASH_FIND_STR(world->groups, name, group);
-	
-	/* Create group if it doesn't exist yet. */
-	if (group == NULL) {
-		group = mp_alloc(&mp_group);
-		L_assert(L, strlen(name) < WORLD_GROUPNAME_LENGTH,
-		    "Group name '%s' is too long", name);
-		
-		/* Set group name, ID, and add it to hash. */
-		strcpy(group->name, name);
-		group->id = world->next_group_id++;
-		L_assert(L, group->id < WORLD_HANDLERS_MAX, "Too many shape "
-		    "groups (%i).", group->id);
-		HASH_ADD_STR(world->groups, name, group);
-	}
+	L_assert(L, strlen(name) < WORLD_GROUPNAME_LENGTH,
+	    "Group name '%s' is too long", name);
+	group = world_get_group(world, name);
 	s->group = group->id;	/* Assign group ID to shape. */
 	
 	/* Set default attribute values. */
@@ -1577,26 +1735,9 @@ NewShape(lua_State *L)
 #endif
 
 	/* Add to tree. */
-	bb = &s->go.bb;
-	switch (s->shape_type) {
-	case SHAPE_CIRCLE:
-		bb->l = s->shape.circle.offset.x - s->shape.circle.radius +
-		    round(body->pos.x);
-		bb->b = s->shape.circle.offset.y - s->shape.circle.radius +
-		    round(body->pos.y);
-		bb->r = bb->l + s->shape.circle.radius * 2;
-		bb->t = bb->b + s->shape.circle.radius * 2;
-		break;
-	case SHAPE_RECTANGLE:
-		bb->l = s->shape.rect.l + round(body->pos.x);
-		bb->b = s->shape.rect.b + round(body->pos.y);
-		bb->r = s->shape.rect.r + round(body->pos.x);
-		bb->t = s->shape.rect.t + round(body->pos.y);
-		break;
-	default:
+	if (s->shape_type != SHAPE_CIRCLE && s->shape_type != SHAPE_RECTANGLE)
 		luaL_error(L, "Invalid shape type (%i).", s->shape_type);
-	}
-	qtree_add(&body->world->shape_tree, &s->go);
+	shape_add_tree(s);
 
 	lua_pushlightuserdata(L, s);	/* Return shape pointer. */
 	return 1;
@@ -1642,7 +1783,7 @@ SetSpriteList(lua_State *L)
 	Tile *tile;
 	SpriteList *sprite_list;
 	TexFrag texfrag;
-	vect_i tmp, size = {0, 0}, pos;
+	vect_i tmp, size = {0, 0};
 
 	n = lua_gettop(L);
 	L_assert(L, n >= 2 && n <= 3, "Incorrect number of arguments.");
@@ -1670,12 +1811,15 @@ SetSpriteList(lua_State *L)
 
 	/* Tile bounding box might change. Therefore we remove tile from tree
 	   and then re-add it.*/
-	if (tile->go.stored)	/* If is stored within space tree. */
-		qtree_remove(&tile->body->world->tile_tree, &tile->go);
+	if (tile_in_tree(tile))	/* If is stored within space tree. */
+		tile_remove_tree(tile);
 	
 	if (sprite_list == NULL || sprite_list->num_frames == 0)
 		return 0; /* No sprites to display, don't add to tree. */
 	L_assert(L, sprite_list->tex != NULL, "Sprite list with no texture.");
+	
+	/* Animated tile: show current frame of the new sprite list. */
+	tile_update_frameindex(tile);
 
 	/* If tile size is positive, it doesn't depend on sprite size. */
 	if (tile->size.x > 0.0) {
@@ -1715,13 +1859,8 @@ SetSpriteList(lua_State *L)
 	if (no_lookup)
 		return 0; /* Argument says it mustn't be added to quad tree. */
 
-	/* Position within world. */
-	pos.x = tile->pos.x + round(tile->body->pos.x);
-	pos.y = tile->pos.y + round(tile->body->pos.y);
-	
 	/* Add to tree. */
-	bb_init(&tile->go.bb, pos.x, pos.y, pos.x + size.x, pos.y + size.y);
-	qtree_add(&tile->body->world->tile_tree, &tile->go);
+	tile_add_tree(tile);
 
 	return 0;
 }
@@ -1985,6 +2124,7 @@ Animate(lua_State *L)
 	int n, *objtype;
 	double *fps, *start_time;
 	World *world;
+	Tile *tile = NULL;
 
 	n = lua_gettop(L);
 	L_assert(L, n >= 3 && n <= 4, "Invalid number of arguments.");
@@ -1994,7 +2134,7 @@ Animate(lua_State *L)
 	L_assert(L, objtype != NULL, "NULL object pointer.");
 	switch (*objtype) {
 	case OBJTYPE_TILE: {
-		Tile *tile = (Tile *)objtype;
+		tile = (Tile *)objtype;
 		world = tile->body->world;
 		anim_type = &tile->anim_type;
 		fps = &tile->anim_FPS;
@@ -2029,6 +2169,10 @@ Animate(lua_State *L)
 		*start_time += lua_tonumber(L, 4);
 	}
 	
+	/* Attach tile to a shared animation clock. */
+	if (tile != NULL)
+		tile_set_anim(tile, *anim_type, *fps, *start_time);
+	
 	return 0;
 }
 
@@ -2054,7 +2198,8 @@ StopAnimation(lua_State *L)
 	case OBJTYPE_TILE: {
 		Tile *tile = (Tile *)objtype;
 		world = tile->body->world;
-		tile->anim_type = TILE_ANIM_NONE;
+		tile_set_anim(tile, TILE_ANIM_NONE, tile->anim_FPS,
+		    tile->anim_start);
 		break;
 	}
 	case OBJTYPE_PARALLAX: {
@@ -2120,13 +2265,18 @@ SetAnimPos(lua_State *L)
 }
 
 /*
- * SetPos(object, pos)
+ * SetPos(object, pos, teleport=false)
  *
  * object	Accepted objects: Body, Camera, Tile.
  *		Also shapes are accepted, but act a bit differently. Since there
  *		is no explicit position relative to owner Body, this position is
  *		added to the shape's current "position".
  * pos		Position vector.
+ * teleport	Body or Camera only. If true, the object jumps to [pos]: it is
+ *		not drawn sliding over from its old position, and a fast body
+ *		does not collide with what lies in between. Leave it false when
+ *		moving something a little every step, so that the movement
+ *		stays smooth.
  *
  * Change position of something. If object is a Tile, then only its relative
  * position is altered (with respect to the body that owns the Tile).
@@ -2134,11 +2284,13 @@ SetAnimPos(lua_State *L)
 static int
 SetPos(lua_State *L)
 {
-	int *objtype;
+	int *objtype, teleport;
 
-	L_numarg_check(L, 2);
+	L_assert(L, lua_gettop(L) == 2 || lua_gettop(L) == 3,
+	    "Incorrect number of arguments.");
 	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
 	luaL_checktype(L, 2, LUA_TTABLE);
+	teleport = lua_toboolean(L, 3);
 
 	objtype = lua_touserdata(L, 1);
 	L_assert(L, objtype != NULL, "NULL object pointer.");
@@ -2146,18 +2298,26 @@ SetPos(lua_State *L)
 	switch (*objtype) {
 	case OBJTYPE_BODY: {
 		Body *body = (Body *)objtype;
-		body_set_pos(body, L_getstk_vect_f(L, 2));
+		if (teleport)
+			body_teleport(body, L_getstk_vect_f(L, 2));
+		else
+			body_set_pos(body, L_getstk_vect_f(L, 2));
 		break;
 	}
 	case OBJTYPE_CAMERA: {
 		Camera *cam = (Camera *)objtype;
 		cam_set_pos(cam, L_getstk_vect_f(L, 2));
+		if (teleport) {
+			cam->body.prevstep_pos = cam->body.pos;
+			cam->body.prevframe_pos = cam->body.pos;
+		}
 		break;
 	}
 	case OBJTYPE_TILE: {
 		Tile *tile = (Tile *)objtype;
 		tile->pos = L_getstk_vect_i(L, 2);
-		tile_update_tree(tile);
+		if (tile_in_tree(tile))
+			tile_update_tree(tile);
 		break;
 	}
 	case OBJTYPE_SHAPE: {
@@ -2847,11 +3007,15 @@ GetData(lua_State *L)
 
 /*
  * Link(child, parent)
+ * Link(child, parent, follow)
  *
  * child, parent	Body objects as returned by NewBody().
+ * follow		If true, child keeps its current offset from parent and is
+ *			moved along with it once per step (after step functions,
+ *			before collision handling). Default is false.
  *
- * Attach child to parent. This child-parent connection has no meaning outside
- * of what the script decides to do with it.
+ * Attach child to parent. Without follow, this child-parent connection has no
+ * meaning outside of what the script decides to do with it.
  *	* To "unlink", call eapi.Unlink().
  *	* To get a list of attached children , call eapi.GetChildren(parent).
  *	* To get a child's parent, call eapi.GetParent(child).
@@ -2859,10 +3023,11 @@ GetData(lua_State *L)
 static int
 Link(lua_State *L)
 {
-	int i;
+	int n, follow;
 	Body *child, *parent;
 
-	L_numarg_check(L, 2);
+	n = lua_gettop(L);
+	L_assert(L, n == 2 || n == 3, "Incorrect number of arguments.");
 	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
 	luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
 
@@ -2870,20 +3035,10 @@ Link(lua_State *L)
 	parent = lua_touserdata(L, 2);
 	L_assert_objtype(L, child, OBJTYPE_BODY);
 	L_assert_objtype(L, parent, OBJTYPE_BODY);
+	L_assert(L, child != parent, "Body cannot be linked to itself.");
+	follow = (n == 3) ? lua_toboolean(L, 3) : 0;
 
-	if (child->parent == parent)
-		return 0;	/* Already linked. */
-
-	/* Set parent as child's parent, and add child to parent's child list.*/
-	child->parent = parent;
-	for (i = 0; i < BODY_CHILDREN_MAX; i++) {
-		assert(parent->children[i] != child);
-		if (parent->children[i] == NULL)
-			break;	/* Found a free spot. */
-	}
-	assert(i != BODY_CHILDREN_MAX);
-	parent->children[i] = child;
-	
+	body_link(child, parent, follow);
 	return 0;
 }
 
@@ -2895,7 +3050,6 @@ Link(lua_State *L)
 static int
 Unlink(lua_State *L)
 {
-	int i;
 	Body *body;
 
 	L_numarg_check(L, 1);
@@ -2904,16 +3058,7 @@ Unlink(lua_State *L)
 	body = lua_touserdata(L, 1);
 	L_assert_objtype(L, body, OBJTYPE_BODY);
 
-	if (body->parent != NULL) {
-		/* Remove body from its parent's child list. */
-		for (i = 0; i < BODY_CHILDREN_MAX; i++) {
-			if (body->parent->children[i] == body) {
-				body->parent->children[i] = NULL;
-				break;
-			}
-		}
-		body->parent = NULL;	/* Unset parent link. */
-	}
+	body_unlink(body);
 	return 0;
 }
 
@@ -2950,8 +3095,8 @@ GetParentFunc(lua_State *L)
 static int
 GetChildren(lua_State *L)
 {
-	int i, key;
-	Body *body;
+	int key;
+	Body *body, *child;
 
 	L_numarg_check(L, 1);
 	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
@@ -2962,11 +3107,9 @@ GetChildren(lua_State *L)
 	/* Create and return an array of lightuserdata pointers to children. */
 	lua_newtable(L);
 	key = 1;
-	for (i = 0; i < BODY_CHILDREN_MAX; i++) {
-		if (body->children[i] == NULL)
-			continue;
+	for (child = body->children; child != NULL; child = child->sibling_next) {
 		lua_pushinteger(L, key++);
-		lua_pushlightuserdata(L, body->children[i]);
+		lua_pushlightuserdata(L, child);
 		lua_settable(L, -3);
 	}
 	return 1;
@@ -3220,7 +3363,7 @@ SelectShape(lua_State *L)
 	
 	/* Look up nearby shapes from quad tree. */
 	QTreeObject *intersect[100];
-	int too_many = qtree_lookup(&world->shape_tree, &bb, intersect, 100, &num_shapes);
+	int too_many = world_lookup_shapes(world, &bb, intersect, 100, &num_shapes);
 	L_assert(L, !too_many, "Too many shapes in SelectShape().");
 	
 	/* Go over the lookup shapes. If we find one which really intersects our
@@ -3238,146 +3381,1004 @@ SelectShape(lua_State *L)
 	return 0;
 }
 
-
 /*
- * __Clear()
- *
- * Destroy sprites, clear out all worlds and schedule them for destruction,
- * unbind all keys.
+ * Set up query filter from optional group name argument at [index]. Returns 0
+ * if there's no group by that name (so nothing can match).
  */
 static int
-__Clear(lua_State *L)
+group_filter_arg(lua_State *L, int index, World *world, CastFilter *filter)
 {
-	extern int *key_bind;
-	extern mem_pool mp_camera, mp_body, mp_parallax;
-	extern mem_pool mp_group;
-	extern World *worlds[WORLDS_MAX];
-	extern int drawShapes, drawTileTree, drawShapeTree, outsideView;
-	int i;
-
-	L_numarg_check(L, 0);
-	glClearColor(0.0, 0.0, 0.0, 0.0);	/* Reset clear color. */
-	SDL_ShowCursor(SDL_DISABLE);		/* Hide cursor. */
-
-	/* Fade out all sound channels. */
-	audio_fadeout_group(0, 1000);
-
-	/* Disable debug modes. */
-	drawShapes = 0;
-	drawTileTree = 0;
-	drawShapeTree = 0;
-	outsideView = 0;
-
-	/* Clear worlds and schedule them for destruction. */
-	for (i = 0; i < WORLDS_MAX; i++) {
-		if (worlds[i] == NULL)
-			continue;
-		worlds[i]->killme = 1;
-		world_clear(worlds[i]);
-	}
-	assert(mp_first(&mp_body) == NULL);
-	assert(mp_first(&mp_camera) == NULL);
-	assert(mp_first(&mp_parallax) == NULL);
-	assert(mp_first(&mp_group) == NULL);
+	Group *group;
 	
-	/* Destroy textures and sounds that have not been used in a while. */
-	texture_free_unused();
-	audio_free_unused();
-
-	/* Unbind keys. */
-	memset(key_bind, 0, sizeof(uint) * (SDLK_LAST + EXTRA_KEYBIND));
+	filter->group = 0;
+	filter->handler_group = 0;
+	filter->ignore = NULL;
+	if (lua_isnoneornil(L, index))
+		return 1;
 	
-	return 0;
+	luaL_checktype(L, index, LUA_TSTRING);
+	HASH_FIND_STR(world->groups, lua_tostring(L, index), group);
+	if (group == NULL)
+		return 0;
+	filter->group = group->id;
+	return 1;
 }
 
 /*
- * Quit()
- *
- * Terminate program.
+ * Push a list of shapes. If there's a table at [index], it is reused: shapes
+ * are stored in it as an array, and leftover entries from previous use are
+ * cleared. This way scripts that query every step do not create garbage.
  */
-static int
-Quit(lua_State *L)
+static void
+push_shape_list(lua_State *L, int index, Shape **shapes, uint num_shapes)
 {
-	L_numarg_check(L, 0);
-	exit(EXIT_SUCCESS);
+	uint i;
+	
+	if (lua_istable(L, index))
+		lua_pushvalue(L, index);
+	else
+		lua_createtable(L, num_shapes, 0);
+	for (i = 0; i < num_shapes; i++) {
+		lua_pushlightuserdata(L, shapes[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	for (i = num_shapes + 1;; i++) {
+		lua_rawgeti(L, -1, i);
+		if (lua_isnil(L, -1))
+			break;
+		lua_pop(L, 1);
+		lua_pushnil(L);
+		lua_rawseti(L, -2, i);
+	}
+	lua_pop(L, 1);
 }
 
+/* Scratch space for shape queries. */
+#define QUERY_MAX	500
+static Shape	*query_shapes[QUERY_MAX];
+static CastHit	 query_hits[QUERY_MAX];
+
 /*
- * PlaySound(world, filename, loops=0, volume=1, fadeInTime=0) -> sound
+ * ShapeCast(world, shape, from, to, groupName=nil) -> hit
  *
- * world	World as returned by NewWorld(). This is necessary because when
- *		a world is paused, we also must pause all sounds bound to it. If
- *		false is used here, then the sound does not belong to any world.
- * filename	Sound filename (e.g., "script/click.ogg").
- * loops	How many times the sound should be looped. Zero means the sound
- *		will be played only once. -1 will play it forever (until some
- *		other condition stops it).
- * volume	Number in the range [0..1].
- * fadeInTime	The time it takes for sound to go from zero volume to full
- *		volume.
+ * world	Game world as returned by NewWorld().
+ * shape	Shape specification, same as for NewShape().
+ * from, to	Start and end positions of the (imaginary) body that the shape
+ *		is attached to.
+ * groupName	Ignore all shapes that do not belong to this group.
  *
- * Play a sound. Returns a sound handle which can be used to stop the sound or
- * change it's volume, add effects, etc.
+ * Move shape from one position to the other and return the first shape it
+ * touches on the way, or nil if nothing is hit. Shapes already overlapping
+ * the start position are ignored.
+ *
+ * hit = {
+ *	shape	Shape that was hit.
+ *	toi	Time of impact: 0 at "from", 1 at "to".
+ *	normal	Contact normal {x=?,y=?}, pointing away from the hit shape.
+ *	pos	Position at time of impact {x=?,y=?}.
+ * }
  */
 static int
-PlaySound(lua_State *L)
+ShapeCast(lua_State *L)
 {
-	int n = lua_gettop(L);
-	L_assert(L, n >= 2 && n <= 5, "Incorrect number of arguments.");
-	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
-	luaL_checktype(L, 2, LUA_TSTRING);
-	
-	/* World or no world. */
-        World *world;
-	if (lua_islightuserdata(L, 1)) {
-		world = lua_touserdata(L, 1);
-		L_assert_objtype(L, world, OBJTYPE_WORLD);
-	} else {
-		L_assert(L, lua_isboolean(L, 1) && !lua_toboolean(L, 1),
-		    "First argument should be either either world or false.");
-	    	world = NULL;
-	}
-	
-	int loops = 0;
-	if (!lua_isnoneornil(L, 3)) {
-		luaL_checktype(L, 3, LUA_TNUMBER);
-		loops = lua_tonumber(L, 3);
-	}
-	L_assert(L, loops >= -1, "Invalid number of loops (%d).", loops);
+	int n, rc;
+	vect_f from, to;
+	vect_i offset = {0, 0};
+	World *world;
+	Shape cast;
+	CastFilter filter;
+	CastHit hit;
 	
-	int volume = MIX_MAX_VOLUME;
-	if (!lua_isnoneornil(L, 4)) {
-		luaL_checktype(L, 4, LUA_TNUMBER);
-		volume = round(lua_tonumber(L, 4) * MIX_MAX_VOLUME);
-	}
-	L_assert(L, volume >= 0 && volume <= MIX_MAX_VOLUME, "Volume out of "
-	    "range.", volume);
+	n = lua_gettop(L);
+	L_assert(L, n >= 4 && n <= 5, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	luaL_checktype(L, 2, LUA_TTABLE);
 	
-	int fade_in = 0;
-	if (!lua_isnoneornil(L, 5)) {
-		luaL_checktype(L, 5, LUA_TNUMBER);
-		fade_in = round(lua_tonumber(L, 5) * 1000.0);
-	}
-	L_assert(L, fade_in >= 0, "Invalid fade-in time.");
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	shape_init(&cast);
+	rc = L_getstk_shape(L, 2, offset, &cast);
+	L_assert(L, rc == L_OK, "Invalid shape: %s", L_statstr(rc));
+	from = L_getstk_vect_f(L, 3);
+	to = L_getstk_vect_f(L, 4);
 	
-	/* Start playing. Use world pointer as group number. */
-        int channel;
-        uint sound_id;
-        const char *filename = lua_tostring(L, 2);
-	audio_play(filename, (uintptr_t)world, volume, loops, fade_in, &sound_id,
-                   &channel);
+	if (!group_filter_arg(L, 5, world, &filter))
+		return 0;	/* No such group, nothing to hit. */
+	if (!world_shapecast(world, &cast, from, vect_f_sub(to, from), &filter,
+	    &hit))
+		return 0;
 	
-	/* Return sound handle = {soundID=sound_id, channel=ch}. */
-	lua_createtable(L, 0, 2);
-	lua_pushstring(L, "soundID");
-	lua_pushnumber(L, sound_id);
-	lua_rawset(L, -3);
-	lua_pushstring(L, "channel");
-	lua_pushnumber(L, channel);
-	lua_rawset(L, -3);
+	lua_createtable(L, 0, 4);
+	lua_pushlightuserdata(L, hit.shape);
+	lua_setfield(L, -2, "shape");
+	lua_pushnumber(L, hit.toi);
+	lua_setfield(L, -2, "toi");
+	L_push_vect_f(L, hit.normal);
+	lua_setfield(L, -2, "normal");
+	L_push_vect_f(L, vect_f_add(from,
+	    vect_f_scale(vect_f_sub(to, from), hit.toi)));
+	lua_setfield(L, -2, "pos");
 	return 1;
 }
-
+/*
+ * Raycast(world, from, to, groupName=nil) -> shape, pos, normal
+ *
+ * world	Game world as returned by NewWorld().
+ * from, to	Ray start and end points.
+ * groupName	Ignore all shapes that do not belong to this group.
+ *
+ * Return the first shape hit by the ray, the point where it was hit, and
+ * surface normal at that point. If nothing is hit, return nil. Shapes that
+ * contain the start point are not hit.
+ */
+static int
+Raycast(lua_State *L)
+{
+	int n;
+	vect_f from, to;
+	World *world;
+	CastFilter filter;
+	CastHit hit;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 3 && n <= 4, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	from = L_getstk_vect_f(L, 2);
+	to = L_getstk_vect_f(L, 3);
+	if (!group_filter_arg(L, 4, world, &filter))
+		return 0;	/* No such group, nothing to hit. */
+	
+	if (world_raycast(world, from, vect_f_sub(to, from), &filter, &hit,
+	    1) == 0)
+		return 0;
+	lua_pushlightuserdata(L, hit.shape);
+	L_push_vect_f(L, vect_f_add(from,
+	    vect_f_scale(vect_f_sub(to, from), hit.toi)));
+	L_push_vect_f(L, hit.normal);
+	return 3;
+}
+
+/*
+ * RaycastAll(world, from, to, groupName=nil, result=nil) -> shapes, count
+ *
+ * Same as Raycast(), but return all shapes hit by the ray, nearest first. If
+ * a result table is provided, shapes are stored in it (and it is returned),
+ * otherwise a new table is created.
+ */
+static int
+RaycastAll(lua_State *L)
+{
+	int n;
+	uint i, num_hits;
+	vect_f from, to;
+	World *world;
+	CastFilter filter;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 3 && n <= 5, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	from = L_getstk_vect_f(L, 2);
+	to = L_getstk_vect_f(L, 3);
+	num_hits = 0;
+	if (group_filter_arg(L, 4, world, &filter)) {
+		num_hits = world_raycast(world, from, vect_f_sub(to, from),
+		    &filter, query_hits, QUERY_MAX);
+	}
+	for (i = 0; i < num_hits; i++)
+		query_shapes[i] = query_hits[i].shape;
+	push_shape_list(L, 5, query_shapes, num_hits);
+	lua_pushinteger(L, num_hits);
+	return 2;
+}
+
+/*
+ * Common part of OverlapBox() and OverlapCircle(): shape [s] is placed at
+ * [pos], group name and result table are at [index] and [index + 1].
+ */
+static int
+overlap_query(lua_State *L, World *world, Shape *s, vect_f pos, int index)
+{
+	int too_many;
+	uint num_shapes;
+	CastFilter filter;
+	
+	num_shapes = 0;
+	if (group_filter_arg(L, index, world, &filter)) {
+		too_many = world_overlap(world, s, pos, &filter, query_shapes,
+		    QUERY_MAX, &num_shapes);
+		L_assert(L, !too_many, "Too many shapes in overlap query.");
+	}
+	push_shape_list(L, index + 1, query_shapes, num_shapes);
+	lua_pushinteger(L, num_shapes);
+	return 2;
+}
+
+/*
+ * OverlapBox(world, box, groupName=nil, result=nil) -> shapes, count
+ *
+ * world	Game world as returned by NewWorld().
+ * box		Bounding box in world coordinates: {l=?, r=?, b=?, t=?}.
+ * groupName	Ignore all shapes that do not belong to this group.
+ * result	Table to store found shapes in (see RaycastAll()).
+ *
+ * Return all shapes that overlap box.
+ */
+static int
+OverlapBox(lua_State *L)
+{
+	int n;
+	World *world;
+	Shape box;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 2 && n <= 4, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	shape_init(&box);
+	box.shape_type = SHAPE_RECTANGLE;
+	L_getstk_BB(L, 2, &box.shape.rect);
+	L_assert(L, bb_valid(box.shape.rect), "Invalid box.");
+	return overlap_query(L, world, &box, vect_f_zero, 3);
+}
+
+/*
+ * OverlapCircle(world, center, radius, groupName=nil, result=nil)
+ *     -> shapes, count
+ *
+ * Return all shapes that overlap circle. See OverlapBox().
+ */
+static int
+OverlapCircle(lua_State *L)
+{
+	int n;
+	World *world;
+	Shape circle;
+	vect_f center;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 3 && n <= 5, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	center = L_getstk_vect_f(L, 2);
+	shape_init(&circle);
+	circle.shape_type = SHAPE_CIRCLE;
+	circle.shape.circle.radius = round(luaL_checknumber(L, 3));
+	L_assert(L, circle.shape.circle.radius > 0, "Invalid radius.");
+	return overlap_query(L, world, &circle, center, 4);
+}
+
+/*
+ * NearestShape(world, point, groupName=nil, maxDist=nil) -> shape, distance
+ *
+ * world	Game world as returned by NewWorld().
+ * point	World position vector.
+ * groupName	Ignore all shapes that do not belong to this group.
+ * maxDist	Ignore shapes further away than this.
+ *
+ * Return shape nearest to point and its distance (zero if point is inside the
+ * shape). If there's none, return nil.
+ */
+static int
+NearestShape(lua_State *L)
+{
+	int n;
+	double max_dist, dist;
+	vect_f point;
+	World *world;
+	Shape *s;
+	CastFilter filter;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 2 && n <= 4, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	point = L_getstk_vect_f(L, 2);
+	max_dist = luaL_optnumber(L, 4, HUGE_VAL);
+	if (!group_filter_arg(L, 3, world, &filter))
+		return 0;	/* No such group. */
+	
+	s = world_nearest_shape(world, point, max_dist, &filter, &dist);
+	if (s == NULL)
+		return 0;
+	lua_pushlightuserdata(L, s);
+	lua_pushnumber(L, dist);
+	return 2;
+}
+
+/*
+ * Check that the table at [index] is an array of static body objects of given
+ * type (tiles or shapes), and store them in a newly allocated array (free it
+ * with mem_free()).
+ */
+static void **
+static_object_list(lua_State *L, int index, World *world, int objtype,
+    uint *count)
+{
+	void **list;
+	int *obj;
+	Body *body;
+	uint i, n;
+	
+	luaL_checktype(L, index, LUA_TTABLE);
+	n = lua_objlen(L, index);
+	for (i = 1; i <= n; i++) {
+		lua_rawgeti(L, index, i);
+		obj = lua_touserdata(L, -1);
+		lua_pop(L, 1);
+		if (obj == NULL || *obj != objtype)
+			luaL_error(L, "Expected a list of %s objects (item %d).",
+			    L_objtype_name(objtype), i);
+		body = (objtype == OBJTYPE_TILE) ? ((Tile *)obj)->body :
+		    ((Shape *)obj)->body;
+		if (body != &world->static_body)
+			luaL_error(L, "Only static body objects can be cooked "
+			    "(item %d).", i);
+	}
+	
+	list = mem_alloc((n + 1) * sizeof(void *), "Room object list");
+	for (i = 0; i < n; i++) {
+		lua_rawgeti(L, index, i + 1);
+		list[i] = lua_touserdata(L, -1);
+		lua_pop(L, 1);
+	}
+	*count = n;
+	return list;
+}
+
+/*
+ * SaveRoomBlob(world, filename, tiles, shapes, cellSize=512) -> success
+ *
+ * world	Game world the objects belong to.
+ * filename	Cooked room file to write.
+ * tiles	Array of static body tiles.
+ * shapes	Array of static body shapes.
+ * cellSize	Size of the cells that objects are grouped into, for streaming
+ *		(pixels).
+ *
+ * Write tiles and shapes into a cooked room file (see room.h), which
+ * LoadRoomBlob() can later recreate them from.
+ */
+static int
+SaveRoomBlob(lua_State *L)
+{
+	World *world;
+	void **tiles, **shapes;
+	uint num_tiles, num_shapes, cell_size;
+	int n, status;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 4 && n <= 5, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	luaL_checktype(L, 2, LUA_TSTRING);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	cell_size = ROOM_CELL_SIZE;
+	if (!lua_isnoneornil(L, 5)) {
+		luaL_checktype(L, 5, LUA_TNUMBER);
+		L_assert(L, lua_tonumber(L, 5) >= 1, "Invalid cell size.");
+		cell_size = lua_tonumber(L, 5);
+	}
+	tiles = static_object_list(L, 3, world, OBJTYPE_TILE, &num_tiles);
+	shapes = static_object_list(L, 4, world, OBJTYPE_SHAPE, &num_shapes);
+	
+	status = room_save(world, lua_tostring(L, 2), (Tile **)tiles,
+	    num_tiles, (Shape **)shapes, num_shapes, cell_size);
+	mem_free(tiles);
+	mem_free(shapes);
+	lua_pushboolean(L, status == ROOM_OK);
+	return 1;
+}
+
+/*
+ * Is script file newer than [mtime]? Missing files are not.
+ */
+static int
+source_newer(const char *filename, time_t mtime)
+{
+	struct stat st;
+
+	return stat(filename, &st) == 0 && st.st_mtime > mtime;
+}
+
+/*
+ * LoadRoomBlob(world, filename, sources=nil, stream=false) -> numTiles, numShapes
+ *
+ * world	Game world as returned by NewWorld().
+ * filename	Cooked room file written by SaveRoomBlob().
+ * sources	Script the room was cooked from, or a list of scripts (the
+ *		edit script along with those defining the functions it calls).
+ *		If any of them has been modified since the room file was
+ *		written, the room file is out of date.
+ * stream	If true, objects are created (and destroyed) cell by cell as
+ *		cameras move about (see stream.h), instead of all at once.
+ *
+ * Create the tiles and shapes stored in a cooked room file, all attached to
+ * the world's static body. If the file is missing, invalid or out of date,
+ * nothing is created, and nil plus an error message is returned.
+ */
+static int
+LoadRoomBlob(lua_State *L)
+{
+	struct stat room_st;
+	const char *filename;
+	World *world;
+	uint i, num_sources, num_tiles, num_shapes;
+	int n, status, stale;
+	
+	n = lua_gettop(L);
+	L_assert(L, n >= 2 && n <= 4, "Invalid number of arguments (%i).", n);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	luaL_checktype(L, 2, LUA_TSTRING);
+	
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	L_assert(L, world->killme == 0, "Dying world");
+	filename = lua_tostring(L, 2);
+	
+	if (stat(filename, &room_st) != 0) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "No room file '%s'.", filename);
+		return 2;
+	}
+	stale = 0;
+	if (lua_istable(L, 3)) {
+		num_sources = lua_objlen(L, 3);
+		for (i = 1; i <= num_sources && !stale; i++) {
+			L_getlistitem(L, 3, i);
+			L_assert(L, lua_isstring(L, -1), "Expected filename.");
+			stale = source_newer(lua_tostring(L, -1),
+			    room_st.st_mtime);
+			lua_pop(L, 1);
+		}
+	} else if (!lua_isnoneornil(L, 3)) {
+		luaL_checktype(L, 3, LUA_TSTRING);
+		stale = source_newer(lua_tostring(L, 3), room_st.st_mtime);
+	}
+	if (stale) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Room file '%s' is out of date.", filename);
+		return 2;
+	}
+	
+	if (lua_toboolean(L, 4)) {
+		L_assert(L, world->stream == NULL,
+		    "World is already streaming a room.");
+		status = stream_open(world, filename, &num_tiles, &num_shapes);
+	} else
+		status = room_load(world, filename, &num_tiles, &num_shapes);
+	if (status != ROOM_OK) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "%s: %s", filename, room_statstr(status));
+		return 2;
+	}
+	lua_pushnumber(L, num_tiles);
+	lua_pushnumber(L, num_shapes);
+	return 2;
+}
+
+/*
+ * __SetStreamFunc(world, funcID) -> previousFuncID
+ *
+ * world	Game world as returned by NewWorld().
+ * funcID	Stream function ID (0 = none).
+ *
+ * Set the function that is called as func(world, cellX, cellY, loaded) when a
+ * cell of a streamed room has been created (loaded = true) and before it is
+ * destroyed (see stream.h). Scripts use eapi.SetStreamFunc() instead.
+ */
+static int
+__SetStreamFunc(lua_State *L)
+{
+	World *world;
+	uint prev;
+
+	L_numarg_check(L, 2);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	luaL_checktype(L, 2, LUA_TNUMBER);
+
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	prev = world->stream_func_id;
+	world->stream_func_id = lua_tonumber(L, 2);
+	lua_pushnumber(L, prev);
+	return 1;
+}
+
+/*
+ * GetStreamStats(world) -> {cells=?, loaded=?, tiles=?, shapes=?, loads=?,
+ *                           unloads=?, loadTime=?, unloadTime=?, frameTime=?}
+ *
+ * Streamed room statistics (see stream.h), or nil if the world isn't streaming
+ * a room: number of cells and of fully created cells, tiles and shapes that
+ * exist now, cells created and destroyed so far, time spent creating and
+ * destroying them, and time spent streaming in the last update (seconds).
+ */
+static int
+GetStreamStats(lua_State *L)
+{
+	StreamStats stats;
+	World *world;
+
+	L_numarg_check(L, 1);
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	world = lua_touserdata(L, 1);
+	L_assert_objtype(L, world, OBJTYPE_WORLD);
+	if (!stream_get_stats(world, &stats)) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_createtable(L, 0, 9);
+	lua_pushnumber(L, stats.cells);
+	lua_setfield(L, -2, "cells");
+	lua_pushnumber(L, stats.loaded);
+	lua_setfield(L, -2, "loaded");
+	lua_pushnumber(L, stats.tiles);
+	lua_setfield(L, -2, "tiles");
+	lua_pushnumber(L, stats.shapes);
+	lua_setfield(L, -2, "shapes");
+	lua_pushnumber(L, stats.loads);
+	lua_setfield(L, -2, "loads");
+	lua_pushnumber(L, stats.unloads);
+	lua_setfield(L, -2, "unloads");
+	lua_pushnumber(L, stats.load_ns / 1e9);
+	lua_setfield(L, -2, "loadTime");
+	lua_pushnumber(L, stats.unload_ns / 1e9);
+	lua_setfield(L, -2, "unloadTime");
+	lua_pushnumber(L, stats.frame_ns / 1e9);
+	lua_setfield(L, -2, "frameTime");
+	return 1;
+}
+
+/*
+ * GetScriptStats() -> {compiled=?, memoryHits=?, diskHits=?, bytes=?,
+ *                      compileTime=?, loadTime=?, savedTime=?}
+ *
+ * Compiled chunk cache statistics (see chunk.h), counted from the start: number
+ * of scripts compiled from source, number loaded from memory and from
+ * compiled files, size of chunks kept in memory, time spent compiling and
+ * loading cached chunks, and compile time that the cache avoided (seconds).
+ */
+static int
+GetScriptStats(lua_State *L)
+{
+	ChunkStats stats;
+
+	L_numarg_check(L, 0);
+	chunk_get_stats(&stats);
+	lua_createtable(L, 0, 7);
+	lua_pushnumber(L, stats.compiled);
+	lua_setfield(L, -2, "compiled");
+	lua_pushnumber(L, stats.memory_hits);
+	lua_setfield(L, -2, "memoryHits");
+	lua_pushnumber(L, stats.disk_hits);
+	lua_setfield(L, -2, "diskHits");
+	lua_pushnumber(L, stats.bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushnumber(L, stats.compile_ns / 1e9);
+	lua_setfield(L, -2, "compileTime");
+	lua_pushnumber(L, stats.load_ns / 1e9);
+	lua_setfield(L, -2, "loadTime");
+	lua_pushnumber(L, stats.saved_ns / 1e9);
+	lua_setfield(L, -2, "savedTime");
+	return 1;
+}
+
+/*
+ * GetGCStats() -> {heap=?, live=?, steps=?, cycles=?, time=?, frameTime=?}
+ *
+ * Lua garbage collector statistics (see luagc.h): current heap size and heap
+ * size after last full cycle (kilobytes), number of collector steps and
+ * cycles run between frames, total time spent on them and time spent in the
+ * last frame (seconds).
+ */
+static int
+GetGCStats(lua_State *L)
+{
+	LuaGCStats stats;
+
+	L_numarg_check(L, 0);
+	luagc_get_stats(L, &stats);
+	lua_createtable(L, 0, 6);
+	lua_pushnumber(L, stats.heap_kb);
+	lua_setfield(L, -2, "heap");
+	lua_pushnumber(L, stats.live_kb);
+	lua_setfield(L, -2, "live");
+	lua_pushnumber(L, stats.steps);
+	lua_setfield(L, -2, "steps");
+	lua_pushnumber(L, stats.cycles);
+	lua_setfield(L, -2, "cycles");
+	lua_pushnumber(L, stats.time_ns / 1e9);
+	lua_setfield(L, -2, "time");
+	lua_pushnumber(L, stats.frame_ns / 1e9);
+	lua_setfield(L, -2, "frameTime");
+	return 1;
+}
+
+/*
+ * StartTrace()
+ *
+ * Start recording frame timeline (see trace.h). Whatever was recorded before is
+ * dropped.
+ */
+static int
+StartTrace(lua_State *L)
+{
+	L_numarg_check(L, 0);
+	trace_start();
+	return 0;
+}
+
+/*
+ * StopTrace()
+ *
+ * Stop recording frame timeline. What has been recorded can still be dumped.
+ */
+static int
+StopTrace(lua_State *L)
+{
+	L_numarg_check(L, 0);
+	trace_stop();
+	return 0;
+}
+
+/*
+ * DumpTrace(filename=nil) -> success
+ *
+ * filename	Output file; "traceFile" from configuration by default.
+ *
+ * Write recorded frame timeline as Chrome trace event JSON. Returns false if
+ * nothing has been recorded or the file could not be written.
+ */
+static int
+DumpTrace(lua_State *L)
+{
+	const char *filename;
+
+	filename = luaL_optstring(L, 1, config.trace_file.data);
+	lua_pushboolean(L, trace_dump(filename) == 0);
+	return 1;
+}
+
+/*
+ * __Clear()
+ *
+ * Destroy sprites, clear out all worlds and schedule them for destruction,
+ * unbind all keys.
+ */
+static int
+__Clear(lua_State *L)
+{
+	extern int *key_bind;
+	extern mem_pool mp_camera, mp_body, mp_parallax;
+	extern mem_pool mp_group;
+	extern World *worlds[WORLDS_MAX];
+	extern int drawShapes, drawTileTree, drawShapeTree, outsideView;
+	int i;
+
+	L_numarg_check(L, 0);
+	glcall_post(reset_screen_call, NULL, 0);	/* Clear color, cursor. */
+
+	/* Fade out all sound channels. */
+	audio_fadeout_group(0, 1000);
+
+	/* Disable debug modes. */
+	drawShapes = 0;
+	drawTileTree = 0;
+	drawShapeTree = 0;
+	outsideView = 0;
+
+	/* Clear worlds and schedule them for destruction. */
+	for (i = 0; i < WORLDS_MAX; i++) {
+		if (worlds[i] == NULL)
+			continue;
+		worlds[i]->killme = 1;
+		world_clear(worlds[i]);
+	}
+	assert(mp_first(&mp_body) == NULL);
+	assert(mp_first(&mp_camera) == NULL);
+	assert(mp_first(&mp_parallax) == NULL);
+	assert(mp_first(&mp_group) == NULL);
+	
+	/* Destroy textures that have not been used in a while (sound cache
+	   manages itself). */
+	texture_free_unused();
+
+	/* Unbind keys. */
+	memset(key_bind, 0, sizeof(uint) * (SDLK_LAST + EXTRA_KEYBIND));
+	
+	return 0;
+}
+
+/*
+ * Quit()
+ *
+ * Terminate program. With a render thread, this happens once the current frame
+ * is done.
+ */
+static int
+Quit(lua_State *L)
+{
+	extern void game_quit(void);	/* Defined in main.c */
+
+	L_numarg_check(L, 0);
+	game_quit();
+	return 0;
+}
+
+/*
+ * Push sound handle = {soundID=sound_id, channel=ch}.
+ */
+static void
+push_sound_handle(lua_State *L, uint sound_id, int channel)
+{
+	lua_createtable(L, 0, 2);
+	lua_pushstring(L, "soundID");
+	lua_pushnumber(L, sound_id);
+	lua_rawset(L, -3);
+	lua_pushstring(L, "channel");
+	lua_pushnumber(L, channel);
+	lua_rawset(L, -3);
+}
+
+/*
+ * Get body that produces or hears a sound: Body or Camera at stack index.
+ */
+static Body *
+sound_body_arg(lua_State *L, int index, const char *what)
+{
+	int *objtype;
+
+	luaL_checktype(L, index, LUA_TLIGHTUSERDATA);
+	objtype = lua_touserdata(L, index);
+	L_assert(L, objtype, "%s: NULL object pointer.", what);
+	switch (*objtype) {
+	case OBJTYPE_BODY:
+		return (Body *)objtype;
+	case OBJTYPE_CAMERA:
+		return &((Camera *)objtype)->body;
+	default:
+		luaL_error(L, "Invalid %s type (%s). Either Body or Camera "
+		    "expected.", what, L_objtype_name(*objtype));
+	}
+	/* NOTREACHED */
+	return NULL;
+}
+
+/*
+ * PrefetchSound(filename)
+ *
+ * filename	Sound filename, or a table of filenames.
+ *
+ * Start decoding sounds in background so that playing them later does not
+ * cause a hitch.
+ */
+static int
+PrefetchSound(lua_State *L)
+{
+	L_numarg_check(L, 1);
+	if (lua_istable(L, 1)) {
+		lua_pushnil(L);
+		while (lua_next(L, 1) != 0) {
+			L_assert(L, lua_type(L, -1) == LUA_TSTRING,
+			    "Table should contain sound filenames.");
+			audio_prefetch(lua_tostring(L, -1));
+			lua_pop(L, 1);
+		}
+		return 0;
+	}
+	luaL_checktype(L, 1, LUA_TSTRING);
+	audio_prefetch(lua_tostring(L, 1));
+	return 0;
+}
+
+static void
+push_sound_stats(const char *name, uint bytes, uint32_t load_ms, uint plays,
+    void *arg)
+{
+	lua_State *L = arg;
+
+	lua_createtable(L, 0, 3);
+	lua_pushnumber(L, bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushnumber(L, load_ms / 1000.0);
+	lua_setfield(L, -2, "loadTime");
+	lua_pushnumber(L, plays);
+	lua_setfield(L, -2, "plays");
+	lua_setfield(L, -2, name);
+}
+
+/*
+ * GetSoundStats() -> {bytes=?, budget=?, hits=?, misses=?, evictions=?,
+ *                     loadTime=?, sounds={[filename]={bytes=?, loadTime=?,
+ *                     plays=?}, ..}}
+ *
+ * Sound cache statistics: size of decoded samples (bytes), cache size limit,
+ * number of plays that found the sound ready (hits) or had to wait for it to
+ * load (misses), number of sounds evicted, and total decoding time in seconds.
+ */
+static int
+GetSoundStats(lua_State *L)
+{
+	AudioStats stats;
+
+	L_numarg_check(L, 0);
+	audio_get_stats(&stats);
+	lua_createtable(L, 0, 7);
+	lua_pushnumber(L, stats.bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushnumber(L, stats.budget);
+	lua_setfield(L, -2, "budget");
+	lua_pushnumber(L, stats.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushnumber(L, stats.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushnumber(L, stats.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushnumber(L, stats.load_ms / 1000.0);
+	lua_setfield(L, -2, "loadTime");
+	lua_createtable(L, 0, stats.num_sounds);
+	audio_foreach_sound(push_sound_stats, L);
+	lua_setfield(L, -2, "sounds");
+	return 1;
+}
+
+/*
+ * PlaySound(world, filename, loops=0, volume=1, fadeInTime=0, priority=0)
+ *     -> sound
+ *
+ * world	World as returned by NewWorld(). This is necessary because when
+ *		a world is paused, we also must pause all sounds bound to it. If
+ *		false is used here, then the sound does not belong to any world.
+ * filename	Sound filename (e.g., "script/click.ogg").
+ * loops	How many times the sound should be looped. Zero means the sound
+ *		will be played only once. -1 will play it forever (until some
+ *		other condition stops it).
+ * volume	Number in the range [0..1].
+ * fadeInTime	The time it takes for sound to go from zero volume to full
+ *		volume.
+ * priority	When all mixer channels are busy, sounds with lowest priority
+ *		(then lowest volume) are stopped first to make room.
+ *
+ * Play a sound. Returns a sound handle which can be used to stop the sound or
+ * change it's volume, add effects, etc.
+ */
+static int
+PlaySound(lua_State *L)
+{
+	int n = lua_gettop(L);
+	L_assert(L, n >= 2 && n <= 6, "Incorrect number of arguments.");
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	luaL_checktype(L, 2, LUA_TSTRING);
+	
+	/* World or no world. */
+        World *world;
+	if (lua_islightuserdata(L, 1)) {
+		world = lua_touserdata(L, 1);
+		L_assert_objtype(L, world, OBJTYPE_WORLD);
+	} else {
+		L_assert(L, lua_isboolean(L, 1) && !lua_toboolean(L, 1),
+		    "First argument should be either either world or false.");
+	    	world = NULL;
+	}
+	
+	int loops = 0;
+	if (!lua_isnoneornil(L, 3)) {
+		luaL_checktype(L, 3, LUA_TNUMBER);
+		loops = lua_tonumber(L, 3);
+	}
+	L_assert(L, loops >= -1, "Invalid number of loops (%d).", loops);
+	
+	int volume = MIX_MAX_VOLUME;
+	if (!lua_isnoneornil(L, 4)) {
+		luaL_checktype(L, 4, LUA_TNUMBER);
+		volume = round(lua_tonumber(L, 4) * MIX_MAX_VOLUME);
+	}
+	L_assert(L, volume >= 0 && volume <= MIX_MAX_VOLUME, "Volume out of "
+	    "range.", volume);
+	
+	int fade_in = 0;
+	if (!lua_isnoneornil(L, 5)) {
+		luaL_checktype(L, 5, LUA_TNUMBER);
+		fade_in = round(lua_tonumber(L, 5) * 1000.0);
+	}
+	L_assert(L, fade_in >= 0, "Invalid fade-in time.");
+	
+	int priority = 0;
+	if (!lua_isnoneornil(L, 6)) {
+		luaL_checktype(L, 6, LUA_TNUMBER);
+		priority = lua_tonumber(L, 6);
+	}
+	
+	/* Start playing. Use world pointer as group number. */
+        int channel;
+        uint sound_id;
+        const char *filename = lua_tostring(L, 2);
+	audio_play(filename, (uintptr_t)world, volume, loops, fade_in, priority,
+                   &sound_id, &channel);
+	
+	push_sound_handle(L, sound_id, channel);
+	return 1;
+}
+
+/*
+ * PlaySoundAt(world, filename, source, listener, distMaxVolume, distSilence,
+ *     loops=0, priority=0) -> sound or nil
+ *
+ * world, filename, loops, priority
+ *		See PlaySound().
+ * source, listener, distMaxVolume, distSilence
+ *		See BindVolume().
+ *
+ * Play a sound whose volume and panning depend on where source is relative to
+ * listener. Unless sound is looped forever, nothing is played (and nil is
+ * returned) if listener is out of hearing range, so that inaudible sounds do
+ * not take up mixer channels.
+ */
+static int
+PlaySoundAt(lua_State *L)
+{
+	int n = lua_gettop(L);
+	L_assert(L, n >= 6 && n <= 8, "Incorrect number of arguments.");
+	luaL_checktype(L, 2, LUA_TSTRING);
+	luaL_checktype(L, 5, LUA_TNUMBER);
+	luaL_checktype(L, 6, LUA_TNUMBER);
+	
+	World *world = NULL;
+	if (lua_islightuserdata(L, 1)) {
+		world = lua_touserdata(L, 1);
+		L_assert_objtype(L, world, OBJTYPE_WORLD);
+	} else {
+		L_assert(L, lua_isboolean(L, 1) && !lua_toboolean(L, 1),
+		    "First argument should be either either world or false.");
+	}
+	Body *source = sound_body_arg(L, 3, "Source");
+	Body *listener = sound_body_arg(L, 4, "Listener");
+	float dist_maxvol = lua_tonumber(L, 5);
+	float dist_silence = lua_tonumber(L, 6);
+	L_assert(L, dist_maxvol >= 0.0, "Max volume distance must not be "
+	    "negative.");
+	L_assert(L, dist_silence > dist_maxvol, "Silence distance must be "
+	    "greater than max volume distance");
+	
+	int loops = 0;
+	if (!lua_isnoneornil(L, 7)) {
+		luaL_checktype(L, 7, LUA_TNUMBER);
+		loops = lua_tonumber(L, 7);
+	}
+	L_assert(L, loops >= -1, "Invalid number of loops (%d).", loops);
+	
+	int priority = 0;
+	if (!lua_isnoneornil(L, 8)) {
+		luaL_checktype(L, 8, LUA_TNUMBER);
+		priority = lua_tonumber(L, 8);
+	}
+	
+	int channel;
+	uint sound_id;
+	if (!audio_play_at(lua_tostring(L, 2), (uintptr_t)world, loops,
+	    priority, source, listener, dist_maxvol, dist_silence, 1,
+	    &sound_id, &channel)) {
+		lua_pushnil(L);
+		return 1;
+	}
+	push_sound_handle(L, sound_id, channel);
+	return 1;
+}
+
 /*
  * FadeSound(sound, time)
  *
@@ -3434,7 +4435,7 @@ LUA_FadeSound(lua_State *L)
 }
 
 /*
- * BindVolume(sound, source, listener, distMaxVolume, distSilence)
+ * BindVolume(sound, source, listener, distMaxVolume, distSilence, pan=false)
  *
  * sound                Sound handle as returned by PlaySound().
  * source               Object that is producing the sound.
@@ -3445,48 +4446,25 @@ LUA_FadeSound(lua_State *L)
  *                      closer), then sound is played at max volume.
  * distSilence          When listener body is this far from source (or further),
  *                      then sound volume drops off to zero.
+ * pan                  Pan sound according to horizontal offset of source from
+ *                      listener (stereo output only).
+ *
+ * Unless the sound loops forever, it is stopped right away if listener is out of
+ * hearing range, so that inaudible sounds do not hold on to mixer channels.
  */
 static int
 BindVolume(lua_State *L)
 {
-        L_numarg_check(L, 5);
+        int n = lua_gettop(L);
+        L_assert(L, n == 5 || n == 6, "Incorrect number of arguments.");
         luaL_checktype(L, 1, LUA_TTABLE);
-        luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
-        luaL_checktype(L, 3, LUA_TLIGHTUSERDATA);
         luaL_checktype(L, 4, LUA_TNUMBER);
         luaL_checktype(L, 5, LUA_TNUMBER);
+        int pan = lua_toboolean(L, 6);
 	
-        /* Extract source body. */
-        Body *source;
-        int *objtype = lua_touserdata(L, 2);
-        L_assert(L, objtype, "Source: NULL object pointer.");
-        switch (*objtype) {
-        case OBJTYPE_BODY:
-                source = (Body *)objtype;
-                break;
-        case OBJTYPE_CAMERA:
-                source = &((Camera *)objtype)->body;
-                break;
-        default:
-                return luaL_error(L, "Invalid source type (%s). Either Body or "
-                                  "Camera expected.", L_objtype_name(*objtype));
-        }
-                                  
-        /* Extract listener body. */
-        Body *listener;
-        objtype = lua_touserdata(L, 3);
-        L_assert(L, objtype, "Listener: NULL object pointer.");
-        switch (*objtype) {
-        case OBJTYPE_BODY:
-                listener = (Body *)objtype;
-                break;
-        case OBJTYPE_CAMERA:
-                listener = &((Camera *)objtype)->body;
-                break;
-        default:
-                return luaL_error(L, "Invalid listener type (%s). Either Body or "
-                                  "Camera expected.", L_objtype_name(*objtype));
-        }
+        /* Extract source and listener bodies. */
+        Body *source = sound_body_arg(L, 2, "Source");
+        Body *listener = sound_body_arg(L, 3, "Listener");
                                   
         /* Extract and verify distances. */
         float dist_maxvol = lua_tonumber(L, 4);
@@ -3507,7 +4485,7 @@ BindVolume(lua_State *L)
         L_assert(L, channel >= 0, "Invalid channel (%i).", channel);
         
         audio_bind_volume(channel, sound_id, source, listener, dist_maxvol,
-                          dist_silence);
+                          dist_silence, pan);
         return 0;
 }
 
@@ -3764,6 +4742,7 @@ eapi_register(lua_State *L, int audio_enabled)
 	EAPI_ADD_FUNC(L, eapi_index, "NewParallax", NewParallax);
 	EAPI_ADD_FUNC(L, eapi_index, "NewCamera", NewCamera);
 	EAPI_ADD_FUNC(L, eapi_index, "NewPath", NewPath);
+	EAPI_ADD_FUNC(L, eapi_index, "GetPathLength", GetPathLength);
 
 	/* Destructor functions. */
 	EAPI_ADD_FUNC(L, eapi_index, "__Destroy", __Destroy);
@@ -3848,16 +4827,35 @@ eapi_register(lua_State *L, int audio_enabled)
 	EAPI_ADD_FUNC(L, eapi_index, "Log", Log);
 	EAPI_ADD_FUNC(L, eapi_index, "Dump", Dump);
 	EAPI_ADD_FUNC(L, eapi_index, "SelectShape", SelectShape);
+	EAPI_ADD_FUNC(L, eapi_index, "ShapeCast", ShapeCast);
+	EAPI_ADD_FUNC(L, eapi_index, "Raycast", Raycast);
+	EAPI_ADD_FUNC(L, eapi_index, "RaycastAll", RaycastAll);
+	EAPI_ADD_FUNC(L, eapi_index, "OverlapBox", OverlapBox);
+	EAPI_ADD_FUNC(L, eapi_index, "OverlapCircle", OverlapCircle);
+	EAPI_ADD_FUNC(L, eapi_index, "NearestShape", NearestShape);
+	EAPI_ADD_FUNC(L, eapi_index, "SaveRoomBlob", SaveRoomBlob);
+	EAPI_ADD_FUNC(L, eapi_index, "LoadRoomBlob", LoadRoomBlob);
+	EAPI_ADD_FUNC(L, eapi_index, "__SetStreamFunc", __SetStreamFunc);
+	EAPI_ADD_FUNC(L, eapi_index, "GetStreamStats", GetStreamStats);
+	EAPI_ADD_FUNC(L, eapi_index, "GetScriptStats", GetScriptStats);
+	EAPI_ADD_FUNC(L, eapi_index, "GetGCStats", GetGCStats);
+	EAPI_ADD_FUNC(L, eapi_index, "StartTrace", StartTrace);
+	EAPI_ADD_FUNC(L, eapi_index, "StopTrace", StopTrace);
+	EAPI_ADD_FUNC(L, eapi_index, "DumpTrace", DumpTrace);
 	EAPI_ADD_FUNC(L, eapi_index, "NextCamera", NextCamera);
 	EAPI_ADD_FUNC(L, eapi_index, "IsValidShape", IsValidShape);
 	EAPI_ADD_FUNC(L, eapi_index, "ShowCursor", ShowCursorFunc);
 	EAPI_ADD_FUNC(L, eapi_index, "HideCursor", HideCursor);
 	EAPI_ADD_FUNC(L, eapi_index, "SwitchFramebuffer", SwitchFramebuffer);
 	EAPI_ADD_FUNC(L, eapi_index, "FadeFramebuffer", FadeFramebuffer);
+	EAPI_ADD_FUNC(L, eapi_index, "SetScreenFade", SetScreenFade);
 	
 	/* Sound. */
 	if (audio_enabled) {
 		EAPI_ADD_FUNC(L, eapi_index, "PlaySound", PlaySound);
+		EAPI_ADD_FUNC(L, eapi_index, "PlaySoundAt", PlaySoundAt);
+		EAPI_ADD_FUNC(L, eapi_index, "PrefetchSound", PrefetchSound);
+		EAPI_ADD_FUNC(L, eapi_index, "GetSoundStats", GetSoundStats);
 		EAPI_ADD_FUNC(L, eapi_index, "FadeSound", LUA_FadeSound);
 		EAPI_ADD_FUNC(L, eapi_index, "SetVolume", SetVolume);
 		EAPI_ADD_FUNC(L, eapi_index, "BindVolume", BindVolume);
@@ -3869,6 +4867,9 @@ eapi_register(lua_State *L, int audio_enabled)
                 EAPI_ADD_FUNC(L, eapi_index, "ResumeMusic", LUA_ResumeMusic);
 	} else {
 		EAPI_ADD_FUNC(L, eapi_index, "PlaySound", __Dummy);
+		EAPI_ADD_FUNC(L, eapi_index, "PlaySoundAt", __Dummy);
+		EAPI_ADD_FUNC(L, eapi_index, "PrefetchSound", __Dummy);
+		EAPI_ADD_FUNC(L, eapi_index, "GetSoundStats", __Dummy);
                 EAPI_ADD_FUNC(L, eapi_index, "FadeSound", __Dummy);
 		EAPI_ADD_FUNC(L, eapi_index, "SetVolume", __Dummy);
 		EAPI_ADD_FUNC(L, eapi_index, "BindVolume", __Dummy);
@@ -3886,11 +4887,22 @@ eapi_register(lua_State *L, int audio_enabled)
 	EAPI_ADD_INT(L, eapi_index, "ANIM_CLAMP", TILE_ANIM_CLAMP);
 	EAPI_ADD_INT(L, eapi_index, "ANIM_REVERSE", TILE_ANIM_REVERSE);
 	
+	/* Path interpolation, outside, and motion types. */
+	EAPI_ADD_INT(L, eapi_index, "PATH_LINEAR", PATH_LINEAR);
+	EAPI_ADD_INT(L, eapi_index, "PATH_CUBIC", PATH_CUBIC);
+	EAPI_ADD_INT(L, eapi_index, "PATH_HERMITE", PATH_HERMITE);
+	EAPI_ADD_INT(L, eapi_index, "PATH_LOOP", PATH_LOOP);
+	EAPI_ADD_INT(L, eapi_index, "PATH_CLAMP", PATH_CLAMP);
+	EAPI_ADD_INT(L, eapi_index, "PATH_REVERSE", PATH_REVERSE);
+	EAPI_ADD_INT(L, eapi_index, "PATH_NORMAL", PATH_NORMAL);
+	EAPI_ADD_INT(L, eapi_index, "PATH_PIECEWISE", PATH_PIECEWISE);
+	EAPI_ADD_INT(L, eapi_index, "PATH_CONSTANT", PATH_CONSTANT);
+	
 	/* Last key index. */
 	EAPI_ADD_INT(L, eapi_index, "SDLK_LAST", SDLK_LAST);
 	
 	/* Load the part of eapi interface that lives in eapi.lua. */
-	if ((luaL_loadfile(L, "eapi.lua") ||
+	if ((chunk_loadfile(L, "eapi.lua") ||
 	    lua_pcall(L, 0, 0, errfunc_index))) {
 		log_err("[Lua] %s", lua_tostring(L, -1));
 		abort();
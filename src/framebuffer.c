@@ -8,6 +8,9 @@
 
 extern Config config;
 
+/* Draws the published render snapshot (see main.c). */
+void redraw_frame(void);
+
 enum {
     JUST_DISPLAY = 0,
     CROSSFADE,
@@ -17,17 +20,38 @@ enum {
     ZOOM_OUT,
 };
 
+/*
+ * Off-screen render targets. They are only needed while the picture on screen
+ * is not simply the frame being drawn: after switch_framebuffer() froze the
+ * old frame, and while a transition effect runs. Otherwise we draw straight
+ * into the back buffer and targets are not even allocated.
+ *
+ * In low-res mode (config.low_res) the world is always drawn into a target of
+ * native screen size, so fill cost does not depend on window size. The target
+ * is then magnified either by an integer factor with nearest filtering, or
+ * "sharp bilinear": first by an integer factor (nearest) into the prescale
+ * target, then the rest of the way with linear filtering. Only pixel edges get
+ * blurred that way.
+ */
+static int fb_supported = 0;	/* GL_EXT_framebuffer_object present. */
+static int npot_supported = 0;	/* Exact-size textures allowed. */
 static int fb_to_display = 0;
 static int fb_to_draw_into = 0;
-static GLuint fbo_id[] = { 0, 0 };
-static GLuint texture_id[] = { 0, 0 };
+static int drawing_to_fbo = 0;	/* Was current frame drawn into a target? */
+#define PRESCALE 2
+static GLuint fbo_id[] = { 0, 0, 0 };
+static GLuint texture_id[] = { 0, 0, 0 };
+static uint prescale_factor = 0;	/* Size of prescale target. */
 
 /*
- * Since framebuffer texture has power of two dimensions, these texture coords
- * are necessary to extract the actual content (excluding the blank area).
+ * If framebuffer texture has power of two dimensions, these texture coords are
+ * necessary to extract the actual content (excluding the blank area).
  */
-static float fb_texture_s;
-static float fb_texture_t;
+static float fb_texture_s[] = { 1.0, 1.0, 1.0 };
+static float fb_texture_t[] = { 1.0, 1.0, 1.0 };
+
+/* Fade to color; alpha is the amount (0 = off). */
+static float fade_color[4] = { 0.0, 0.0, 0.0, 0.0 };
 
 #ifdef __WIN32
 PFNGLGENFRAMEBUFFERSEXTPROC glGenFramebuffersEXT = 0;
@@ -36,16 +60,11 @@ PFNGLDELETEFRAMEBUFFERSEXTPROC glDeleteFramebuffersEXT = 0;
 PFNGLFRAMEBUFFERTEXTURE2DEXTPROC glFramebufferTexture2DEXT = 0;
 #endif
 
-void switch_framebuffer(void) {
-    fb_to_draw_into = fb_to_draw_into ^ 1;
-    fb_to_display = fb_to_draw_into ^ 1;
-}
-
-static void init_framebuffer(int i) {
-    uint fb_texture_w = nearest_pow2(config.screen_width);
-    uint fb_texture_h = nearest_pow2(config.screen_height);
-    fb_texture_s = (float)config.screen_width / fb_texture_w;
-    fb_texture_t = (float)config.screen_height / fb_texture_h;
+void setup_framebuffer(int supported) {
+    fb_supported = supported;
+    npot_supported = check_extension("GL_ARB_texture_non_power_of_two");
+    if (!fb_supported)
+	return;
 
 #ifdef __WIN32
     glGenFramebuffersEXT = (PFNGLGENFRAMEBUFFERSEXTPROC)
@@ -57,12 +76,74 @@ static void init_framebuffer(int i) {
     glFramebufferTexture2DEXT = (PFNGLFRAMEBUFFERTEXTURE2DEXTPROC)
 	wglGetProcAddress("glFramebufferTexture2DEXT");
 #endif
+}
+
+/*
+ * Largest integer factor screen can be magnified by within window (at least
+ * one).
+ */
+static uint integer_factor(void) {
+    uint scale = MIN2(config.window_width / config.screen_width,
+		      config.window_height / config.screen_height);
+    return scale < 1 ? 1 : scale;
+}
+
+/*
+ * Part of window the screen is shown in (normalized coordinates). With
+ * integer scaling, screen is magnified by the largest whole factor that fits
+ * and centered; otherwise it is stretched to fill the window keeping its
+ * aspect ratio (w_l, w_b, w_r, w_t).
+ */
+static void output_rect(float *l, float *b, float *r, float *t) {
+    uint scale;
+    float w, h;
+
+    if (!config.integer_scale || config.sharp_bilinear) {
+	*l = config.w_l;
+	*b = config.w_b;
+	*r = config.w_r;
+	*t = config.w_t;
+	return;
+    }
+    scale = integer_factor();
+    w = (float)(scale * config.screen_width) / config.window_width;
+    h = (float)(scale * config.screen_height) / config.window_height;
+    *l = 0.5 - 0.5 * w;
+    *r = 0.5 + 0.5 * w;
+    *b = 0.5 - 0.5 * h;
+    *t = 0.5 + 0.5 * h;
+}
+
+static void delete_framebuffer(int i) {
+    if (texture_id[i]) {
+	glDeleteTextures(1, &texture_id[i]);
+	texture_id[i] = 0;
+    }
+    if (fbo_id[i]) {
+	glDeleteFramebuffersEXT(1, &fbo_id[i]);
+	fbo_id[i] = 0;
+    }
+}
+
+static void create_framebuffer(int i, uint w, uint h, GLint filter) {
+    uint fb_texture_w, fb_texture_h;
+
+    if (npot_supported) {
+	fb_texture_w = w;
+	fb_texture_h = h;
+    }
+    else {
+	fb_texture_w = nearest_pow2(w);
+	fb_texture_h = nearest_pow2(h);
+    }
+    fb_texture_s[i] = (float)w / fb_texture_w;
+    fb_texture_t[i] = (float)h / fb_texture_h;
 
     /* generate texture */
     glGenTextures(1, &texture_id[i]);
     glBindTexture(GL_TEXTURE_2D, texture_id[i]);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fb_texture_w, fb_texture_h,
@@ -77,59 +158,227 @@ static void init_framebuffer(int i) {
 			      GL_TEXTURE_2D, texture_id[i], 0);
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);	
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+}
+
+static void init_framebuffer(int i) {
+    GLint filter;
+
+    if (fbo_id[i])
+	return;
+
+    /* Whole pixels stay whole when scaled by an integer factor. */
+    filter = (config.integer_scale || config.sharp_bilinear) ?
+	GL_NEAREST : GL_LINEAR;
+    create_framebuffer(i, config.screen_width, config.screen_height, filter);
 }
 
+void switch_framebuffer(void) {
+    extern uint bound_texture;
+
+    /*
+     * If the last frame went straight to the back buffer, there is no copy
+     * of it to keep showing. Draw the published snapshot (which is what is
+     * on screen) once more, into a target.
+     */
+    if (fb_supported && !drawing_to_fbo) {
+	init_framebuffer(fb_to_draw_into);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_id[fb_to_draw_into]);
+	drawing_to_fbo = 1;
+	glClearColor(0.0, 0.0, 0.0, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	redraw_frame();
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	bound_texture = 0;
+    }
+
+    fb_to_draw_into = fb_to_draw_into ^ 1;
+    fb_to_display = fb_to_draw_into ^ 1;
+}
+
+static int effect_num = JUST_DISPLAY;
+
+/*
+ * Prepare to draw a frame: into a target if the frame is not going to be shown
+ * as is, straight into the back buffer otherwise.
+ */
 void bind_framebuffer(void) {
-    static int init_done = 0;
-    if (!init_done) {
-	init_framebuffer(0);
-	init_framebuffer(1);
-	init_done = 1;
+    drawing_to_fbo = fb_supported && (config.low_res ||
+				      effect_num != JUST_DISPLAY ||
+				      fb_to_display != fb_to_draw_into);
+    if (drawing_to_fbo) {
+	init_framebuffer(fb_to_draw_into);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_id[fb_to_draw_into]);
+	return;
     }
-    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_id[fb_to_draw_into]);
+
+    /* Clear whole window, so letterbox area is black. */
+    if (fb_supported)
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    glViewport(0, 0, config.window_width, config.window_height);
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
 }
 
-static void draw_prolog(GLuint texture_id, float alpha) {
-    glBindTexture(GL_TEXTURE_2D, texture_id);
+/*
+ * Set viewport, given in screen pixels. When drawing straight into the back
+ * buffer, it is mapped to where the screen is shown within window.
+ */
+void framebuffer_viewport(int x, int y, int w, int h) {
+    float l, b, r, t, sx, sy;
+
+    if (drawing_to_fbo) {
+	glViewport(x, y, w, h);
+	return;
+    }
+    output_rect(&l, &b, &r, &t);
+    sx = (r - l) * config.window_width / config.screen_width;
+    sy = (t - b) * config.window_height / config.screen_height;
+    glViewport(lround(l * config.window_width + x * sx),
+	       lround(b * config.window_height + y * sy),
+	       lround(w * sx), lround(h * sy));
+}
+
+/*
+ * Set fade color; color[3] is the amount of fade (0 = none, 1 = solid color).
+ */
+void set_screen_fade(const float color[4]) {
+    int i;
+
+    for (i = 0; i < 4; i++)
+	fade_color[i] = color[i];
+}
+
+static void unit_projection(uint w, uint h) {
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0, 1.0, 0.0, 1.0, 0.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+static void window_projection(void) {
+    unit_projection(config.window_width, config.window_height);
+}
+
+static void draw_prolog(int i, float alpha) {
+    glBindTexture(GL_TEXTURE_2D, texture_id[i]);
     glColor4f(1.0, 1.0, 1.0, alpha);
 }
 
-static void draw_scaled(GLuint texture_id, float q) {
-    float w = 0.5 * (config.w_r - config.w_l);
-    float h = 0.5 * (config.w_t - config.w_b);
-    draw_prolog(texture_id, 1.0);
+static void draw_scaled(int i, float q) {
+    float l, b, r, t, w, h, cx, cy;
+    output_rect(&l, &b, &r, &t);
+    w = 0.5 * (r - l);
+    h = 0.5 * (t - b);
+    cx = 0.5 * (l + r);
+    cy = 0.5 * (b + t);
+    draw_prolog(i, 1.0);
     glBegin(GL_QUADS);
     glTexCoord2f(0, 0);
-    glVertex2f(0.5 - q * w, 0.5 - q * h);
-    glTexCoord2f(0, fb_texture_t);
-    glVertex2f(0.5 - q * w, 0.5 + q * h);
-    glTexCoord2f(fb_texture_s, fb_texture_t);
-    glVertex2f(0.5 + q * w, 0.5 + q * h);
-    glTexCoord2f(fb_texture_s, 0);
-    glVertex2f(0.5 + q * w, 0.5 - q * h);
+    glVertex2f(cx - q * w, cy - q * h);
+    glTexCoord2f(0, fb_texture_t[i]);
+    glVertex2f(cx - q * w, cy + q * h);
+    glTexCoord2f(fb_texture_s[i], fb_texture_t[i]);
+    glVertex2f(cx + q * w, cy + q * h);
+    glTexCoord2f(fb_texture_s[i], 0);
+    glVertex2f(cx + q * w, cy - q * h);
     glEnd();
-} 
+}
 
-static void draw_image(GLuint texture_id, float x, float y, float alpha) {
-    draw_prolog(texture_id, alpha);
+static void draw_image(int i, float x, float y, float alpha) {
+    float l, b, r, t;
+    output_rect(&l, &b, &r, &t);
+    draw_prolog(i, alpha);
     glBegin(GL_QUADS);
     glTexCoord2f(0, 0);
-    glVertex2f(config.w_l + x, config.w_b + y);
-    glTexCoord2f(0, fb_texture_t);
-    glVertex2f(config.w_l + x, config.w_t + y);
-    glTexCoord2f(fb_texture_s, fb_texture_t);
-    glVertex2f(config.w_r + x, config.w_t + y);
-    glTexCoord2f(fb_texture_s, 0);
-    glVertex2f(config.w_r + x, config.w_b + y);
+    glVertex2f(l + x, b + y);
+    glTexCoord2f(0, fb_texture_t[i]);
+    glVertex2f(l + x, t + y);
+    glTexCoord2f(fb_texture_s[i], fb_texture_t[i]);
+    glVertex2f(r + x, t + y);
+    glTexCoord2f(fb_texture_s[i], 0);
+    glVertex2f(r + x, b + y);
     glEnd();
-} 
+}
+
+/*
+ * Cover the screen area with fade color.
+ */
+static void draw_fade(void) {
+    float l, b, r, t;
+    output_rect(&l, &b, &r, &t);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_TEXTURE_2D);
+    glColor4fv(fade_color);
+    glBegin(GL_QUADS);
+    glVertex2f(l, b);
+    glVertex2f(l, t);
+    glVertex2f(r, t);
+    glVertex2f(r, b);
+    glEnd();
+    glEnable(GL_TEXTURE_2D);
+    glColor4f(1.0, 1.0, 1.0, 1.0);
+}
 
+/*
+ * Sharp bilinear, first step: magnify target i by the integer factor into the
+ * prescale target (nearest filtering). Returns the target to show instead.
+ */
+static int prescale(int i) {
+    uint k = integer_factor();
+
+    if (prescale_factor != k) {
+	delete_framebuffer(PRESCALE);
+	create_framebuffer(PRESCALE, k * config.screen_width,
+			   k * config.screen_height, GL_LINEAR);
+	prescale_factor = k;
+    }
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_id[PRESCALE]);
+    unit_projection(k * config.screen_width, k * config.screen_height);
+    draw_prolog(i, 1.0);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0);
+    glVertex2f(0, 0);
+    glTexCoord2f(0, fb_texture_t[i]);
+    glVertex2f(0, 1);
+    glTexCoord2f(fb_texture_s[i], fb_texture_t[i]);
+    glVertex2f(1, 1);
+    glTexCoord2f(fb_texture_s[i], 0);
+    glVertex2f(1, 0);
+    glEnd();
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    window_projection();
+    return PRESCALE;
+}
+
+/*
+ * Show framebuffer with fade applied in the same pass: clear screen area to
+ * fade color, then blend the image over it.
+ */
 static void just_display_framebuffer(void) {
-    draw_image(texture_id[fb_to_display], 0, 0, 1.0);
+    float l, b, r, t;
+    int i = fb_to_display;
+
+    if (config.sharp_bilinear)
+	i = prescale(i);
+    if (fade_color[3] <= 0.0) {
+	draw_image(i, 0, 0, 1.0);
+	return;
+    }
+    output_rect(&l, &b, &r, &t);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(lround(l * config.window_width),
+	      lround(b * config.window_height),
+	      lround((r - l) * config.window_width),
+	      lround((t - b) * config.window_height));
+    glClearColor(fade_color[0], fade_color[1], fade_color[2], 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    draw_image(i, 0, 0, 1.0 - fade_color[3]);
 }
 
-static int effect_num = JUST_DISPLAY;
 static uint64_t timer;
 static void start_timer(void) {
     timer = SDL_GetTicks();
@@ -145,32 +394,36 @@ static float gain(float x, float q) {
 }
 
 static void zoom_in(float progress) {
-    draw_image(texture_id[fb_to_display], 0, 0, 1.0);
-    draw_scaled(texture_id[fb_to_draw_into], progress);
+    draw_image(fb_to_display, 0, 0, 1.0);
+    draw_scaled(fb_to_draw_into, progress);
 }
 
 static void zoom_out(float progress) {
-    draw_image(texture_id[fb_to_draw_into], 0, 0, 1.0);
-    draw_scaled(texture_id[fb_to_display], (1.0 - progress));
+    draw_image(fb_to_draw_into, 0, 0, 1.0);
+    draw_scaled(fb_to_display, (1.0 - progress));
 }
 
 static void slide_sideways(float progress, float dir) {
+    float l, b, r, t;
+    output_rect(&l, &b, &r, &t);
     progress = gain(progress, 4);
-    float width = dir * (config.w_r - config.w_l);
-    draw_image(texture_id[fb_to_display], 0, 0, 1.0);
-    draw_image(texture_id[fb_to_draw_into], (1.0 - progress) * width, 0, 1.0);
+    float width = dir * (r - l);
+    draw_image(fb_to_display, 0, 0, 1.0);
+    draw_image(fb_to_draw_into, (1.0 - progress) * width, 0, 1.0);
 }
 
 static void crossfade(float progress) {
-    draw_image(texture_id[fb_to_draw_into], 0, 0, 1.0);
+    draw_image(fb_to_draw_into, 0, 0, 1.0);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    draw_image(texture_id[fb_to_display], 0, 0, 1.0 - progress);
+    draw_image(fb_to_display, 0, 0, 1.0 - progress);
 }
 
 static void display_effect(void) {
     float progress = timer_progress(0.5);
     if (progress >= 1.0) {
+	/* Transition is over: the old frame is no longer needed. */
 	effect_num = JUST_DISPLAY;
+	delete_framebuffer(fb_to_display);
 	fb_to_display = fb_to_draw_into;
 	just_display_framebuffer();
     }
@@ -192,6 +445,8 @@ static void display_effect(void) {
 	    crossfade(progress);
 	    break;
 	}
+	if (fade_color[3] > 0.0)
+	    draw_fade();
     }
 }
 
@@ -211,14 +466,28 @@ void fade_to_other_framebuffer(int transition_type) {
 
 void draw_framebuffer(void) {
     extern uint bound_texture;
+
+    /* Frame is already in the back buffer; only fade may be left to do. */
+    if (!drawing_to_fbo) {
+	if (!fb_supported) {
+	    /* No targets, no transitions: just show the new frame. */
+	    effect_num = JUST_DISPLAY;
+	    fb_to_display = fb_to_draw_into;
+	}
+	if (fade_color[3] > 0.0) {
+	    window_projection();
+	    draw_fade();
+	}
+	return;
+    }
+
+    /* Both images are needed during a transition. */
+    init_framebuffer(fb_to_display);
+
     glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
-    glViewport(0, 0, config.window_width, config.window_height);
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-
-    glOrtho(0.0, 1.0, 0.0, 1.0, 0.0, 1.0);
+    window_projection();
     glBlendFunc(GL_ONE, GL_ZERO);
 
     framebuffer_effect();
@@ -228,16 +497,9 @@ void draw_framebuffer(void) {
     bound_texture = 0;
 }
 
-static void delete_framebuffer(int i) {
-    if (texture_id[i]) {
-	glDeleteTextures(1, &texture_id[i]);
-    }
-    if (fbo_id[i]) {
-	glDeleteFramebuffersEXT(1, &fbo_id[i]);
-    }
-}
-
 void cleanup_framebuffer(void) {
     delete_framebuffer(0);
     delete_framebuffer(1);
+    delete_framebuffer(PRESCALE);
+    prescale_factor = 0;
 }
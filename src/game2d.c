@@ -2,6 +2,7 @@
 #include <lua.h>
 #include <math.h>
 #include "game2d.h"
+#include "glcall.h"
 #include "log.h"
 #include "lua_util.h"
 #include "mem.h"
@@ -11,6 +12,9 @@
 
 static Texture	*texture_hash;
 
+static void	anim_clock_release(World *world, AnimClock *clock);
+static void	anim_list_remove(World *world, Tile *tile);
+
 void
 tf_init(TexFrag *tf, float l, float b, float r, float t)
 {
@@ -103,8 +107,12 @@ parallax_update(Parallax *px, const Camera *cam)
 	while (px->body.tiles != NULL)
 		tile_free(px->body.tiles);
 
-	/* Parallax body always has the same position as camera body. */
-	px->body.pos = vect_f_round(cam->body.pos);
+	/* Parallax body always has the same position as camera body. Tiles
+	   are laid out for the (possibly interpolated) position at which
+	   camera is drawn, so parallax body itself must not be interpolated
+	   again: its previous step position is made equal to current. */
+	px->body.pos = body_render_pos(&cam->body);
+	px->body.prevstep_pos = px->body.pos;
 	px->body.prevframe_pos = vect_f_round(cam->body.prevframe_pos);
 	
 	size = px->size;
@@ -163,9 +171,8 @@ parallax_update(Parallax *px, const Camera *cam)
 			
 			/* Copy animation parameters and color into the new
 			   tile. */
-			tile->anim_type = px->anim_type;
-			tile->anim_start = px->anim_start;
-			tile->anim_FPS = px->anim_FPS;
+			tile_set_anim(tile, px->anim_type, px->anim_FPS,
+			    px->anim_start);
 			tile->color = px->color;
 		}
 	}
@@ -260,9 +267,16 @@ texture_alloc()
 	return mp_alloc(&mp_texture);
 }
 
+static void
+delete_texture(void *arg)
+{
+	glDeleteTextures(1, arg);
+}
+
 /*
  * Release resources held inside texture struct. Namely, call glDeleteTextures()
- * for the texture ID.
+ * for the texture ID (on the GL thread, once a snapshot that no longer uses it
+ * is drawn; see glcall.h).
  */
 static void
 texture_destroy(Texture *tex)
@@ -270,7 +284,7 @@ texture_destroy(Texture *tex)
 	assert(tex != NULL);
 	
 	log_msg("Deleting texture '%s' (id=%i).", tex->name, tex->id);
-	glDeleteTextures(1, &tex->id);
+	glcall_post(delete_texture, &tex->id, sizeof(tex->id));
 	
 	memset(tex, 0, sizeof(*tex));
 	strcpy(tex->name, "Unused texture");
@@ -341,10 +355,32 @@ texture_free_unused()
 
 extern uint bound_texture;
 
+/* Texture to create on the GL thread. */
+typedef struct {
+	Texture		*tex;
+	SDL_Surface	*img;		/* From load_texture_image(). */
+	GLint		filter;
+} TextureUpload;
+
+static void
+upload_texture(void *arg)
+{
+	TextureUpload *up = arg;
+
+	glGenTextures(1, &up->tex->id);
+	glBindTexture(GL_TEXTURE_2D, up->tex->id);
+	bound_texture = up->tex->id;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, up->filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, up->filter);
+	upload_surface(up->tex, up->img);
+}
+
 Texture *
 texture_lookup_or_create(const char *name)
 {
-	GLint filter;
+	TextureUpload up;
 	Texture *tex;
 	
 	/* See if a texture with this name already exists. */
@@ -364,21 +400,17 @@ texture_lookup_or_create(const char *name)
 	/* Extract the actual filename and filter setting. */
 	if (memcmp(name, "f=1;", 4) == 0) {
 		name = &name[4];
-		filter = GL_LINEAR;
+		up.filter = GL_LINEAR;
 	} else
-		filter = GL_NEAREST;
+		up.filter = GL_NEAREST;
 	
-	glGenTextures(1, &tex->id);
-	glBindTexture(GL_TEXTURE_2D, tex->id);
-	bound_texture = tex->id;
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
-	
-	/* load_texture_from_file() initializes "w", "h", "pow_w", "pow_h", and
-	   "name" texture struct members. */
-	load_texture_from_file(tex, name);
+	/* load_texture_image() initializes "w", "h", "pow_w", and "pow_h"
+	   texture struct members. Image is decoded here, only the upload
+	   happens on the GL thread. */
+	up.tex = tex;
+	up.img = load_texture_image(tex, name);
+	glcall(upload_texture, &up);
+	SDL_FreeSurface(up.img);
 	
 	/* Mark texture as recently used. */
 	tex->usage = TEXTURE_HISTORY;
@@ -468,6 +500,8 @@ tile_init(Tile *tile, Body *body, vect_i pos, vect_i size,
 	tile->anim_type = TILE_ANIM_NONE;
 	tile->anim_start = 0.0;
 	tile->anim_FPS = 0.0;
+	tile->anim_clock = NULL;
+	tile->anim_index = -1;
 	
 	tile->pos = pos;
 	tile->size = size;
@@ -481,14 +515,17 @@ tile_init(Tile *tile, Body *body, vect_i pos, vect_i size,
 void
 tile_destroy(Tile *tile)
 {
-	QTree *tree;
 	assert(tile != NULL && tile->body != NULL);
 
+	/* Let go of animation clock. */
+	if (tile->anim_clock != NULL)
+		anim_clock_release(tile->body->world, tile->anim_clock);
+	if (tile->anim_index >= 0)
+		anim_list_remove(tile->body->world, tile);
+
 	/* Remove from quad tree if it's in there. */
-	if (tile->go.stored) {
-		tree = &tile->body->world->tile_tree;
-		qtree_remove(tree, &tile->go);
-	}
+	if (tile_in_tree(tile))
+		tile_remove_tree(tile);
 
 	/* Remove from body's list if the tile was ever added to it. */
 	if (tile->prev != NULL || tile->next != NULL) {
@@ -508,56 +545,43 @@ tile_free(Tile *t)
 }
 
 /*
- * Given tile animation parameters and time since animation start, calculate
- * what is the current frame (from tile's sprite list) that must be displayed.
- * Update the frame_index member variable accordingly.
+ * Calculate clock's current frame for the present world step.
  */
-void
-tile_update_frameindex(Tile *tile)
+static void
+anim_clock_update(AnimClock *clock, World *world)
 {
-	int *fi;
-	double now, delta;
-	World *world;
+	int *fi, N, period;
+	double delta;
 	
-	assert(tile != NULL && tile->sprite_list != NULL);
-	fi = &tile->frame_index;	/* A shorter name. */
+	clock->valid = 1;
+	clock->step = world->step;
+	fi = &clock->frame_index;	/* A shorter name. */
+	N = clock->key.num_frames;
 	
-	/* Check in what way or if at all tile should be animated. */
-	switch (tile->anim_type) {
-	case TILE_ANIM_NONE:
-		return;
+	/* Time since animation start. */
+	delta = world->step * world->step_sec - clock->key.start;
+	
+	switch (clock->key.type) {
 	case TILE_ANIM_LOOP:
-		world = tile->body->world;
-		now = world->step * world->step_sec; /* World time. */
-		delta = now - tile->anim_start;
-		
-		if (tile->anim_FPS >= 0.0) {
-			*fi = floor(delta * tile->anim_FPS);
+		if (clock->key.FPS >= 0.0) {
+			*fi = floor(delta * clock->key.FPS);
 		} else {
 			/* Frame index calculation for when we're going
 			   backwards. */
-			*fi = tile->sprite_list->num_frames -
-			    floor(delta * -tile->anim_FPS) - 1;
+			*fi = N - floor(delta * -clock->key.FPS) - 1;
 		}
 		
-		if (*fi < 0) {
-			*fi = tile->sprite_list->num_frames -
-			    ((-*fi) % tile->sprite_list->num_frames);
-		}
-		*fi %= tile->sprite_list->num_frames;
+		if (*fi < 0)
+			*fi = N - ((-*fi) % N);
+		*fi %= N;
 		return;
 	case TILE_ANIM_CLAMP:
-		world = tile->body->world;
-		now = world->step * world->step_sec; /* World time. */
-		delta = now - tile->anim_start;
-		
-		if (tile->anim_FPS >= 0.0) {
-			*fi = floor(delta * tile->anim_FPS);
+		if (clock->key.FPS >= 0.0) {
+			*fi = floor(delta * clock->key.FPS);
 		} else {
 			/* Frame index calculation for when we're going
 			   backwards. */
-			*fi = tile->sprite_list->num_frames -
-			    floor(delta * -tile->anim_FPS) - 1;
+			*fi = N - floor(delta * -clock->key.FPS) - 1;
 		}
 		
 		if (*fi < 0) {
@@ -566,41 +590,218 @@ tile_update_frameindex(Tile *tile)
 			/* We're in clamp mode, animation is going backwards.
 			   If we've reached the first frame., there's no need to
 			   keep animating, just leave frame index at 0. */
-			if (tile->anim_FPS <= 0.0)
-				tile->anim_type = TILE_ANIM_NONE;
-		} else if (*fi >= tile->sprite_list->num_frames) {
-			*fi = tile->sprite_list->num_frames - 1;
+			if (clock->key.FPS <= 0.0)
+				clock->finished = 1;
+		} else if (*fi >= N) {
+			*fi = N - 1;
 		
 			/* We're in clamp mode, animation is going forward. If
 			   we've reached the last frame, there's no need to keep
 			   animating, just leave frame index as is. */
-			if (tile->anim_FPS >= 0.0)
-				tile->anim_type = TILE_ANIM_NONE;
+			if (clock->key.FPS >= 0.0)
+				clock->finished = 1;
 		}
 		return;
 	case TILE_ANIM_REVERSE:
-		fatal_error("ANIM_REVERSE not implemented yet!");
+		/* Go back and forth: 0, 1, .., N-1, N-2, .., 1, 0, 1, ..
+		   With negative FPS, start from the last frame instead. */
+		if (N == 1) {
+			*fi = 0;
+			return;
+		}
+		period = 2 * (N - 1);
+		*fi = (int)floor(delta * fabs(clock->key.FPS)) % period;
+		if (*fi < 0)
+			*fi += period;
+		if (*fi >= N)
+			*fi = period - *fi;
+		if (clock->key.FPS < 0.0)
+			*fi = N - 1 - *fi;
+		return;
 	default:
 		fatal_error("Invalid tile animation type: (%i).",
-		    tile->anim_type);
+		    clock->key.type);
 	}
-	/* NOTREACHED */
 }
 
 /*
- * Remove and re-add tile to tile quad tree. Call this function whenever the
- * size or position of a tile changes. Including when the position of the body
- * that the tile belongs to changes.
+ * Find a clock with matching parameters in world's clock hash, or create a new
+ * one. Reference count is incremented.
+ */
+static AnimClock *
+anim_clock_acquire(World *world, enum TileAnimType type, int num_frames,
+    double start, double FPS)
+{
+	extern mem_pool mp_animclock;
+	AnimClock *clock, key_holder;
+	
+	/* Zero the whole key first, so padding bytes compare equal too. */
+	memset(&key_holder.key, 0, sizeof(key_holder.key));
+	key_holder.key.type = type;
+	key_holder.key.num_frames = num_frames;
+	key_holder.key.start = start;
+	key_holder.key.FPS = FPS;
+	
+	HASH_FIND(hh, world->anim_clocks, &key_holder.key,
+	    sizeof(key_holder.key), clock);
+	if (clock == NULL) {
+		clock = mp_alloc(&mp_animclock);
+		memset(clock, 0, sizeof(*clock));
+		clock->key = key_holder.key;
+		HASH_ADD(hh, world->anim_clocks, key, sizeof(clock->key),
+		    clock);
+	}
+	clock->refcount++;
+	return clock;
+}
+
+static void
+anim_clock_release(World *world, AnimClock *clock)
+{
+	extern mem_pool mp_animclock;
+	
+	assert(clock->refcount > 0);
+	if (--clock->refcount > 0)
+		return;
+	HASH_DEL(world->anim_clocks, clock);
+	mp_free(&mp_animclock, clock);
+}
+
+/*
+ * Add tile to world's list of animated tiles.
+ */
+static void
+anim_list_add(World *world, Tile *tile)
+{
+	assert(tile->anim_index < 0);
+	if (world->num_anim_tiles == world->max_anim_tiles) {
+		world->max_anim_tiles = world->max_anim_tiles ?
+		    world->max_anim_tiles * 2 : 64;
+		mem_realloc((void **)&world->anim_tiles,
+		    world->max_anim_tiles * sizeof(Tile *), "Animated tiles");
+	}
+	tile->anim_index = world->num_anim_tiles;
+	world->anim_tiles[world->num_anim_tiles++] = tile;
+}
+
+/*
+ * Remove tile from world's list of animated tiles. The last tile on the list
+ * takes its place.
+ */
+static void
+anim_list_remove(World *world, Tile *tile)
+{
+	Tile *last;
+	
+	assert(tile->anim_index >= 0 &&
+	    (uint)tile->anim_index < world->num_anim_tiles &&
+	    world->anim_tiles[tile->anim_index] == tile);
+	last = world->anim_tiles[--world->num_anim_tiles];
+	world->anim_tiles[tile->anim_index] = last;
+	last->anim_index = tile->anim_index;
+	tile->anim_index = -1;
+}
+
+/*
+ * Set (or with type TILE_ANIM_NONE, stop) tile animation. Tile is attached to
+ * a shared clock with the same animation parameters, and shows the current
+ * frame right away.
  */
 void
-tile_update_tree(Tile *tile)
+tile_set_anim(Tile *tile, enum TileAnimType type, double FPS, double start)
 {
-	vect_i pos;
-	Body *body;
+	World *world;
 	
-	/* Shorthand. */
-	body = tile->body;
+	assert(tile != NULL && tile->body != NULL);
+	world = tile->body->world;
+	
+	if (tile->anim_clock != NULL) {
+		anim_clock_release(world, tile->anim_clock);
+		tile->anim_clock = NULL;
+	}
+	
+	tile->anim_type = type;
+	tile->anim_FPS = FPS;
+	tile->anim_start = start;
+	if (type == TILE_ANIM_NONE) {
+		if (tile->anim_index >= 0)
+			anim_list_remove(world, tile);
+		return;
+	}
+	if (tile->anim_index < 0)
+		anim_list_add(world, tile);
+	if (tile->sprite_list == NULL || tile->sprite_list->num_frames == 0)
+		return;	/* Clock is attached once there are sprites. */
+	
+	tile->anim_clock = anim_clock_acquire(world, type,
+	    tile->sprite_list->num_frames, start, FPS);
+	tile_update_frameindex(tile);
+}
+
+/*
+ * Update frame index of every animated tile in world. Called once per step, so
+ * this costs as much as there are animated tiles, whether they are in view or
+ * not. Tiles whose clamped animation has finished drop off the list.
+ */
+void
+tile_step_anims(World *world)
+{
+	Tile *tile;
+	uint i;
+	
+	/* Backwards, since a removed tile is replaced by the last one. */
+	for (i = world->num_anim_tiles; i > 0; i--) {
+		tile = world->anim_tiles[i - 1];
+		if (tile->sprite_list != NULL &&
+		    tile->sprite_list->num_frames > 0)
+			tile_update_frameindex(tile);
+	}
+}
+
+/*
+ * Update tile's frame_index from its animation clock. The clock computes the
+ * frame at most once per world step; all tiles sharing it just copy the
+ * result. Once a clamped animation finishes, the tile is no longer animated.
+ */
+void
+tile_update_frameindex(Tile *tile)
+{
+	AnimClock *clock;
+	World *world;
+	
+	assert(tile != NULL && tile->sprite_list != NULL);
+	if (tile->anim_type == TILE_ANIM_NONE)
+		return;
+	
+	/* Attach to a clock if there is none yet, or if the number of frames
+	   has changed since (sprite list was replaced). Attaching updates
+	   frame index too. */
+	clock = tile->anim_clock;
+	if (clock == NULL ||
+	    clock->key.num_frames != tile->sprite_list->num_frames) {
+		tile_set_anim(tile, tile->anim_type, tile->anim_FPS,
+		    tile->anim_start);
+		return;
+	}
+	world = tile->body->world;
+	if (!clock->valid || clock->step != world->step)
+		anim_clock_update(clock, world);
+	tile->frame_index = clock->frame_index;
+	
+	/* Drop finished animations. */
+	if (clock->finished)
+		tile_set_anim(tile, TILE_ANIM_NONE, tile->anim_FPS,
+		    tile->anim_start);
+}
 
+/*
+ * Compute tile's bounding box as if its body was at [pos].
+ */
+void
+tile_bb_at(const Tile *tile, vect_f pos, BB *bb)
+{
+	int x, y;
+	
 	/* Note that we must use absolute values of tile size
 	   components. This is because if negative, then instead
 	   _sprite_ size is used for drawing (not tile size), and tile
@@ -609,9 +810,69 @@ tile_update_tree(Tile *tile)
 	   negated size is exactly what we need here, and is stored in
 	   this way so we wouldn't have to recalculate it each time
 	   this routine is called. */
-	pos.x = tile->pos.x + round(body->pos.x);
-	pos.y = tile->pos.y + round(body->pos.y);
-	bb_init(&tile->go.bb, pos.x, pos.y, pos.x + abs(tile->size.x),
-		     pos.y + abs(tile->size.y));
+	x = tile->pos.x + round(pos.x);
+	y = tile->pos.y + round(pos.y);
+	bb_init(bb, x, y, x + abs(tile->size.x), y + abs(tile->size.y));
+}
+
+/*
+ * Is tile in tile quad tree (either by itself or through body's proxy)?
+ */
+int
+tile_in_tree(const Tile *tile)
+{
+	return tile->go.stored || (tile->flags & TILE_PROXIED);
+}
+
+/*
+ * Add tile to tile quad tree. Tiles of BODY_PROXY bodies become part of their
+ * body's proxy instead.
+ */
+void
+tile_add_tree(Tile *tile)
+{
+	Body *body;
+	
+	assert(!tile_in_tree(tile));
+	body = tile->body;
+	if (body->flags & BODY_PROXY) {
+		tile->flags |= TILE_PROXIED;
+		body_update_tile_proxy(body);
+		return;
+	}
+	tile_bb_at(tile, body->pos, &tile->go.bb);
+	qtree_add(&body->world->tile_tree, &tile->go);
+}
+
+void
+tile_remove_tree(Tile *tile)
+{
+	assert(tile_in_tree(tile));
+	if (tile->flags & TILE_PROXIED) {
+		tile->flags &= ~TILE_PROXIED;
+		body_update_tile_proxy(tile->body);
+		return;
+	}
+	qtree_remove(&tile->body->world->tile_tree, &tile->go);
+}
+
+/*
+ * Remove and re-add tile to tile quad tree. Call this function whenever the
+ * size or position of a tile changes. Including when the position of the body
+ * that the tile belongs to changes.
+ */
+void
+tile_update_tree(Tile *tile)
+{
+	Body *body;
+	
+	/* Shorthand. */
+	body = tile->body;
+	
+	if (tile->flags & TILE_PROXIED) {
+		body_update_tile_proxy(body);
+		return;
+	}
+	tile_bb_at(tile, body->pos, &tile->go.bb);
 	qtree_update(&body->world->tile_tree, &tile->go);
 }
@@ -66,6 +66,10 @@ typedef struct SpriteList_t {
 #define TILE_FLIP_X 	(1<<0)	/* Horizontal flip. */
 #define TILE_FLIP_Y 	(1<<1)	/* Vertical flip. */
 #define TILE_MULTIPLY 	(1<<2)	/* Multiply src onto dst */
+#define TILE_PROXIED	(1<<3)	/* Tile is in tile tree through its body's
+				   proxy (see BODY_PROXY in physics.h). */
+#define TILE_STREAMED	(1<<4)	/* Tile belongs to a streamed room cell (see
+				   stream.h). */
 
 enum TileAnimType {
 	TILE_ANIM_NONE = 100,
@@ -74,6 +78,28 @@ enum TileAnimType {
 	TILE_ANIM_REVERSE
 };
 
+/*
+ * Animation clock. Tiles that are animated with the same parameters (type,
+ * speed, start time, number of frames) share a clock, so the current frame is
+ * calculated once per world step no matter how many tiles display it. Clocks
+ * are kept in a per-world hash and freed once no tile refers to them.
+ */
+typedef struct AnimClock_t {
+	struct {
+		enum TileAnimType type;
+		int		num_frames;
+		double		start;		/* Animation start time. */
+		double		FPS;		/* Frames per second. */
+	} key;
+
+	int		refcount;	/* Number of tiles using this clock. */
+	int		valid;		/* Is frame_index valid for [step]? */
+	uint		step;		/* World step frame was computed for. */
+	int		frame_index;	/* Current frame. */
+	int		finished;	/* Clamped animation has ended. */
+	UT_hash_handle	hh;
+} AnimClock;
+
 /*
  * A tile is like a canvas: drawing area specified by position and size.
  * A list of sprites (SpriteList) is always bound to a tile. One frame from this
@@ -99,12 +125,18 @@ typedef struct Tile_t {
 	double		anim_start;		/* Animation start time. */
 	double		anim_FPS;		/* Animation speed: frames per
 						   second. */
+	AnimClock	*anim_clock;		/* Shared clock (if animated). */
+	int		anim_index;		/* Index in world's anim_tiles
+						   array, or -1 if not
+						   animated. */
 
 	vect_i		pos;			/* Position relative to Body. */
 	vect_i		size;			/* Tile size. */
 	float		depth;			/* Determines drawing order. */
 	uint		flags;
 	int		hidden;
+	uint		stream_index;		/* Index in streamed room file
+						   (TILE_STREAMED). */
 
 	QTreeObject	go;			/* Tile can be added to tree. */
 	struct Tile_t *prev, *next;		/* For use in lists. */
@@ -199,6 +231,13 @@ Tile	*tile_new(Body *body, vect_i pos, vect_i size, SpriteList *sprite_list,
 void	 tile_destroy(Tile *t);
 void	 tile_free(Tile *t);
 void	 tile_update_frameindex(Tile *tile);
+void	 tile_set_anim(Tile *tile, enum TileAnimType type, double FPS,
+	     double start);
+void	 tile_step_anims(struct World_t *world);
+void	 tile_bb_at(const Tile *tile, vect_f pos, BB *bb);
+int	 tile_in_tree(const Tile *tile);
+void	 tile_add_tree(Tile *tile);
+void	 tile_remove_tree(Tile *tile);
 void	 tile_update_tree(Tile *tile);
 
 #endif /* GAME2D_H */
@@ -167,3 +167,139 @@ bb_intersect_resolve(const BB *a, const BB *b, BB *resolve)
 	resolve->l = a->l - b->r;	/* Resolution distance to the right. */	
 	return 1;
 }
+
+/*
+ * Slab interval for one axis: at what fraction of [delta] does moving interval
+ * [a0, a1] start and stop overlapping with [b0, b1]. Returns 0 if they never do.
+ */
+static int
+sweep_axis(double a0, double a1, double delta, int b0, int b1, double *enter,
+    double *exit)
+{
+	if (delta == 0.0) {
+		if (a0 >= b1 || a1 <= b0)
+			return 0;	/* Separated and not moving. */
+		*enter = -HUGE_VAL;
+		*exit = HUGE_VAL;
+		return 1;
+	}
+	if (delta > 0.0) {
+		*enter = (b0 - a1) / delta;
+		*exit = (b1 - a0) / delta;
+	} else {
+		*enter = (b1 - a0) / delta;
+		*exit = (b0 - a1) / delta;
+	}
+	return 1;
+}
+
+/*
+ * Sweep box (l, b, r, t) along [delta] against box [target]. See bb_sweep().
+ */
+static int
+sweep_box(double l, double b, double r, double t, vect_f delta,
+    const BB *target, double *toi, vect_f *normal)
+{
+	double enter_x, exit_x, enter_y, exit_y, enter, exit;
+	
+	if (!sweep_axis(l, r, delta.x, target->l, target->r, &enter_x,
+	    &exit_x) ||
+	    !sweep_axis(b, t, delta.y, target->b, target->t, &enter_y,
+	    &exit_y))
+		return 0;
+	
+	enter = (enter_x > enter_y) ? enter_x : enter_y;
+	exit = (exit_x < exit_y) ? exit_x : exit_y;
+	if (enter >= exit || enter < 0.0 || enter > 1.0)
+		return 0;
+	
+	/* Normal is along the axis that was entered last. */
+	*toi = enter;
+	if (enter_x > enter_y) {
+		normal->x = (delta.x > 0.0) ? -1.0 : 1.0;
+		normal->y = 0.0;
+	} else {
+		normal->x = 0.0;
+		normal->y = (delta.y > 0.0) ? -1.0 : 1.0;
+	}
+	return 1;
+}
+
+/*
+ * Sweep box [a] along [delta] against stationary box [b]. If they come into
+ * contact within the movement, store time of impact (fraction of delta, 0..1)
+ * in [toi], contact normal (pointing from b towards a) in [normal], and return
+ * 1. Boxes that already overlap at the start are not reported; discrete
+ * collision handles those.
+ */
+int
+bb_sweep(const BB *a, vect_f delta, const BB *b, double *toi, vect_f *normal)
+{
+	assert(a != NULL && bb_valid(*a));
+	assert(b != NULL && bb_valid(*b));
+	assert(toi != NULL && normal != NULL);
+	
+	return sweep_box(a->l, a->b, a->r, a->t, delta, b, toi, normal);
+}
+
+/*
+ * Cast a ray from [origin] along [delta] against box [bb]. Same as bb_sweep()
+ * for a box of zero size: a ray that starts inside the box does not hit it.
+ */
+int
+ray_bb(const BB *bb, vect_f origin, vect_f delta, double *toi, vect_f *normal)
+{
+	assert(bb != NULL && bb_valid(*bb));
+	assert(toi != NULL && normal != NULL);
+	
+	return sweep_box(origin.x, origin.y, origin.x, origin.y, delta, bb, toi,
+	    normal);
+}
+
+/*
+ * Distance from point [p] to box [bb] (zero if the point is inside).
+ */
+double
+bb_distance(const BB *bb, vect_f p)
+{
+	double dx, dy;
+	
+	dx = (p.x < bb->l) ? bb->l - p.x : (p.x > bb->r) ? p.x - bb->r : 0.0;
+	dy = (p.y < bb->b) ? bb->b - p.y : (p.y > bb->t) ? p.y - bb->t : 0.0;
+	return sqrt(dx * dx + dy * dy);
+}
+
+/*
+ * Sweep circle (center [a], radius [ra]) along [delta] against stationary
+ * circle (center [b], radius [rb]). Return value and output arguments are the
+ * same as for bb_sweep().
+ */
+int
+circle_sweep(vect_f a, double ra, vect_f delta, vect_f b, double rb,
+    double *toi, vect_f *normal)
+{
+	vect_f p;
+	double qa, qb, qc, disc, t;
+	
+	assert(toi != NULL && normal != NULL);
+	
+	/* Solve |p + delta*t| = ra + rb for t. */
+	p = vect_f_sub(a, b);
+	qa = vect_f_dot(delta, delta);
+	qb = 2.0 * vect_f_dot(p, delta);
+	qc = vect_f_dot(p, p) - (ra + rb) * (ra + rb);
+	if (qc < 0.0 || qa == 0.0)
+		return 0;	/* Overlapping already, or not moving. */
+	disc = qb * qb - 4.0 * qa * qc;
+	if (disc < 0.0)
+		return 0;
+	t = (-qb - sqrt(disc)) / (2.0 * qa);
+	if (t < 0.0 || t > 1.0)
+		return 0;
+	
+	/* At contact, centers are exactly ra + rb apart. */
+	*toi = t;
+	p = vect_f_add(p, vect_f_scale(delta, t));
+	*normal = vect_f_scale(p, 1.0 / (ra + rb));
+	return 1;
+}
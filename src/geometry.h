@@ -49,6 +49,13 @@ int	bb_overlap(const BB *a, const BB *b);
 int	bb_intersect_resolve(const BB *a, const BB *b, BB *resolve);
 void	bb_init(BB *bb, int l, int b, int r, int t);
 void	bb_add_vect(BB *bb, int x, int y);
+int	bb_sweep(const BB *a, vect_f delta, const BB *b, double *toi,
+	    vect_f *normal);
+int	ray_bb(const BB *bb, vect_f origin, vect_f delta, double *toi,
+	    vect_f *normal);
+double	bb_distance(const BB *bb, vect_f p);
+int	circle_sweep(vect_f a, double ra, vect_f delta, vect_f b, double rb,
+	    double *toi, vect_f *normal);
 
 vect_f	vect_f_new(double x, double y);
 vect_f	vect_f_add(vect_f a, vect_f b);
@@ -0,0 +1,210 @@
+#include <assert.h>
+#include <string.h>
+#include <SDL.h>
+#include "glcall.h"
+#include "log.h"
+#include "mem.h"
+
+/* Posted call. */
+typedef struct {
+	glcall_func	func;
+	double		arg[GLCALL_ARG_MAX / sizeof(double)];	/* Aligned. */
+} PostedCall;
+
+static int		 threaded;
+static uint32_t		 gl_tid;	/* SDL_ThreadID() of GL thread. */
+
+/* Lock and condition shared with render.c. Anyone changing shared state
+   signals the condition, and both threads wait on it. */
+static SDL_mutex	*lock;
+static SDL_cond		*cond;
+
+/* Posted calls. The first [num_published] have gone out with a snapshot. */
+static PostedCall	*calls;
+static uint		 num_calls, num_published, max_calls;
+
+/* Call the simulation thread is waiting on. */
+static glcall_func	 wait_func;
+static void		*wait_arg;
+
+/*
+ * Set up. If [want_threaded] is set, calls from other threads are handed over
+ * to the calling thread. Returns whether they will be (false if locks could not
+ * be created).
+ */
+int
+glcall_init(int want_threaded)
+{
+	gl_tid = SDL_ThreadID();
+	threaded = 0;
+	if (!want_threaded)
+		return 0;
+
+	lock = SDL_CreateMutex();
+	cond = SDL_CreateCond();
+	if (lock == NULL || cond == NULL) {
+		log_warn("[SDL] Could not create render thread locks: %s",
+		    SDL_GetError());
+		glcall_cleanup();
+		return 0;
+	}
+	threaded = 1;
+	return 1;
+}
+
+void
+glcall_cleanup(void)
+{
+	if (calls != NULL)
+		mem_free(calls);
+	calls = NULL;
+	num_calls = num_published = max_calls = 0;
+
+	if (cond != NULL)
+		SDL_DestroyCond(cond);
+	if (lock != NULL)
+		SDL_DestroyMutex(lock);
+	cond = NULL;
+	lock = NULL;
+	threaded = 0;
+}
+
+/*
+ * Run the call the simulation thread is waiting on, if there is one. GL thread
+ * only, lock held.
+ */
+static int
+run_waiting(void)
+{
+	if (wait_func == NULL)
+		return 0;
+	wait_func(wait_arg);
+	wait_func = NULL;
+	SDL_CondBroadcast(cond);
+	return 1;
+}
+
+/*
+ * Run [func] on the GL thread and return once it has.
+ */
+void
+glcall(glcall_func func, void *arg)
+{
+	if (!threaded || SDL_ThreadID() == gl_tid) {
+		func(arg);
+		return;
+	}
+
+	SDL_mutexP(lock);
+	assert(wait_func == NULL);	/* Only one simulation thread. */
+	wait_func = func;
+	wait_arg = arg;
+	SDL_CondBroadcast(cond);
+	while (wait_func != NULL)
+		SDL_CondWait(cond, lock);
+	SDL_mutexV(lock);
+}
+
+/*
+ * Queue [func] to be run on the GL thread before the next snapshot is drawn.
+ * [size] bytes at [arg] are copied, and the call gets a pointer to the copy.
+ */
+void
+glcall_post(glcall_func func, const void *arg, uint size)
+{
+	PostedCall *pc;
+	double copy[GLCALL_ARG_MAX / sizeof(double)];
+
+	assert(size <= GLCALL_ARG_MAX);
+	if (!threaded || SDL_ThreadID() == gl_tid) {
+		if (size > 0)
+			memcpy(copy, arg, size);
+		func(copy);
+		return;
+	}
+
+	SDL_mutexP(lock);
+	if (num_calls == max_calls) {
+		max_calls = max_calls ? max_calls * 2 : 64;
+		mem_realloc((void **)&calls, max_calls * sizeof(PostedCall),
+		    "Posted GL calls");
+	}
+	pc = &calls[num_calls++];
+	pc->func = func;
+	if (size > 0)
+		memcpy(pc->arg, arg, size);
+	SDL_mutexV(lock);
+}
+
+void
+glcall_lock(void)
+{
+	if (threaded)
+		SDL_mutexP(lock);
+}
+
+void
+glcall_unlock(void)
+{
+	if (threaded)
+		SDL_mutexV(lock);
+}
+
+void
+glcall_signal(void)
+{
+	if (threaded)
+		SDL_CondBroadcast(cond);
+}
+
+/*
+ * Wait (lock held) until signalled, or at most [timeout_ms]. On the GL thread,
+ * a call the simulation thread is waiting on is run first; that counts as
+ * being signalled. Returns nonzero on timeout.
+ *
+ * Without a render thread there is nobody to wait for: returns right away.
+ */
+int
+glcall_wait(uint timeout_ms)
+{
+	int rc;
+
+	if (!threaded)
+		return 1;
+	if (SDL_ThreadID() == gl_tid && run_waiting())
+		return 0;
+	if (timeout_ms == GLCALL_WAIT_FOREVER)
+		rc = SDL_CondWait(cond, lock);
+	else
+		rc = SDL_CondWaitTimeout(cond, lock, timeout_ms);
+	if (SDL_ThreadID() == gl_tid)
+		run_waiting();
+	return rc == SDL_MUTEX_TIMEDOUT;
+}
+
+/*
+ * Send calls posted so far along with the snapshot being published. Lock held.
+ */
+void
+glcall_publish(void)
+{
+	num_published = num_calls;
+}
+
+/*
+ * Run published calls. GL thread only, lock held.
+ */
+void
+glcall_run_published(void)
+{
+	uint i;
+
+	if (num_published == 0)
+		return;
+	for (i = 0; i < num_published; i++)
+		calls[i].func(calls[i].arg);
+	memmove(calls, &calls[num_published],
+	    (num_calls - num_published) * sizeof(PostedCall));
+	num_calls -= num_published;
+	num_published = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef GLCALL_H
+#define GLCALL_H
+
+#include "common.h"
+
+/*
+ * OpenGL calls from the simulation.
+ *
+ * SDL 1.2 ties the OpenGL context (and the window) to the thread that set the
+ * video mode. With a render thread (config.render_thread, see main.c), worlds
+ * are stepped and scripts run on a simulation thread of their own, so what
+ * they do to textures, framebuffers or the mouse cursor is handed over to the
+ * GL thread:
+ *
+ *	glcall()	runs a function there and waits for it to return. For
+ *			calls whose results are needed right away (texture IDs).
+ *	glcall_post()	queues a function. Posted calls go along with the next
+ *			render snapshot (see render_publish()), and are run in
+ *			the order they were posted before that snapshot is
+ *			drawn.
+ *
+ * A waiting call may run before calls that were posted earlier.
+ *
+ * Without a render thread, or when already on the GL thread, the function is
+ * simply called.
+ */
+
+#define GLCALL_ARG_MAX		16	/* Bytes of argument a posted call can
+					   take along. */
+#define GLCALL_WAIT_FOREVER	((uint)-1)
+
+typedef void (*glcall_func)(void *arg);
+
+int	glcall_init(int want_threaded);
+void	glcall_cleanup(void);
+void	glcall(glcall_func func, void *arg);
+void	glcall_post(glcall_func func, const void *arg, uint size);
+
+/* Hand-off between the two threads (see render.c). */
+void	glcall_lock(void);
+void	glcall_unlock(void);
+void	glcall_signal(void);
+int	glcall_wait(uint timeout_ms);
+void	glcall_publish(void);
+void	glcall_run_published(void);
+
+#endif /* GLCALL_H */
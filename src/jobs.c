@@ -0,0 +1,178 @@
+#include <assert.h>
+#include <SDL.h>
+#include "jobs.h"
+#include "log.h"
+#include "trace.h"
+
+/*
+ * A minimal job system: a fixed set of worker threads that split a range of
+ * items into chunks. Each thread (the calling thread included) keeps claiming
+ * the next unprocessed chunk until there are none left, so faster threads end
+ * up doing more of the work.
+ *
+ * With zero workers everything runs on the calling thread.
+ */
+
+static SDL_Thread	*workers[JOBS_WORKERS_MAX];
+static int		 num_workers;
+static int		 quit;
+
+static SDL_mutex	*lock;		/* Protects batch.next. */
+static SDL_sem		*start_sem;	/* Posted once per worker per batch. */
+static SDL_sem		*done_sem;	/* Workers post this when finished. */
+
+/* Batch that is currently being processed. */
+static struct {
+	job_func	func;
+	void		*arg;
+	uint		count;		/* Total number of items. */
+	uint		chunk;		/* Items per claim. */
+	uint		next;		/* First unclaimed item. */
+} batch;
+
+/*
+ * Claim next chunk of items. Return false if all items have been claimed.
+ */
+static int
+claim(uint *begin, uint *end)
+{
+	int claimed;
+
+	SDL_mutexP(lock);
+	*begin = batch.next;
+	claimed = (*begin < batch.count);
+	if (claimed) {
+		*end = MIN2(*begin + batch.chunk, batch.count);
+		batch.next = *end;
+	}
+	SDL_mutexV(lock);
+	return claimed;
+}
+
+static void
+run_chunks(void)
+{
+	uint begin, end;
+	uint64_t t;
+
+	t = TRACE_BEGIN();
+	while (claim(&begin, &end))
+		batch.func(batch.arg, begin, end);
+	TRACE_END("Jobs", t);
+}
+
+static int
+worker_main(void *unused)
+{
+	UNUSED(unused);
+	for (;;) {
+		SDL_SemWait(start_sem);
+		if (quit)
+			break;
+		run_chunks();
+		SDL_SemPost(done_sem);
+	}
+	return 0;
+}
+
+/*
+ * Start worker threads.
+ *
+ * n		Number of worker threads (not counting the main thread). Zero
+ *		or less means that jobs are run on the calling thread only.
+ */
+void
+jobs_init(int n)
+{
+	int i;
+
+	assert(num_workers == 0);
+	if (n <= 0)
+		return;
+	if (n > JOBS_WORKERS_MAX) {
+		log_warn("Too many worker threads (%i), using %i.", n,
+		    JOBS_WORKERS_MAX);
+		n = JOBS_WORKERS_MAX;
+	}
+
+	lock = SDL_CreateMutex();
+	start_sem = SDL_CreateSemaphore(0);
+	done_sem = SDL_CreateSemaphore(0);
+	if (lock == NULL || start_sem == NULL || done_sem == NULL) {
+		log_warn("[SDL] Could not create job system locks: %s",
+		    SDL_GetError());
+		jobs_shutdown();
+		return;
+	}
+
+	quit = 0;
+	for (i = 0; i < n; i++) {
+		workers[i] = SDL_CreateThread(worker_main, NULL);
+		if (workers[i] == NULL) {
+			log_warn("[SDL] Could not create worker thread: %s",
+			    SDL_GetError());
+			break;
+		}
+		num_workers++;
+	}
+	log_msg("Job system started with %i worker thread(s).", num_workers);
+}
+
+/*
+ * Stop worker threads and free their resources.
+ */
+void
+jobs_shutdown(void)
+{
+	int i;
+
+	quit = 1;
+	for (i = 0; i < num_workers; i++)
+		SDL_SemPost(start_sem);
+	for (i = 0; i < num_workers; i++) {
+		SDL_WaitThread(workers[i], NULL);
+		workers[i] = NULL;
+	}
+	num_workers = 0;
+
+	if (lock != NULL)
+		SDL_DestroyMutex(lock);
+	if (start_sem != NULL)
+		SDL_DestroySemaphore(start_sem);
+	if (done_sem != NULL)
+		SDL_DestroySemaphore(done_sem);
+	lock = NULL;
+	start_sem = done_sem = NULL;
+}
+
+/*
+ * Call [func] for all items 0..count-1, split into chunks of [chunk] items.
+ * Returns once all items have been processed.
+ */
+void
+jobs_run(job_func func, void *arg, uint count, uint chunk)
+{
+	int i;
+
+	assert(func != NULL && chunk > 0);
+	if (count == 0)
+		return;
+
+	/* Not worth waking anyone up. */
+	if (num_workers == 0 || count <= chunk) {
+		func(arg, 0, count);
+		return;
+	}
+
+	batch.func = func;
+	batch.arg = arg;
+	batch.count = count;
+	batch.chunk = chunk;
+	batch.next = 0;
+
+	for (i = 0; i < num_workers; i++)
+		SDL_SemPost(start_sem);
+	run_chunks();	/* Calling thread helps out. */
+	for (i = 0; i < num_workers; i++)
+		SDL_SemWait(done_sem);
+}
@@ -0,0 +1,19 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "common.h"
+
+#define JOBS_WORKERS_MAX	8
+
+/*
+ * Job function processes items [begin, end) of whatever array [arg] refers to.
+ * It may be called from any worker thread, so it must not touch Lua, OpenGL,
+ * memory pools, or anything else that is not thread-safe.
+ */
+typedef void (*job_func)(void *arg, uint begin, uint end);
+
+void	jobs_init(int num_workers);
+void	jobs_shutdown(void);
+void	jobs_run(job_func func, void *arg, uint count, uint chunk);
+
+#endif /* JOBS_H */
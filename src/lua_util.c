@@ -269,7 +269,7 @@ L_getstk_shape(lua_State *L, int index, vect_i offset, Shape *s)
 		radius = lua_tonumber(L, -1);
 		if (radius <= 0)
 			return L_NEGATIVE_RADIUS;
-		if (radius == floor(radius))
+		if (radius != floor(radius))
 			return L_FRACTIONAL_RADIUS;
 			
 		/* Assign radius and offset to shape. */
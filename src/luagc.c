@@ -0,0 +1,93 @@
+#include <lua.h>
+#include "luagc.h"
+#include "misc.h"
+
+static uint		frame_ns;	/* Frame time budget (0 = Lua's GC). */
+static int		gc_pause;	/* Heap growth before next cycle (%). */
+static int		in_cycle;	/* Collection cycle in progress? */
+static LuaGCStats	stats;
+
+/*
+ * Set up collector parameters. With zero [frame_ms] collection stays
+ * automatic, only with the given pause and step multiplier.
+ */
+void
+luagc_init(lua_State *L, int pause, int stepmul, uint frame_ms)
+{
+	/* A cycle must free something before the next one is due. */
+	pause = MAX2(pause, 110);
+	stepmul = MAX2(stepmul, 1);
+
+	lua_gc(L, LUA_GCSETPAUSE, pause);
+	lua_gc(L, LUA_GCSETSTEPMUL, stepmul);
+	gc_pause = pause;
+	frame_ns = frame_ms * 1000000;
+	stats.live_kb = lua_gc(L, LUA_GCCOUNT, 0);
+	if (frame_ns > 0)
+		lua_gc(L, LUA_GCSTOP, 0);
+}
+
+/*
+ * Take one collector step. Returns nonzero if a cycle was finished.
+ */
+static int
+step(lua_State *L)
+{
+	in_cycle = 1;
+	stats.steps++;
+	if (lua_gc(L, LUA_GCSTEP, 0)) {
+		in_cycle = 0;
+		stats.cycles++;
+		stats.live_kb = lua_gc(L, LUA_GCCOUNT, 0);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Collect garbage for the rest of the frame. [busy_ns] is how much of frame
+ * time budget was used up by everything else.
+ */
+void
+luagc_frame(lua_State *L, uint64_t busy_ns)
+{
+	uint threshold_kb;
+	uint64_t start, end, now;
+
+	if (frame_ns == 0)
+		return;		/* Automatic collection. */
+
+	start = time_ns();
+	stats.frame_ns = 0;
+	threshold_kb = (uint64_t)stats.live_kb * gc_pause / 100;
+	stats.heap_kb = lua_gc(L, LUA_GCCOUNT, 0);
+	if (stats.heap_kb >= 2 * threshold_kb) {
+		/* Far behind: finish cycle now. */
+		while (!step(L))
+			;
+	} else if (in_cycle || stats.heap_kb >= threshold_kb) {
+		/* Always make some progress, then go on while there's time
+		   left. */
+		end = start + (busy_ns < frame_ns ? frame_ns - busy_ns : 0);
+		do {
+			if (step(L))
+				break;
+			now = time_ns();
+		} while (now < end);
+	} else {
+		return;		/* Nothing to do. */
+	}
+
+	/* Stepping turns automatic collection back on. */
+	lua_gc(L, LUA_GCSTOP, 0);
+	stats.heap_kb = lua_gc(L, LUA_GCCOUNT, 0);
+	stats.frame_ns = time_ns() - start;
+	stats.time_ns += stats.frame_ns;
+}
+
+void
+luagc_get_stats(lua_State *L, LuaGCStats *result)
+{
+	stats.heap_kb = lua_gc(L, LUA_GCCOUNT, 0);
+	*result = stats;
+}
@@ -0,0 +1,39 @@
+#ifndef LUAGC_H
+#define LUAGC_H
+
+#include <lua.h>
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Scheduled Lua garbage collection.
+ *
+ * Left to itself, Lua's incremental collector runs whenever allocation debt
+ * builds up, which tends to be in the middle of world steps and collision
+ * handlers. Instead, the engine can stop automatic collection and run
+ * collector steps once per frame, after the frame has been presented, for as
+ * long as the frame time budget allows.
+ *
+ * A collection cycle is started once the heap has grown [pause] percent over
+ * what was live after the previous cycle (like Lua's own "setpause"). Each
+ * collector step does an amount of work set by [stepmul] (Lua's "setstepmul").
+ * While a cycle is in progress, at least one step is taken every frame, and if
+ * the heap gets twice as big as it should before a cycle starts, the cycle is
+ * finished right away no matter the budget.
+ */
+
+/* Collector statistics. */
+typedef struct {
+	uint		heap_kb;	/* Lua heap size. */
+	uint		live_kb;	/* Heap size after last full cycle. */
+	uint		steps;		/* Collector steps taken. */
+	uint		cycles;		/* Full cycles completed. */
+	uint64_t	time_ns;	/* Total time spent collecting. */
+	uint64_t	frame_ns;	/* Time spent collecting in last frame. */
+} LuaGCStats;
+
+void	luagc_init(lua_State *L, int pause, int stepmul, uint frame_ms);
+void	luagc_frame(lua_State *L, uint64_t busy_ns);
+void	luagc_get_stats(lua_State *L, LuaGCStats *result);
+
+#endif /* LUAGC_H */
@@ -13,15 +13,23 @@
 #include <SDL_opengl.h>
 
 #include "audio.h"
+#include "chunk.h"
 #include "config.h"
 #include "draw.h"
 #include "game2d.h"
+#include "glcall.h"
+#include "jobs.h"
 #include "log.h"
 #include "lua_util.h"
+#include "luagc.h"
 #include "mem.h"
 #include "misc.h"
 #include "path.h"
 #include "physics.h"
+#include "prof.h"
+#include "render.h"
+#include "stream.h"
+#include "trace.h"
 #include "world.h"
 #include "str.h"
 
@@ -32,9 +40,14 @@ void	eapi_register(lua_State *L, int audio_enabled);	/* Defined in eapi.c */
 /* The following functions are defined at the bottom of this file. */
 static void	setup_memory();
 static void	cleanup();
-static void	draw(Camera *cam);
+static int	simulate(void *unused);
+static void	render_loop(void);
+static void	draw_frame(const RenderFrame *frame, int overlays);
+static void	draw(const RenderFrame *frame, const RenderView *view,
+		    int overlays);
 static void	process_events();
 static void	exec_key_binding(lua_State *L, SDLKey key, uint8_t state);
+static void	trace_key_pressed(void);
 static void	read_cfg_file();
 static void	parse_cmd_opt(int argc, char *argv[]);
 static void	game_window();
@@ -48,7 +61,7 @@ int	drawShapes, drawTileTree, drawShapeTree, outsideView;
 /* Memory pools. */
 mem_pool mp_world, mp_camera, mp_parallax;
 mem_pool mp_shape, mp_listvect, mp_path;
-mem_pool mp_texture, mp_sprite, mp_tile;
+mem_pool mp_texture, mp_sprite, mp_tile, mp_animclock;
 mem_pool mp_sound;
 mem_pool mp_body;
 mem_pool mp_treenode, mp_treeobjptr;
@@ -58,6 +71,7 @@ mem_pool mp_group;
 static lua_State	*L;			/* Lua state. */
 static int		lua_stack_size;		/* For debugging. */
 static uint32_t		fps_time;		/* Last FPS update time. */
+static int		quit_requested;		/* See game_quit(). */
 
 /*
  * Game time is the time spent actually advancing (stepping) worlds. It can be
@@ -94,7 +108,9 @@ error_handler(lua_State *L)
 	return 1;
 }
 
+void setup_framebuffer(int supported);
 void bind_framebuffer(void);
+void framebuffer_viewport(int x, int y, int w, int h);
 void draw_framebuffer(void);
 void cleanup_framebuffer(void);
 
@@ -102,11 +118,10 @@ static SDL_Joystick *joystick[MAX_JOYSTICKS];
 
 int main(int argc, char *argv[])
 {
-	uint32_t now, before, delta_time, game_delta_time, remainder;
-	int steps_per_frame, fps_count, world_i, cam_i, arg_i, sound_works, i;
+	int arg_i, sound_works, i;
 	const SDL_version *sdl_version;
 	int fb_support = 1;
-	World *world;
+	SDL_Thread *sim_thread;
 
 	log_open(NULL);		/* Log output goes to stderr. */
 	
@@ -114,6 +129,9 @@ int main(int argc, char *argv[])
         str_init(&config.name);
 	str_init(&config.version);
 	str_init(&config.location);
+	str_init(&config.profile_report);
+	str_init(&config.profile_stacks);
+	str_init(&config.trace_file);
 	
 	/* Start Lua. */
 	L = luaL_newstate();
@@ -147,6 +165,11 @@ int main(int argc, char *argv[])
 	/* Allocate memory for pools & set atexit() which will free them. */
 	setup_memory();
 	atexit(cleanup);
+	
+	/* Frame timeline trace. */
+	trace_init(config.trace_events);
+	if (config.trace)
+		trace_start();
 
 	/* Print game name and version. */
         cfg_get_str("name", &config.name);
@@ -168,6 +191,13 @@ int main(int argc, char *argv[])
 	sound_works = audio_init();
 	game_window();
 
+	/* This thread owns the OpenGL context. With a render thread, GL calls
+	   from scripts are handed over to it. */
+	config.render_thread = glcall_init(config.render_thread);
+	
+	/* Start worker threads for render preparation. */
+	jobs_init(config.render_threads);
+
 	/* Allocate key binding array. We add SDLK_LAST to mouse button
 	   enumerations so their bindings can be stored in the same array.*/
 	key_bind = mem_alloc(sizeof(uint) * (SDLK_LAST + EXTRA_KEYBIND),
@@ -189,6 +219,7 @@ int main(int argc, char *argv[])
 		log_warn("GL_EXT_framebuffer_object not present.");
 		fb_support = 0;
 	}
+	setup_framebuffer(fb_support);
 	if (!check_extension("GL_ARB_imaging"))
 		log_warn("GL_ARB_imaging not present.");
 	if (!check_extension("GL_ARB_vertex_buffer_object"))
@@ -214,6 +245,10 @@ int main(int argc, char *argv[])
 	glPixelStorei(GL_PACK_ALIGNMENT, 1);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
+	/* Route script loading through compiled chunk cache. */
+	chunk_init(config.script_cache);
+	chunk_register(L);
+	
 	/* Register "API" functions with Lua. */
 	eapi_register(L, sound_works);
 	
@@ -224,8 +259,14 @@ int main(int argc, char *argv[])
 	lua_getfield(L, eapi_index, "__ExecuteKeyBinding");
 	keyfunc_index = lua_gettop(L);
 	
+	/* Profile script callbacks if asked to. */
+	if (config.profile) {
+		prof_init(L, config.profile_sampling, config.profile_report.data,
+		    config.profile_stacks.data);
+	}
+	
 	/* Execute user script. */
-	if ((luaL_loadfile(L, "script/first.lua") ||
+	if ((chunk_loadfile(L, "script/first.lua") ||
 	    lua_pcall(L, 0, 0, errfunc_index))) {
 		log_err("[Lua] %s", lua_tostring(L, -1));
 		abort();
@@ -240,13 +281,48 @@ int main(int argc, char *argv[])
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();	/* Keep identity matrix at the bottom. */
 
-	/* Main loop. */
+	/* From now on, Lua garbage is collected between frames. */
+	luagc_init(L, config.gc_pause, config.gc_stepmul, config.gc_frame_ms);
+
+	/* Main loop. With a render thread, scripts run on the simulation thread
+	   from now on, and this thread draws. */
+	if (config.render_thread &&
+	    (sim_thread = SDL_CreateThread(simulate, NULL)) == NULL) {
+		log_warn("[SDL] Could not create simulation thread: %s",
+		    SDL_GetError());
+		glcall_cleanup();
+		config.render_thread = 0;
+	}
+	if (!config.render_thread) {
+		simulate(NULL);
+		/* NOTREACHED */
+	}
+	render_loop();
+	SDL_WaitThread(sim_thread, NULL);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Step worlds and capture what cameras see, frame after frame. Without a render
+ * thread, frames are also drawn here and this never returns (see game_quit());
+ * with one, this is the simulation thread.
+ */
+static int
+simulate(void *unused)
+{
+	uint32_t now, before, delta_time, game_delta_time, remainder;
+	uint64_t frame_start, busy, t, stream_budget;
+	int steps_per_frame, fps_count, world_i, stepped;
+	World *world;
+
+	UNUSED(unused);
 	game_time = 0;		/* Game time starts at zero. */
 	remainder = 0;		/* Used in game time calculations. */
 	before = fps_time = SDL_GetTicks();
 	fps_count = 0;
-	for (;;) {
+	while (!quit_requested) {
 		now = SDL_GetTicks();	/* Current real time. */
+		frame_start = time_ns();
 		
 		/* Compute how much time has passed since last time. Watch out
 		   for time wrap-around. */
@@ -285,11 +361,15 @@ int main(int argc, char *argv[])
 		
 		/* Handle user input. */
 		process_events();
-                
-                /* Adjust audio volume for channels that are bound to bodies. */
-                audio_adjust_volume();
+		
+		/* Pick up sounds decoded in background. */
+		t = TRACE_BEGIN();
+		audio_collect_prefetched();
+		TRACE_END("Audio", t);
 		
 		/* Step worlds. */
+		stepped = 0;
+		stream_budget = config.stream_budget_ms * 1000000ULL;
 		for (world_i = 0; world_i < WORLDS_MAX; world_i++) {
 			if ((world = worlds[world_i]) == NULL || world->killme)
 				continue;
@@ -301,6 +381,13 @@ int main(int argc, char *argv[])
 				if (world->paused)
 					continue;
 
+				/* Bring in streamed room cells around
+				   cameras before anything collides with
+				   them. */
+				stream_update(world, L, &stream_budget);
+				if (world->killme)
+					break;
+
 				/* Step world -- execute body step
 				   functions, timers, collision handlers. */
 				world_step(world, L, steps_per_frame++ == 0);
@@ -313,8 +400,14 @@ int main(int argc, char *argv[])
 				if (world->killme)
 					break;	/* No need to keep going. */
 			}
+			stepped |= (steps_per_frame > 0);
 		}
 		
+		/* Bodies have moved: adjust volume and panning for channels
+		   that are bound to them. */
+		if (stepped)
+			audio_adjust_volume();
+		
 		/*
 		 * Deal with worlds that have either been destroyed or created
 		 * in the loop above. Must do this here, before rendering, so
@@ -329,137 +422,113 @@ int main(int argc, char *argv[])
 			if (world->killme) {
 				world_free(world);
 				worlds[world_i] = NULL;
-			} else if (world->virgin) {
+				continue;
+			}
+			if (world->virgin) {
 				/* We must give scripts control over what the
 				   contents of the world look like before
 				   drawing it. Otherwise we get such artifacts
 				   as camera centered on origin even though it
-				   should be tracking a player character. */
+				   should be tracking a player character.
+				   Stream in first, so that the step sees what
+				   the cameras see. */
+				stream_update(world, L, &stream_budget);
 				world_step(world, L, 1);
 				world->virgin = 0;
+				continue;	/* Draw as is, no interpolation. */
 			}
-		}
+			
+			/* Cameras have moved: make sure what they see is
+			   there. */
+			stream_update(world, L, &stream_budget);
 
-		/*
-		 * Draw what each camera sees.
-		 *
-		 * Calling glClear(GL_COLOR_BUFFER_BIT) to clear frame buffer
-		 * before anything is rendered isn't necessary, but may be done
-		 * here if desired.
-		 */
-		if (fb_support) {
-			bind_framebuffer();
-		}
-		else {
-			glClearColor(0.0, 0.0, 0.0, 1.0);
-			glClear(GL_COLOR_BUFFER_BIT);		    
+			/* Where between last two steps are we right now. */
+			world_set_render_alpha(world, game_time);
 		}
-		for (cam_i = 0; cam_i < CAMERAS_MAX; cam_i++) {
-			if (cameras[cam_i] != NULL)
-				draw(cameras[cam_i]);
+
+		/* Take a snapshot of what cameras see, and hand it over to be
+		   drawn. */
+		render_capture(cameras);
+		if (config.render_thread) {
+			busy = time_ns() - frame_start;
+			render_publish();	/* Waits if drawing lags. */
+		} else {
+			render_publish();
+			draw_frame(render_acquire(NULL), 1);
+			busy = time_ns() - frame_start;
+			t = TRACE_BEGIN();
+			SDL_GL_SwapBuffers();
+			TRACE_END("Swap", t);
 		}
-		if (fb_support) draw_framebuffer();
-		/*
-		 * These may be executed here, but don't seem to do much.
-		 * glFlush();
-		 * glFinish();
-		 */
-		SDL_GL_SwapBuffers();
+		
+		/* Use what's left of frame time to collect garbage. */
+		t = TRACE_BEGIN();
+		luagc_frame(L, busy);
+		TRACE_END("Lua GC", t);
+		TRACE_END("Frame", frame_start);
 	}
-	/* NOTREACHED */
+	render_finish();
+	return 0;
 }
 
 /*
- * Depth comparison routine to use with qsort(). Into the screen is the negative
- * direction, out of the screen -- positive. We want tiles sorted back to front.
+ * With a render thread, the main thread keeps the window responsive, runs GL
+ * calls that come from the simulation thread (see glcall.h), and draws the
+ * latest snapshot, until the simulation thread is done.
  */
-static int
-tile_depth_cmp(const void *a, const void *b)
+static void
+render_loop(void)
 {
-	float a_depth, b_depth;
-	Tile *a_tile, *b_tile;
-	GLuint a_texid, b_texid;
-	
-	a_tile = (*(QTreeObject **)a)->ptr;
-	b_tile = (*(QTreeObject **)b)->ptr;
+	const RenderFrame *frame;
+	uint64_t t;
+	int fresh;
 
-	assert(a != NULL && b != NULL);
-	assert(a_tile != b_tile);
-	assert(a_tile != NULL && a_tile->objtype == OBJTYPE_TILE);
-	assert(b_tile != NULL && b_tile->objtype == OBJTYPE_TILE);
-	
-	a_depth = a_tile->depth;
-	b_depth = b_tile->depth;
-	
-	/* If the depth values of both tiles are the same, compare their
-	   pointers. This will ensure that overlapping tiles with equal depth
-	   will not flicker due to differing implementations of qsort() or other
-	   factors. */
-	if (a_depth == b_depth) {
-		a_texid = a_tile->sprite_list->tex->id;
-		b_texid = b_tile->sprite_list->tex->id;
-		if (a_texid == b_texid)
-			return (a_tile < b_tile) ? -1 : 1;
-		return a_texid < b_texid ? -1 : 1;
+	for (;;) {
+		/* Only this thread may pump events; the simulation thread
+		   reads them from the queue. */
+		t = TRACE_BEGIN();
+		SDL_PumpEvents();
+		TRACE_END("Pump events", t);
+
+		if ((frame = render_acquire(&fresh)) == NULL)
+			break;
+
+		/* Overlays can only be drawn while the world is as captured:
+		   keep showing the frame that had them. */
+		if (!fresh && (frame->debug & RENDER_OVERLAYS))
+			continue;
+		draw_frame(frame, fresh);
+		t = TRACE_BEGIN();
+		SDL_GL_SwapBuffers();
+		TRACE_END("Swap", t);
 	}
-	
-	return (a_depth < b_depth) ? -1 : 1;
 }
 
+/*
+ * Draw what each camera sees. Framebuffer code decides whether this goes
+ * straight to the back buffer or into an off-screen target (transitions).
+ * Debug overlays are drawn only if [overlays] is set.
+ */
 static void
-draw_visible_tiles(Camera *cam, World *world, BB *visible_area)
+draw_frame(const RenderFrame *frame, int overlays)
 {
-	int stat;
-	uint i, num_tiles;
-	Tile *tile;
-	static QTreeObject *visible_tiles[TILES_MAX];
-	
-	/* Look up visible tiles. */
-	stat = qtree_lookup(&world->tile_tree, visible_area, visible_tiles,
-	    TILES_MAX, &num_tiles);
-#ifndef NDEBUG
-	if (stat != 0) {
-		log_err("Too many visible tiles.");
-		abort();
-	}
-#endif
-	
-	/* Add camera tiles to the list, since those are always visible and not
-	   in quad tree. */
-	for (tile = cam->body.tiles; tile != NULL; tile = tile->next) {
-		assert(num_tiles < TILES_MAX);
-		visible_tiles[num_tiles++] = &tile->go;
-	}
-
-	/* Update parallax tiles and add them to lookup hash as well. */
-	for (i = 0; i < WORLD_PX_PLANES_MAX; i++) {
-		if (world->px_planes[i] == NULL)
-			continue;
-		parallax_update(world->px_planes[i], cam);
-		for (tile = world->px_planes[i]->body.tiles; tile != NULL;
-		    tile = tile->next) {
-			assert(num_tiles < TILES_MAX);
-			visible_tiles[num_tiles++] = &tile->go;
-		}
-	}
-	
-	/* Sort tiles by depth, so drawing happens back to front. */
-	qsort(visible_tiles, num_tiles, sizeof(QTreeObject *), tile_depth_cmp);
-	
-	/* Draw visible tiles. */
-	glBegin(GL_QUADS);
-	for (i = 0; i < num_tiles; i++) {
-		tile = visible_tiles[i]->ptr;
-		assert(tile->objtype == OBJTYPE_TILE);
-		
-		/* The tile should not have been added to tree if it has no
-		   sprites. */
-		assert(tile->sprite_list != NULL &&
-		    tile->sprite_list->num_frames > 0);
-		
-		draw_tile(cam, tile);
-	}
-	glEnd();
+	uint64_t t;
+	uint i;
+
+	t = TRACE_BEGIN();
+	bind_framebuffer();
+	for (i = 0; i < frame->num_views; i++)
+		draw(frame, &frame->views[i], overlays);
+	render_release();
+	TRACE_END("Draw", t);
+	t = TRACE_BEGIN();
+	draw_framebuffer();
+	TRACE_END("Framebuffer", t);
+	/*
+	 * These may be executed here, but don't seem to do much.
+	 * glFlush();
+	 * glFinish();
+	 */
 }
 
 static void
@@ -472,7 +541,7 @@ draw_visible_shapes(const World *world, const BB *visible_area)
 	QTreeObject *visible_shapes[MAX_SHAPES];
 	
 	/* Look up visible shapes. */
-	stat = qtree_lookup(&world->shape_tree, visible_area, visible_shapes,
+	stat = world_lookup_shapes(world, visible_area, visible_shapes,
 	    MAX_SHAPES, &num_shapes);
 #ifndef NDEBUG
 	if (stat != 0) {
@@ -493,32 +562,30 @@ draw_visible_shapes(const World *world, const BB *visible_area)
 }
 
 static void
-draw(Camera *cam)
+draw(const RenderFrame *frame, const RenderView *view, int overlays)
 {
 	Matrix m;
 	Body *bp;
-	BB visible_area;
-	vect_i visible_size, visible_halfsize;
 	World *world;
+	vect_i visible_size, visible_halfsize;
+	float rev_pos[4];
+	uint debug;
 
-	/* Camera should be bound to exactly one world (the one its body
-	   belongs to. */
-	world = cam->body.world;
-	assert(world != NULL);
+	world = view->world;
+	debug = overlays ? frame->debug : 0;
 
 	/* Camera viewport. */
-	glViewport(cam->viewport.l, cam->viewport.t,
-	    cam->viewport.r - cam->viewport.l,	/* width */
-	    cam->viewport.b - cam->viewport.t);	/* height */
+	framebuffer_viewport(view->viewport.l, view->viewport.t,
+	    view->viewport.r - view->viewport.l,	/* width */
+	    view->viewport.b - view->viewport.t);	/* height */
 
 	/* Visible area projection. */
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	visible_size.x = round(cam->size.x/cam->zoom);
-	visible_size.y = round(cam->size.y/cam->zoom);
+	visible_size = view->visible_size;
 	visible_halfsize.x = visible_size.x/2;
 	visible_halfsize.y = visible_size.y/2;
-	if (!outsideView)
+	if (!(frame->debug & RENDER_OUTSIDE_VIEW))
 		glOrtho(-visible_halfsize.x, visible_halfsize.x,
 		    -visible_halfsize.y, visible_halfsize.y, 0.0, 1.0);
 	else
@@ -526,18 +593,12 @@ draw(Camera *cam)
 		    -visible_size.y, +visible_size.y, 0.0, 1.0);
 	glMatrixMode(GL_MODELVIEW);
 
-	/* Visible area bounding box. */
-	bb_init(&visible_area,
-	    round(cam->body.pos.x) - visible_halfsize.x,
-	    round(cam->body.pos.y) - visible_halfsize.y,
-	    round(cam->body.pos.x) + visible_halfsize.x,
-	    round(cam->body.pos.y) + visible_halfsize.y);
-
 	/* Draw background-color quad. */
-	if (world->bg_color[3] > 0.0)	/* If visible (alpha > 0) */
-		draw_quad(cam, &visible_area, world->bg_color);
+	if (view->bg_color[3] > 0.0)	/* If visible (alpha > 0) */
+		draw_quad(view->cam_pos, &view->visible_area, view->bg_color);
 
-	draw_visible_tiles(cam, world, &visible_area);
+	/* Draw visible tiles. */
+	draw_render_view(view);
 
 	/* Set modelview matrix according to camera. Since we do this, the
 	   following drawing functions do not take camera position into account.
@@ -547,26 +608,68 @@ draw(Camera *cam)
 	   position because we must draw them pixel-accurate (body/camera
 	   positions are rounded). The stuff below is just for debugging so
 	   we don't really care. */
-	cam_view(cam, &m);
+	rev_pos[0] = -view->cam_pos.x;
+	rev_pos[1] = -view->cam_pos.y;
+	rev_pos[2] = 0.0;
+	rev_pos[3] = 1.0;
+	m_set_translate(&m, rev_pos);
 	glLoadMatrixf(m.val);
 
-	if (drawShapes) {
+	if (debug & RENDER_SHAPES) {
 		/* Draw axes and all visible shapes. */
 		draw_axes();
-		draw_visible_shapes(world, &visible_area);
+		draw_visible_shapes(world, &view->visible_area);
 
 		/* Draw points at body positions. */
 		for (bp = world->bodies; bp != NULL; bp = bp->next)
 			draw_point(bp->pos);
 		draw_point(world->static_body.pos);
 	}
-	if (drawTileTree)
+	if (debug & RENDER_TILE_TREE)
 		draw_qtree(&world->tile_tree);
-	if (drawShapeTree)
+	if (debug & RENDER_SHAPE_TREE)
 		draw_qtree(&world->shape_tree);
 	glLoadIdentity();
 }
 
+/*
+ * Draw the front render snapshot again (framebuffer.c uses this to keep a copy
+ * of what is on screen). With a render thread the world may have moved on
+ * since, so there are no debug overlays then.
+ */
+void
+redraw_frame(void)
+{
+	const RenderFrame *frame;
+	uint i;
+
+	frame = render_current();
+	for (i = 0; i < frame->num_views; i++)
+		draw(frame, &frame->views[i], !config.render_thread);
+}
+
+/*
+ * Quit the game (eapi.Quit(), window closed). With a render thread, SDL and
+ * OpenGL must be shut down on the main thread: the simulation loop ends, and
+ * the main thread exits once it sees so.
+ */
+void
+game_quit(void)
+{
+	if (!config.render_thread)
+		exit(EXIT_SUCCESS);
+	quit_requested = 1;
+}
+
+#ifdef __APPLE__
+static void
+iconify_window(void *unused)
+{
+	UNUSED(unused);
+	SDL_WM_IconifyWindow();
+}
+#endif
+
 static void joystick_movement(uint8_t state, int axis, int *dirs) {
     if (dirs[axis]) {
 	int sym = (dirs[axis] + 1) / 2;
@@ -593,27 +696,38 @@ process_events()
 	SDLKey sym;
 	SDL_Event ev;
 	static int axis_dir[MAX_AXIS];
+	uint64_t t;
 	
-	while (SDL_PollEvent(&ev) != 0) {
+	t = TRACE_BEGIN();
+	if (!config.render_thread)
+		SDL_PumpEvents();	/* Main thread does this otherwise. */
+	while (SDL_PeepEvents(&ev, 1, SDL_GETEVENT, SDL_ALLEVENTS) > 0) {
 		switch (ev.type) {
 		case SDL_QUIT:
-			exit(EXIT_SUCCESS);
+			game_quit();
+			continue;
 		case SDL_KEYDOWN:
 			sym = ev.key.keysym.sym;
 			state = SDL_KEYDOWN;
+			if (sym != 0 && (uint)sym == config.trace_key) {
+				trace_key_pressed();
+				continue;
+			}
 #ifdef __APPLE__
                         /* Handle `Command + Q` and `Command + H` events on Mac OS X. */
                         SDLMod mod = ev.key.keysym.mod;
                         if (mod == KMOD_LMETA || mod == KMOD_RMETA) {
                                 if (sym == SDLK_q)
-                                        exit(EXIT_SUCCESS);
+                                        game_quit();
                                 if (sym == SDLK_h)
-                                        SDL_WM_IconifyWindow();
+                                        glcall_post(iconify_window, NULL, 0);
                         }
 #endif
 			break;
 		case SDL_KEYUP:
 			sym = ev.key.keysym.sym;
+			if (sym != 0 && (uint)sym == config.trace_key)
+				continue;	/* Handled on key down. */
 			state = SDL_KEYUP;
 			break;
 		case SDL_JOYAXISMOTION:  /* Handle Joystick Motion */
@@ -658,6 +772,22 @@ process_events()
 		/* Execute function bound to this key (if any). */
 		exec_key_binding(L, sym, state);
 	}
+	TRACE_END("Events", t);
+}
+
+/*
+ * Trace key starts recording a trace (see trace.h), and when pressed again,
+ * writes what has been recorded so far.
+ */
+static void
+trace_key_pressed(void)
+{
+	if (!trace_on) {
+		trace_start();
+		log_msg("Recording trace.");
+	} else {
+		trace_dump(config.trace_file.data);
+	}
 }
 
 static void
@@ -675,7 +805,8 @@ exec_key_binding(lua_State *L, SDLKey key, uint8_t state)
 	lua_pushinteger(L, func_id);		/* ... func func_id */
 	lua_pushinteger(L, key);		/* ... func func_id keyNum */
 	lua_pushboolean(L, state == SDL_KEYDOWN); /* ... func func_id keyNum keyState */
-	if (lua_pcall(L, 3, 0, errfunc_index)) {
+	render_invalidate();	/* Script may change what's on screen. */
+	if (prof_pcall(L, 3, errfunc_index, PROF_KEY, func_id)) {
 		log_err("[Lua] %s", lua_tostring(L, -1));
 		abort();
 	}
@@ -743,6 +874,36 @@ read_cfg_file()
 	config.window_width = cfg_get_int("windowWidth");
 	config.window_height = cfg_get_int("windowHeight");
 	config.screen_bpp = cfg_get_int("screenBPP");
+	config.interpolate = GET_CFG("interpolate", cfg_get_bool, 0);
+	config.pixel_snap = GET_CFG("pixelSnap", cfg_get_bool, 1);
+	config.render_threads = GET_CFG("renderThreads", cfg_get_int, 0);
+	config.render_thread = GET_CFG("renderThread", cfg_get_bool, 0);
+	config.integer_scale = GET_CFG("integerScale", cfg_get_bool, 0);
+	config.low_res = GET_CFG("lowRes", cfg_get_bool, 0);
+	config.sharp_bilinear = GET_CFG("sharpBilinear", cfg_get_bool, 0);
+	config.loose_trees = GET_CFG("looseTrees", cfg_get_bool, 0);
+	config.body_proxies = GET_CFG("bodyProxies", cfg_get_bool, 0);
+	config.script_cache = GET_CFG("scriptCache", cfg_get_bool, 0);
+	config.gc_pause = GET_CFG("gcPause", cfg_get_int, 200);
+	config.gc_stepmul = GET_CFG("gcStepMul", cfg_get_int, 200);
+	config.gc_frame_ms = GET_CFG("gcFrameTime", cfg_get_int, 0);
+	config.profile = GET_CFG("profile", cfg_get_bool, 0);
+	config.profile_sampling = GET_CFG("profileSampling", cfg_get_int, 0);
+	str_assign_cstr(&config.profile_report, "profile.txt");
+	if (cfg_has_field("profileReport"))
+		cfg_get_str("profileReport", &config.profile_report);
+	if (cfg_has_field("profileStacks"))
+		cfg_get_str("profileStacks", &config.profile_stacks);
+	config.trace = GET_CFG("trace", cfg_get_bool, 0);
+	config.trace_events = GET_CFG("traceEvents", cfg_get_int, 65536);
+	config.trace_key = GET_CFG("traceKey", cfg_get_int, 0);
+	str_assign_cstr(&config.trace_file, "trace.json");
+	if (cfg_has_field("traceFile"))
+		cfg_get_str("traceFile", &config.trace_file);
+	config.stream_margin = GET_CFG("streamMargin", cfg_get_int, 256);
+	config.stream_unload_margin = GET_CFG("streamUnloadMargin", cfg_get_int,
+	    1024);
+	config.stream_budget_ms = GET_CFG("streamBudget", cfg_get_int, 2);
 }
 
 static void calculate_screen_dimensions(void) {
@@ -859,12 +1020,14 @@ setup_memory()
 	mem_pool_init(&mp_texture, sizeof(Texture), 100, "Texture pool");
 	mem_pool_init(&mp_sprite, sizeof(SpriteList), 1000, "SpriteList pool");
 	mem_pool_init(&mp_tile, sizeof(Tile), TILES_MAX, "Tile pool");
+	mem_pool_init(&mp_animclock, sizeof(AnimClock), 1000,
+	    "Animation clock pool");
 	mem_pool_init(&mp_body, sizeof(Body), 10000, "Body pool");
 	mem_pool_init(&mp_treenode, sizeof(QTreeNode), 20000, "Quad tree node "
 	    "pool");
 	mem_pool_init(&mp_treeobjptr, sizeof(QTreeObjectPtr), 50000,
 	    "Quad tree object pointer pool");
-	mem_pool_init(&mp_group, sizeof(Group), WORLD_HANDLERS_MAX,
+	mem_pool_init(&mp_group, sizeof(Group), WORLD_GROUPS_EST,
 	    "Shape collision group pool");
 }
 
@@ -879,5 +1042,11 @@ cleanup()
 		if (joystick[i]) SDL_JoystickClose(joystick[i]);
 	}
 	audio_close();	/* Close audio if it was opened. */
+	jobs_shutdown();
+	render_cleanup();
+	glcall_cleanup();
+	chunk_cleanup();
+	prof_cleanup();	/* Writes profile. */
+	trace_cleanup();
 	SDL_Quit();	/* Finally, kill SDL. */
 }
@@ -1,3 +1,7 @@
+#if !defined(_WIN32) && !defined(__APPLE__)
+#define _POSIX_C_SOURCE 199309L	/* clock_gettime() */
+#endif
+
 #include <lua.h>
 #include <SDL.h>
 #include <SDL_image.h>
@@ -5,6 +9,12 @@
 #include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
 #include "config.h"
 #include "log.h"
 #include "lua_util.h"
@@ -42,13 +52,15 @@ gentex_checkerboard(int width, int height)
 #endif /* Unused block. */
 
 /*
- * Load OpenGL texture from SDL surface.
+ * Convert SDL surface into pixels that can be fed directly into OpenGL, and
+ * store image size in texture. Needs no OpenGL, so it can be done on any
+ * thread (see glcall.h).
  *
  * tex		Texture object that will be modified.
- * img		SDL surface to be loaded.
+ * img		SDL surface to be converted.
  */
-void
-surface_to_texture(Texture *tex, SDL_Surface *img)
+static SDL_Surface *
+convert_surface(Texture *tex, SDL_Surface *img)
 {
 	SDL_Surface *converted;
 	Uint32 flags, rmask, gmask, bmask, amask;
@@ -97,35 +109,42 @@ surface_to_texture(Texture *tex, SDL_Surface *img)
 	tex->h = img->h;
 	tex->pow_w = nearest_pow2(img->w);
 	tex->pow_h = nearest_pow2(img->h);
+	return converted;
+}
 
+/*
+ * Load pixels from convert_surface() into currently bound OpenGL texture.
+ */
+void
+upload_surface(Texture *tex, SDL_Surface *converted)
+{
 	/* Create a blank texture with power-of-two dimensions. Then load
 	   converted image data into its lower left. */
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->pow_w, tex->pow_h, 0,
 	    GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, converted->w, converted->h,
 	    GL_RGBA, GL_UNSIGNED_BYTE, converted->pixels);
-	    
-	SDL_FreeSurface(converted);
 }
 
 /*
  * Given an image filename, load it as SDL surface using SDL_image's
- * IMG_Load(); then convert it to OpenGL texture and free the surface.
+ * IMG_Load(), and return it converted (see convert_surface()).
  */
-void
-load_texture_from_file(Texture *tex, const char *filename)
+SDL_Surface *
+load_texture_image(Texture *tex, const char *filename)
 {
-	SDL_Surface *img;
+	SDL_Surface *img, *converted;
 
-	log_msg("Loading '%s' into texture memory (id=%i).", filename, tex->id);
+	log_msg("Loading '%s' into texture memory.", filename);
 	img = IMG_Load(filename);
 	if (img == NULL) {
 		log_err("[SDL_image] %s.", IMG_GetError());
 		abort();
 	}
 
-	surface_to_texture(tex, img);
+	converted = convert_surface(tex, img);
 	SDL_FreeSurface(img);
+	return converted;
 }
 
 /*
@@ -366,3 +385,34 @@ color_uint32_to_floatv(uint32_t in, float out[4])
 #endif
 }
 
+
+/*
+ * Read a monotonic clock, in nanoseconds from some arbitrary point. Use this to
+ * time short intervals, where SDL_GetTicks() (milliseconds) is too coarse.
+ */
+uint64_t
+time_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000 +
+	    (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000 /
+	    freq.QuadPart;
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	
+	if (timebase.denom == 0)
+		mach_timebase_info(&timebase);
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
@@ -14,8 +14,8 @@ int	check_extension(const char *name);
 int	getopt_bsd(int argc, char* const argv[], const char *optstring);
 
 /* Textures. */
-void	surface_to_texture(Texture *tex, SDL_Surface *img);
-void	load_texture_from_file(Texture *tex, const char *filename);
+SDL_Surface *load_texture_image(Texture *tex, const char *filename);
+void	upload_surface(Texture *tex, SDL_Surface *converted);
 
 /* Read/write OpenGL buffers. */
 void	read_screen(void *pixels, GLenum color_buffer, int w, int h);
@@ -38,4 +38,7 @@ int	float_eq(float a, float b, float epsilon);
 uint32_t color_floatv_to_uint32(float color[4]);
 void	color_uint32_to_floatv(uint32_t in, float out[4]);
 
+/* Timing. */
+uint64_t time_ns(void);
+
 #endif /* MISC_H */
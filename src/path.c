@@ -6,7 +6,6 @@
 #include "log.h"
 #include "mem.h"
 #include "path.h"
-#include "utlist.h"
 
 /*
  * Initialize Path structure. See the structure definition (path.h) for what the
@@ -16,7 +15,8 @@ void
 path_init(Path *path, int interp, int closed, int outside, int motion)
 {
 	assert(path != NULL);
-	assert(interp == PATH_LINEAR);
+	assert(interp == PATH_LINEAR || interp == PATH_CUBIC ||
+	    interp == PATH_HERMITE);
 	assert(outside == PATH_LOOP || outside == PATH_CLAMP ||
 	    outside == PATH_REVERSE);
 	assert(motion == PATH_NORMAL || motion == PATH_PIECEWISE ||
@@ -26,9 +26,12 @@ path_init(Path *path, int interp, int closed, int outside, int motion)
 	path->refcount = 0;
 	path->points = NULL;
 	path->num_points = 0;
-	path->last_index = 0;
-	path->last_point = NULL;
+	path->max_points = 0;
+	path->arclen = NULL;
+	path->num_arclen = 0;
+	path->arclen_valid = 0;
 	path->interp = interp;
+	path->tension = 0.0;
 	path->closed = closed;
 	path->outside = outside;
 	path->motion = motion;
@@ -45,18 +48,15 @@ path_new(int interp, int closed, int outside, int motion)
 	return path;
 }
 
-void	 
+void
 path_destroy(Path *path)
 {
-	vect_f_list *lv;
 	assert(path != NULL && path->refcount == 0);
 	
-	/* Destroy point list. */
-	while (path->points != NULL) {
-		lv = path->points;
-		DL_DELETE(path->points, path->points);
-		listvect_free(lv);
-	}
+	if (path->points != NULL)
+		mem_free(path->points);
+	if (path->arclen != NULL)
+		mem_free(path->arclen);
 	memset(path, 0, sizeof(Path));
 }
 
@@ -75,14 +75,16 @@ path_free(Path *path)
 void
 path_add(Path *path, vect_f p)
 {
-	vect_f_list *lv;
-	
-	lv = listvect_new(p);
-	DL_APPEND(path->points, lv);
+	assert(path != NULL);
 	
-	path->num_points++;
-	if (path->last_point == NULL)
-		path->last_point = path->points;
+	/* Make room. */
+	if (path->num_points == path->max_points) {
+		path->max_points = path->max_points ? path->max_points * 2 : 8;
+		mem_realloc((void **)&path->points,
+		    path->max_points * sizeof(vect_f), "Path points");
+	}
+	path->points[path->num_points++] = p;
+	path->arclen_valid = 0;
 }
 
 vect_f
@@ -90,82 +92,233 @@ path_get(Path *path, int index)
 {
 	assert(path != NULL && path->num_points > 0);
 	assert(index >= 0 && index < path->num_points);
-	assert(path->last_index >= 0 && path->last_index < path->num_points);
-	assert(path->last_point != NULL);
 	
-	if (index >= path->last_index) {
-		while (index != path->last_index) {
-			path->last_index++;
-			path->last_point = path->last_point->next;
-		}
-	} else {
-		while (index != path->last_index) {
-			path->last_index--;
-			path->last_point = path->last_point->prev;
-		}
+	return path->points[index];
+}
+
+/*
+ * Set Hermite tangent tension. Zero gives a Catmull-Rom spline, one makes
+ * tangents vanish.
+ */
+void
+path_set_tension(Path *path, float tension)
+{
+	assert(path != NULL);
+	
+	path->tension = tension;
+	path->arclen_valid = 0;
+}
+
+/*
+ * Point access for segment neighbours: indices wrap around on closed paths and
+ * are clamped to first/last point on open ones.
+ */
+static vect_f
+point_at(Path *path, int i)
+{
+	int N = path->num_points;
+	
+	if (path->closed) {
+		i %= N;
+		if (i < 0)
+			i += N;
+	} else if (i < 0) {
+		i = 0;
+	} else if (i >= N) {
+		i = N - 1;
 	}
-	return path->last_point->v;
+	return path->points[i];
 }
 
+/*
+ * Number of segments. For an open path this is one less than number of points.
+ * For closed paths they're the same.
+ */
 static int
-linear(Path *path, float t, vect_f *result)
+num_segments(Path *path)
+{
+	return path->closed ? path->num_points : path->num_points - 1;
+}
+
+/*
+ * Evaluate segment i (going from point i to point i+1) at f (0..1).
+ */
+static vect_f
+segment_eval(Path *path, int i, float f)
 {
-	int i, j, N;
-	vect_f p1, p2;
-	float tfrac;
+	vect_f p0, p1, p2, p3, m1, m2, result;
+	float f2, f3, s;
 	
-	/* N is number of segments. For an open path this is one less than
-	   number of points. For closed paths they're the same. */
-	N = path->closed ? path->num_points : path->num_points - 1;
+	p1 = point_at(path, i);
+	p2 = point_at(path, i + 1);
+	if (path->interp == PATH_LINEAR) {
+		/* p = p1*(1-f) + p2*f. */
+		result.x = p1.x + (p2.x - p1.x) * f;
+		result.y = p1.y + (p2.y - p1.y) * f;
+		return result;
+	}
 	
-	switch (path->motion) {
-	case PATH_NORMAL:
-		t *= N;
-		break;
-	case PATH_PIECEWISE:
-		break;
-	case PATH_CONSTANT:
-	default:
-		fatal_error("Unsupported motion type: %i.", path->motion);
+	/* Cubic Hermite with tangents from neighbouring points. */
+	p0 = point_at(path, i - 1);
+	p3 = point_at(path, i + 2);
+	s = (path->interp == PATH_HERMITE) ? (1.0 - path->tension) / 2 : 0.5;
+	m1.x = (p2.x - p0.x) * s;
+	m1.y = (p2.y - p0.y) * s;
+	m2.x = (p3.x - p1.x) * s;
+	m2.y = (p3.y - p1.y) * s;
+	
+	f2 = f * f;
+	f3 = f2 * f;
+	result.x = (2*f3 - 3*f2 + 1) * p1.x + (f3 - 2*f2 + f) * m1.x +
+	    (-2*f3 + 3*f2) * p2.x + (f3 - f2) * m2.x;
+	result.y = (2*f3 - 3*f2 + 1) * p1.y + (f3 - 2*f2 + f) * m1.y +
+	    (-2*f3 + 3*f2) * p2.y + (f3 - f2) * m2.y;
+	return result;
+}
+
+/*
+ * Rebuild cumulative arc length table.
+ */
+static void
+build_arclen(Path *path)
+{
+	int i, k, N, S;
+	vect_f p, prev;
+	float len;
+	
+	N = num_segments(path);
+	S = (path->interp == PATH_LINEAR) ? 1 : PATH_ARCLEN_SAMPLES;
+	
+	mem_realloc((void **)&path->arclen, (N * S + 1) * sizeof(float),
+	    "Path arc length table");
+	path->num_arclen = N * S + 1;
+	
+	len = 0.0;
+	path->arclen[0] = 0.0;
+	prev = path->points[0];
+	for (i = 0; i < N; i++) {
+		for (k = 1; k <= S; k++) {
+			p = segment_eval(path, i, (float)k / S);
+			len += sqrt((p.x - prev.x) * (p.x - prev.x) +
+			    (p.y - prev.y) * (p.y - prev.y));
+			path->arclen[i * S + k] = len;
+			prev = p;
+		}
 	}
+	path->arclen_valid = 1;
+}
+
+/*
+ * Total path length (for curved paths, an approximation).
+ */
+float
+path_length(Path *path)
+{
+	assert(path != NULL);
+	if (path->num_points < 2)
+		return 0.0;
 	
-	/* i is index of point that comes before t, and j is index of point
-	   that comes after t. */
+	if (!path->arclen_valid)
+		build_arclen(path);
+	return path->arclen[path->num_arclen - 1];
+}
+
+/*
+ * Bring t into base range [0, B] according to path "outside" setting.
+ */
+static float
+wrap(Path *path, float t, float B)
+{
 	switch (path->outside) {
+	case PATH_LOOP:
+		t = fmod(t, B);
+		if (t < 0.0)
+			t += B;
+		return t;
+	case PATH_CLAMP:
+		if (t < 0.0)
+			return 0.0;
+		if (t > B)
+			return B;
+		return t;
 	case PATH_REVERSE:
-		/* If we're going in the negative direction, translate t so it
-		   maps to the same point in positive direction. */
+		/* Ping-pong: t and -t map to the same point. */
+		t = fmod(t, 2*B);
 		if (t < 0.0)
-			t = 2*N - t;
-		
-		i = ((int)floor(t)) % (2*N);
-		j = ((int)ceil(t)) % (2*N);
-		if (i >= path->num_points)
-			i = (2*N - i) % path->num_points;
-		if (j >= path->num_points)
-			j = (2*N - j) % path->num_points;
+			t += 2*B;
+		if (t > B)
+			t = 2*B - t;
+		return t;
+	default:
+		fatal_error("Invalid path outside type: %i.", path->outside);
+	}
+	/* NOTREACHED */
+	return 0.0;
+}
+
+/*
+ * Translate distance along path into piecewise time (0..N) by binary search of
+ * the arc length table.
+ */
+static float
+distance_to_piecewise(Path *path, float s)
+{
+	const float *arclen;
+	int lo, hi, mid, S;
+	float seglen;
+	
+	arclen = path->arclen;
+	S = (path->interp == PATH_LINEAR) ? 1 : PATH_ARCLEN_SAMPLES;
+	
+	/* Find last sample k such that arclen[k] <= s. */
+	lo = 0;
+	hi = path->num_arclen - 2;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (arclen[mid] <= s)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	
+	seglen = arclen[lo + 1] - arclen[lo];
+	if (seglen <= 0.0)
+		return (float)lo / S;
+	return (lo + (s - arclen[lo]) / seglen) / S;
+}
+
+/*
+ * Interpolate without argument checks; path must have at least two points and
+ * an up to date arc length table (if motion is constant).
+ */
+static vect_f
+interp(Path *path, float t)
+{
+	int i, N;
+	
+	N = num_segments(path);
+	switch (path->motion) {
+	case PATH_NORMAL:
+		t = wrap(path, t, 1.0) * N;
 		break;
-	case PATH_CLAMP:
-		i = (int)floor(t);
-		j = (int)ceil(t);
-		if (i >= N)
-			i = N;
-		if (j >= N)
-			j = N;
+	case PATH_PIECEWISE:
+		t = wrap(path, t, N);
 		break;
-	case PATH_LOOP:
-		i = ((int)floor(t)) % N;
-		j = ((int)ceil(t)) % N;
+	case PATH_CONSTANT:
+		t = wrap(path, t, 1.0) * path->arclen[path->num_arclen - 1];
+		t = distance_to_piecewise(path, t);
 		break;
+	default:
+		fatal_error("Unsupported motion type: %i.", path->motion);
 	}
 	
-	p1 = path_get(path, i);
-	p2 = path_get(path, j);
-	tfrac = t - floor(t); /* Fractional part of t. */
-
-	/* Calculate interpolation p = p1*(1-t) + p2*t. */
-	*result = vect_f_add(vect_f_scale(p1, 1-tfrac), vect_f_scale(p2, tfrac));
-	return 0;
+	/* i is index of segment that t falls on. */
+	i = (int)floor(t);
+	if (i >= N)
+		i = N - 1;
+	if (i < 0)
+		i = 0;
+	return segment_eval(path, i, t - i);
 }
 
 /*
@@ -182,17 +335,32 @@ linear(Path *path, float t, vect_f *result)
 int
 path_interp(Path *path, float t, vect_f *result)
 {
-	assert(path != NULL);
+	assert(path != NULL && result != NULL);
 	if (path->num_points < 2)
 		return 1;
 	
-	switch (path->interp) {
-	case PATH_LINEAR:
-		return linear(path, t, result);
-	default:
-		fatal_error("Interpolation type (%i) unsupported.",
-		    path->interp);
-	}
-	/* NOTREACHED */
-	return 1;
+	if (path->motion == PATH_CONSTANT && !path->arclen_valid)
+		build_arclen(path);
+	*result = interp(path, t);
+	return 0;
+}
+
+/*
+ * Same as path_interp(), but for a number of time values at once: result[i]
+ * is computed from t[i]. Use this to move many objects along the same path.
+ */
+int
+path_interp_batch(Path *path, const float *t, vect_f *result, uint count)
+{
+	uint i;
+	
+	assert(path != NULL && t != NULL && result != NULL);
+	if (path->num_points < 2)
+		return 1;
+	
+	if (path->motion == PATH_CONSTANT && !path->arclen_valid)
+		build_arclen(path);
+	for (i = 0; i < count; i++)
+		result[i] = interp(path, t[i]);
+	return 0;
 }
@@ -1,11 +1,13 @@
 #ifndef PATH_H
 #define PATH_H
 
+#include "common.h"
 #include "geometry.h"
 
 /* Type of interpolation. */
 #define PATH_LINEAR	10
-#define PATH_CUBIC	11
+#define PATH_CUBIC	11	/* Catmull-Rom spline. */
+#define PATH_HERMITE	12	/* Cubic Hermite (cardinal) spline. */
 	
 /* What happens when t falls outside of base range. */
 #define PATH_LOOP	20
@@ -17,6 +19,9 @@
 #define PATH_PIECEWISE	31
 #define PATH_CONSTANT	32
 
+/* Arc length table samples per segment for curved paths. */
+#define PATH_ARCLEN_SAMPLES	16
+
 /*
  * Path is a list of points whose values can be used for interpolation to
  * produce intermediate positions. Time (or progress) value is supplied to an
@@ -24,8 +29,10 @@
  * There are several variables (members of Path) that control the behavior of
  * this function:
  *	interp	Interpolation type. LINEAR is as if straight line segments were
- *		drawn from point to point, without any curvature. Other possible
- *		types such as CUBIC, COSINE, HERMITE produce smoother movement.
+ *		drawn from point to point, without any curvature. CUBIC
+ *		(Catmull-Rom) and HERMITE produce smooth curves that pass
+ *		through every point. HERMITE tangents are scaled by
+ *		(1 - tension); zero tension makes it the same as CUBIC.
  *	closed	Closed paths have first and last points connected. The other
  *		option would be an open path.
  *	outside	This variable controls what happens when time (t) value falls
@@ -44,20 +51,27 @@
  *		corresponds to points[1], and t=N-1 corresponds to points[N-1].
  *		CONSTANT goes from 0..1, and produces constant velocity motion
  *		(as opposed to PIECEWISE moving faster for longer intervals, and
- *		slower for shorter ones).
+ *		slower for shorter ones). It is implemented by looking up
+ *		path's cumulative arc length table (binary search), which is
+ *		rebuilt whenever points change.
  */
 typedef struct {
 	int	objtype;	/* = OBJTYPE_PATH */
 	int	refcount;	/* Reference count. */
 
-	vect_f_list	*points;
-	int		num_points;
+	vect_f	*points;	/* Point array. */
+	int	num_points;
+	int	max_points;	/* Allocated size of points array. */
 	
-	/* Index of, and pointer to, the point last accessed. */
-	int		last_index;
-	vect_f_list	*last_point;
+	/* Cumulative arc length: arclen[k] is the length of path from its
+	   first point up to sample k. There is one sample per segment for
+	   linear paths, PATH_ARCLEN_SAMPLES for curved ones. */
+	float	*arclen;
+	int	num_arclen;
+	int	arclen_valid;	/* Is table up to date with points? */
 	
-	int	interp;		/* Linear, cosine, cubic, hermite, .. */
+	int	interp;		/* Linear, cubic, hermite. */
+	float	tension;	/* Hermite tangent tension. */
 	int	closed;		/* Open or closed path. */
 	int	outside;	/* Loop, clamp, or reverse. */
 	int 	motion;		/* Normal, piecewise, constant. */
@@ -70,6 +84,10 @@ void	 path_free(Path *path);
 
 vect_f	 path_get(Path *path, int index);
 void	 path_add(Path *path, vect_f p);
+void	 path_set_tension(Path *path, float tension);
+float	 path_length(Path *path);
 int	 path_interp(Path *path, float t, vect_f *result);
+int	 path_interp_batch(Path *path, const float *t, vect_f *result,
+	     uint count);
 
 #endif /* PATH_H */
@@ -64,7 +64,10 @@ shape_destroy(Shape *s)
 	assert(body != NULL && body->objtype == OBJTYPE_BODY);
 
 	/* Remove from tree if it's in there. */
-	if (s->go.stored) {
+	if (s->flags & SHAPE_PROXIED) {
+		s->flags &= ~SHAPE_PROXIED;
+		body_update_shape_proxy(body);
+	} else if (s->go.stored) {
 		tree = &body->world->shape_tree;
 		qtree_remove(tree, &s->go);
 	}
@@ -86,35 +89,69 @@ shape_free(Shape *shape)
 	mp_free(&mp_shape, shape);
 }
 
+/*
+ * Compute shape's bounding box as if its body was at [pos].
+ */
 void
-shape_update_tree(Shape *s)
+shape_bb_at(const Shape *s, vect_f pos, BB *bb)
 {
-	BB *bb;
-	Body *body;
-	
-	/* Shorthand. */
-	body = s->body;
-	
-	/* Re-add to quad tree. */
-	bb = &s->go.bb;
 	switch (s->shape_type) {
 	case SHAPE_CIRCLE:
 		bb->l = s->shape.circle.offset.x - s->shape.circle.radius +
-		    round(body->pos.x);
+		    round(pos.x);
 		bb->b = s->shape.circle.offset.y - s->shape.circle.radius +
-		    round(body->pos.y);
+		    round(pos.y);
 		bb->r = bb->l + s->shape.circle.radius * 2;
 		bb->t = bb->b + s->shape.circle.radius * 2;
 		break;
 	case SHAPE_RECTANGLE:
-		bb->l = s->shape.rect.l + round(body->pos.x);
-		bb->b = s->shape.rect.b + round(body->pos.y);
-		bb->r = s->shape.rect.r + round(body->pos.x);
-		bb->t = s->shape.rect.t + round(body->pos.y);
+		bb->l = s->shape.rect.l + round(pos.x);
+		bb->b = s->shape.rect.b + round(pos.y);
+		bb->r = s->shape.rect.r + round(pos.x);
+		bb->t = s->shape.rect.t + round(pos.y);
 		break;
 	default:
 		log_err("Invalid shape type (%i).", s->shape_type);
 		abort();
 	}
+}
+
+/*
+ * Add shape to shape quad tree. Shapes of BODY_PROXY bodies become part of
+ * their body's proxy instead.
+ */
+void
+shape_add_tree(Shape *s)
+{
+	Body *body;
+	
+	/* Shorthand. */
+	body = s->body;
+	
+	assert(!s->go.stored && !(s->flags & SHAPE_PROXIED));
+	if (body->flags & BODY_PROXY) {
+		s->flags |= SHAPE_PROXIED;
+		body_update_shape_proxy(body);
+		return;
+	}
+	shape_bb_at(s, body->pos, &s->go.bb);
+	qtree_add(&body->world->shape_tree, &s->go);
+}
+
+void
+shape_update_tree(Shape *s)
+{
+	Body *body;
+	
+	/* Shorthand. */
+	body = s->body;
+	
+	if (s->flags & SHAPE_PROXIED) {
+		body_update_shape_proxy(body);
+		return;
+	}
+	
+	/* Re-add to quad tree. */
+	shape_bb_at(s, body->pos, &s->go.bb);
 	qtree_update(&body->world->shape_tree, &s->go);
 }
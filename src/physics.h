@@ -19,6 +19,10 @@ struct World_t;
 				   This is only used for debugging --
 				   intersecting shapes are drawn in a different
 				   color. */
+#define SHAPE_PROXIED	(1<<1)	/* Shape is in shape tree through its body's
+				   proxy (see BODY_PROXY). */
+#define SHAPE_STREAMED	(1<<2)	/* Shape belongs to a streamed room cell (see
+				   stream.h). */
 
 /*
  * Shape represents a physical shape: either rectangle or circle.
@@ -37,6 +41,8 @@ typedef struct Shape_t {
 	uint		flags;
 	
 	uint		group;		/* Collision group ID. */
+	uint		stream_index;	/* Index in streamed room file
+					   (SHAPE_STREAMED). */
 	
 	QTreeObject	go;		/* So shape can be added to quad tree.*/
 	struct Shape_t *prev, *next;	/* For use in lists. */
@@ -52,7 +58,6 @@ typedef struct {
 	int	id;		/* Index into owner object's timer list. */
 } Timer;
 
-#define BODY_CHILDREN_MAX	100
 #define BODY_TIMERS_MAX		10
 
 #define BODY_SPECIAL	(1<<0)	/* Special bodies (Camera, Parallax, static) are
@@ -61,6 +66,20 @@ typedef struct {
 				   they are not considered for collisions. */
 #define BODY_SLEEP	(1<<1)	/* If set, it is OK for body to be inactive once
 				   outside camera visibility. */
+#define BODY_FOLLOW	(1<<2)	/* Body keeps its offset from parent body (see
+				   body_link()), and is moved along with it
+				   during the hierarchy pass of each step. */
+#define BODY_FAST	(1<<3)	/* Body moves far enough in one step to pass
+				   through thin shapes. Its shapes are swept
+				   from previous to current position, and the
+				   body is pulled back to the first contact. */
+#define BODY_PROXY	(1<<4)	/* Body's tiles and shapes are represented in
+				   world quad trees by one proxy object each,
+				   covering all of them. Moving the body then
+				   updates two tree objects instead of one per
+				   tile and shape. Lookups through
+				   world_lookup_tiles() and world_lookup_shapes()
+				   expand proxies back into tiles and shapes. */
 
 typedef struct Body_t {
 	int		objtype;	/* = OBJTYPE_BODY */
@@ -77,9 +96,17 @@ typedef struct Body_t {
 
 	struct Tile_t	*tiles;		/* List of tiles. */
 	struct Shape_t	*shapes;	/* List of shapes. */
+	QTreeObject	tile_proxy;	/* Stands in for tiles (BODY_PROXY). */
+	QTreeObject	shape_proxy;	/* Stands in for shapes (BODY_PROXY). */
 
+	/* Link hierarchy. Children form a doubly linked list (head->sibling_prev
+	   points to the last child) so that linking and unlinking is O(1). */
 	struct Body_t	*parent;
-	struct Body_t	*children[BODY_CHILDREN_MAX];
+	struct Body_t	*children;	/* First child. */
+	struct Body_t	*sibling_prev, *sibling_next;
+	vect_f		link_offset;	/* Position relative to parent. */
+	int		path_bind;	/* Index into world's path_binds array,
+					   or -1 if body is not on a path. */
 	
 	/* Body step functions and timers are executed when the body is visible
 	   (or close to being inside camera view). */
@@ -100,7 +127,9 @@ void	 shape_init(Shape *t);
 Shape	*shape_new();
 void	 shape_destroy(Shape *t);
 void	 shape_free(Shape *t);
+void	 shape_add_tree(Shape *s);
 void	 shape_update_tree(Shape *s);
+void	 shape_bb_at(const Shape *s, vect_f pos, BB *bb);
 
 void	 body_init(Body *tb, struct World_t *world, vect_f pos, uint flags);
 Body	*body_new(struct World_t *world, vect_f pos, uint flags);
@@ -110,6 +139,13 @@ void	 body_free(Body *tb);
 void	 body_step(Body *tb, lua_State *L, void *script_ptr);
 void	 body_afterstep(Body *tb, lua_State *L, void *script_ptr);
 void	 body_set_pos(Body *tb, vect_f pos);
+void	 body_teleport(Body *body, vect_f pos);
+void	 body_update_tile_proxy(Body *body);
+void	 body_update_shape_proxy(Body *body);
+vect_f	 body_render_pos(const Body *body);
+void	 body_link(Body *child, Body *parent, int follow);
+void	 body_unlink(Body *child);
+void	 body_update_children(Body *parent);
 Timer	*body_add_timer(Body *body, double when, int func_id);
 void	 body_run_timers(Body *body, lua_State *L);
 
@@ -0,0 +1,335 @@
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "mem.h"
+#include "misc.h"
+#include "prof.h"
+#include "uthash.h"
+
+#define PROF_WHERE_MAX	96	/* "source:line" length limit. */
+#define PROF_STACK_MAX	2048	/* Folded stack length limit. */
+#define PROF_DEPTH_MAX	48	/* Deeper stacks are cut (innermost kept). */
+
+/* Callback function location and kind of callback. */
+typedef struct {
+	ProfKind	kind;
+	char		where[PROF_WHERE_MAX];
+} ProfKey;
+
+/* Timing of one callback function. */
+typedef struct {
+	ProfKey		key;
+	uint		calls;
+	uint64_t	total_ns;	/* Including nested callbacks. */
+	uint64_t	self_ns;	/* Excluding nested callbacks. */
+	uint64_t	max_ns;		/* Longest call. */
+	UT_hash_handle	hh;
+} ProfEntry;
+
+/* Sample count of a folded stack (or of a function, see leaf_hash). */
+typedef struct {
+	char		*stack;
+	uint		samples;
+	UT_hash_handle	hh;
+} ProfStack;
+
+static const char *kind_names[PROF_KINDS] = {
+	"other", "step", "afterstep", "timer", "collision", "key", "stream"
+};
+
+static int		 enabled;
+static int		 getfunc_ref;	/* eapi.__GetFunc() registry ref. */
+static ProfEntry	*entry_hash;
+static ProfStack	*stack_hash;	/* Sampled stacks. */
+static ProfStack	*leaf_hash;	/* Samples by innermost function. */
+static ProfKind		 cur_kind;	/* Kind of outermost callback being
+					   run (root of sampled stacks). */
+static uint64_t		 nested_ns;	/* Time in callbacks nested within the
+					   current one. */
+static uint64_t		 start_ns;
+static uint		 samples;
+static char		 report_file[256], stacks_file[256];
+
+/*
+ * Add sample to stack or function sample count.
+ */
+static void
+add_sample(ProfStack **hash, const char *stack)
+{
+	ProfStack *s;
+	uint len;
+
+	len = strlen(stack);
+	HASH_FIND(hh, *hash, stack, len, s);
+	if (s == NULL) {
+		s = mem_alloc(sizeof(ProfStack), "Profiler stack");
+		s->stack = mem_alloc(len + 1, "Profiler stack");
+		memcpy(s->stack, stack, len + 1);
+		s->samples = 0;
+		HASH_ADD_KEYPTR(hh, *hash, s->stack, len, s);
+	}
+	s->samples++;
+}
+
+/*
+ * Frame name for stack samples: "name (source:line)" or just "source:line",
+ * and "name [C]" for C functions.
+ */
+static void
+frame_name(const lua_Debug *ar, char *buf, uint size)
+{
+	if (ar->linedefined < 0)
+		snprintf(buf, size, "%s [C]", ar->name ? ar->name : "?");
+	else if (ar->name != NULL)
+		snprintf(buf, size, "%s (%s:%d)", ar->name, ar->short_src,
+		    ar->linedefined);
+	else
+		snprintf(buf, size, "%s:%d", ar->short_src, ar->linedefined);
+}
+
+/*
+ * Count hook: record current Lua stack, outermost frame first.
+ */
+static void
+sample_hook(lua_State *L, lua_Debug *hook_ar)
+{
+	lua_Debug ar[PROF_DEPTH_MAX];
+	char stack[PROF_STACK_MAX], frame[PROF_WHERE_MAX + 64];
+	uint len;
+	int i, n;
+
+	(void)hook_ar;
+	if (!enabled)
+		return;
+	for (n = 0; n < PROF_DEPTH_MAX && lua_getstack(L, n, &ar[n]); n++)
+		lua_getinfo(L, "Sn", &ar[n]);
+	if (n == 0)
+		return;
+	samples++;
+
+	len = snprintf(stack, sizeof(stack), "%s", kind_names[cur_kind]);
+	for (i = n - 1; i >= 0; i--) {
+		frame_name(&ar[i], frame, sizeof(frame));
+		if (len + 1 + strlen(frame) >= sizeof(stack))
+			break;	/* Rest won't fit. */
+		len += snprintf(stack + len, sizeof(stack) - len, ";%s", frame);
+	}
+	add_sample(&stack_hash, stack);
+
+	frame_name(&ar[0], frame, sizeof(frame));
+	add_sample(&leaf_hash, frame);
+}
+
+/*
+ * Start profiling. Every [sample_count] Lua VM instructions, the stack is
+ * sampled (0 = no sampling). [report] and [stacks] are output file names
+ * (empty = don't write).
+ */
+void
+prof_init(lua_State *L, uint sample_count, const char *report,
+    const char *stacks)
+{
+	extern int eapi_index;
+
+	lua_getfield(L, eapi_index, "__GetFunc");
+	if (!lua_isfunction(L, -1)) {
+		log_warn("eapi.__GetFunc() missing, profiler disabled.");
+		lua_pop(L, 1);
+		return;
+	}
+	getfunc_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	snprintf(report_file, sizeof(report_file), "%s", report);
+	snprintf(stacks_file, sizeof(stacks_file), "%s", stacks);
+	if (sample_count > 0)
+		lua_sethook(L, sample_hook, LUA_MASKCOUNT, sample_count);
+	start_ns = time_ns();
+	enabled = 1;
+	log_msg("Profiling scripts (sampling %s).",
+	    sample_count > 0 ? "on" : "off");
+}
+
+/*
+ * Find (or create) timing entry of callback [func_id].
+ */
+static ProfEntry *
+find_entry(lua_State *L, ProfKind kind, uint func_id)
+{
+	ProfEntry *entry;
+	ProfKey key;
+	lua_Debug ar;
+
+	memset(&key, 0, sizeof(key));	/* Padding is part of the key. */
+	key.kind = kind;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, getfunc_ref);
+	lua_pushinteger(L, func_id);
+	lua_call(L, 1, 1);				/* ... func? */
+	if (lua_isfunction(L, -1) && lua_getinfo(L, ">S", &ar)) {
+		snprintf(key.where, sizeof(key.where), "%s:%d", ar.short_src,
+		    ar.linedefined);
+	} else {
+		lua_pop(L, 1);
+		strcpy(key.where, "?");
+	}
+
+	HASH_FIND(hh, entry_hash, &key, sizeof(key), entry);
+	if (entry == NULL) {
+		entry = mem_alloc(sizeof(ProfEntry), "Profiler entry");
+		memset(entry, 0, sizeof(*entry));
+		entry->key = key;
+		HASH_ADD(hh, entry_hash, key, sizeof(key), entry);
+	}
+	return entry;
+}
+
+/*
+ * Same as lua_pcall(L, nargs, 0, errfunc) on callback [func_id], which is at
+ * the stack below its arguments. Time is recorded if profiling.
+ */
+int
+prof_pcall(lua_State *L, int nargs, int errfunc, ProfKind kind, uint func_id)
+{
+	ProfEntry *entry;
+	ProfKind outer_kind;
+	uint64_t outer_nested_ns, start, elapsed;
+	int status;
+
+	if (!enabled)
+		return lua_pcall(L, nargs, 0, errfunc);
+
+	entry = find_entry(L, kind, func_id);
+	outer_kind = cur_kind;
+	outer_nested_ns = nested_ns;
+	if (cur_kind == PROF_OTHER)
+		cur_kind = kind;
+	nested_ns = 0;
+
+	start = time_ns();
+	status = lua_pcall(L, nargs, 0, errfunc);
+	elapsed = time_ns() - start;
+
+	entry->calls++;
+	entry->total_ns += elapsed;
+	entry->self_ns += elapsed - MIN2(nested_ns, elapsed);
+	entry->max_ns = MAX2(entry->max_ns, elapsed);
+	cur_kind = outer_kind;
+	nested_ns = outer_nested_ns + elapsed;
+	return status;
+}
+
+static int
+entry_cmp(ProfEntry *a, ProfEntry *b)
+{
+	return (a->self_ns < b->self_ns) - (a->self_ns > b->self_ns);
+}
+
+static int
+stack_cmp(ProfStack *a, ProfStack *b)
+{
+	return (a->samples < b->samples) - (a->samples > b->samples);
+}
+
+static void
+write_report(uint64_t wall_ns)
+{
+	ProfEntry *entry;
+	ProfStack *s;
+	uint64_t self_ns = 0;
+	FILE *f;
+
+	if ((f = fopen(report_file, "w")) == NULL) {
+		log_warn("Could not write profile report %s.", report_file);
+		return;
+	}
+	HASH_SORT(entry_hash, entry_cmp);
+	for (entry = entry_hash; entry != NULL; entry = entry->hh.next)
+		self_ns += entry->self_ns;
+
+	fprintf(f, "%.1f s profiled, %.1f ms (%.1f%%) in callbacks.\n\n",
+	    wall_ns / 1e9, self_ns / 1e6,
+	    wall_ns > 0 ? 100.0 * self_ns / wall_ns : 0.0);
+	fprintf(f, "%9s %10s %10s %9s %9s  %-10s %s\n", "calls", "self ms",
+	    "total ms", "avg us", "max us", "kind", "function");
+	for (entry = entry_hash; entry != NULL; entry = entry->hh.next) {
+		fprintf(f, "%9u %10.2f %10.2f %9.1f %9.1f  %-10s %s\n",
+		    entry->calls, entry->self_ns / 1e6, entry->total_ns / 1e6,
+		    entry->total_ns / 1e3 / entry->calls, entry->max_ns / 1e3,
+		    kind_names[entry->key.kind], entry->key.where);
+	}
+
+	if (samples > 0) {
+		fprintf(f, "\n%u samples by function.\n\n", samples);
+		fprintf(f, "%9s %7s  %s\n", "samples", "%", "function");
+		HASH_SORT(leaf_hash, stack_cmp);
+		for (s = leaf_hash; s != NULL; s = s->hh.next) {
+			fprintf(f, "%9u %7.2f  %s\n", s->samples,
+			    100.0 * s->samples / samples, s->stack);
+		}
+	}
+	fclose(f);
+	log_msg("Profile report written to %s.", report_file);
+}
+
+static void
+write_stacks(void)
+{
+	ProfEntry *entry;
+	ProfStack *s;
+	FILE *f;
+
+	if ((f = fopen(stacks_file, "w")) == NULL) {
+		log_warn("Could not write profile stacks %s.", stacks_file);
+		return;
+	}
+	if (samples > 0) {
+		for (s = stack_hash; s != NULL; s = s->hh.next)
+			fprintf(f, "%s %u\n", s->stack, s->samples);
+	} else {
+		for (entry = entry_hash; entry != NULL; entry = entry->hh.next)
+			fprintf(f, "%s;%s %llu\n", kind_names[entry->key.kind],
+			    entry->key.where,
+			    (unsigned long long)(entry->self_ns / 1000));
+	}
+	fclose(f);
+	log_msg("Profile stacks written to %s.", stacks_file);
+}
+
+static void
+free_stacks(ProfStack **hash)
+{
+	ProfStack *s, *tmp;
+
+	HASH_ITER(hh, *hash, s, tmp) {
+		HASH_DEL(*hash, s);
+		mem_free(s->stack);
+		mem_free(s);
+	}
+}
+
+/*
+ * Write profile and stop profiling.
+ */
+void
+prof_cleanup(void)
+{
+	ProfEntry *entry, *tmp;
+
+	if (!enabled)
+		return;
+	enabled = 0;
+
+	if (report_file[0] != '\0')
+		write_report(time_ns() - start_ns);
+	if (stacks_file[0] != '\0')
+		write_stacks();
+
+	HASH_ITER(hh, entry_hash, entry, tmp) {
+		HASH_DEL(entry_hash, entry);
+		mem_free(entry);
+	}
+	free_stacks(&stack_hash);
+	free_stacks(&leaf_hash);
+	samples = 0;
+}
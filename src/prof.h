@@ -0,0 +1,44 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <lua.h>
+#include "common.h"
+
+/*
+ * Lua script profiler.
+ *
+ * All script callbacks (step functions, timers, collision handlers, key
+ * bindings, stream functions) go through eapi.__CallFunc(), so Lua's own tools
+ * can't tell them apart. When the profiler is on, each callback call is made
+ * with prof_pcall() instead of lua_pcall(): it times the call and adds the time
+ * to the callback function's definition site ("script/Forest.lua:12"),
+ * separately for each kind of callback. Time spent in callbacks called from
+ * within other callbacks is counted as total time of both, but as self time of
+ * the inner one only.
+ *
+ * Optionally, the Lua stack is also sampled every so many VM instructions
+ * (a count hook), which tells where inside the callbacks the time goes.
+ *
+ * At exit, a flat report sorted by self time is written, and a stack file in
+ * the "folded" format that flamegraph.pl reads: sampled stacks if sampling is
+ * on, otherwise callback self times in microseconds.
+ */
+
+typedef enum {
+	PROF_OTHER,		/* Outside callbacks (e.g., room scripts). */
+	PROF_STEP,
+	PROF_AFTERSTEP,
+	PROF_TIMER,
+	PROF_COLLISION,
+	PROF_KEY,
+	PROF_STREAM,
+	PROF_KINDS
+} ProfKind;
+
+void	prof_init(lua_State *L, uint sample_count, const char *report,
+	    const char *stacks);
+void	prof_cleanup(void);
+int	prof_pcall(lua_State *L, int nargs, int errfunc, ProfKind kind,
+	    uint func_id);
+
+#endif /* PROF_H */
@@ -39,14 +39,20 @@ free_node(QTreeNode *node)
 }
 
 /*
- * Initialize quad tree.
+ * Initialize quad tree. Root node initially covers 2^levels units around the
+ * origin. As objects are added outside of it, the root is replaced by larger
+ * nodes (see grow_root()); when content goes away, it shrinks back, but never
+ * below the initial size.
+ *
+ * If [loose] is nonzero, each object is stored in exactly one node (see
+ * QTree struct in qtree.h).
  */
 void
-qtree_init(QTree *tree, uint levels)
+qtree_init(QTree *tree, uint levels, int loose)
 {
 	uint halfsize;
 	
-	assert(tree != NULL && levels > 0 && levels < 21);
+	assert(tree != NULL && levels > 0 && levels <= QTREE_LEVELS_MAX);
 	
 	/* Create root node and initialize it. */
 	tree->root = new_node();
@@ -54,6 +60,122 @@ qtree_init(QTree *tree, uint levels)
 	tree->root->level = levels;
 	halfsize = 1 << (levels-1);		/* halfsize = 2^(levels-1) */
 	bb_init(&tree->root->bb, -halfsize, -halfsize, halfsize, halfsize);
+	tree->min_level = levels;
+	tree->loose = loose;
+}
+
+/*
+ * Area that objects stored in node can occupy: node's own bounding box, or in
+ * a loose tree, that box expanded by half node size on each side.
+ */
+static void
+node_bounds(const QTreeNode *node, int loose, BB *bb)
+{
+	int margin;
+	
+	*bb = node->bb;
+	if (loose) {
+		margin = node->size >> 1;
+		bb->l -= margin;
+		bb->b -= margin;
+		bb->r += margin;
+		bb->t += margin;
+	}
+}
+
+/*
+ * Grow tree until its root node encloses bounding box. Each time, the old root
+ * becomes one of the four children of a new root twice its size, extended in
+ * the direction of the bounding box. Since root corner moves by a multiple of
+ * old root size, node grid of every existing level stays where it was.
+ */
+static void
+grow_root(QTree *tree, const BB *bb)
+{
+	QTreeNode *old, *root;
+	int kid, left, bottom;
+	
+	while (bb->l < tree->root->bb.l || bb->r > tree->root->bb.r ||
+	    bb->b < tree->root->bb.b || bb->t > tree->root->bb.t) {
+		old = tree->root;
+		if (old->level >= QTREE_LEVELS_MAX) {
+			log_err("Bounding box {l=%i,r=%i,b=%i,t=%i} is outside "
+			    "largest possible partitioned space "
+			    "{l=%i,r=%i,b=%i,t=%i}. Did something fall through "
+			    "the floor?", bb->l, bb->r, bb->b, bb->t,
+			    old->bb.l, old->bb.r, old->bb.b, old->bb.t);
+			abort();
+		}
+		
+		/* Grow towards the bounding box. */
+		root = new_node();
+		root->level = old->level + 1;
+		root->size = old->size << 1;
+		root->bb = old->bb;
+		left = (bb->l < old->bb.l);
+		bottom = (bb->b < old->bb.b);
+		if (left)
+			root->bb.l -= old->size;
+		else
+			root->bb.r += old->size;
+		if (bottom)
+			root->bb.b -= old->size;
+		else
+			root->bb.t += old->size;
+		
+		/* Old root is on the opposite side (see add_object() for
+		   child indices). Empty old root is simply dropped. */
+		kid = left ? (bottom ? 3 : 2) : (bottom ? 0 : 1);
+		if (old->objects == NULL && old->kids[0] == NULL &&
+		    old->kids[1] == NULL && old->kids[2] == NULL &&
+		    old->kids[3] == NULL) {
+			free_node(old);
+		} else {
+			root->kids[kid] = old;
+			old->parent = root;
+		}
+		tree->root = root;
+	}
+}
+
+/*
+ * While the root node holds no objects and has only one child, make the child
+ * the new root (down to the initial tree size). Empty tree gets its initial
+ * root back.
+ */
+static void
+shrink_root(QTree *tree)
+{
+	QTreeNode *root, *kid;
+	int i, num_kids;
+	
+	for (;;) {
+		root = tree->root;
+		if (root->level <= tree->min_level || root->objects != NULL)
+			return;
+		num_kids = 0;
+		for (i = 0; i < 4; i++) {
+			if (root->kids[i] != NULL) {
+				kid = root->kids[i];
+				num_kids++;
+			}
+		}
+		if (num_kids == 0) {
+			/* Tree is empty: back to initial size. */
+			root->level = tree->min_level;
+			root->size = 1 << root->level;
+			bb_init(&root->bb, -(int)root->size/2, -(int)root->size/2,
+			    root->size/2, root->size/2);
+			return;
+		}
+		if (num_kids != 1)
+			return;
+		
+		memset(root->kids, 0, sizeof(root->kids));
+		free_node(root);
+		kid->parent = NULL;
+		tree->root = kid;
+	}
 }
 
 /*
@@ -98,8 +220,10 @@ destroy_node(QTreeNode *node)
 	
 	/* Destroy child nodes recursively. */
 	for (i = 0; i < 4; i++) {
-		if (node->kids[i] != NULL)
+		if (node->kids[i] != NULL) {
 			destroy_node(node->kids[i]);
+			node->kids[i] = NULL;
+		}
 	}
 	
 	/* Free node memory. */
@@ -355,89 +479,105 @@ add_object(QTreeNode *node, QTreeObject *object, vect_i *node_pos, uint num_pos)
 }
 
 /*
- * Add an object to quad tree.
- *
- * tree		The tree.
- * object	Object that is going to be added to the quad tree.
- *		Don't forget to set the bounding box member (bb), so that
- *		qtree_add() would know where in the tree this object is supposed
- *		to go.
+ * Calculate the tree level that a bounding box belongs to, and positions
+ * (bottom left corners) of the up to four nodes at that level that it
+ * intersects (in a loose tree, just one node). Node positions at each level
+ * are multiples of node size, counted from root node corner. Bounding box must
+ * fit within root node. Returns number of node positions.
  */
-void
-qtree_add(QTree *tree, QTreeObject *object)
+static uint
+node_positions(const QTree *tree, const BB *bb, uint *level,
+    vect_i node_pos[4])
 {
-	int left, right, bottom, top;
+	int left, right, bottom, top, ox, oy;
 	uint obj_size, node_size, num_pos;
-	BB *root_bb;
-	vect_i node_pos[4];
 	
-	/* Basic sanity. */
-	assert(tree != NULL && tree->root != NULL);
-	assert(object != NULL && object->ptr != NULL);
-	assert(!object->stored && !object->_visited);
-	assert(object->_level == (uint)-1);
-	assert(object->_nodes[0] == NULL && object->_nodes[1] == NULL &&
-	    object->_nodes[2] == NULL && object->_nodes[3] == NULL);
-	
-	/* Shorthand. */
-	root_bb = &tree->root->bb;
-	assert(bb_valid(*root_bb) && bb_valid(object->bb));
-	left = object->bb.l;
-	right = object->bb.r;
-	bottom = object->bb.b;
-	top = object->bb.t;
-	
-#ifndef NDEBUG
-	/* Make sure object bounding box fits inside root node. */
-	if (left < root_bb->l || right > root_bb->r ||
-	    bottom < root_bb->b || top > root_bb->t) {
-		log_err("Object (%p) with bounding box {l=%i,r=%i,b=%i,t=%i} "
-		    "is outside partitioned space {l=%i,r=%i,b=%i,t=%i}. Did "
-		    "something fall through the floor? Maybe tree depth "
-		    "argument of eapi.NewWorld() should be increased?", object,
-		    left, right, bottom, top, root_bb->l, root_bb->r,
-		    root_bb->b, root_bb->t);
-		abort();
-	}
-#endif
+	/* Bounding box relative to root corner (never negative). */
+	assert(bb_valid(*bb));
+	ox = tree->root->bb.l;
+	oy = tree->root->bb.b;
+	left = bb->l - ox;
+	right = bb->r - ox;
+	bottom = bb->b - oy;
+	top = bb->t - oy;
+	assert(left >= 0 && bottom >= 0 && right <= (int)tree->root->size &&
+	    top <= (int)tree->root->size);
 
 	/* Calculate at which node level object should be inserted. */
-	object->_level = 0;
+	*level = 0;
 	node_size = 1;
 	obj_size = MAX2(right - left, top - bottom);
 	while (node_size < obj_size) {
 		node_size <<= 1;	/* 1, 2, 4, 8, 16, .. */
-		object->_level++;
+		(*level)++;
+	}
+	
+	/* Loose tree: the one node that contains bounding box center. Its
+	   loose bounds contain all of the bounding box. */
+	if (tree->loose) {
+		node_pos[0].x = ox + ((left + right) / 2) / node_size *
+		    node_size;
+		node_pos[0].y = oy + ((bottom + top) / 2) / node_size *
+		    node_size;
+		return 1;
 	}
 	
 	/* Calculate positions of nodes (at the selected level) that object will
 	   be added to. */
-	left = (left < 0) ? -((-left-1)/node_size)-1 : left/node_size;
-	right = (right <= 0) ? -(-right/node_size)-1 : (right-1)/node_size;
-	bottom = (bottom < 0) ? -((-bottom-1)/node_size)-1 : bottom/node_size;
-	top = (top <= 0) ? -(-top/node_size)-1 : (top-1)/node_size;
+	left = left/node_size;
+	right = (right > 0) ? (right-1)/node_size : 0;
+	bottom = bottom/node_size;
+	top = (top > 0) ? (top-1)/node_size : 0;
 	assert(right >= left && top >= bottom);
 	
 	/* Create an array containing (up to 4) new node positions. */
-	node_pos[0].x = left * node_size;
-	node_pos[0].y = bottom * node_size;
+	node_pos[0].x = ox + left * node_size;
+	node_pos[0].y = oy + bottom * node_size;
 	num_pos = 1;
 	if (left != right) {
-		node_pos[1].x = right * node_size;
-		node_pos[1].y = bottom * node_size;
+		node_pos[1].x = ox + right * node_size;
+		node_pos[1].y = oy + bottom * node_size;
 		num_pos = 2;
 		if (bottom != top) {
-			node_pos[2].x = left * node_size;
-			node_pos[2].y = top * node_size;
-			node_pos[3].x = right * node_size;
-			node_pos[3].y = top * node_size;
+			node_pos[2].x = ox + left * node_size;
+			node_pos[2].y = oy + top * node_size;
+			node_pos[3].x = ox + right * node_size;
+			node_pos[3].y = oy + top * node_size;
 			num_pos = 4;
 		}
 	} else if (bottom != top) {
-		node_pos[1].x = left * node_size;
-		node_pos[1].y = top * node_size;
+		node_pos[1].x = ox + left * node_size;
+		node_pos[1].y = oy + top * node_size;
 		num_pos = 2;
 	}
+	return num_pos;
+}
+
+/*
+ * Add an object to quad tree.
+ *
+ * tree		The tree.
+ * object	Object that is going to be added to the quad tree.
+ *		Don't forget to set the bounding box member (bb), so that
+ *		qtree_add() would know where in the tree this object is supposed
+ *		to go.
+ */
+void
+qtree_add(QTree *tree, QTreeObject *object)
+{
+	uint num_pos;
+	vect_i node_pos[4];
+	
+	/* Basic sanity. */
+	assert(tree != NULL && tree->root != NULL);
+	assert(object != NULL && object->ptr != NULL);
+	assert(!object->stored && !object->_visited);
+	assert(object->_level == (uint)-1);
+	assert(object->_nodes[0] == NULL && object->_nodes[1] == NULL &&
+	    object->_nodes[2] == NULL && object->_nodes[3] == NULL);
+	
+	grow_root(tree, &object->bb);
+	num_pos = node_positions(tree, &object->bb, &object->_level, node_pos);
 	
 	/* Recursive tree traversal to add object to nodes. */
 	add_object(tree->root, object, node_pos, num_pos);
@@ -448,6 +588,209 @@ qtree_add(QTree *tree, QTreeObject *object)
 	object->stored = 1;
 }
 
+/*
+ * Object placement for qtree_build(): one per node the object goes into.
+ */
+typedef struct {
+	uint64_t	key;		/* Level and Morton code of node. */
+	uint		x, y;		/* Node position in node size units,
+					   relative to root corner. */
+	QTreeObject	*object;
+} Placement;
+
+/*
+ * Spread the low 32 bits of x out to even bit positions.
+ */
+static uint64_t
+spread_bits(uint64_t x)
+{
+	x &= 0xFFFFFFFF;
+	x = (x | x << 16) & 0x0000FFFF0000FFFFULL;
+	x = (x | x << 8) & 0x00FF00FF00FF00FFULL;
+	x = (x | x << 4) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | x << 2) & 0x3333333333333333ULL;
+	x = (x | x << 1) & 0x5555555555555555ULL;
+	return x;
+}
+
+/*
+ * Morton code: interleave the bits of x and y (y bits go into odd positions).
+ */
+static uint64_t
+morton(uint x, uint y)
+{
+	return spread_bits(x) | spread_bits(y) << 1;
+}
+
+/*
+ * Sort placements by key: LSD radix sort, one byte at a time. Bytes that are
+ * the same in all keys are skipped. [tmp] must have room for [num] placements.
+ * Returns whichever of the two buffers ends up holding the result.
+ */
+static Placement *
+sort_placements(Placement *a, Placement *tmp, uint num)
+{
+	uint count[256], i, shift, sum, c;
+	Placement *swap;
+	
+	for (shift = 0; shift < 64; shift += 8) {
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < num; i++)
+			count[(a[i].key >> shift) & 0xFF]++;
+		if (count[(a[0].key >> shift) & 0xFF] == num)
+			continue;	/* Same byte in all keys. */
+		
+		for (i = sum = 0; i < 256; i++) {
+			c = count[i];
+			count[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < num; i++)
+			tmp[count[(a[i].key >> shift) & 0xFF]++] = a[i];
+		swap = a;
+		a = tmp;
+		tmp = swap;
+	}
+	return a;
+}
+
+/*
+ * Return child [kid] of node, creating it if it doesn't exist yet.
+ */
+static QTreeNode *
+get_child(QTreeNode *node, int kid)
+{
+	QTreeNode *child;
+	uint halfsize;
+	
+	if (node->kids[kid] != NULL)
+		return node->kids[kid];
+	
+	halfsize = node->size >> 1;
+	child = new_node();
+	child->bb = node->bb;
+	switch (kid) {
+	case 0:	child->bb.r -= halfsize; child->bb.b += halfsize; break;
+	case 1:	child->bb.r -= halfsize; child->bb.t -= halfsize; break;
+	case 2:	child->bb.l += halfsize; child->bb.t -= halfsize; break;
+	case 3:	child->bb.l += halfsize; child->bb.b += halfsize; break;
+	}
+	child->level = node->level - 1;
+	child->size = halfsize;
+	child->parent = node;
+	node->kids[kid] = child;
+	return child;
+}
+
+/*
+ * Add a number of objects at once. The result is the same as calling
+ * qtree_add() for each object, but considerably faster for large batches
+ * (e.g., all the static tiles of a level).
+ *
+ * Node placements of all objects are sorted by level and Morton code of the
+ * node position, so that objects that go into the same node are adjacent, and
+ * consecutive nodes share most of their path from root. The path to previous
+ * node is kept, so each node is found by descending only from the deepest
+ * ancestor it shares with the previous one.
+ */
+void
+qtree_build(QTree *tree, QTreeObject **objects, uint num_objects)
+{
+	extern mem_pool mp_treeobjptr;
+	QTreeNode *path[32], *node;
+	QTreeObjectPtr *obj_ptr;
+	QTreeObject *object;
+	Placement *buf, *placements, *p;
+	vect_i node_pos[4];
+	uint i, j, k, num, level, root_level, d;
+	int kid;
+	
+	assert(tree != NULL && tree->root != NULL);
+	assert(objects != NULL || num_objects == 0);
+	if (num_objects == 0)
+		return;
+	
+	/* Grow tree first: node positions are relative to root corner. */
+	for (i = 0; i < num_objects; i++)
+		grow_root(tree, &objects[i]->bb);
+	
+	root_level = tree->root->level;
+	buf = mem_alloc(2 * 4 * num_objects * sizeof(Placement),
+	    "Quad tree placements");
+	
+	/* Work out node placements. Key is level in high bits, followed by
+	   node position (in units of node size, relative to root corner)
+	   as Morton code. */
+	num = 0;
+	for (i = 0; i < num_objects; i++) {
+		object = objects[i];
+		assert(object != NULL && object->ptr != NULL);
+		assert(!object->stored && !object->_visited);
+		assert(object->_level == (uint)-1);
+		
+		k = node_positions(tree, &object->bb, &object->_level,
+		    node_pos);
+		for (j = 0; j < k; j++) {
+			p = &buf[num++];
+			p->x = (node_pos[j].x - tree->root->bb.l) >>
+			    object->_level;
+			p->y = (node_pos[j].y - tree->root->bb.b) >>
+			    object->_level;
+			p->key = ((uint64_t)object->_level << 58) |
+			    morton(p->x, p->y);
+			p->object = object;
+		}
+	}
+	placements = sort_placements(buf, &buf[num], num);
+	
+	/* Walk placements, finding (or creating) each node once. */
+	path[root_level] = tree->root;
+	node = NULL;
+	for (i = 0; i < num; i++) {
+		p = &placements[i];
+		object = p->object;
+		level = object->_level;
+		if (i == 0 || p->key != p[-1].key) {
+			/* Deepest node that contains this and previous node
+			   (path from root to it is still valid). */
+			d = root_level;
+			if (i > 0 && level == p[-1].object->_level) {
+				d = level;
+				while (((p->x ^ p[-1].x) | (p->y ^ p[-1].y)) >>
+				    (d - level))
+					d++;
+			}
+			
+			/* Descend to node level. */
+			for (; d > level; d--) {
+				j = d - 1 - level;
+				kid = ((p->x >> j) & 1) ?
+				    (((p->y >> j) & 1) ? 3 : 2) :
+				    (((p->y >> j) & 1) ? 0 : 1);
+				path[d - 1] = get_child(path[d], kid);
+			}
+			node = path[level];
+		}
+		
+		/* Prepend object pointer to node's object list. */
+		obj_ptr = mp_alloc(&mp_treeobjptr);
+		obj_ptr->object = object;
+		LL_PREPEND(node->objects, obj_ptr);
+		node->num_objects++;
+		for (k = 0; k < 4; k++) {
+			if (object->_nodes[k] == NULL) {
+				object->_nodes[k] = node;
+				break;
+			}
+		}
+		assert(k < 4);
+	}
+	
+	for (i = 0; i < num_objects; i++)
+		objects[i]->stored = 1;
+	mem_free(buf);
+}
+
 static void
 remove_node_if_empty(QTreeNode *node)
 {
@@ -533,10 +876,8 @@ handle_new_node_pos(vect_i node_pos, QTreeNode *obj_nodes[],
 void
 qtree_update(QTree *tree, QTreeObject *object)
 {
-	int left, right, bottom, top, i;
-	uint obj_size, node_size, num_new_pos, num_obj_nodes, new_level;
-	BB *root_bb;
-	vect_i new_node_pos[4], newpos;
+	uint i, num_pos, num_new_pos, num_obj_nodes, new_level;
+	vect_i node_pos[4], new_node_pos[4];
 	QTreeNode *remove_from[4];
 	
 	/* Basic sanity. */
@@ -547,44 +888,10 @@ qtree_update(QTree *tree, QTreeObject *object)
 	assert(object->_nodes[0] != NULL || object->_nodes[1] != NULL ||
 	    object->_nodes[2] != NULL || object->_nodes[3] != NULL);
 	
-	/* Shorthand. */
-	root_bb = &tree->root->bb;
-	assert(bb_valid(*root_bb) && bb_valid(object->bb));
-	left = object->bb.l;
-	right = object->bb.r;
-	bottom = object->bb.b;
-	top = object->bb.t;
-	
-#ifndef NDEBUG
-	/* Make sure object bounding box fits inside root node. */
-	if (left < root_bb->l || right > root_bb->r ||
-	    bottom < root_bb->b || top > root_bb->t) {
-		log_err("Object (%p) with bounding box {l=%i,r=%i,b=%i,t=%i} "
-		    "is outside partitioned space {l=%i,r=%i,b=%i,t=%i}. Did "
-		    "something fall through the floor? Maybe tree depth "
-		    "argument of eapi.NewWorld() should be increased?", object,
-		    left, right, bottom, top, root_bb->l, root_bb->r,
-		    root_bb->b, root_bb->t);
-		abort();
-	}
-#endif
-
-	/* Calculate at which node level object should be inserted. */
-	new_level = 0;
-	node_size = 1;
-	obj_size = MAX2(right - left, top - bottom);
-	while (node_size < obj_size) {
-		node_size <<= 1;	/* 1, 2, 4, 8, 16, .. */
-		new_level++;
-	}
-	
-	/* Calculate positions of nodes (at the selected level) that object
-	   should belong to after we're done with this routine. */
-	left = (left < 0) ? -((-left-1)/node_size)-1 : left/node_size;
-	right = (right <= 0) ? -(-right/node_size)-1 : (right-1)/node_size;
-	bottom = (bottom < 0) ? -((-bottom-1)/node_size)-1 : bottom/node_size;
-	top = (top <= 0) ? -(-top/node_size)-1 : (top-1)/node_size;
-	assert(right >= left && top >= bottom);
+	/* Calculate positions of nodes that object should belong to after
+	   we're done with this routine. */
+	grow_root(tree, &object->bb);
+	num_pos = node_positions(tree, &object->bb, &new_level, node_pos);
 	
 	/* Save the nodes that object belongs to presently. We'll remove the
 	    object from these nodes later. Also clear object's node list. */
@@ -597,34 +904,12 @@ qtree_update(QTree *tree, QTreeObject *object)
 		 * handling is simple: add to new nodes, and then remove from
 		 * old nodes.
 		 */
-		
-		/* Create an array containing (up to 4) new node positions. */
-		new_node_pos[0].x = left * node_size;
-		new_node_pos[0].y = bottom * node_size;
-		num_new_pos = 1;
-		if (left != right) {
-			new_node_pos[1].x = right * node_size;
-			new_node_pos[1].y = bottom * node_size;
-			num_new_pos = 2;
-			if (bottom != top) {
-				new_node_pos[2].x = left * node_size;
-				new_node_pos[2].y = top * node_size;
-				new_node_pos[3].x = right * node_size;
-				new_node_pos[3].y = top * node_size;
-				num_new_pos = 4;
-			}
-		} else if (bottom != top) {
-			new_node_pos[1].x = left * node_size;
-			new_node_pos[1].y = top * node_size;
-			num_new_pos = 2;
-		}
-		
-		/* Recursive tree traversal to add object to new nodes. */
 		object->_level = new_level;
-		add_object(tree->root, object, new_node_pos, num_new_pos);
+		add_object(tree->root, object, node_pos, num_pos);
 		
 		/* Remove object from nodes it was previously stored in. */
 		remove_object_from_nodes(object, remove_from);
+		shrink_root(tree);
 		
 		/* Verify that object is still in the tree. */
 		assert(object->_nodes[0] != NULL || object->_nodes[1] != NULL ||
@@ -632,33 +917,11 @@ qtree_update(QTree *tree, QTreeObject *object)
 		return;
 	}
 	
-	/* Create an array containing (up to 4) new node positions. */
+	/* Keep nodes that object is still in, collect positions of new ones. */
 	num_new_pos = 0;
 	num_obj_nodes = 0;
-	newpos.x = left * node_size;
-	newpos.y = bottom * node_size;
-	handle_new_node_pos(newpos, remove_from, object->_nodes, &num_obj_nodes,
-	    new_node_pos, &num_new_pos);
-	if (left != right) {
-		newpos.x = right * node_size;
-		newpos.y = bottom * node_size;
-		handle_new_node_pos(newpos, remove_from, object->_nodes,
-		    &num_obj_nodes, new_node_pos, &num_new_pos);
-		if (bottom != top) {
-			newpos.x = left * node_size;
-			newpos.y = top * node_size;
-			handle_new_node_pos(newpos, remove_from, object->_nodes,
-			    &num_obj_nodes, new_node_pos, &num_new_pos);
-			
-			newpos.x = right * node_size;
-			newpos.y = top * node_size;
-			handle_new_node_pos(newpos, remove_from, object->_nodes,
-			    &num_obj_nodes, new_node_pos, &num_new_pos);
-		}
-	} else if (bottom != top) {
-		newpos.x = left * node_size;
-		newpos.y = top * node_size;
-		handle_new_node_pos(newpos, remove_from, object->_nodes,
+	for (i = 0; i < num_pos; i++) {
+		handle_new_node_pos(node_pos[i], remove_from, object->_nodes,
 		    &num_obj_nodes, new_node_pos, &num_new_pos);
 	}
 	
@@ -669,6 +932,7 @@ qtree_update(QTree *tree, QTreeObject *object)
 	
 	/* Remove object from nodes it was previously stored in (if any). */
 	remove_object_from_nodes(object, remove_from);
+	shrink_root(tree);
 	
 #ifndef NDEBUG
 	/* Verify that object is still in the tree. */
@@ -700,6 +964,7 @@ qtree_remove(QTree *tree, QTreeObject *object)
 	
 	/* Remove object from its nodes. */
 	remove_object_from_nodes(object, object->_nodes);
+	shrink_root(tree);
 	
 	/* Unset "stored" flag since this object is no longer stored within the
 	   quad tree. Also set level to -1 for the same purpose. */
@@ -716,6 +981,7 @@ qtree_remove(QTree *tree, QTreeObject *object)
  *		provided bounding box.
  * bb		We're looking for nodes that overlap this bounding box. If NULL,
  *		all child node objects are added unconditionally.
+ * loose	Is this a loose tree (node bounds are expanded)?
  * lookup	Result array of tree objects.
  * max_results	Max size of result array.
  * num_results	Number of objects added to lookup array.
@@ -726,11 +992,11 @@ qtree_remove(QTree *tree, QTreeObject *object)
  *		will be truncated.
  */
 static int
-lookup_objects(QTreeNode *node, const BB *bb, QTreeObject **lookup,
+lookup_objects(QTreeNode *node, const BB *bb, int loose, QTreeObject **lookup,
     uint max_results, uint *num_results)
 {
 	int i;
-	BB *child_bb;
+	BB child_bb;
 	QTreeNode *child;
 	QTreeObject *object;
 	QTreeObjectPtr *object_ptr;
@@ -763,8 +1029,8 @@ lookup_objects(QTreeNode *node, const BB *bb, QTreeObject **lookup,
 		for (i = 0; i < 4; i++) {
 			child = node->kids[i];
 			if (child != NULL) {
-				if (lookup_objects(child, NULL, lookup, max_results,
-				    num_results) != 0)
+				if (lookup_objects(child, NULL, loose, lookup,
+				    max_results, num_results) != 0)
 					return 1;
 			}
 		}
@@ -776,16 +1042,16 @@ lookup_objects(QTreeNode *node, const BB *bb, QTreeObject **lookup,
 		child = node->kids[i];
 		if (child == NULL)
 			continue;	/* Ignore empty slot. */
-		child_bb = &child->bb;
-		if (!bb_overlap(bb, child_bb))
+		node_bounds(child, loose, &child_bb);
+		if (!bb_overlap(bb, &child_bb))
 			continue;	/* No intersection with child node. */
-		if (child_bb->l >= bb->l && child_bb->b >= bb->b &&
-		    child_bb->r <= bb->r && child_bb->t <= bb->t) {
+		if (child_bb.l >= bb->l && child_bb.b >= bb->b &&
+		    child_bb.r <= bb->r && child_bb.t <= bb->t) {
 			/* Bounding box completely encloses child node. Add its
 			   objects and the objects of further child nodes
 			   unconditionally. */
-			if (lookup_objects(child, NULL, lookup, max_results,
-			    num_results) != 0)
+			if (lookup_objects(child, NULL, loose, lookup,
+			    max_results, num_results) != 0)
 				return 1;
 			continue;
 		}
@@ -793,7 +1059,8 @@ lookup_objects(QTreeNode *node, const BB *bb, QTreeObject **lookup,
 		/* Child node intersects requested bounding box. But since it
 		   it does not fall entirely within it, we pass requested
 		   bounding box as argument. */
-		if (lookup_objects(child, bb, lookup, max_results, num_results) != 0)
+		if (lookup_objects(child, bb, loose, lookup, max_results,
+		    num_results) != 0)
 			return 1;
 	}
 	return 0;
@@ -820,9 +1087,10 @@ int
 qtree_lookup(const QTree *tree, const BB *bb, QTreeObject **result,
     uint max_results, uint *num_results)
 {
-	int stat;
-	uint i;
-	BB *root_bb;
+	int stat, kid, margin;
+	uint i, halfsize;
+	QTreeNode *node;
+	BB root_bb;
 
 	assert(tree != NULL && tree->root != NULL);
 	assert(bb != NULL && bb_valid(*bb));
@@ -831,12 +1099,36 @@ qtree_lookup(const QTree *tree, const BB *bb, QTreeObject **result,
 	/* If we don't intersect root node bounding box, then no need to bother
 	   looking anything up. */
 	*num_results = 0;
-	root_bb = &tree->root->bb;
-	if (!bb_overlap(bb, root_bb))
+	node = tree->root;
+	node_bounds(node, tree->loose, &root_bb);
+	if (!bb_overlap(bb, &root_bb))
 		return 0;
 	
+	/* Skip down to the deepest node that encloses the bounding box, as
+	   long as nodes on the way hold no objects themselves. In a loose tree
+	   child bounds overlap, so bounding box must keep clear of the split
+	   lines by the margin. */
+	while (node->objects == NULL && node->level > 0) {
+		halfsize = node->size >> 1;
+		margin = tree->loose ? halfsize >> 1 : 0;
+		if (bb->r + margin <= node->bb.l + (int)halfsize)
+			kid = 1;
+		else if (bb->l - margin >= node->bb.l + (int)halfsize)
+			kid = 2;
+		else
+			break;		/* Straddles vertical split. */
+		if (bb->b - margin >= node->bb.b + (int)halfsize)
+			kid = (kid == 1) ? 0 : 3;
+		else if (bb->t + margin > node->bb.b + (int)halfsize)
+			break;		/* Straddles horizontal split. */
+		if (node->kids[kid] == NULL)
+			return 0;	/* Nothing there. */
+		node = node->kids[kid];
+	}
+	
 	/* Perform recursive lookup. */
-	stat = lookup_objects(tree->root, bb, result, max_results, num_results);
+	stat = lookup_objects(node, bb, tree->loose, result, max_results,
+	    num_results);
 	
 	/* Set visited flag for found objects to zero. */
 	for (i = 0; i < *num_results; i++) {
@@ -845,6 +1137,259 @@ qtree_lookup(const QTree *tree, const BB *bb, QTreeObject **result,
 	return stat;
 }
 
+/*
+ * Objects that ray cast and nearest queries have already passed to their
+ * callbacks. An object can be in up to four nodes, this keeps it from being
+ * considered more than once.
+ */
+static QTreeObject	**visited;
+static uint		num_visited, max_visited;
+
+static int
+mark_visited(QTreeObject *object)
+{
+	if (object->_visited)
+		return 0;
+	if (num_visited == max_visited) {
+		max_visited = max_visited ? max_visited * 2 : 256;
+		mem_realloc((void **)&visited,
+		    max_visited * sizeof(QTreeObject *), "Visited objects");
+	}
+	visited[num_visited++] = object;
+	object->_visited = 1;
+	return 1;
+}
+
+static void
+clear_visited(void)
+{
+	uint i;
+	
+	for (i = 0; i < num_visited; i++)
+		visited[i]->_visited = 0;
+	num_visited = 0;
+}
+
+/*
+ * Where ray (fraction of [delta]) enters node bounding box. Returns 0 if it
+ * misses the box, or only reaches it after [max_t].
+ */
+static int
+ray_enters_node(const BB *bb, vect_f origin, vect_f delta, double max_t,
+    double *enter)
+{
+	double t0, t1, lo, hi;
+	
+	lo = 0.0;
+	hi = max_t;
+	if (delta.x == 0.0) {
+		if (origin.x < bb->l || origin.x > bb->r)
+			return 0;
+	} else {
+		t0 = (bb->l - origin.x) / delta.x;
+		t1 = (bb->r - origin.x) / delta.x;
+		lo = MAX2(lo, MIN2(t0, t1));
+		hi = MIN2(hi, MAX2(t0, t1));
+	}
+	if (delta.y == 0.0) {
+		if (origin.y < bb->b || origin.y > bb->t)
+			return 0;
+	} else {
+		t0 = (bb->b - origin.y) / delta.y;
+		t1 = (bb->t - origin.y) / delta.y;
+		lo = MAX2(lo, MIN2(t0, t1));
+		hi = MIN2(hi, MAX2(t0, t1));
+	}
+	*enter = lo;
+	return lo <= hi;
+}
+
+/*
+ * Node bounds for a ray cast: node_bounds() grown by [ext] on each side. A box
+ * with half size [ext] swept along the ray touches what is in the node only if
+ * its center passes through these bounds.
+ */
+static void
+cast_bounds(const QTreeNode *node, int loose, vect_i ext, BB *bb)
+{
+	node_bounds(node, loose, bb);
+	bb->l -= ext.x;
+	bb->b -= ext.y;
+	bb->r += ext.x;
+	bb->t += ext.y;
+}
+
+/*
+ * Hand node's objects to ray callback, then descend into child nodes in the
+ * order ray enters them. Child nodes that ray only reaches after it has been
+ * clipped are skipped. Returns new ray length.
+ */
+static double
+raycast_node(QTreeNode *node, int loose, vect_i ext, vect_f origin,
+    vect_f delta, double max_t, QTreeRayFunc func, void *arg)
+{
+	uint i, j, num_kids;
+	double enter, kid_enter[4];
+	QTreeNode *kids[4];
+	BB kid_bb;
+	QTreeObjectPtr *object_ptr;
+	
+	for (object_ptr = node->objects; object_ptr != NULL;
+	    object_ptr = object_ptr->next) {
+		if (mark_visited(object_ptr->object))
+			max_t = func(object_ptr->object, max_t, arg);
+	}
+	
+	/* Sort child nodes by where ray enters them (insertion sort). */
+	num_kids = 0;
+	for (i = 0; i < 4; i++) {
+		if (node->kids[i] == NULL)
+			continue;
+		cast_bounds(node->kids[i], loose, ext, &kid_bb);
+		if (!ray_enters_node(&kid_bb, origin, delta, max_t, &enter))
+			continue;
+		for (j = num_kids; j > 0 && kid_enter[j-1] > enter; j--) {
+			kids[j] = kids[j-1];
+			kid_enter[j] = kid_enter[j-1];
+		}
+		kids[j] = node->kids[i];
+		kid_enter[j] = enter;
+		num_kids++;
+	}
+	
+	for (i = 0; i < num_kids && kid_enter[i] <= max_t; i++)
+		max_t = raycast_node(kids[i], loose, ext, origin, delta,
+		    max_t, func, arg);
+	return max_t;
+}
+
+/*
+ * Walk the tree along a ray from [origin] to [origin + delta], nearest nodes
+ * first, and call [func] for each object found on the way. Since [func] can
+ * shorten the ray, a "first hit" query stops looking once nothing nearer than
+ * the best hit so far can be found.
+ */
+void
+qtree_raycast(const QTree *tree, vect_f origin, vect_f delta,
+    QTreeRayFunc func, void *arg)
+{
+	double enter;
+	BB root_bb;
+	vect_i ext = {0, 0};
+	
+	assert(tree != NULL && tree->root != NULL && func != NULL);
+	
+	node_bounds(tree->root, tree->loose, &root_bb);
+	if (!ray_enters_node(&root_bb, origin, delta, 1.0, &enter))
+		return;
+	raycast_node(tree->root, tree->loose, ext, origin, delta, 1.0, func,
+	    arg);
+	clear_visited();
+}
+
+/*
+ * Same as qtree_raycast(), but for box [bb] moving along [delta]: [func] is
+ * called for objects in the nodes that the box passes, nearest nodes first.
+ */
+void
+qtree_sweep(const QTree *tree, const BB *bb, vect_f delta, QTreeRayFunc func,
+    void *arg)
+{
+	double enter;
+	BB root_bb;
+	vect_i ext;
+	vect_f origin;
+	
+	assert(tree != NULL && tree->root != NULL && func != NULL);
+	assert(bb != NULL && bb->l <= bb->r && bb->b <= bb->t);
+	
+	/* Sweep the box center, with node bounds grown by (rounded up) half
+	   box size instead. */
+	origin.x = (bb->l + bb->r) / 2.0;
+	origin.y = (bb->b + bb->t) / 2.0;
+	ext.x = (bb->r - bb->l + 1) / 2;
+	ext.y = (bb->t - bb->b + 1) / 2;
+	cast_bounds(tree->root, tree->loose, ext, &root_bb);
+	if (!ray_enters_node(&root_bb, origin, delta, 1.0, &enter))
+		return;
+	raycast_node(tree->root, tree->loose, ext, origin, delta, 1.0, func,
+	    arg);
+	clear_visited();
+}
+
+/*
+ * Branch and bound search for the nearest object: nodes closer to the point
+ * are searched first, and nodes further away than the best distance found so
+ * far are skipped.
+ */
+static void
+nearest_node(QTreeNode *node, int loose, vect_f point, QTreeDistFunc func,
+    void *arg, double *best_dist, QTreeObject **best)
+{
+	uint i, j, num_kids;
+	double dist, kid_dist[4];
+	QTreeNode *kids[4];
+	BB kid_bb;
+	QTreeObject *object;
+	QTreeObjectPtr *object_ptr;
+	
+	for (object_ptr = node->objects; object_ptr != NULL;
+	    object_ptr = object_ptr->next) {
+		object = object_ptr->object;
+		if (!mark_visited(object) ||
+		    bb_distance(&object->bb, point) >= *best_dist)
+			continue;
+		dist = func(object, arg);
+		if (dist >= 0.0 && dist < *best_dist) {
+			*best_dist = dist;
+			*best = object;
+		}
+	}
+	
+	/* Sort child nodes by distance (insertion sort). */
+	num_kids = 0;
+	for (i = 0; i < 4; i++) {
+		if (node->kids[i] == NULL)
+			continue;
+		node_bounds(node->kids[i], loose, &kid_bb);
+		dist = bb_distance(&kid_bb, point);
+		if (dist >= *best_dist)
+			continue;
+		for (j = num_kids; j > 0 && kid_dist[j-1] > dist; j--) {
+			kids[j] = kids[j-1];
+			kid_dist[j] = kid_dist[j-1];
+		}
+		kids[j] = node->kids[i];
+		kid_dist[j] = dist;
+		num_kids++;
+	}
+	
+	for (i = 0; i < num_kids && kid_dist[i] < *best_dist; i++)
+		nearest_node(kids[i], loose, point, func, arg, best_dist,
+		    best);
+}
+
+/*
+ * Find object nearest to [point], but no further than [max_dist]. Distance to
+ * each candidate is computed by [func]. Returns NULL if nothing was found,
+ * otherwise the object, and its distance in [dist].
+ */
+QTreeObject *
+qtree_nearest(const QTree *tree, vect_f point, double max_dist,
+    QTreeDistFunc func, void *arg, double *dist)
+{
+	QTreeObject *best;
+	
+	assert(tree != NULL && tree->root != NULL && func != NULL);
+	assert(dist != NULL);
+	
+	best = NULL;
+	*dist = max_dist;
+	nearest_node(tree->root, tree->loose, point, func, arg, dist, &best);
+	clear_visited();
+	return best;
+}
+
 /*
  * Initialize a QTreeObject structure.
  */
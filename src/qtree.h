@@ -48,23 +48,58 @@ typedef struct QTreeNode_t {
 	struct QTreeNode_t *kids[4];
 } QTreeNode;
 
+/* Largest tree (root node covers 2^QTREE_LEVELS_MAX units). */
+#define QTREE_LEVELS_MAX	28
+
 /*
  * Top structure of quad tree.
+ *
+ * In a regular tree an object is linked into every node (up to four) that its
+ * bounding box overlaps at the object's level. A loose tree instead treats
+ * each node as covering half its size more on every side, and links an object
+ * only into the node that holds its bounding box center. An object that moves
+ * within a node then needs no relinking, and one that crosses into another
+ * node is relinked exactly once. Lookups descend into nodes by their expanded
+ * bounds, so they still find every object that overlaps the query (possibly
+ * along with a few more distant candidates).
  */
 typedef struct {
 	QTreeNode	*root;
+	uint		min_level;	/* Root never shrinks below this. */
+	int		loose;		/* Loose tree? */
 } QTree;
 
-void	qtree_init(QTree *tree, uint levels);
+/*
+ * Ray cast callback. Called for each object in nodes that the ray passes
+ * before [max_t] (a fraction of ray length). Returns how far the ray should
+ * go on: the time of impact with the object to clip the ray there, or [max_t]
+ * unchanged to ignore it.
+ */
+typedef double (*QTreeRayFunc)(QTreeObject *object, double max_t, void *arg);
+
+/*
+ * Nearest object callback. Returns distance to object, or a negative value
+ * if the object should be ignored.
+ */
+typedef double (*QTreeDistFunc)(QTreeObject *object, void *arg);
+
+void	qtree_init(QTree *tree, uint levels, int loose);
 void	qtree_destroy(QTree *tree);
 
 void	qtree_obj_init(QTreeObject *obj, void *ptr);
 
 void	qtree_add(QTree *tree, QTreeObject *object);
+void	qtree_build(QTree *tree, QTreeObject **objects, uint num_objects);
 void	qtree_remove(QTree *tree, QTreeObject *object);
 void	qtree_update(QTree *tree, QTreeObject *object);
 
 int	qtree_lookup(const QTree *tree, const BB *bb, QTreeObject **result,
 	    uint max_results, uint *num_results);
+void	qtree_raycast(const QTree *tree, vect_f origin, vect_f delta,
+	    QTreeRayFunc func, void *arg);
+void	qtree_sweep(const QTree *tree, const BB *bb, vect_f delta,
+	    QTreeRayFunc func, void *arg);
+QTreeObject *qtree_nearest(const QTree *tree, vect_f point, double max_dist,
+	    QTreeDistFunc func, void *arg, double *dist);
 
 #endif /* QTREE_H */
@@ -0,0 +1,412 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "glcall.h"
+#include "jobs.h"
+#include "log.h"
+#include "mem.h"
+#include "physics.h"
+#include "qtree.h"
+#include "render.h"
+#include "trace.h"
+#include "vertex.h"
+#include "world.h"
+
+/* Snapshot buffers (see render.h). */
+static RenderFrame	frames[3];
+static RenderFrame	*back = &frames[0];	/* Being captured. */
+static RenderFrame	*ready = &frames[1];	/* Published. */
+static RenderFrame	*front = &frames[2];	/* Being drawn. */
+static int		captured;	/* Back buffer holds a new snapshot. */
+static int		dirty = 1;	/* Snapshot is out of date. */
+
+/* Shared with the GL thread, under glcall_lock(). */
+static int		pending;	/* Ready buffer has not been taken. */
+static int		holding;	/* Overlays of front snapshot are being
+					   drawn from world state. */
+static int		finished;	/* No more snapshots are coming. */
+
+/* How long the GL thread waits for a new snapshot before drawing the front
+   one again. */
+#define RENDER_WAIT_MS	16
+
+/* Number of tiles worker threads process at a time. */
+#define VERTEX_CHUNK	256
+
+/* Scratch space for tile lookups. */
+static QTreeObject	*visible_tiles[TILES_MAX];
+
+/*
+ * Depth comparison routine to use with qsort(). Into the screen is the negative
+ * direction, out of the screen -- positive. We want tiles sorted back to front.
+ */
+static int
+tile_depth_cmp(const void *a, const void *b)
+{
+	float a_depth, b_depth;
+	Tile *a_tile, *b_tile;
+	uint a_texid, b_texid;
+
+	a_tile = (*(QTreeObject **)a)->ptr;
+	b_tile = (*(QTreeObject **)b)->ptr;
+
+	assert(a != NULL && b != NULL);
+	assert(a_tile != b_tile);
+	assert(a_tile != NULL && a_tile->objtype == OBJTYPE_TILE);
+	assert(b_tile != NULL && b_tile->objtype == OBJTYPE_TILE);
+
+	a_depth = a_tile->depth;
+	b_depth = b_tile->depth;
+
+	/* If the depth values of both tiles are the same, compare their
+	   pointers. This will ensure that overlapping tiles with equal depth
+	   will not flicker due to differing implementations of qsort() or other
+	   factors. */
+	if (a_depth == b_depth) {
+		a_texid = a_tile->sprite_list->tex->id;
+		b_texid = b_tile->sprite_list->tex->id;
+		if (a_texid == b_texid)
+			return (a_tile < b_tile) ? -1 : 1;
+		return a_texid < b_texid ? -1 : 1;
+	}
+
+	return (a_depth < b_depth) ? -1 : 1;
+}
+
+/*
+ * Copy tile data into a render record.
+ */
+static void
+capture_tile(RenderView *view, Tile *tile)
+{
+	RenderTile *rt;
+	SpriteList *sprite_list;
+
+	/* The tile should not have been added to tree if it has no
+	   sprites. */
+	sprite_list = tile->sprite_list;
+	assert(sprite_list != NULL && sprite_list->num_frames > 0);
+
+	/* Frame index of animated tiles is kept current by
+	   tile_step_anims(). */
+	assert(!tile->hidden);
+	assert(tile->frame_index < sprite_list->num_frames);
+	assert((tile->size.x > 0 && tile->size.y > 0) ||
+	    (tile->size.x < 0 && tile->size.y < 0));
+
+	/* Make room. */
+	if (view->num_tiles == view->max_tiles) {
+		view->max_tiles = view->max_tiles ? view->max_tiles * 2 : 1024;
+		mem_realloc((void **)&view->tiles,
+		    view->max_tiles * sizeof(RenderTile), "Render tiles");
+		mem_realloc((void **)&view->verts,
+		    view->max_tiles * 4 * sizeof(RenderVertex),
+		    "Render vertices");
+	}
+	rt = &view->tiles[view->num_tiles++];
+
+	rt->tex_id = sprite_list->tex->id;
+	rt->flags = tile->flags;
+	rt->color = tile->color;
+	rt->texfrag = sprite_list->frames[tile->frame_index];
+	rt->rel_pos = tile->pos;
+	rt->angle = tile->angle;
+	assert(rt->texfrag.r > rt->texfrag.l && rt->texfrag.b > rt->texfrag.t);
+
+	/* If size is negative, use sprite size. */
+	rt->size = tile->size;
+	if (rt->size.x < 0) {
+		rt->size.x = round((rt->texfrag.r - rt->texfrag.l) *
+		    sprite_list->tex->pow_w);
+		rt->size.y = round((rt->texfrag.b - rt->texfrag.t) *
+		    sprite_list->tex->pow_h);
+	}
+
+	/* Subtract camera position from object position. */
+	rt->pos = vect_f_sub(body_render_pos(tile->body), view->cam_pos);
+}
+
+/*
+ * Job function: generate vertices for tiles [begin, end) of a view.
+ */
+static void
+gen_vertices(void *arg, uint begin, uint end)
+{
+	const RenderView *view;
+
+	view = arg;
+	vertex_gen(&view->tiles[begin], &view->verts[4*begin], end - begin);
+}
+
+/*
+ * Look up tiles that camera can see, sort them, and store their render records
+ * in view.
+ */
+static void
+capture_view(RenderView *view, Camera *cam)
+{
+	int stat;
+	uint i, j, num_tiles;
+	vect_f cam_pos;
+	vect_i halfsize;
+	Tile *tile;
+	World *world;
+	uint64_t t;
+
+	/* Camera should be bound to exactly one world (the one its body
+	   belongs to. */
+	world = cam->body.world;
+	assert(world != NULL);
+
+	view->world = world;
+	view->viewport = cam->viewport;
+	view->visible_size.x = round(cam->size.x/cam->zoom);
+	view->visible_size.y = round(cam->size.y/cam->zoom);
+	view->cam_pos = body_render_pos(&cam->body);
+	memcpy(view->bg_color, world->bg_color, sizeof(view->bg_color));
+
+	/* Visible area bounding box. */
+	halfsize.x = view->visible_size.x/2;
+	halfsize.y = view->visible_size.y/2;
+	cam_pos = vect_f_round(view->cam_pos);
+	bb_init(&view->visible_area,
+	    cam_pos.x - halfsize.x, cam_pos.y - halfsize.y,
+	    cam_pos.x + halfsize.x, cam_pos.y + halfsize.y);
+
+	/* Look up visible tiles. */
+	t = TRACE_BEGIN();
+	stat = world_lookup_tiles(world, &view->visible_area, visible_tiles,
+	    TILES_MAX, &num_tiles);
+#ifndef NDEBUG
+	if (stat != 0) {
+		log_err("Too many visible tiles.");
+		abort();
+	}
+#endif
+
+	/* Add camera tiles to the list, since those are always visible and not
+	   in quad tree. */
+	for (tile = cam->body.tiles; tile != NULL; tile = tile->next) {
+		assert(num_tiles < TILES_MAX);
+		visible_tiles[num_tiles++] = &tile->go;
+	}
+
+	/* Update parallax tiles and add them to the list as well. */
+	for (i = 0; i < WORLD_PX_PLANES_MAX; i++) {
+		if (world->px_planes[i] == NULL)
+			continue;
+		parallax_update(world->px_planes[i], cam);
+		for (tile = world->px_planes[i]->body.tiles; tile != NULL;
+		    tile = tile->next) {
+			assert(num_tiles < TILES_MAX);
+			visible_tiles[num_tiles++] = &tile->go;
+		}
+	}
+
+	/* Drop hidden tiles before sorting. */
+	for (i = j = 0; i < num_tiles; i++) {
+		tile = visible_tiles[i]->ptr;
+		if (!tile->hidden)
+			visible_tiles[j++] = visible_tiles[i];
+	}
+	num_tiles = j;
+	TRACE_END("Cull", t);
+
+	/* Sort tiles by depth, so drawing happens back to front. */
+	t = TRACE_BEGIN();
+	qsort(visible_tiles, num_tiles, sizeof(QTreeObject *), tile_depth_cmp);
+	TRACE_END("Sort", t);
+
+	/* Store render records. */
+	t = TRACE_BEGIN();
+	view->num_tiles = 0;
+	for (i = 0; i < num_tiles; i++) {
+		tile = visible_tiles[i]->ptr;
+		assert(tile->objtype == OBJTYPE_TILE);
+		capture_tile(view, tile);
+	}
+
+	/* Vertex generation only reads the records, so it can be split. */
+	jobs_run(gen_vertices, view, view->num_tiles, VERTEX_CHUNK);
+	TRACE_END("Vertices", t);
+}
+
+/*
+ * Mark snapshot as out of date. Call this whenever something that
+ * is drawn may have changed (world was stepped, Lua code was run).
+ */
+void
+render_invalidate(void)
+{
+	dirty = 1;
+}
+
+/*
+ * Capture what each camera sees into the back buffer. Does nothing if the
+ * snapshot is still up to date.
+ */
+void
+render_capture(Camera *cams[CAMERAS_MAX])
+{
+	extern Config config;
+	extern int drawShapes, drawTileTree, drawShapeTree, outsideView;
+	uint i;
+	uint64_t t;
+
+	/* Interpolated positions change every frame. */
+	if (!dirty && !config.interpolate)
+		return;
+	t = TRACE_BEGIN();
+
+	back->num_views = 0;
+	for (i = 0; i < CAMERAS_MAX; i++) {
+		if (cams[i] != NULL)
+			capture_view(&back->views[back->num_views++], cams[i]);
+	}
+	back->debug = (drawShapes ? RENDER_SHAPES : 0) |
+	    (drawTileTree ? RENDER_TILE_TREE : 0) |
+	    (drawShapeTree ? RENDER_SHAPE_TREE : 0) |
+	    (outsideView ? RENDER_OUTSIDE_VIEW : 0);
+	captured = 1;
+	dirty = 0;
+	TRACE_END("Capture", t);
+}
+
+/*
+ * Hand captured snapshot (if there is a new one) and calls posted since last
+ * time over to the GL thread.
+ */
+void
+render_publish(void)
+{
+	extern Config config;
+	RenderFrame *tmp;
+	uint64_t t;
+	int overlays;
+
+	t = TRACE_BEGIN();
+	glcall_lock();
+
+	/* Previous snapshot must have been taken. */
+	while (pending || holding)
+		glcall_wait(GLCALL_WAIT_FOREVER);
+
+	overlays = 0;
+	if (captured) {
+		tmp = ready;
+		ready = back;
+		back = tmp;
+		pending = 1;
+		captured = 0;
+		overlays = ready->debug & RENDER_OVERLAYS;
+	}
+	glcall_publish();
+	glcall_signal();
+
+	/* Overlays are drawn from world state, so keep it as captured until
+	   they have been. */
+	if (overlays && config.render_thread) {
+		while (pending || holding)
+			glcall_wait(GLCALL_WAIT_FOREVER);
+	}
+	glcall_unlock();
+	TRACE_END("Publish", t);
+}
+
+/*
+ * Simulation has ended: render_acquire() returns NULL from now on.
+ */
+void
+render_finish(void)
+{
+	glcall_lock();
+	finished = 1;
+	glcall_signal();
+	glcall_unlock();
+}
+
+/*
+ * Take the latest published snapshot for drawing (GL thread). If none has
+ * been published within RENDER_WAIT_MS, the front snapshot is returned again.
+ * [fresh] (may be NULL) is set if the snapshot is a new one.
+ *
+ * Calls published along with the snapshot are run first, while the front
+ * snapshot is still what is on screen (switch_framebuffer() draws it).
+ */
+const RenderFrame *
+render_acquire(int *fresh)
+{
+	extern Config config;
+	RenderFrame *tmp;
+	int is_new;
+
+	glcall_lock();
+	while (!pending && !finished) {
+		if (glcall_wait(RENDER_WAIT_MS))
+			break;	/* Timed out. */
+	}
+	if (finished) {
+		glcall_unlock();
+		return NULL;
+	}
+
+	glcall_run_published();
+	is_new = pending;
+	if (pending) {
+		tmp = front;
+		front = ready;
+		ready = tmp;
+		pending = 0;
+		holding = config.render_thread &&
+		    (front->debug & RENDER_OVERLAYS);
+		glcall_signal();
+	}
+	glcall_unlock();
+
+	if (fresh != NULL)
+		*fresh = is_new;
+	return front;
+}
+
+/*
+ * Overlays of the front snapshot have been drawn: simulation may go on.
+ */
+void
+render_release(void)
+{
+	glcall_lock();
+	if (holding) {
+		holding = 0;
+		glcall_signal();
+	}
+	glcall_unlock();
+}
+
+/*
+ * Return the snapshot being drawn.
+ */
+const RenderFrame *
+render_current(void)
+{
+	return front;
+}
+
+void
+render_cleanup(void)
+{
+	uint i, j;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < CAMERAS_MAX; j++) {
+			if (frames[i].views[j].tiles != NULL) {
+				mem_free(frames[i].views[j].tiles);
+				mem_free(frames[i].views[j].verts);
+			}
+		}
+	}
+	memset(frames, 0, sizeof(frames));
+	captured = pending = holding = finished = 0;
+	dirty = 1;
+}
@@ -0,0 +1,110 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "common.h"
+#include "game2d.h"
+#include "geometry.h"
+
+/*
+ * Render snapshot.
+ *
+ * Once worlds have been stepped, everything that is needed to draw what each
+ * camera sees (visible tiles in drawing order, their transforms, camera state)
+ * is copied into a RenderFrame. Drawing then reads only the snapshot and issues
+ * GL calls; it does not touch cameras, bodies, tiles or quad trees (debug
+ * overlays aside).
+ *
+ * Render records are then turned into vertices (four per tile), ready to be
+ * fed to OpenGL as vertex arrays. This part can be split between worker
+ * threads (see jobs.c).
+ *
+ * If nothing could have changed since the last capture (no world stepped, no
+ * Lua code ran, no interpolation), capturing is skipped and the same snapshot
+ * is simply drawn again.
+ *
+ * Snapshots are triple buffered, so that with a render thread (see main.c)
+ * the simulation can capture the next one while the GL thread draws another:
+ *
+ *	render_capture()	fills the back buffer (simulation thread);
+ *	render_publish()	swaps it with the ready one, along with GL calls
+ *				posted meanwhile (see glcall.h). Waits while the
+ *				previous snapshot is still ready, so simulation
+ *				runs at most one frame ahead of drawing;
+ *	render_acquire()	makes the ready buffer the front one, the one
+ *				being drawn (GL thread), after running those
+ *				calls. If there is no new snapshot within a
+ *				frame's time, the front one is drawn again.
+ *
+ * Without a render thread these simply happen in turn.
+ *
+ * Debug overlays (shapes, quad trees) are drawn from live world state rather
+ * than the snapshot. With a render thread, the simulation waits after
+ * publishing a snapshot with overlays on until it has been drawn, and a front
+ * snapshot that is drawn again is drawn without them.
+ */
+
+/*
+ * Everything needed to draw one tile.
+ */
+typedef struct {
+	uint		tex_id;		/* OpenGL texture ID. */
+	uint		flags;		/* Tile flags (flip, multiply). */
+	uint32_t	color;		/* Tile color. */
+	TexFrag		texfrag;	/* Current animation frame. */
+	vect_f		pos;		/* Body position relative to camera. */
+	vect_i		rel_pos;	/* Tile position relative to body. */
+	vect_i		size;		/* Tile size (never negative). */
+	float		angle;		/* Rotation angle. */
+} RenderTile;
+
+/*
+ * Interleaved vertex: texture coordinates, color, and position.
+ */
+typedef struct {
+	float		u, v;
+	uint32_t	color;
+	float		x, y;
+} RenderVertex;
+
+/*
+ * What one camera sees.
+ */
+typedef struct {
+	struct World_t	*world;		/* Camera's world, for debug overlays
+					   (shapes, quad trees) only. */
+	BB		viewport;	/* Viewport within window. */
+	vect_i		visible_size;	/* Visible area size (zoom applied). */
+	BB		visible_area;	/* Visible area in world coordinates. */
+	vect_f		cam_pos;	/* Position camera is drawn at. */
+	float		bg_color[4];	/* World background color. */
+
+	RenderTile	*tiles;		/* Visible tiles, back to front. */
+	RenderVertex	*verts;		/* Four vertices per tile. */
+	uint		num_tiles;
+	uint		max_tiles;	/* Allocated size of tiles array. */
+} RenderView;
+
+/* Debug drawing modes (RenderFrame.debug), as scripts have set them. */
+#define RENDER_SHAPES		0x1	/* drawShapes */
+#define RENDER_TILE_TREE	0x2	/* drawTileTree */
+#define RENDER_SHAPE_TREE	0x4	/* drawShapeTree */
+#define RENDER_OUTSIDE_VIEW	0x8	/* outsideView */
+#define RENDER_OVERLAYS		(RENDER_SHAPES | RENDER_TILE_TREE | \
+				 RENDER_SHAPE_TREE)
+
+typedef struct {
+	RenderView	views[CAMERAS_MAX];
+	uint		num_views;
+	uint		debug;		/* RENDER_* flags. */
+} RenderFrame;
+
+void		 render_invalidate(void);
+void		 render_capture(Camera *cams[CAMERAS_MAX]);
+void		 render_publish(void);
+void		 render_finish(void);
+const RenderFrame *render_acquire(int *fresh);
+void		 render_release(void);
+const RenderFrame *render_current(void);
+void		 render_cleanup(void);
+
+#endif /* RENDER_H */
@@ -0,0 +1,673 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "mem.h"
+#include "room.h"
+#include "utlist.h"
+
+/*
+ * Room file contents as they are being collected by room_save().
+ */
+typedef struct {
+	char		*strings;
+	uint		 strings_size, max_strings;
+	SpriteList	**lists;	/* Sprite lists already written. */
+	RoomSprite	*sprites;
+	uint		 num_sprites, max_sprites;
+	TexFrag		*frames;
+	uint		 num_frames, max_frames;
+	RoomCell	*cells;
+	uint		 num_cells, max_cells;
+} RoomWriter;
+
+/*
+ * Object's place in cell order (see room_save()).
+ */
+typedef struct {
+	int32_t		x, y;		/* Cell. */
+	uint		index;		/* Index into caller's object array. */
+	BB		bb;
+} CellEntry;
+
+/*
+ * Make sure a growable array has room for [need] elements.
+ */
+static void
+reserve(void **array, uint *max, uint need, size_t elem_size,
+    const char *descr)
+{
+	if (need <= *max)
+		return;
+	while (*max < need)
+		*max = *max ? *max * 2 : 64;
+	mem_realloc(array, *max * elem_size, descr);
+}
+
+/*
+ * Return string table offset of [s], adding it if it isn't there yet.
+ */
+static uint
+add_string(RoomWriter *w, const char *s)
+{
+	uint off, len;
+
+	for (off = 0; off < w->strings_size; off += len) {
+		if (strcmp(&w->strings[off], s) == 0)
+			return off;
+		len = strlen(&w->strings[off]) + 1;
+	}
+	len = strlen(s) + 1;
+	reserve((void **)&w->strings, &w->max_strings, w->strings_size + len,
+	    sizeof(char), "Room strings");
+	memcpy(&w->strings[w->strings_size], s, len);
+	w->strings_size += len;
+	return off;
+}
+
+/*
+ * Return index of sprite list within room file, adding it if necessary.
+ * Sprite lists are shared (see spritelist_new()), so comparing pointers is
+ * enough to find duplicates.
+ */
+static uint
+add_sprite(RoomWriter *w, SpriteList *list)
+{
+	RoomSprite *rs;
+	uint i;
+
+	for (i = 0; i < w->num_sprites; i++) {
+		if (w->lists[i] == list)
+			return i;
+	}
+	if (w->num_sprites == w->max_sprites) {
+		reserve((void **)&w->sprites, &w->max_sprites,
+		    w->num_sprites + 1, sizeof(RoomSprite), "Room sprites");
+		mem_realloc((void **)&w->lists,
+		    w->max_sprites * sizeof(SpriteList *), "Room sprite lists");
+	}
+	reserve((void **)&w->frames, &w->max_frames,
+	    w->num_frames + list->num_frames, sizeof(TexFrag), "Room frames");
+
+	w->lists[i] = list;
+	rs = &w->sprites[w->num_sprites++];
+	rs->texname = add_string(w, list->tex->name);
+	rs->first_frame = w->num_frames;
+	rs->num_frames = list->num_frames;
+	memcpy(&w->frames[w->num_frames], list->frames,
+	    list->num_frames * sizeof(TexFrag));
+	w->num_frames += list->num_frames;
+	return i;
+}
+
+static void
+cell_entry(CellEntry *e, const BB *bb, uint index, uint cell_size)
+{
+	e->x = floor((bb->l + bb->r) / 2.0 / cell_size);
+	e->y = floor((bb->b + bb->t) / 2.0 / cell_size);
+	e->index = index;
+	e->bb = *bb;
+}
+
+/*
+ * Order objects by cell row, then column. Objects within a cell keep their
+ * original order.
+ */
+static int
+cell_entry_cmp(const void *a, const void *b)
+{
+	const CellEntry *ea = a, *eb = b;
+
+	if (ea->y != eb->y)
+		return (ea->y < eb->y) ? -1 : 1;
+	if (ea->x != eb->x)
+		return (ea->x < eb->x) ? -1 : 1;
+	return (ea->index < eb->index) ? -1 : (ea->index > eb->index);
+}
+
+/*
+ * Add object [e] to the last cell, or start a new cell for it.
+ */
+static RoomCell *
+add_to_cell(RoomWriter *w, const CellEntry *e)
+{
+	RoomCell *cell;
+
+	cell = (w->num_cells > 0) ? &w->cells[w->num_cells - 1] : NULL;
+	if (cell != NULL && cell->x == e->x && cell->y == e->y) {
+		cell->l = MIN2(cell->l, e->bb.l);
+		cell->b = MIN2(cell->b, e->bb.b);
+		cell->r = MAX2(cell->r, e->bb.r);
+		cell->t = MAX2(cell->t, e->bb.t);
+		return cell;
+	}
+	reserve((void **)&w->cells, &w->max_cells, w->num_cells + 1,
+	    sizeof(RoomCell), "Room cells");
+	cell = &w->cells[w->num_cells++];
+	memset(cell, 0, sizeof(*cell));
+	cell->x = e->x;
+	cell->y = e->y;
+	cell->l = e->bb.l;
+	cell->b = e->bb.b;
+	cell->r = e->bb.r;
+	cell->t = e->bb.t;
+	return cell;
+}
+
+/*
+ * Build cell table from tiles and shapes sorted by cell.
+ */
+static void
+build_cells(RoomWriter *w, const CellEntry *te, uint num_tiles,
+    const CellEntry *se, uint num_shapes)
+{
+	RoomCell *cell;
+	uint i, j;
+
+	for (i = j = 0; i < num_tiles || j < num_shapes; ) {
+		if (j == num_shapes ||
+		    (i < num_tiles && cell_entry_cmp(&te[i], &se[j]) <= 0)) {
+			cell = add_to_cell(w, &te[i]);
+			if (cell->num_tiles++ == 0)
+				cell->first_tile = i;
+			i++;
+		} else {
+			cell = add_to_cell(w, &se[j]);
+			if (cell->num_shapes++ == 0)
+				cell->first_shape = j;
+			j++;
+		}
+	}
+
+	/* Empty ranges start where the previous cell's range ends, and
+	   zero-sized boxes are grown so they can overlap something. */
+	for (i = 0; i < w->num_cells; i++) {
+		cell = &w->cells[i];
+		if (cell->num_tiles == 0 && i > 0)
+			cell->first_tile = cell[-1].first_tile +
+			    cell[-1].num_tiles;
+		if (cell->num_shapes == 0 && i > 0)
+			cell->first_shape = cell[-1].first_shape +
+			    cell[-1].num_shapes;
+		cell->r = MAX2(cell->r, cell->l + 1);
+		cell->t = MAX2(cell->t, cell->b + 1);
+	}
+}
+
+/*
+ * Write static body tiles and shapes into a cooked room file, divided into
+ * cells of [cell_size] pixels. Tile animation start times are stored relative
+ * to current world time.
+ */
+int
+room_save(World *world, const char *filename, Tile **tiles, uint num_tiles,
+    Shape **shapes, uint num_shapes, uint cell_size)
+{
+	RoomWriter w;
+	RoomHeader hdr;
+	RoomTile *rt;
+	RoomShape *rs;
+	CellEntry *te, *se;
+	Group *group, *tmp, **groups;
+	Tile *tile;
+	Shape *s;
+	BB bb;
+	double now;
+	uint i;
+	FILE *f;
+	int ok;
+
+	assert(world != NULL && filename != NULL && cell_size > 0);
+	assert(num_tiles == 0 || tiles != NULL);
+	assert(num_shapes == 0 || shapes != NULL);
+	memset(&w, 0, sizeof(w));
+	now = world->step * world->step_sec;
+
+	/* Sort objects by cell. */
+	te = mem_alloc((num_tiles + 1) * sizeof(CellEntry), "Room cells");
+	for (i = 0; i < num_tiles; i++) {
+		tile_bb_at(tiles[i], world->static_body.pos, &bb);
+		cell_entry(&te[i], &bb, i, cell_size);
+	}
+	qsort(te, num_tiles, sizeof(CellEntry), cell_entry_cmp);
+	se = mem_alloc((num_shapes + 1) * sizeof(CellEntry), "Room cells");
+	for (i = 0; i < num_shapes; i++) {
+		shape_bb_at(shapes[i], world->static_body.pos, &bb);
+		cell_entry(&se[i], &bb, i, cell_size);
+	}
+	qsort(se, num_shapes, sizeof(CellEntry), cell_entry_cmp);
+	build_cells(&w, te, num_tiles, se, num_shapes);
+
+	/* Collision groups by ID. */
+	groups = mem_alloc((world->next_group_id + 1) * sizeof(Group *),
+	    "Room groups");
+	memset(groups, 0, (world->next_group_id + 1) * sizeof(Group *));
+	HASH_ITER(hh, world->groups, group, tmp)
+		groups[group->id] = group;
+
+	rt = mem_alloc((num_tiles + 1) * sizeof(RoomTile), "Room tiles");
+	for (i = 0; i < num_tiles; i++) {
+		tile = tiles[te[i].index];
+		assert(tile->body == &world->static_body);
+		rt[i].x = tile->pos.x;
+		rt[i].y = tile->pos.y;
+		rt[i].w = tile->size.x;
+		rt[i].h = tile->size.y;
+		rt[i].depth = tile->depth;
+		rt[i].angle = tile->angle;
+		rt[i].color = tile->color;
+		rt[i].flags = tile->flags & ~TILE_STREAMED;
+		rt[i].sprite = (tile->sprite_list != NULL) ?
+		    add_sprite(&w, tile->sprite_list) : ROOM_NONE;
+		rt[i].frame_index = tile->frame_index;
+		rt[i].anim_type = tile->anim_type;
+		rt[i].hidden = tile->hidden;
+		rt[i].anim_FPS = tile->anim_FPS;
+		rt[i].anim_start = tile->anim_start - now;
+	}
+
+	rs = mem_alloc((num_shapes + 1) * sizeof(RoomShape), "Room shapes");
+	for (i = 0; i < num_shapes; i++) {
+		s = shapes[se[i].index];
+		assert(s->body == &world->static_body);
+		assert(s->group <= world->next_group_id && groups[s->group]);
+		rs[i].type = s->shape_type;
+		if (s->shape_type == SHAPE_CIRCLE) {
+			rs[i].l = s->shape.circle.offset.x;
+			rs[i].b = s->shape.circle.offset.y;
+			rs[i].r = s->shape.circle.radius;
+			rs[i].t = 0;
+		} else {
+			rs[i].l = s->shape.rect.l;
+			rs[i].b = s->shape.rect.b;
+			rs[i].r = s->shape.rect.r;
+			rs[i].t = s->shape.rect.t;
+		}
+		rs[i].group = add_string(&w, groups[s->group]->name);
+		rs[i].color = s->color;
+	}
+
+	/* Pad string table so the arrays that follow stay aligned. */
+	reserve((void **)&w.strings, &w.max_strings, w.strings_size + 4,
+	    sizeof(char), "Room strings");
+	while (w.strings_size % 4 != 0)
+		w.strings[w.strings_size++] = '\0';
+
+	memcpy(hdr.magic, ROOM_MAGIC, sizeof(hdr.magic));
+	hdr.version = ROOM_VERSION;
+	hdr.strings_size = w.strings_size;
+	hdr.num_sprites = w.num_sprites;
+	hdr.num_frames = w.num_frames;
+	hdr.num_tiles = num_tiles;
+	hdr.num_shapes = num_shapes;
+	hdr.cell_size = cell_size;
+	hdr.num_cells = w.num_cells;
+
+	ok = 0;
+	if ((f = fopen(filename, "wb")) != NULL) {
+		ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+		    fwrite(w.strings, 1, w.strings_size, f) == w.strings_size &&
+		    fwrite(w.sprites, sizeof(RoomSprite), w.num_sprites, f) ==
+		    w.num_sprites &&
+		    fwrite(w.frames, sizeof(TexFrag), w.num_frames, f) ==
+		    w.num_frames &&
+		    fwrite(rt, sizeof(RoomTile), num_tiles, f) == num_tiles &&
+		    fwrite(rs, sizeof(RoomShape), num_shapes, f) == num_shapes &&
+		    fwrite(w.cells, sizeof(RoomCell), w.num_cells, f) ==
+		    w.num_cells;
+		ok = (fclose(f) == 0) && ok;
+	}
+	if (!ok)
+		log_err("[Room] Could not write '%s'.", filename);
+
+	mem_free(groups);
+	mem_free(te);
+	mem_free(se);
+	mem_free(rt);
+	mem_free(rs);
+	mem_free(w.strings);
+	if (w.cells != NULL)
+		mem_free(w.cells);
+	if (w.sprites != NULL) {
+		mem_free(w.sprites);
+		mem_free(w.lists);
+		mem_free(w.frames);
+	}
+	return ok ? ROOM_OK : ROOM_IO_ERROR;
+}
+
+/*
+ * Read whole file into memory. Returned buffer must be freed with mem_free().
+ */
+static void *
+read_file(const char *filename, size_t *size)
+{
+	FILE *f;
+	long len;
+	void *data;
+
+	if ((f = fopen(filename, "rb")) == NULL)
+		return NULL;
+	if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	data = mem_alloc(len + 1, "Room file");
+	if (fread(data, 1, len, f) != (size_t)len) {
+		mem_free(data);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	*size = len;
+	return data;
+}
+
+/*
+ * Is [off] a valid string table offset for a name shorter than [max_len]?
+ * The string table is known to end with a NUL character.
+ */
+static int
+valid_name(const RoomHeader *hdr, const char *strings, uint32_t off,
+    size_t max_len)
+{
+	return off < hdr->strings_size && strlen(&strings[off]) < max_len;
+}
+
+/*
+ * Check that the file is complete and that every index, offset and enum
+ * within it is in range, so that nothing has to be checked (or undone) while
+ * objects are being created.
+ */
+static int
+room_validate(const void *data, size_t size)
+{
+	const RoomHeader *hdr;
+	const RoomSprite *sprites;
+	const TexFrag *frames;
+	const RoomTile *rt;
+	const RoomShape *rs;
+	const RoomCell *cells;
+	const char *strings;
+	uint64_t expected;
+	uint i, j, next_tile, next_shape;
+
+	hdr = data;
+	if (size < sizeof(RoomHeader) ||
+	    memcmp(hdr->magic, ROOM_MAGIC, sizeof(hdr->magic)) != 0)
+		return ROOM_BAD_FORMAT;
+	if (hdr->version != ROOM_VERSION)
+		return ROOM_BAD_VERSION;
+
+	expected = sizeof(RoomHeader) + (uint64_t)hdr->strings_size +
+	    (uint64_t)hdr->num_sprites * sizeof(RoomSprite) +
+	    (uint64_t)hdr->num_frames * sizeof(TexFrag) +
+	    (uint64_t)hdr->num_tiles * sizeof(RoomTile) +
+	    (uint64_t)hdr->num_shapes * sizeof(RoomShape) +
+	    (uint64_t)hdr->num_cells * sizeof(RoomCell);
+	if (expected != size || hdr->strings_size % 4 != 0 ||
+	    hdr->cell_size == 0)
+		return ROOM_BAD_FORMAT;
+
+	strings = (const char *)(hdr + 1);
+	sprites = (const RoomSprite *)(strings + hdr->strings_size);
+	frames = (const TexFrag *)(sprites + hdr->num_sprites);
+	rt = (const RoomTile *)(frames + hdr->num_frames);
+	rs = (const RoomShape *)(rt + hdr->num_tiles);
+	cells = (const RoomCell *)(rs + hdr->num_shapes);
+	if (hdr->strings_size > 0 && strings[hdr->strings_size - 1] != '\0')
+		return ROOM_BAD_FORMAT;
+
+	for (i = 0; i < hdr->num_sprites; i++) {
+		if (!valid_name(hdr, strings, sprites[i].texname,
+		    TEXTURE_NAME_MAX) || sprites[i].num_frames == 0 ||
+		    sprites[i].first_frame > hdr->num_frames ||
+		    sprites[i].num_frames >
+		    hdr->num_frames - sprites[i].first_frame)
+			return ROOM_BAD_OBJECT;
+	}
+	for (i = 0; i < hdr->num_frames; i++) {
+		if (!(frames[i].r > frames[i].l && frames[i].b > frames[i].t))
+			return ROOM_BAD_OBJECT;
+	}
+	for (i = 0; i < hdr->num_tiles; i++) {
+		if (rt[i].anim_type < TILE_ANIM_NONE ||
+		    rt[i].anim_type > TILE_ANIM_REVERSE)
+			return ROOM_BAD_OBJECT;
+		if (rt[i].sprite == ROOM_NONE)
+			continue;
+		j = rt[i].sprite;
+		if (j >= hdr->num_sprites ||
+		    rt[i].frame_index >= sprites[j].num_frames ||
+		    !((rt[i].w > 0 && rt[i].h > 0) ||
+		    (rt[i].w < 0 && rt[i].h < 0)))
+			return ROOM_BAD_OBJECT;
+	}
+	for (i = 0; i < hdr->num_shapes; i++) {
+		if (!valid_name(hdr, strings, rs[i].group,
+		    WORLD_GROUPNAME_LENGTH))
+			return ROOM_BAD_OBJECT;
+		switch (rs[i].type) {
+		case SHAPE_CIRCLE:
+			if (rs[i].r < 0)
+				return ROOM_BAD_OBJECT;
+			break;
+		case SHAPE_RECTANGLE:
+			if (rs[i].l > rs[i].r || rs[i].b > rs[i].t)
+				return ROOM_BAD_OBJECT;
+			break;
+		default:
+			return ROOM_BAD_OBJECT;
+		}
+	}
+
+	/* Cell ranges must cover all objects, each exactly once. */
+	next_tile = next_shape = 0;
+	for (i = 0; i < hdr->num_cells; i++) {
+		if (cells[i].first_tile != next_tile ||
+		    cells[i].num_tiles > hdr->num_tiles - next_tile ||
+		    cells[i].first_shape != next_shape ||
+		    cells[i].num_shapes > hdr->num_shapes - next_shape ||
+		    cells[i].l >= cells[i].r || cells[i].b >= cells[i].t)
+			return ROOM_BAD_FORMAT;
+		next_tile += cells[i].num_tiles;
+		next_shape += cells[i].num_shapes;
+	}
+	if (next_tile != hdr->num_tiles || next_shape != hdr->num_shapes)
+		return ROOM_BAD_FORMAT;
+	return ROOM_OK;
+}
+
+/*
+ * Read and validate a cooked room file. Release with room_close().
+ */
+int
+room_open(const char *filename, RoomData *room)
+{
+	size_t file_size;
+	int status;
+
+	assert(filename != NULL && room != NULL);
+	memset(room, 0, sizeof(*room));
+	if ((room->data = read_file(filename, &file_size)) == NULL)
+		return ROOM_IO_ERROR;
+	if ((status = room_validate(room->data, file_size)) != ROOM_OK) {
+		mem_free(room->data);
+		room->data = NULL;
+		return status;
+	}
+
+	room->hdr = room->data;
+	room->strings = (const char *)(room->hdr + 1);
+	room->sprites = (const RoomSprite *)(room->strings +
+	    room->hdr->strings_size);
+	room->frames = (const TexFrag *)(room->sprites +
+	    room->hdr->num_sprites);
+	room->tiles = (const RoomTile *)(room->frames + room->hdr->num_frames);
+	room->shapes = (const RoomShape *)(room->tiles + room->hdr->num_tiles);
+	room->cells = (const RoomCell *)(room->shapes + room->hdr->num_shapes);
+	return ROOM_OK;
+}
+
+void
+room_close(RoomData *room)
+{
+	if (room->data != NULL)
+		mem_free(room->data);
+	memset(room, 0, sizeof(*room));
+}
+
+/*
+ * Sprite list [index] of room file (and its texture), created if necessary.
+ */
+SpriteList *
+room_sprite(const RoomData *room, uint index)
+{
+	const RoomSprite *sprite;
+
+	assert(index < room->hdr->num_sprites);
+	sprite = &room->sprites[index];
+	return spritelist_new(
+	    texture_lookup_or_create(&room->strings[sprite->texname]),
+	    (TexFrag *)&room->frames[sprite->first_frame], sprite->num_frames);
+}
+
+/*
+ * Create tile [index] of room file within world's static body. Tile's bounding
+ * box is set, but adding it to the quad tree is left to the caller (there's
+ * nothing to add if it has no sprite list). [sprite_list] is the tile's sprite
+ * list, as returned by room_sprite().
+ */
+Tile *
+room_new_tile(World *world, const RoomData *room, uint index,
+    SpriteList *sprite_list)
+{
+	const RoomTile *rt;
+	Body *body;
+	Tile *tile;
+	vect_i pos, size;
+	double now;
+
+	assert(index < room->hdr->num_tiles);
+	rt = &room->tiles[index];
+	body = &world->static_body;
+	pos.x = rt->x;
+	pos.y = rt->y;
+	size.x = rt->w;
+	size.y = rt->h;
+	tile = tile_new(body, pos, size, sprite_list, rt->depth);
+	tile->angle = rt->angle;
+	tile->color = rt->color;
+	tile->flags = rt->flags;
+	tile->frame_index = rt->frame_index;
+	tile->hidden = (rt->hidden != 0);
+	if (rt->anim_type != TILE_ANIM_NONE) {
+		now = world->step * world->step_sec;
+		tile_set_anim(tile, rt->anim_type, rt->anim_FPS,
+		    now + rt->anim_start);
+	}
+	tile_bb_at(tile, body->pos, &tile->go.bb);
+	return tile;
+}
+
+/*
+ * Create shape [index] of room file within world's static body. Like with
+ * tiles, adding it to the quad tree is left to the caller.
+ */
+Shape *
+room_new_shape(World *world, const RoomData *room, uint index)
+{
+	const RoomShape *rs;
+	Body *body;
+	Shape *s;
+
+	assert(index < room->hdr->num_shapes);
+	rs = &room->shapes[index];
+	body = &world->static_body;
+	s = shape_new();
+	s->shape_type = rs->type;
+	if (rs->type == SHAPE_CIRCLE) {
+		s->shape.circle.offset.x = rs->l;
+		s->shape.circle.offset.y = rs->b;
+		s->shape.circle.radius = rs->r;
+	} else {
+		bb_init(&s->shape.rect, rs->l, rs->b, rs->r, rs->t);
+	}
+	s->body = body;
+	DL_APPEND(body->shapes, s);
+	s->group = world_get_group(world, &room->strings[rs->group])->id;
+	s->color = rs->color;
+	shape_bb_at(s, body->pos, &s->go.bb);
+	return s;
+}
+
+/*
+ * Create the tiles and shapes of a cooked room within world's static body.
+ * The whole file is validated first, so on failure nothing has been created.
+ * Number of created objects is stored in [num_tiles] and [num_shapes].
+ */
+int
+room_load(World *world, const char *filename, uint *num_tiles,
+    uint *num_shapes)
+{
+	RoomData room;
+	const RoomTile *rt;
+	SpriteList **lists;
+	QTreeObject **objects;
+	Tile *tile;
+	uint i, num_objects;
+	int status;
+
+	assert(world != NULL && filename != NULL);
+	if ((status = room_open(filename, &room)) != ROOM_OK)
+		return status;
+
+	/* Sprite lists (and their textures). */
+	lists = mem_alloc((room.hdr->num_sprites + 1) * sizeof(SpriteList *),
+	    "Room sprite lists");
+	for (i = 0; i < room.hdr->num_sprites; i++)
+		lists[i] = room_sprite(&room, i);
+
+	/* Objects are collected and added to quad trees all at once. */
+	objects = mem_alloc((MAX2(room.hdr->num_tiles, room.hdr->num_shapes) +
+	    1) * sizeof(QTreeObject *), "Room tree objects");
+
+	num_objects = 0;
+	for (i = 0; i < room.hdr->num_tiles; i++) {
+		rt = &room.tiles[i];
+		tile = room_new_tile(world, &room, i,
+		    (rt->sprite != ROOM_NONE) ? lists[rt->sprite] : NULL);
+		if (tile->sprite_list != NULL)
+			objects[num_objects++] = &tile->go;
+	}
+	qtree_build(&world->tile_tree, objects, num_objects);
+
+	for (i = 0; i < room.hdr->num_shapes; i++)
+		objects[i] = &room_new_shape(world, &room, i)->go;
+	qtree_build(&world->shape_tree, objects, room.hdr->num_shapes);
+
+	if (num_tiles != NULL)
+		*num_tiles = room.hdr->num_tiles;
+	if (num_shapes != NULL)
+		*num_shapes = room.hdr->num_shapes;
+	mem_free(objects);
+	mem_free(lists);
+	room_close(&room);
+	return ROOM_OK;
+}
+
+const char *
+room_statstr(int status)
+{
+	switch (status) {
+	case ROOM_OK: return "OK.";
+	case ROOM_IO_ERROR: return "Could not read or write room file.";
+	case ROOM_BAD_FORMAT: return "Not a room file, or truncated.";
+	case ROOM_BAD_VERSION: return "Room file version mismatch.";
+	case ROOM_BAD_OBJECT: return "Invalid object in room file.";
+	default: return "Unknown status code.";
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include "common.h"
+#include "game2d.h"
+#include "physics.h"
+#include "world.h"
+
+/*
+ * Cooked rooms.
+ *
+ * Room scenery (static body tiles and shapes) is normally built by running
+ * edit scripts that create objects one at a time through eapi. A cooked room
+ * file holds the same objects in packed arrays, so that they can be recreated
+ * in one go without any Lua involvement:
+ *
+ *	RoomHeader
+ *	char		strings[strings_size]	NUL-terminated, padded to 4 bytes
+ *	RoomSprite	sprites[num_sprites]
+ *	TexFrag		frames[num_frames]	sprite list frames
+ *	RoomTile	tiles[num_tiles]
+ *	RoomShape	shapes[num_shapes]
+ *	RoomCell	cells[num_cells]
+ *
+ * Names (texture names, collision group names) are stored as offsets into the
+ * string table. All fields are 32 bits wide and stored in host byte order;
+ * cooked files are a cache, not an interchange format.
+ *
+ * The room is divided into square cells of cell_size pixels. Every object
+ * belongs to the cell its bounding box center is in, and objects are stored
+ * sorted by cell, so that each cell owns a range of tiles and a range of shapes.
+ * Rooms that are streamed (see stream.h) are created one cell at a time.
+ */
+
+#define ROOM_MAGIC	"LRDR"
+#define ROOM_VERSION	2
+#define ROOM_NONE	0xFFFFFFFF	/* No sprite list. */
+#define ROOM_CELL_SIZE	512		/* Default cell size. */
+
+typedef struct {
+	char		magic[4];	/* = ROOM_MAGIC */
+	uint32_t	version;	/* = ROOM_VERSION */
+	uint32_t	strings_size;
+	uint32_t	num_sprites;
+	uint32_t	num_frames;
+	uint32_t	num_tiles;
+	uint32_t	num_shapes;
+	uint32_t	cell_size;
+	uint32_t	num_cells;
+} RoomHeader;
+
+typedef struct {
+	uint32_t	texname;	/* Texture name (string offset). */
+	uint32_t	first_frame;	/* Index into frames array. */
+	uint32_t	num_frames;
+} RoomSprite;
+
+typedef struct {
+	int32_t		x, y;		/* Position relative to static body. */
+	int32_t		w, h;		/* Size (negative = sprite size). */
+	float		depth;
+	float		angle;
+	uint32_t	color;
+	uint32_t	flags;
+	uint32_t	sprite;		/* Sprite list index or ROOM_NONE. */
+	uint32_t	frame_index;
+	uint32_t	anim_type;
+	uint32_t	hidden;
+	float		anim_FPS;
+	float		anim_start;	/* Relative to world time at load. */
+} RoomTile;
+
+typedef struct {
+	uint32_t	type;		/* SHAPE_CIRCLE or SHAPE_RECTANGLE. */
+	int32_t		l, b, r, t;	/* Circle: offset x, offset y, radius. */
+	uint32_t	group;		/* Collision group name (string offset). */
+	uint32_t	color;
+} RoomShape;
+
+typedef struct {
+	int32_t		x, y;		/* Cell position in cell_size units. */
+	int32_t		l, b, r, t;	/* Bounding box of cell's objects. */
+	uint32_t	first_tile;	/* Tile range. */
+	uint32_t	num_tiles;
+	uint32_t	first_shape;	/* Shape range. */
+	uint32_t	num_shapes;
+} RoomCell;
+
+/* Validated room file in memory (see room_open()). */
+typedef struct {
+	void			*data;
+	const RoomHeader	*hdr;
+	const char		*strings;
+	const RoomSprite	*sprites;
+	const TexFrag		*frames;
+	const RoomTile		*tiles;
+	const RoomShape		*shapes;
+	const RoomCell		*cells;
+} RoomData;
+
+/* Return codes. */
+enum {
+	ROOM_OK,
+	ROOM_IO_ERROR,
+	ROOM_BAD_FORMAT,
+	ROOM_BAD_VERSION,
+	ROOM_BAD_OBJECT
+};
+
+int		 room_save(World *world, const char *filename, Tile **tiles,
+		    uint num_tiles, Shape **shapes, uint num_shapes,
+		    uint cell_size);
+int		 room_load(World *world, const char *filename, uint *num_tiles,
+		    uint *num_shapes);
+const char	*room_statstr(int status);
+
+int		 room_open(const char *filename, RoomData *room);
+void		 room_close(RoomData *room);
+SpriteList	*room_sprite(const RoomData *room, uint index);
+Tile		*room_new_tile(World *world, const RoomData *room, uint index,
+		    SpriteList *sprite_list);
+Shape		*room_new_shape(World *world, const RoomData *room, uint index);
+
+#endif /* ROOM_H */
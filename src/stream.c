@@ -0,0 +1,460 @@
+#include <assert.h>
+#include <lua.h>
+#include <math.h>
+#include <string.h>
+#include "config.h"
+#include "game2d.h"
+#include "log.h"
+#include "mem.h"
+#include "misc.h"
+#include "physics.h"
+#include "prof.h"
+#include "room.h"
+#include "stream.h"
+#include "trace.h"
+
+#define STREAM_BATCH	16	/* Objects created between budget checks. */
+
+/* Cell states. */
+enum {
+	CELL_UNLOADED,
+	CELL_LOADING,		/* Some of cell's objects have been created. */
+	CELL_LOADED
+};
+
+typedef struct Stream_t {
+	RoomData	room;
+	SpriteList	**lists;	/* Sprite lists by room file index,
+					   created when first needed. */
+	Tile		**tiles;	/* Created tiles by room file index. */
+	Shape		**shapes;	/* Created shapes by room file index. */
+	uchar		*state;		/* Cell states. */
+	uint		*progress;	/* Objects created so far in each cell
+					   (tiles first, then shapes). */
+	int		loading;	/* Cell being loaded in the background
+					   (-1 = none). */
+	StreamStats	stats;
+} Stream;
+
+static uint	generation;	/* Incremented as streams are closed. */
+
+/*
+ * Start streaming cooked room [filename] into world. Nothing is created until
+ * stream_update() is called. Number of tiles and shapes in the room is stored
+ * in [num_tiles] and [num_shapes].
+ */
+int
+stream_open(World *world, const char *filename, uint *num_tiles,
+    uint *num_shapes)
+{
+	Stream *st;
+	const RoomHeader *hdr;
+	int status;
+
+	assert(world != NULL && filename != NULL);
+	st = mem_alloc(sizeof(Stream), "Stream");
+	memset(st, 0, sizeof(*st));
+	if ((status = room_open(filename, &st->room)) != ROOM_OK) {
+		mem_free(st);
+		return status;
+	}
+	stream_close(world);
+
+	hdr = st->room.hdr;
+	st->lists = mem_alloc((hdr->num_sprites + 1) * sizeof(SpriteList *),
+	    "Stream sprite lists");
+	memset(st->lists, 0, (hdr->num_sprites + 1) * sizeof(SpriteList *));
+	st->tiles = mem_alloc((hdr->num_tiles + 1) * sizeof(Tile *),
+	    "Stream tiles");
+	memset(st->tiles, 0, (hdr->num_tiles + 1) * sizeof(Tile *));
+	st->shapes = mem_alloc((hdr->num_shapes + 1) * sizeof(Shape *),
+	    "Stream shapes");
+	memset(st->shapes, 0, (hdr->num_shapes + 1) * sizeof(Shape *));
+	st->state = mem_alloc(hdr->num_cells + 1, "Stream cell states");
+	memset(st->state, CELL_UNLOADED, hdr->num_cells + 1);
+	st->progress = mem_alloc((hdr->num_cells + 1) * sizeof(uint),
+	    "Stream cell progress");
+	memset(st->progress, 0, (hdr->num_cells + 1) * sizeof(uint));
+	st->loading = -1;
+	st->stats.cells = hdr->num_cells;
+
+	world->stream = st;
+	if (num_tiles != NULL)
+		*num_tiles = hdr->num_tiles;
+	if (num_shapes != NULL)
+		*num_shapes = hdr->num_shapes;
+	log_msg("Streaming room %s (%u cells of %u px).", filename,
+	    hdr->num_cells, hdr->cell_size);
+	return ROOM_OK;
+}
+
+/*
+ * Stop streaming. Objects that have been created stay in world's static body.
+ */
+void
+stream_close(World *world)
+{
+	Stream *st;
+
+	assert(world != NULL);
+	if ((st = world->stream) == NULL)
+		return;
+	world->stream = NULL;
+	generation++;
+
+	mem_free(st->progress);
+	mem_free(st->state);
+	mem_free(st->shapes);
+	mem_free(st->tiles);
+	mem_free(st->lists);
+	room_close(&st->room);
+	mem_free(st);
+}
+
+/*
+ * Create up to STREAM_BATCH more objects of cell [c]. Returns true once all of
+ * cell's objects have been created.
+ */
+static int
+load_batch(World *world, Stream *st, uint c)
+{
+	QTreeObject *tiles[STREAM_BATCH], *shapes[STREAM_BATCH];
+	const RoomCell *cell;
+	const RoomTile *rt;
+	SpriteList *list;
+	Tile *tile;
+	Shape *s;
+	uint n, end, i, num_tiles, num_shapes;
+
+	cell = &st->room.cells[c];
+	end = cell->num_tiles + cell->num_shapes;
+	num_tiles = num_shapes = 0;
+	for (n = st->progress[c]; n < end && num_tiles + num_shapes <
+	    STREAM_BATCH; n++) {
+		if (n < cell->num_tiles) {
+			i = cell->first_tile + n;
+			rt = &st->room.tiles[i];
+			list = NULL;
+			if (rt->sprite != ROOM_NONE) {
+				if (st->lists[rt->sprite] == NULL) {
+					st->lists[rt->sprite] =
+					    room_sprite(&st->room, rt->sprite);
+				}
+				list = st->lists[rt->sprite];
+			}
+			tile = room_new_tile(world, &st->room, i, list);
+			tile->flags |= TILE_STREAMED;
+			tile->stream_index = i;
+			st->tiles[i] = tile;
+			st->stats.tiles++;
+			if (list != NULL)
+				tiles[num_tiles++] = &tile->go;
+		} else {
+			i = cell->first_shape + (n - cell->num_tiles);
+			s = room_new_shape(world, &st->room, i);
+			s->flags |= SHAPE_STREAMED;
+			s->stream_index = i;
+			st->shapes[i] = s;
+			st->stats.shapes++;
+			shapes[num_shapes++] = &s->go;
+		}
+	}
+	qtree_build(&world->tile_tree, tiles, num_tiles);
+	qtree_build(&world->shape_tree, shapes, num_shapes);
+	st->progress[c] = n;
+	st->state[c] = (n == end) ? CELL_LOADED : CELL_LOADING;
+	return n == end;
+}
+
+/*
+ * Destroy whatever has been created of cell [c].
+ */
+static void
+unload_cell(Stream *st, uint c)
+{
+	const RoomCell *cell;
+	uint i;
+
+	cell = &st->room.cells[c];
+	for (i = cell->first_tile; i < cell->first_tile + cell->num_tiles;
+	    i++) {
+		if (st->tiles[i] == NULL)
+			continue;
+		tile_free(st->tiles[i]);
+		st->tiles[i] = NULL;
+		st->stats.tiles--;
+	}
+	for (i = cell->first_shape; i < cell->first_shape + cell->num_shapes;
+	    i++) {
+		if (st->shapes[i] == NULL)
+			continue;
+		shape_free(st->shapes[i]);
+		st->shapes[i] = NULL;
+		st->stats.shapes--;
+	}
+	if (st->state[c] == CELL_LOADED)
+		st->stats.loaded--;
+	st->state[c] = CELL_UNLOADED;
+	st->progress[c] = 0;
+	if (st->loading == (int)c)
+		st->loading = -1;
+	st->stats.unloads++;
+}
+
+/*
+ * Call world's stream function for cell [c]. Returns false if the script got
+ * rid of the stream (e.g., by clearing the world), in which case [st] must not
+ * be touched anymore.
+ */
+static int
+call_func(World *world, lua_State *L, Stream *st, uint c, int loaded)
+{
+	extern int callfunc_index, errfunc_index;
+	const RoomCell *cell;
+	uint func_id, gen;
+
+	if ((func_id = world->stream_func_id) == 0)
+		return 1;
+	cell = &st->room.cells[c];
+	gen = generation;
+
+	lua_pushvalue(L, callfunc_index);
+	lua_pushinteger(L, func_id);
+	lua_pushboolean(L, 0);		/* Do not remove function. */
+	lua_pushlightuserdata(L, world);
+	lua_pushinteger(L, cell->x);
+	lua_pushinteger(L, cell->y);
+	lua_pushboolean(L, loaded);
+	if (prof_pcall(L, 6, errfunc_index, PROF_STREAM, func_id)) {
+		log_err("[Lua] %s", lua_tostring(L, -1));
+		abort();
+	}
+	return gen == generation && world->stream == st && !world->killme;
+}
+
+/*
+ * Bounding box of cell [c]'s objects in world coordinates.
+ */
+static void
+cell_bb(const World *world, const Stream *st, uint c, BB *bb)
+{
+	const RoomCell *cell;
+	int x, y;
+
+	cell = &st->room.cells[c];
+	x = round(world->static_body.pos.x);
+	y = round(world->static_body.pos.y);
+	bb_init(bb, cell->l + x, cell->b + y, cell->r + x, cell->t + y);
+}
+
+static int
+overlaps_any(const BB *bb, const BB *boxes, uint n)
+{
+	uint i;
+
+	for (i = 0; i < n; i++) {
+		if (bb_overlap(bb, &boxes[i]))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Squared distance from the center of [bb] to the nearest camera center.
+ */
+static int64_t
+cell_distance(const BB *bb, const vect_i *centers, uint n)
+{
+	int64_t dx, dy, d, best;
+	uint i;
+
+	best = INT64_MAX;
+	for (i = 0; i < n; i++) {
+		dx = (bb->l + bb->r) / 2 - centers[i].x;
+		dy = (bb->b + bb->t) / 2 - centers[i].y;
+		d = dx*dx + dy*dy;
+		best = MIN2(best, d);
+	}
+	return best;
+}
+
+/*
+ * Create and destroy streamed room cells according to where world's cameras
+ * are (see stream.h). Background loading takes at most [*budget_ns], which is
+ * reduced by the time it took; cells that cameras already see are created
+ * regardless.
+ */
+void
+stream_update(World *world, lua_State *L, uint64_t *budget_ns)
+{
+	extern Camera *cameras[CAMERAS_MAX];
+	extern Config config;
+	BB view[CAMERAS_MAX], near[CAMERAS_MAX], far[CAMERAS_MAX], bb;
+	vect_i center[CAMERAS_MAX], half;
+	uint64_t start, t, elapsed, trace_start;
+	int64_t d, best_d;
+	uint i, c, num_views, num_cells, margin, unload_margin;
+	int best, complete;
+	Stream *st;
+	Camera *cam;
+
+	if ((st = world->stream) == NULL || world->killme)
+		return;
+	start = time_ns();
+	trace_start = TRACE_BEGIN();
+
+	/* What cameras see, and the areas to load and keep around it. */
+	margin = config.stream_margin;
+	unload_margin = MAX2(config.stream_unload_margin, margin);
+	for (i = num_views = 0; i < CAMERAS_MAX; i++) {
+		if ((cam = cameras[i]) == NULL || cam->body.world != world)
+			continue;
+		center[num_views].x = round(cam->body.pos.x);
+		center[num_views].y = round(cam->body.pos.y);
+		half.x = round(cam->size.x / cam->zoom / 2);
+		half.y = round(cam->size.y / cam->zoom / 2);
+		bb_init(&view[num_views],
+		    center[num_views].x - half.x, center[num_views].y - half.y,
+		    center[num_views].x + half.x, center[num_views].y + half.y);
+		bb_init(&near[num_views],
+		    view[num_views].l - margin, view[num_views].b - margin,
+		    view[num_views].r + margin, view[num_views].t + margin);
+		bb_init(&far[num_views],
+		    view[num_views].l - unload_margin,
+		    view[num_views].b - unload_margin,
+		    view[num_views].r + unload_margin,
+		    view[num_views].t + unload_margin);
+		num_views++;
+	}
+	if (num_views == 0)
+		goto done;	/* Keep what there is until there's a camera. */
+	num_cells = st->room.hdr->num_cells;
+
+	/* Destroy cells that are far from all cameras. */
+	for (c = 0; c < num_cells; c++) {
+		if (st->state[c] == CELL_UNLOADED)
+			continue;
+		cell_bb(world, st, c, &bb);
+		if (overlaps_any(&bb, far, num_views))
+			continue;
+		if (st->state[c] == CELL_LOADED &&
+		    !call_func(world, L, st, c, 0))
+			goto gone;
+		t = time_ns();
+		unload_cell(st, c);
+		st->stats.unload_ns += time_ns() - t;
+	}
+
+	/* Create visible cells right away. */
+	for (c = 0; c < num_cells; c++) {
+		if (st->state[c] == CELL_LOADED)
+			continue;
+		cell_bb(world, st, c, &bb);
+		if (!overlaps_any(&bb, view, num_views))
+			continue;
+		t = time_ns();
+		while (!load_batch(world, st, c))
+			;
+		st->stats.load_ns += time_ns() - t;
+		st->stats.loaded++;
+		st->stats.loads++;
+		if (st->loading == (int)c)
+			st->loading = -1;
+		if (!call_func(world, L, st, c, 1))
+			goto gone;
+	}
+
+	/* Create nearby cells while there's time, nearest first. */
+	while (*budget_ns > 0) {
+		if (st->loading < 0) {
+			best = -1;
+			best_d = INT64_MAX;
+			for (c = 0; c < num_cells; c++) {
+				if (st->state[c] == CELL_LOADED)
+					continue;
+				cell_bb(world, st, c, &bb);
+				if (!overlaps_any(&bb, near, num_views))
+					continue;
+				d = cell_distance(&bb, center, num_views);
+				if (d < best_d) {
+					best_d = d;
+					best = c;
+				}
+			}
+			if (best < 0)
+				break;	/* Everything nearby is loaded. */
+			st->loading = best;
+		}
+		c = st->loading;
+		t = time_ns();
+		complete = load_batch(world, st, c);
+		elapsed = time_ns() - t;
+		st->stats.load_ns += elapsed;
+		*budget_ns -= MIN2(elapsed, *budget_ns);
+		if (!complete)
+			continue;
+		st->stats.loaded++;
+		st->stats.loads++;
+		st->loading = -1;
+		if (!call_func(world, L, st, c, 1))
+			goto gone;
+	}
+
+done:
+	st->stats.frame_ns = time_ns() - start;
+gone:
+	/* If a script closed the stream, there are no stats to update, but the
+	   time spent still goes into the trace. */
+	TRACE_END("Stream", trace_start);
+}
+
+/*
+ * Called when a streamed tile or shape (TILE_STREAMED or SHAPE_STREAMED flag)
+ * is about to be destroyed by other means than streaming, so that the stream
+ * won't destroy it again. Objects left over from a stream that has since been
+ * closed are not found at their index, and are ignored.
+ */
+void
+stream_forget(void *object)
+{
+	World *world;
+	Stream *st;
+	uint i;
+
+	switch (*(int *)object) {
+	case OBJTYPE_TILE:
+		world = ((Tile *)object)->body->world;
+		if ((st = world->stream) == NULL)
+			return;
+		i = ((Tile *)object)->stream_index;
+		if (i < st->room.hdr->num_tiles && st->tiles[i] == object) {
+			st->tiles[i] = NULL;
+			st->stats.tiles--;
+		}
+		break;
+	case OBJTYPE_SHAPE:
+		world = ((Shape *)object)->body->world;
+		if ((st = world->stream) == NULL)
+			return;
+		i = ((Shape *)object)->stream_index;
+		if (i < st->room.hdr->num_shapes && st->shapes[i] == object) {
+			st->shapes[i] = NULL;
+			st->stats.shapes--;
+		}
+		break;
+	default:
+		assert(0);
+	}
+}
+
+/*
+ * Get streaming statistics. Returns false if world isn't streaming a room.
+ */
+int
+stream_get_stats(const World *world, StreamStats *stats)
+{
+	if (world->stream == NULL)
+		return 0;
+	*stats = world->stream->stats;
+	return 1;
+}
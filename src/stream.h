@@ -0,0 +1,54 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <lua.h>
+#include <stdint.h>
+#include "common.h"
+#include "world.h"
+
+/*
+ * Streamed rooms.
+ *
+ * Loading a cooked room (see room.h) creates all of its tiles and shapes, and
+ * they stay until the world is cleared. A streamed room instead keeps the room
+ * file in memory, and stream_update() creates and destroys the objects one cell
+ * at a time, depending on where the world's cameras are:
+ *
+ *	- cells that a camera sees are created right away;
+ *	- cells within [streamMargin] pixels of what a camera sees are created a
+ *	  few objects at a time, nearest first, for as long as the frame's time
+ *	  budget lasts;
+ *	- cells farther than [streamUnloadMargin] pixels from what every camera
+ *	  sees are destroyed.
+ *
+ * Streamed objects are static scenery: there is no way for scripts to have
+ * pointers to them, other than through collision handlers and lookups. Bodies
+ * that are stepped far away from cameras (those without the BODY_SLEEP flag)
+ * find no ground there.
+ *
+ * Scripts may set a function that is called once a cell has been created and
+ * before it is destroyed (see world->stream_func_id), to keep state that goes
+ * with the cell. It is not called when the whole world is cleared.
+ */
+
+/* Streaming statistics. */
+typedef struct {
+	uint		cells;		/* Cells in room. */
+	uint		loaded;		/* Cells fully created. */
+	uint		tiles;		/* Tiles currently created. */
+	uint		shapes;		/* Shapes currently created. */
+	uint		loads;		/* Cells created so far. */
+	uint		unloads;	/* Cells destroyed so far. */
+	uint64_t	load_ns;	/* Time spent creating cells. */
+	uint64_t	unload_ns;	/* Time spent destroying cells. */
+	uint64_t	frame_ns;	/* Time spent in last stream_update(). */
+} StreamStats;
+
+int	stream_open(World *world, const char *filename, uint *num_tiles,
+	    uint *num_shapes);
+void	stream_close(World *world);
+void	stream_update(World *world, lua_State *L, uint64_t *budget_ns);
+void	stream_forget(void *object);
+int	stream_get_stats(const World *world, StreamStats *stats);
+
+#endif /* STREAM_H */
@@ -0,0 +1,159 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL.h>
+#include "log.h"
+#include "mem.h"
+#include "trace.h"
+
+/* Recorded event. */
+typedef struct {
+	const char	*name;
+	uint64_t	start, end;	/* Nanoseconds (see time_ns()). */
+	uint32_t	tid;		/* SDL_ThreadID() of recording thread. */
+	uint32_t	seq;		/* Event number + 1 once written, 0 while
+					   being written. */
+} TraceEvent;
+
+int			 trace_on;
+static TraceEvent	*ring;
+static uint32_t		 ring_mask;	/* Ring size - 1 (size is 2^n). */
+static uint		 ring_size;
+static uint32_t		 head;		/* Number of next event. */
+static uint64_t		 trace_start_ns;
+static uint32_t		 main_tid;
+
+/*
+ * Set ring buffer size to hold at least [max_events] events. The buffer is
+ * allocated when recording is first started.
+ */
+void
+trace_init(uint max_events)
+{
+	assert(ring == NULL);
+	for (ring_size = 1024; ring_size < max_events &&
+	    ring_size < (1U << 24); ring_size *= 2)
+		;
+	ring_mask = ring_size - 1;
+	main_tid = SDL_ThreadID();
+}
+
+void
+trace_cleanup(void)
+{
+	trace_on = 0;
+	if (ring != NULL) {
+		mem_free(ring);
+		ring = NULL;
+	}
+}
+
+/*
+ * Start recording into an empty buffer. Call with no other threads running
+ * markers.
+ */
+void
+trace_start(void)
+{
+	assert(ring_size > 0);
+	if (ring == NULL)
+		ring = mem_alloc(ring_size * sizeof(TraceEvent), "Trace ring");
+	memset(ring, 0, ring_size * sizeof(TraceEvent));
+	head = 0;
+	trace_start_ns = time_ns();
+	__sync_synchronize();
+	trace_on = 1;
+}
+
+void
+trace_stop(void)
+{
+	trace_on = 0;
+}
+
+/*
+ * Record event that started at [start] and ends now. Use TRACE_END() instead.
+ */
+void
+trace_add(const char *name, uint64_t start)
+{
+	TraceEvent *ev;
+	uint64_t end;
+	uint32_t n;
+
+	end = time_ns();
+	n = __sync_fetch_and_add(&head, 1);
+	ev = &ring[n & ring_mask];
+	ev->seq = 0;
+	__sync_synchronize();
+	ev->name = name;
+	ev->start = start;
+	ev->end = end;
+	ev->tid = SDL_ThreadID();
+	__sync_synchronize();
+	ev->seq = n + 1;
+}
+
+/*
+ * Copy event number [n] out of the ring. Returns false if it has been (or is
+ * being) overwritten.
+ */
+static int
+read_event(uint32_t n, TraceEvent *copy)
+{
+	const volatile TraceEvent *ev;
+
+	ev = &ring[n & ring_mask];
+	if (ev->seq != n + 1)
+		return 0;
+	__sync_synchronize();
+	copy->name = ev->name;
+	copy->start = ev->start;
+	copy->end = ev->end;
+	copy->tid = ev->tid;
+	__sync_synchronize();
+	return ev->seq == n + 1;
+}
+
+/*
+ * Write recorded events into [filename] as Chrome trace event JSON. Recording
+ * goes on. Returns 0 on success, -1 if nothing was recorded or the file could
+ * not be written.
+ */
+int
+trace_dump(const char *filename)
+{
+	TraceEvent ev;
+	uint32_t n, end, written;
+	FILE *f;
+
+	if (ring == NULL || head == 0)
+		return -1;
+	if ((f = fopen(filename, "w")) == NULL) {
+		log_warn("Could not write trace %s.", filename);
+		return -1;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+	    "\"tid\":%u,\"args\":{\"name\":\"Main\"}}", main_tid);
+
+	end = head;
+	n = (end > ring_mask) ? end - ring_mask : 0;
+	for (written = 0; n < end; n++) {
+		if (!read_event(n, &ev) || ev.start < trace_start_ns)
+			continue;
+		fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+		    "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ev.name, ev.tid,
+		    (ev.start - trace_start_ns) / 1e3,
+		    (ev.end - ev.start) / 1e3);
+		written++;
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f) != 0) {
+		log_warn("Could not write trace %s.", filename);
+		return -1;
+	}
+	log_msg("Trace with %u events written to %s.", written, filename);
+	return 0;
+}
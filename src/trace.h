@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "misc.h"
+
+/*
+ * Frame timeline trace.
+ *
+ * Code that wants to show up on the timeline is wrapped in a pair of markers:
+ *
+ *	start = TRACE_BEGIN();
+ *	...
+ *	TRACE_END("Collisions", start);
+ *
+ * While recording, each pair adds one event (name, thread, start and end time)
+ * to a ring buffer; the oldest events are overwritten. Any thread may add
+ * events: a slot is claimed with an atomic increment, so there are no locks.
+ * trace_dump() writes the events that are in the buffer as Chrome trace event
+ * JSON (load into chrome://tracing or ui.perfetto.dev).
+ *
+ * When not recording, the markers only test a flag. Names must be string
+ * constants, since only the pointer is stored.
+ */
+
+extern int	trace_on;	/* Recording? Read only. */
+
+#define TRACE_BEGIN()	(trace_on ? time_ns() : 0)
+#define TRACE_END(name, start)						\
+do {									\
+	if (trace_on && (start) != 0)					\
+		trace_add((name), (start));				\
+} while (0)
+
+void	trace_init(uint max_events);
+void	trace_cleanup(void);
+void	trace_start(void);
+void	trace_stop(void);
+void	trace_add(const char *name, uint64_t start);
+int	trace_dump(const char *filename);
+
+#endif /* TRACE_H */
@@ -0,0 +1,136 @@
+#include <math.h>
+#include "vertex.h"
+
+#if defined(__SSE2__) && !defined(NO_SIMD)
+#define VERTEX_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * For each flip combination (TILE_FLIP_X | TILE_FLIP_Y) and each corner (BL,
+ * BR, TR, TL): which members of TexFrag, taken as an array {l, b, r, t}, give
+ * corner's u and v. Texture is upside down (t < b); flipping swaps left/right
+ * or top/bottom.
+ */
+static const uchar uv_swizzle[4][4][2] = {
+	{ {0, 1}, {2, 1}, {2, 3}, {0, 3} },	/* No flip. */
+	{ {2, 1}, {0, 1}, {0, 3}, {2, 3} },	/* FLIP_X */
+	{ {0, 3}, {2, 3}, {2, 1}, {0, 1} },	/* FLIP_Y */
+	{ {2, 3}, {0, 3}, {0, 1}, {2, 1} }	/* FLIP_X | FLIP_Y */
+};
+
+#ifdef VERTEX_SSE2
+
+/*
+ * Corner positions, one corner per lane. Sine and cosine are computed once per
+ * tile.
+ */
+static void
+gen_positions(const RenderTile *rt, RenderVertex *v)
+{
+	__m128 cx, cy, x, y, cs, sn;
+	float x0, x1, y0, y1, out_x[4], out_y[4];
+	int c;
+
+	x0 = rt->rel_pos.x;
+	x1 = rt->rel_pos.x + rt->size.x;
+	y0 = rt->rel_pos.y;
+	y1 = rt->rel_pos.y + rt->size.y;
+
+	/* _mm_set_ps() takes lanes last to first: BL, BR, TR, TL. */
+	cx = _mm_set_ps(x0, x1, x1, x0);
+	cy = _mm_set_ps(y1, y1, y0, y0);
+
+	if (rt->angle != 0.0) {
+		cs = _mm_set1_ps(cosf(rt->angle));
+		sn = _mm_set1_ps(sinf(rt->angle));
+		x = _mm_sub_ps(_mm_mul_ps(cx, cs), _mm_mul_ps(cy, sn));
+		y = _mm_add_ps(_mm_mul_ps(cx, sn), _mm_mul_ps(cy, cs));
+		cx = x;
+		cy = y;
+	}
+	x = _mm_add_ps(cx, _mm_set1_ps(rt->pos.x));
+	y = _mm_add_ps(cy, _mm_set1_ps(rt->pos.y));
+
+	/* Vertices are interleaved, so scatter lanes back out. */
+	_mm_storeu_ps(out_x, x);
+	_mm_storeu_ps(out_y, y);
+	for (c = 0; c < 4; c++) {
+		v[c].x = out_x[c];
+		v[c].y = out_y[c];
+	}
+}
+
+#else /* VERTEX_SSE2 */
+
+/*
+ * Corner positions, scalar version. Sine and cosine are computed once per tile.
+ */
+static void
+gen_positions(const RenderTile *rt, RenderVertex *v)
+{
+	float cx[4], cy[4], px, py, cs, sn;
+	int c;
+
+	cx[0] = cx[3] = rt->rel_pos.x;
+	cx[1] = cx[2] = rt->rel_pos.x + rt->size.x;
+	cy[0] = cy[1] = rt->rel_pos.y;
+	cy[2] = cy[3] = rt->rel_pos.y + rt->size.y;
+	px = rt->pos.x;
+	py = rt->pos.y;
+
+	if (rt->angle != 0.0) {
+		cs = cosf(rt->angle);
+		sn = sinf(rt->angle);
+		for (c = 0; c < 4; c++) {
+			v[c].x = cx[c] * cs - cy[c] * sn + px;
+			v[c].y = cx[c] * sn + cy[c] * cs + py;
+		}
+	} else {
+		for (c = 0; c < 4; c++) {
+			v[c].x = cx[c] + px;
+			v[c].y = cy[c] + py;
+		}
+	}
+}
+
+#endif /* VERTEX_SSE2 */
+
+/*
+ * Generate vertices for [n] render records. Corners are produced in BL, BR, TR,
+ * TL order.
+ */
+void
+vertex_gen(const RenderTile *rt, RenderVertex *v, uint n)
+{
+	const uchar (*sw)[2];
+	const float *tf;
+	uint i;
+	int c;
+
+	for (i = 0; i < n; i++, rt++, v += 4) {
+		gen_positions(rt, v);
+
+		/* Texture coordinates and color. */
+		tf = &rt->texfrag.l;
+		sw = uv_swizzle[rt->flags & (TILE_FLIP_X | TILE_FLIP_Y)];
+		for (c = 0; c < 4; c++) {
+			v[c].u = tf[sw[c][0]];
+			v[c].v = tf[sw[c][1]];
+			v[c].color = rt->color;
+		}
+	}
+}
+
+/*
+ * Name of the kernel this build uses (for logs and benchmarks).
+ */
+const char *
+vertex_kernel_name(void)
+{
+#ifdef VERTEX_SSE2
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
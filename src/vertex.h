@@ -0,0 +1,18 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include "render.h"
+
+/*
+ * Tile vertex generation: turn render records into four vertices each.
+ *
+ * Where SSE2 is available at compile time (always on x86-64, -msse2 on 32-bit
+ * x86) the four corner positions of a tile are computed in one register, one
+ * corner per lane. Elsewhere, or when built with NO_SIMD, plain scalar code is
+ * used. Both produce the same vertices.
+ */
+
+void		vertex_gen(const RenderTile *rt, RenderVertex *v, uint n);
+const char	*vertex_kernel_name(void);
+
+#endif /* VERTEX_H */
@@ -1,10 +1,16 @@
 #include <SDL.h>
 #include <assert.h>
 #include <math.h>
+#include "collide.h"
+#include "config.h"
 #include "world.h"
 #include "game2d.h"
 #include "log.h"
 #include "lua_util.h"
+#include "prof.h"
+#include "render.h"
+#include "stream.h"
+#include "trace.h"
 #include "utlist.h"
 
 /* Collision distance defines how far, for a given shape [S], we look for other
@@ -27,7 +33,9 @@ static uint num_iter_bodies = 0;
 uint iter_body_count = 0;
 
 /*
- * Remember current body positions.
+ * Remember current body positions. All bodies are done, not just the nearby
+ * ones in iter_bodies: a body may be moved (or drawn) without taking part in
+ * the step, and must not then interpolate from where it was long ago.
  */
 static void
 save_prev_body_positions(World *world, int first_step)
@@ -41,12 +49,8 @@ save_prev_body_positions(World *world, int first_step)
 	assert(world->static_body.prevstep_pos.x == world->static_body.pos.x &&
 	    world->static_body.prevstep_pos.y == world->static_body.pos.y);
 	
-	/* Save body positions. Do this only for the nearby bodies saved in
-	   iter_bodies array. */
-	for (i = 0; i < num_iter_bodies; i++) {
-		body = iter_bodies[i];
-		assert(body != NULL);	/* Bodies should not have been removed
-					   at this point. */
+	/* Save body positions. */
+	for (body = world->bodies; body != NULL; body = body->next) {
 		if (first_step)
 			body->prevframe_pos = body->pos;
 		body->prevstep_pos = body->pos;
@@ -72,9 +76,108 @@ save_prev_body_positions(World *world, int first_step)
 	}
 }
 
+/*
+ * Store [object] in result slot [i] if that is free (NULL), otherwise append
+ * it. Returns nonzero if there's no room.
+ */
+static int
+put_result(QTreeObject **result, uint i, QTreeObject *object,
+    uint max_results, uint *num_results)
+{
+	if (result[i] == NULL) {
+		result[i] = object;
+		return 0;
+	}
+	if (*num_results == max_results)
+		return 1;
+	result[(*num_results)++] = object;
+	return 0;
+}
+
+/*
+ * Replace body proxies (see BODY_PROXY) among tree lookup results with those
+ * of the bodies' tiles (if [tiles] is set) or shapes that overlap [bb].
+ * Returns nonzero if some did not fit into [max_results].
+ */
+static int
+expand_proxies(const BB *bb, int tiles, QTreeObject **result,
+    uint max_results, uint *num_results)
+{
+	int stat;
+	uint i, j, num_found;
+	Body *body;
+	Tile *tile;
+	Shape *s;
+	
+	stat = 0;
+	num_found = *num_results;
+	for (i = 0; i < num_found; i++) {
+		body = result[i]->ptr;
+		if (body->objtype != OBJTYPE_BODY)
+			continue;
+		
+		/* Proxy slot is reused for the first member, the rest are
+		   appended. */
+		result[i] = NULL;
+		if (tiles) {
+			for (tile = body->tiles; tile != NULL; tile = tile->next) {
+				if ((tile->flags & TILE_PROXIED) &&
+				    bb_overlap(bb, &tile->go.bb))
+					stat |= put_result(result, i, &tile->go,
+					    max_results, num_results);
+			}
+		} else {
+			for (s = body->shapes; s != NULL; s = s->next) {
+				if ((s->flags & SHAPE_PROXIED) &&
+				    bb_overlap(bb, &s->go.bb))
+					stat |= put_result(result, i, &s->go,
+					    max_results, num_results);
+			}
+		}
+	}
+	
+	/* Close the gaps left by proxies with nothing to add. */
+	for (i = j = 0; i < *num_results; i++) {
+		if (result[i] != NULL)
+			result[j++] = result[i];
+	}
+	*num_results = j;
+	return stat;
+}
+
+/*
+ * Look up tiles that (possibly) overlap [bb]. Same as qtree_lookup() on world's
+ * tile tree, except that results are always tiles, even for bodies that are in
+ * the tree as a whole.
+ */
+int
+world_lookup_tiles(const World *world, const BB *bb, QTreeObject **result,
+    uint max_results, uint *num_results)
+{
+	int stat;
+	
+	stat = qtree_lookup(&world->tile_tree, bb, result, max_results,
+	    num_results);
+	return expand_proxies(bb, 1, result, max_results, num_results) || stat;
+}
+
+/*
+ * Same as world_lookup_tiles(), but for shapes.
+ */
+int
+world_lookup_shapes(const World *world, const BB *bb, QTreeObject **result,
+    uint max_results, uint *num_results)
+{
+	int stat;
+	
+	stat = qtree_lookup(&world->shape_tree, bb, result, max_results,
+	    num_results);
+	return expand_proxies(bb, 0, result, max_results, num_results) || stat;
+}
+
 static void
 invoke_collision_handler(World *world, lua_State *L, Shape *A, Shape *B,
-    BB *resolve, uint func_id)
+    BB *resolve, const Contact *contact, uint func_id)
 {
 	extern int errfunc_index;
 	extern int callfunc_index;
@@ -92,12 +195,16 @@ invoke_collision_handler(World *world, lua_State *L, Shape *A, Shape *B,
 	lua_pushlightuserdata(L, A);
 	lua_pushlightuserdata(L, B);
 	
-	/* Push the resolution info. */
+	/* Push the resolution info: bounding box resolution, then contact
+	   normal and depth (moving A by normal * depth separates shapes). */
 	L_push_BB(L, resolve);
+	L_push_vect_f(L, contact->normal);
+	lua_pushnumber(L, contact->depth);
 	
 	/* Call Lua collision handler function. */
-	/* Stack: ... __CallFunc func_id false worldPtr shapeA shapeB resolve */
-	if (lua_pcall(L, 6, 0, errfunc_index)) {
+	/* Stack: ... __CallFunc func_id false worldPtr shapeA shapeB resolve
+	   normal depth */
+	if (prof_pcall(L, 8, errfunc_index, PROF_COLLISION, func_id)) {
 		log_err("[Lua] %s", lua_tostring(L, -1));
 		abort();
 	}
@@ -138,7 +245,7 @@ handle_shape_collisions(World *world, Shape *s, Collision *collision_array,
 	    s->go.bb.t + COLLISION_DISTANCE);
 	    
 	/* Get a list of shapes that this one potentially intersects. */
-	stat = qtree_lookup(&world->shape_tree, &exp_shape_bb, intersect_maybe,
+	stat = world_lookup_shapes(world, &exp_shape_bb, intersect_maybe,
 	    MAX_SHAPES, &num_shapes);
 #ifndef NDEBUG
 	if (stat != 0) {
@@ -158,10 +265,16 @@ handle_shape_collisions(World *world, Shape *s, Collision *collision_array,
 		if (s->body == other_s->body)
 			continue;	/* Skip shapes with the same body. */
 		
+		/* Reject pairs that have no handlers registered in either
+		   order. */
+		if (!(world->group_masks[s->group] &
+		    GROUP_CATEGORY(other_s->group)))
+			continue;
+		
 		/* Find if there's a collision routine registered for these
 		   shapes. */
-		handler = &world->collision_map[s->group][other_s->group];
-		if (handler->func_id != 0) {
+		handler = world_get_handler(world, s->group, other_s->group);
+		if (handler != NULL && handler->func_id != 0) {
 			assert(*num_collisions < max_collisions);
 			col = &collision_array[(*num_collisions)++];
 			col->func_id = handler->func_id;
@@ -174,8 +287,8 @@ handle_shape_collisions(World *world, Shape *s, Collision *collision_array,
 	
 		/* Switch order of shapes, and look for registered handler
 		   again. */
-		handler = &world->collision_map[other_s->group][s->group];
-		if (handler->func_id != 0) {
+		handler = world_get_handler(world, other_s->group, s->group);
+		if (handler != NULL && handler->func_id != 0) {
 			assert(*num_collisions < max_collisions);
 			col = &collision_array[(*num_collisions)++];
 			col->func_id = handler->func_id;
@@ -261,6 +374,7 @@ static void
 resolve_collisions(World *world, lua_State *L)
 {
 	BB resolve;
+	Contact contact;
 	Shape *s, *shape_A, *shape_B;
 	uint i, num_collisions;
 #define MAX_COLLISIONS 2000
@@ -313,6 +427,12 @@ resolve_collisions(World *world, lua_State *L)
 		prev_shape_A = shape_A;
 		prev_shape_B = shape_B;
 		
+		/* Exact test; pairs whose bounding boxes touch but shapes do
+		   not (e.g., circle near a corner) never reach Lua. */
+		if (!collide_shapes(shape_A, &shape_A->go.bb, shape_B,
+		    &shape_B->go.bb, &contact))
+			continue;
+		
 		/* Compute resolution box and invoke handler. */
 		if (bb_intersect_resolve(&shape_B->go.bb, &shape_A->go.bb, &resolve)) {
 #ifndef NDEBUG
@@ -323,9 +443,453 @@ resolve_collisions(World *world, lua_State *L)
 			shape_B->flags |= SHAPE_INTERSECT;
 #endif
 			invoke_collision_handler(world, L, shape_A, shape_B,
-			    &resolve, col->func_id);
+			    &resolve, &contact, col->func_id);
+		}
+	}
+}
+
+/*
+ * Check shape against query filter.
+ */
+static int
+filter_accepts(const World *world, const CastFilter *filter,
+    const Shape *other_s)
+{
+	Handler *handler;
+	
+	if (filter->ignore != NULL && other_s->body == filter->ignore)
+		return 0;
+	if (filter->group != 0 && other_s->group != filter->group)
+		return 0;
+	if (filter->handler_group != 0) {
+		if (!(world->group_masks[filter->handler_group] &
+		    GROUP_CATEGORY(other_s->group)))
+			return 0;
+		handler = world_get_handler(world, filter->handler_group,
+		    other_s->group);
+		if (handler == NULL || handler->func_id == 0)
+			handler = world_get_handler(world, other_s->group,
+			    filter->handler_group);
+		if (handler == NULL || handler->func_id == 0)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * State of a shape cast query, passed to sweep_hit() by qtree_sweep().
+ */
+typedef struct {
+	World		*world;
+	const Shape	*s;
+	BB		start;		/* Shape's box at the start. */
+	vect_f		center;		/* Circle center at the start. */
+	vect_f		delta;
+	const CastFilter *filter;
+	CastHit		*hit;
+	int		found;
+} SweepQuery;
+
+static double
+sweep_hit_shape(SweepQuery *q, Shape *other_s, double max_t)
+{
+	const Shape *s;
+	double toi;
+	vect_f normal;
+	int stat;
+	
+	assert(other_s->objtype == OBJTYPE_SHAPE);
+	s = q->s;
+	if (other_s == s || !filter_accepts(q->world, q->filter, other_s))
+		return max_t;
+	
+	if (s->shape_type == SHAPE_CIRCLE &&
+	    other_s->shape_type == SHAPE_CIRCLE) {
+		stat = circle_sweep(q->center, s->shape.circle.radius,
+		    q->delta, circle_center(&other_s->go.bb),
+		    other_s->shape.circle.radius, &toi, &normal);
+	} else {
+		stat = bb_sweep(&q->start, q->delta, &other_s->go.bb, &toi,
+		    &normal);
+	}
+	if (!stat || toi >= q->hit->toi)
+		return max_t;
+	q->hit->shape = other_s;
+	q->hit->toi = toi;
+	q->hit->normal = normal;
+	q->found = 1;
+	return MIN2(max_t, toi);
+}
+
+static double
+sweep_hit(QTreeObject *object, double max_t, void *arg)
+{
+	Body *body;
+	Shape *s;
+	
+	body = object->ptr;
+	if (body->objtype != OBJTYPE_BODY)
+		return sweep_hit_shape(arg, object->ptr, max_t);
+	
+	/* Body proxy: try each of its shapes. */
+	for (s = body->shapes; s != NULL; s = s->next) {
+		if (s->flags & SHAPE_PROXIED)
+			max_t = sweep_hit_shape(arg, s, max_t);
+	}
+	return max_t;
+}
+
+/*
+ * Sweep shape [s] (its body placed at [from]) along [delta] and find the first
+ * shape in world's shape tree it would touch. Shapes that [s] already overlaps
+ * at the start are not reported. Circles against circles are swept exactly,
+ * everything else as boxes (same as discrete collision). The tree is walked
+ * in the order the shape passes through it, and the walk stops once nothing
+ * nearer than the first hit so far can be found.
+ *
+ * Returns 1 and fills [hit] if something is hit, 0 otherwise.
+ */
+int
+world_shapecast(World *world, const Shape *s, vect_f from, vect_f delta,
+    const CastFilter *filter, CastHit *hit)
+{
+	SweepQuery q;
+	BB end;
+	
+	assert(world != NULL && s != NULL && filter != NULL && hit != NULL);
+	
+	/* Box movement is between rounded positions, like the boxes
+	   themselves. */
+	shape_bb_at(s, from, &q.start);
+	shape_bb_at(s, vect_f_add(from, delta), &end);
+	q.delta.x = end.l - q.start.l;
+	q.delta.y = end.b - q.start.b;
+	q.center = circle_center(&q.start);
+	
+	q.world = world;
+	q.s = s;
+	q.filter = filter;
+	q.hit = hit;
+	q.found = 0;
+	hit->toi = 2.0;
+	qtree_sweep(&world->shape_tree, &q.start, q.delta, sweep_hit, &q);
+	return q.found;
+}
+
+/*
+ * State of a ray cast query, passed to ray_hit() by qtree_raycast().
+ */
+typedef struct {
+	World		*world;
+	vect_f		from, delta;
+	const CastFilter *filter;
+	CastHit		*hits;
+	uint		max_hits, num_hits;
+} RayQuery;
+
+static double
+ray_hit_shape(RayQuery *q, Shape *s, double max_t)
+{
+	CastHit *hit;
+	double toi;
+	vect_f normal;
+	uint i;
+	int stat;
+	
+	assert(s->objtype == OBJTYPE_SHAPE);
+	if (!filter_accepts(q->world, q->filter, s))
+		return max_t;
+	
+	if (s->shape_type == SHAPE_CIRCLE) {
+		stat = circle_sweep(q->from, 0.0, q->delta,
+		    circle_center(&s->go.bb), s->shape.circle.radius, &toi,
+		    &normal);
+	} else {
+		stat = ray_bb(&s->go.bb, q->from, q->delta, &toi, &normal);
+	}
+	if (!stat || toi > max_t)
+		return max_t;
+	
+	/* Append hit, or if there's no room, replace the farthest one. */
+	if (q->num_hits < q->max_hits) {
+		hit = &q->hits[q->num_hits++];
+	} else {
+		hit = &q->hits[0];
+		for (i = 1; i < q->num_hits; i++) {
+			if (q->hits[i].toi > hit->toi)
+				hit = &q->hits[i];
 		}
 	}
+	hit->shape = s;
+	hit->toi = toi;
+	hit->normal = normal;
+	if (q->num_hits < q->max_hits)
+		return max_t;
+	
+	/* Array is full: hits further than the farthest one kept no longer
+	   matter, so the ray can be shortened. */
+	max_t = 0.0;
+	for (i = 0; i < q->num_hits; i++)
+		max_t = MAX2(max_t, q->hits[i].toi);
+	return max_t;
+}
+
+static double
+ray_hit(QTreeObject *object, double max_t, void *arg)
+{
+	Body *body;
+	Shape *s;
+	
+	body = object->ptr;
+	if (body->objtype != OBJTYPE_BODY)
+		return ray_hit_shape(arg, object->ptr, max_t);
+	
+	/* Body proxy: try each of its shapes. */
+	for (s = body->shapes; s != NULL; s = s->next) {
+		if (s->flags & SHAPE_PROXIED)
+			max_t = ray_hit_shape(arg, s, max_t);
+	}
+	return max_t;
+}
+
+static int
+hit_toi_cmp(const void *a, const void *b)
+{
+	const CastHit *ha = a;
+	const CastHit *hb = b;
+	
+	if (ha->toi == hb->toi)
+		return 0;
+	return (ha->toi < hb->toi) ? -1 : 1;
+}
+
+/*
+ * Cast a ray from [from] along [delta] and store up to [max_hits] nearest
+ * shapes it hits in [hits], nearest first. With [max_hits] = 1 this is a first
+ * hit query: tree traversal stops as soon as nothing nearer can be found.
+ * Shapes that contain [from] are not hit. Returns the number of hits.
+ */
+uint
+world_raycast(World *world, vect_f from, vect_f delta,
+    const CastFilter *filter, CastHit *hits, uint max_hits)
+{
+	RayQuery q;
+	
+	assert(world != NULL && filter != NULL && hits != NULL);
+	assert(max_hits > 0);
+	
+	q.world = world;
+	q.from = from;
+	q.delta = delta;
+	q.filter = filter;
+	q.hits = hits;
+	q.max_hits = max_hits;
+	q.num_hits = 0;
+	qtree_raycast(&world->shape_tree, from, delta, ray_hit, &q);
+	
+	qsort(hits, q.num_hits, sizeof(CastHit), hit_toi_cmp);
+	return q.num_hits;
+}
+
+/*
+ * Find shapes that overlap shape [s] with its body placed at [pos]. Found
+ * shapes are stored in [result].
+ *
+ * Return values:
+ *	0 -- success.
+ *	1 -- more than [max_results] shapes found; result is truncated.
+ */
+int
+world_overlap(World *world, const Shape *s, vect_f pos,
+    const CastFilter *filter, Shape **result, uint max_results,
+    uint *num_results)
+{
+	int stat;
+	uint i, num_shapes;
+	BB bb;
+	Shape *other_s;
+	Contact contact;
+	QTreeObject *overlap_maybe[MAX_SHAPES];
+	
+	assert(world != NULL && s != NULL && filter != NULL);
+	assert(result != NULL && num_results != NULL);
+	
+	shape_bb_at(s, pos, &bb);
+	stat = world_lookup_shapes(world, &bb, overlap_maybe,
+	    MAX_SHAPES, &num_shapes);
+	
+	*num_results = 0;
+	for (i = 0; i < num_shapes; i++) {
+		other_s = overlap_maybe[i]->ptr;
+		assert(other_s->objtype == OBJTYPE_SHAPE);
+		if (other_s == s || !filter_accepts(world, filter, other_s))
+			continue;
+		
+		/* Touching does not count. */
+		if (!collide_shapes(s, &bb, other_s, &other_s->go.bb,
+		    &contact) || contact.depth <= 0.0)
+			continue;
+		if (*num_results == max_results)
+			return 1;
+		result[(*num_results)++] = other_s;
+	}
+	return stat;
+}
+
+/*
+ * State of a nearest shape query, passed to object_distance() by
+ * qtree_nearest().
+ */
+typedef struct {
+	const World	*world;
+	vect_f		point;
+	const CastFilter *filter;
+} NearestQuery;
+
+static double
+shape_distance(const NearestQuery *q, const Shape *s)
+{
+	vect_f d;
+	double dist;
+	
+	assert(s->objtype == OBJTYPE_SHAPE);
+	if (!filter_accepts(q->world, q->filter, s))
+		return -1.0;
+	if (s->shape_type != SHAPE_CIRCLE)
+		return bb_distance(&s->go.bb, q->point);
+	
+	d = vect_f_sub(q->point, circle_center(&s->go.bb));
+	dist = sqrt(vect_f_dot(d, d)) - s->shape.circle.radius;
+	return MAX2(dist, 0.0);
+}
+
+/*
+ * Find nearest of the shapes that body proxy stands for. Returns NULL if
+ * none passes query filter.
+ */
+static Shape *
+nearest_proxied_shape(const NearestQuery *q, const Body *body, double *dist)
+{
+	double d;
+	Shape *s, *best;
+	
+	best = NULL;
+	for (s = body->shapes; s != NULL; s = s->next) {
+		if (!(s->flags & SHAPE_PROXIED))
+			continue;
+		d = shape_distance(q, s);
+		if (d >= 0.0 && (best == NULL || d < *dist)) {
+			best = s;
+			*dist = d;
+		}
+	}
+	return best;
+}
+
+static double
+object_distance(QTreeObject *object, void *arg)
+{
+	Body *body;
+	double dist;
+	
+	body = object->ptr;
+	if (body->objtype != OBJTYPE_BODY)
+		return shape_distance(arg, object->ptr);
+	if (nearest_proxied_shape(arg, body, &dist) == NULL)
+		return -1.0;
+	return dist;
+}
+
+/*
+ * Find shape nearest to [point], no further than [max_dist]. Returns NULL if
+ * there's none, otherwise the shape, and its distance in [dist].
+ */
+Shape *
+world_nearest_shape(World *world, vect_f point, double max_dist,
+    const CastFilter *filter, double *dist)
+{
+	NearestQuery q;
+	QTreeObject *object;
+	Body *body;
+	
+	assert(world != NULL && filter != NULL && dist != NULL);
+	
+	q.world = world;
+	q.point = point;
+	q.filter = filter;
+	object = qtree_nearest(&world->shape_tree, point, max_dist,
+	    object_distance, &q, dist);
+	if (object == NULL)
+		return NULL;
+	
+	/* If nearest is a body proxy, find out which of its shapes it was. */
+	body = object->ptr;
+	if (body->objtype == OBJTYPE_BODY)
+		return nearest_proxied_shape(&q, body, dist);
+	return object->ptr;
+}
+
+/*
+ * Continuous collision for bodies flagged BODY_FAST: sweep each of their
+ * shapes from previous step position to the current one. If a shape that has a
+ * collision handler with it is in the way, pull the body back to where they
+ * first touch. The regular (discrete) collision pass that follows then finds
+ * them touching and invokes the handler.
+ */
+static void
+sweep_fast_bodies(World *world)
+{
+	uint i;
+	int found;
+	vect_f delta, pos;
+	Body *body;
+	Shape *s;
+	CastFilter filter;
+	CastHit hit, first;
+	
+	for (i = 0; i < num_iter_bodies; i++) {
+		body = iter_bodies[i];
+		if (body == NULL || !(body->flags & BODY_FAST))
+			continue;
+		delta = vect_f_sub(body->pos, body->prevstep_pos);
+		if (delta.x == 0.0 && delta.y == 0.0)
+			continue;
+		
+		/* Find the earliest hit among all of body's shapes. */
+		found = 0;
+		first.toi = 2.0;
+		for (s = body->shapes; s != NULL; s = s->next) {
+			if (world->group_masks[s->group] == 0)
+				continue;	/* No handlers, can't collide. */
+			filter.group = 0;
+			filter.handler_group = s->group;
+			filter.ignore = body;
+			if (world_shapecast(world, s, body->prevstep_pos, delta,
+			    &filter, &hit) && hit.toi < first.toi) {
+				first = hit;
+				found = 1;
+			}
+		}
+		if (!found)
+			continue;
+		
+		/* Move back to contact. Along an axis aligned normal, the gap
+		   between boxes is a whole number of pixels; land exactly on
+		   it so rounding does not leave the boxes apart. */
+		pos = vect_f_add(body->prevstep_pos,
+		    vect_f_scale(delta, first.toi));
+		if (first.normal.y == 0.0)
+			pos.x = round(body->prevstep_pos.x) +
+			    round((round(body->pos.x) -
+			    round(body->prevstep_pos.x)) * first.toi);
+		else if (first.normal.x == 0.0)
+			pos.y = round(body->prevstep_pos.y) +
+			    round((round(body->pos.y) -
+			    round(body->prevstep_pos.y)) * first.toi);
+		body_set_pos(body, pos);
+		if (body->children != NULL)
+			body_update_children(body);
+	}
 }
 
 /*
@@ -333,12 +897,13 @@ resolve_collisions(World *world, lua_State *L)
  *
  * world		World about to be intialized.
  * step_ms		World step duration in milliseconds.
- * tree_depth		Depth of the quad trees that partition space.
+ * tree_depth		Initial depth of the quad trees that partition space.
  */
 static void
 world_init(World *world, const char *name, uint step_ms, uint tree_depth)
 {
 	extern uint64_t game_time;
+	extern Config config;
 	
 	assert(world != NULL);
 	assert(name != NULL && strlen(name) < WORLD_NAME_LENGTH);
@@ -351,27 +916,60 @@ world_init(World *world, const char *name, uint step_ms, uint tree_depth)
 	world->next_step_time = game_time;
 	world->step_ms = step_ms;
 	world->step_sec = (double)step_ms / 1000.0;
+	world->render_alpha = 1.0;
 	world->killme = 0;
 	world->virgin = 1;
 	
 	world->next_group_id = 1;
 	world->groups = NULL;
-	memset(world->collision_map, 0,
-	    WORLD_HANDLERS_MAX * WORLD_HANDLERS_MAX * sizeof(Handler));
+	world->group_masks = NULL;
+	world->max_groups = 0;
+	world->handlers = NULL;
+	world->handlers_size = 0;
+	world->num_handlers = 0;
 
 	memset(world->bg_color, 0, sizeof(float) * 4);
 	memset(world->timers, 0, sizeof(Timer) * WORLD_TIMERS_MAX);
 	memset(world->px_planes, 0, sizeof(Parallax *) * WORLD_PX_PLANES_MAX);
 	world->bodies = NULL;
+	world->anim_clocks = NULL;
+	world->anim_tiles = NULL;
+	world->num_anim_tiles = world->max_anim_tiles = 0;
+	world->stream = NULL;
+	world->stream_func_id = 0;
+	world->path_binds = NULL;
+	world->num_path_binds = world->max_path_binds = 0;
+	world->path_binds_sorted = 1;
+	world->path_t = NULL;
+	world->path_pos = NULL;
 
 	/* Set up tile & shape quad trees. */
-	qtree_init(&world->tile_tree, tree_depth);
-	qtree_init(&world->shape_tree, tree_depth);
+	qtree_init(&world->tile_tree, tree_depth, config.loose_trees);
+	qtree_init(&world->shape_tree, tree_depth, config.loose_trees);
 
 	/* Init static body. */
 	body_init(&world->static_body, world, vect_f_zero, BODY_SPECIAL);
 }
 
+/*
+ * Compute render interpolation factor from the time left until the next world
+ * step. The last step brought bodies to where they are at next_step_time -- so
+ * at [now], what we should draw lies somewhere between prevstep_pos and pos.
+ */
+void
+world_set_render_alpha(World *world, uint64_t now)
+{
+	assert(world != NULL);
+	if (world->paused || now >= world->next_step_time) {
+		world->render_alpha = 1.0;
+		return;
+	}
+	world->render_alpha = 1.0 - (double)(world->next_step_time - now) /
+	    world->step_ms;
+	if (world->render_alpha < 0.0)
+		world->render_alpha = 0.0;
+}
+
 /*
  * Create a new world and return its pointer. For argument descriptions
  * see world_init().
@@ -404,6 +1002,19 @@ world_destroy(World *world)
 	qtree_destroy(&world->tile_tree);
 	qtree_destroy(&world->shape_tree);
 
+	/* Tiles left the animation list when they were freed. */
+	assert(world->num_anim_tiles == 0);
+	if (world->anim_tiles != NULL)
+		mem_free(world->anim_tiles);
+	
+	/* Bodies were unbound from paths when they were freed. */
+	assert(world->num_path_binds == 0);
+	if (world->path_binds != NULL) {
+		mem_free(world->path_binds);
+		mem_free(world->path_t);
+		mem_free(world->path_pos);
+	}
+
 	memset(world, 0, sizeof(World));
 }
 
@@ -448,6 +1059,124 @@ world_remove_body(World *world, Body *body)
 	}
 }
 
+/*
+ * Move body along path: each step t is increased by speed * step duration and
+ * body is placed at the point path_interp() gives for t. If body is already on
+ * a path, it is moved to the new one.
+ */
+void
+world_bind_path(World *world, Body *body, Path *path, float t, float speed)
+{
+	PathBind *pb;
+	uint size;
+
+	assert(world != NULL && body != NULL && path != NULL);
+	assert(body->world == world && !(body->flags & BODY_SPECIAL));
+	
+	if (body->path_bind >= 0)
+		world_unbind_path(world, body);
+
+	/* Make room (scratch arrays grow along). */
+	if (world->num_path_binds == world->max_path_binds) {
+		size = world->max_path_binds ? world->max_path_binds * 2 : 16;
+		mem_realloc((void **)&world->path_binds,
+		    size * sizeof(PathBind), "Path bindings");
+		mem_realloc((void **)&world->path_t, size * sizeof(float),
+		    "Path times");
+		mem_realloc((void **)&world->path_pos, size * sizeof(vect_f),
+		    "Path positions");
+		world->max_path_binds = size;
+	}
+
+	body->path_bind = world->num_path_binds++;
+	pb = &world->path_binds[body->path_bind];
+	pb->body = body;
+	pb->path = path;
+	pb->t = t;
+	pb->speed = speed;
+	path->refcount++;
+	
+	/* Still grouped by path if it went after the path's other bodies. */
+	if (body->path_bind > 0 && pb[-1].path != path)
+		world->path_binds_sorted = 0;
+}
+
+/*
+ * Stop moving body along its path. The last binding takes the freed slot, so
+ * this does not preserve order.
+ */
+void
+world_unbind_path(World *world, Body *body)
+{
+	PathBind *pb;
+	uint last;
+
+	assert(world != NULL && body != NULL && body->path_bind >= 0);
+	assert((uint)body->path_bind < world->num_path_binds);
+
+	pb = &world->path_binds[body->path_bind];
+	assert(pb->body == body && pb->path->refcount > 0);
+	pb->path->refcount--;
+	
+	last = --world->num_path_binds;
+	if ((uint)body->path_bind != last) {
+		*pb = world->path_binds[last];
+		pb->body->path_bind = body->path_bind;
+		world->path_binds_sorted = 0;
+	}
+	body->path_bind = -1;
+}
+
+/*
+ * Path pointer comparison routine to use with qsort().
+ */
+static int
+path_bind_cmp(const void *a, const void *b)
+{
+	uintptr_t path_a, path_b;
+	
+	path_a = (uintptr_t)((const PathBind *)a)->path;
+	path_b = (uintptr_t)((const PathBind *)b)->path;
+	return (path_a > path_b) - (path_a < path_b);
+}
+
+/*
+ * Advance path bound bodies and move them to their new positions. Bindings are
+ * grouped by path, and all bodies on one path are interpolated in a batch.
+ */
+static void
+update_paths(World *world)
+{
+	PathBind *pb;
+	Path *path;
+	uint i, j, k, n;
+
+	n = world->num_path_binds;
+	if (!world->path_binds_sorted) {
+		qsort(world->path_binds, n, sizeof(PathBind), path_bind_cmp);
+		for (i = 0; i < n; i++)
+			world->path_binds[i].body->path_bind = i;
+		world->path_binds_sorted = 1;
+	}
+
+	for (i = 0; i < n; i = j) {
+		/* Bindings [i, j) share the same path. */
+		path = world->path_binds[i].path;
+		for (j = i; j < n && world->path_binds[j].path == path; j++) {
+			pb = &world->path_binds[j];
+			pb->t += pb->speed * world->step_sec;
+			world->path_t[j - i] = pb->t;
+		}
+		if (path_interp_batch(path, world->path_t, world->path_pos,
+		    j - i) != 0)
+			continue;	/* Fewer than two points. */
+		for (k = i; k < j; k++) {
+			body_set_pos(world->path_binds[k].body,
+			    world->path_pos[k - i]);
+		}
+	}
+}
+
 /*
  * Destroy world and free its memory.
  */
@@ -485,6 +1214,11 @@ world_clear(World *world)
 	while (world->bodies != NULL)
 		body_free(world->bodies);
 
+	/* Stop streaming room cells; the objects of loaded cells go along
+	   with the rest of static body's objects. */
+	stream_close(world);
+	world->stream_func_id = 0;
+	
 	/* Free tiles and shapes owned by world's static body. */
 	while (world->static_body.tiles != NULL)
 		tile_free(world->static_body.tiles);
@@ -510,9 +1244,143 @@ world_clear(World *world)
 	}
 	world->next_group_id = 1;	/* Reset ID counter. */
 	
-	/* Clear collision handler map. */
-	memset(world->collision_map, 0,
-	    WORLD_HANDLERS_MAX * WORLD_HANDLERS_MAX * sizeof(Handler));
+	/* Free group masks and collision handler table. */
+	if (world->group_masks != NULL) {
+		mem_free(world->group_masks);
+		world->group_masks = NULL;
+		world->max_groups = 0;
+	}
+	if (world->handlers != NULL) {
+		mem_free(world->handlers);
+		world->handlers = NULL;
+		world->handlers_size = 0;
+		world->num_handlers = 0;
+	}
+}
+
+/*
+ * Find collision group by name. If there's no such group, create it.
+ */
+Group *
+world_get_group(World *world, const char *name)
+{
+	extern mem_pool mp_group;
+	Group *group;
+	uint old_max;
+	
+	assert(world != NULL && name != NULL);
+	assert(strlen(name) < WORLD_GROUPNAME_LENGTH);
+	
+	HASH_FIND_STR(world->groups, name, group);
+	if (group != NULL)
+		return group;
+	
+	group = mp_alloc(&mp_group);
+	strcpy(group->name, name);
+	group->id = world->next_group_id++;
+	HASH_ADD_STR(world->groups, name, group);
+	
+	/* Make room for group's collision mask. */
+	if (group->id >= world->max_groups) {
+		old_max = world->max_groups;
+		world->max_groups = old_max ? old_max * 2 : 64;
+		mem_realloc((void **)&world->group_masks,
+		    world->max_groups * sizeof(uint64_t), "Group masks");
+		memset(world->group_masks + old_max, 0,
+		    (world->max_groups - old_max) * sizeof(uint64_t));
+	}
+	return group;
+}
+
+static uint
+handler_hash(uint group_A, uint group_B)
+{
+	return (group_A * 2654435761u) ^ (group_B * 40503u);
+}
+
+/*
+ * Find slot for handler (group_A, group_B): either the one where it is stored,
+ * or the empty one where it would go.
+ */
+static Handler *
+handler_slot(Handler *table, uint size, uint group_A, uint group_B)
+{
+	uint i, mask;
+	Handler *h;
+	
+	mask = size - 1;
+	for (i = handler_hash(group_A, group_B) & mask;; i = (i + 1) & mask) {
+		h = &table[i];
+		if (h->group_A == 0 ||
+		    (h->group_A == group_A && h->group_B == group_B))
+			return h;
+	}
+}
+
+/*
+ * Return collision handler registered for shapes of group A colliding with
+ * shapes of group B, or NULL if there's none.
+ */
+Handler *
+world_get_handler(const World *world, uint group_A, uint group_B)
+{
+	Handler *h;
+	
+	if (world->num_handlers == 0)
+		return NULL;
+	h = handler_slot(world->handlers, world->handlers_size, group_A,
+	    group_B);
+	return (h->group_A == 0) ? NULL : h;
+}
+
+/*
+ * Register (or replace) collision handler for group A vs group B. Table is
+ * kept at most half full.
+ */
+void
+world_set_handler(World *world, uint group_A, uint group_B, uint func_id,
+    int priority)
+{
+	Handler *old_table, *h;
+	uint i, old_size;
+	
+	assert(world != NULL);
+	assert(group_A > 0 && group_A < world->next_group_id);
+	assert(group_B > 0 && group_B < world->next_group_id);
+	
+	/* Grow and rehash. */
+	if (2 * (world->num_handlers + 1) > world->handlers_size) {
+		old_table = world->handlers;
+		old_size = world->handlers_size;
+		world->handlers_size = old_size ? old_size * 2 : 64;
+		world->handlers = mem_alloc(world->handlers_size *
+		    sizeof(Handler), "Collision handlers");
+		memset(world->handlers, 0, world->handlers_size *
+		    sizeof(Handler));
+		for (i = 0; i < old_size; i++) {
+			if (old_table[i].group_A == 0)
+				continue;
+			h = handler_slot(world->handlers, world->handlers_size,
+			    old_table[i].group_A, old_table[i].group_B);
+			*h = old_table[i];
+		}
+		if (old_table != NULL)
+			mem_free(old_table);
+	}
+	
+	h = handler_slot(world->handlers, world->handlers_size, group_A,
+	    group_B);
+	if (h->group_A == 0) {
+		h->group_A = group_A;
+		h->group_B = group_B;
+		world->num_handlers++;
+	}
+	h->func_id = func_id;
+	h->priority = priority;
+	
+	/* Pair is now interesting in either order. */
+	world->group_masks[group_A] |= GROUP_CATEGORY(group_B);
+	world->group_masks[group_B] |= GROUP_CATEGORY(group_A);
 }
 
 /*
@@ -579,7 +1447,7 @@ run_timers(World *world, lua_State *L)
 		lua_pushboolean(L, 1);
 		/* Call Lua timer function. */
 		/* Stack: ... __CallFunc func_id true */
-		if (lua_pcall(L, 2, 0, errfunc_index)) {
+		if (prof_pcall(L, 2, errfunc_index, PROF_TIMER, func_id)) {
 			log_err("[Lua] %s", lua_tostring(L, -1));
 			abort();
 		}
@@ -643,6 +1511,24 @@ step_bodies(World *world, lua_State *L, int afterstep)
 	}
 }
 
+/*
+ * Hierarchy pass: move linked child bodies that follow their parents. Only
+ * hierarchy roots are visited here; body_update_children() descends the rest.
+ * All bodies are looked at, not just iter_bodies: a sleeping parent may still
+ * have been moved by a script (or be followed by bodies that are awake).
+ */
+static void
+update_hierarchy(World *world)
+{
+	Body *body;
+	
+	for (body = world->bodies; body != NULL; body = body->next) {
+		if (body->parent != NULL || body->children == NULL)
+			continue;
+		body_update_children(body);
+	}
+}
+
 /*
  * Execute body step functions and timers, then resolve collision (call
  * registered collision handlers), then execute after-step functions.
@@ -667,10 +1553,16 @@ world_step(World *world, lua_State *L, int first_step)
 	Camera *cam;
 	uint cam_i, num_cam_data;
 	vect_f diff;
+	uint64_t step_start, t;
+	
+	step_start = TRACE_BEGIN();
 	
 	/* Shouldn't be a dying world. */
 	assert(world != NULL && !world->killme);
 	
+	/* Scripts are about to run, drawn frame must be captured again. */
+	render_invalidate();
+	
 	/* Prepare an array with camera data (position and size) for this
 	   world. */
 	num_cam_data = 0;
@@ -715,15 +1607,40 @@ world_step(World *world, lua_State *L, int first_step)
 	save_prev_body_positions(world, first_step);
 	
 	/* Execute timers and step functions. */
+	t = TRACE_BEGIN();
 	run_timers(world, L);
+	TRACE_END("Timers", t);
+	t = TRACE_BEGIN();
 	step_bodies(world, L, 0);
+	TRACE_END("Step functions", t);
+	
+	/* Move bodies along their paths. */
+	t = TRACE_BEGIN();
+	update_paths(world);
+	TRACE_END("Paths", t);
+	
+	/* Drag linked children along with their parents. */
+	update_hierarchy(world);
 	
-	/* Now that body positions have possibly changed, resolve collisions. */
+	/* Stop fast bodies at the first thing they would have passed through,
+	   then resolve collisions now that body positions have possibly
+	   changed. */
+	t = TRACE_BEGIN();
+	sweep_fast_bodies(world);
+	TRACE_END("Sweep", t);
+	t = TRACE_BEGIN();
 	resolve_collisions(world, L);
+	TRACE_END("Collisions", t);
 	
 	/* Call after-step functions. */
+	t = TRACE_BEGIN();
 	step_bodies(world, L, 1);
+	TRACE_END("After-step functions", t);
 
-	/* Advance world step number. */
+	/* Advance world step number, then bring animated tiles up to it. */
 	world->step++;
+	t = TRACE_BEGIN();
+	tile_step_anims(world);
+	TRACE_END("Animation", t);
+	TRACE_END("World step", step_start);
 }
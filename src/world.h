@@ -4,12 +4,13 @@
 #include <lua.h>
 #include "common.h"
 #include "qtree.h"
+#include "path.h"
 #include "physics.h"
 #include "str.h"
 
 #define WORLD_TIMERS_MAX	5
 #define WORLD_PX_PLANES_MAX	300
-#define WORLD_HANDLERS_MAX	200
+#define WORLD_GROUPS_EST	200	/* Estimated number of groups (pool size). */
 #define WORLD_NAME_LENGTH	50
 #define WORLD_GROUPNAME_LENGTH	50
 
@@ -31,9 +32,21 @@ typedef struct {
 } Group;
 
 /*
- * Collision handler struct.
+ * Each group has a category bit (group ID modulo 64), and a mask of the
+ * categories it has collision handlers with (in either order). If
+ *	mask[A] & GROUP_CATEGORY(B)
+ * is zero, there is no handler for A vs B or B vs A, and the pair can be
+ * skipped without looking at the handler table. With more than 64 groups
+ * categories are shared, which only means some pairs get looked up in vain.
+ */
+#define GROUP_CATEGORY(id)	((uint64_t)1 << ((id) & 63))
+
+/*
+ * Collision handler struct. Handlers are kept in an open addressing hash
+ * table keyed by (group_A, group_B); group_A == 0 marks an empty slot.
  */
 typedef struct {
+	uint		group_A, group_B; /* Collision group IDs. */
 	uint		func_id;	/* Collision handler function ID. */
 	int		priority;	/* Handler priority determines order in
 					   which handlers are executed when
@@ -41,6 +54,16 @@ typedef struct {
 					   other shape simultaneously. */
 } Handler;
 
+/*
+ * Body moving along a path (see world_bind_path()).
+ */
+typedef struct {
+	Body		*body;
+	Path		*path;
+	float		t;		/* Current time (progress) value. */
+	float		speed;		/* Change of t per second. */
+} PathBind;
+
 /*
  * World struct describes a physical world instance.
  */
@@ -53,6 +76,9 @@ typedef struct World_t {
 	uint	step_ms;	/* Duration of one step in milliseconds. */
 	double	step_sec;	/* Duration of one step in seconds. */
 	uint64_t next_step_time;
+	float	render_alpha;	/* How far (0..1) present game time is from
+				   previous step to the current one. Used to
+				   interpolate body positions when drawing. */
 	int	paused;		/* Is world paused? */
 	
 	Body	static_body;	/* Body for all static shapes. */
@@ -61,13 +87,35 @@ typedef struct World_t {
 	QTree	tile_tree;	/* Quad tree for tiles. */
 	QTree	shape_tree;	/* Quad tree for shapes. */
 	Timer	timers[WORLD_TIMERS_MAX];
+	struct AnimClock_t *anim_clocks; /* Shared tile animation clocks. */
+	struct Tile_t **anim_tiles;	/* Animated tiles (see
+					   tile_step_anims()). */
+	uint	num_anim_tiles, max_anim_tiles;
 	struct Parallax_t *px_planes[WORLD_PX_PLANES_MAX]; /* Parallax planes.*/
+	struct Stream_t *stream;	/* Streamed room (see stream.h). */
+
+	/* Bodies bound to paths. Kept sorted by path (when path_binds_sorted
+	   is set), so that each path's bodies are moved with one
+	   path_interp_batch() call. path_t and path_pos are scratch arrays
+	   of the same size. */
+	PathBind *path_binds;
+	uint	num_path_binds, max_path_binds;
+	int	path_binds_sorted;
+	float	*path_t;
+	vect_f	*path_pos;
+	uint	stream_func_id;	/* Script function called when streamed
+				   room cells come and go. */
 	
 	uint	next_group_id;	/* Collision groups are given consecutive IDs.*/
 	Group	*groups;	/* Map collision group name hashes to group
 				   name and ID. */
+	uint64_t *group_masks;	/* Collision mask for each group ID. */
+	uint	max_groups;	/* Allocated size of group_masks. */
+	
 	/* Map pairs of collision group IDs to their collision handler. */
-	Handler collision_map[WORLD_HANDLERS_MAX][WORLD_HANDLERS_MAX];
+	Handler	*handlers;	/* Hash table (size is a power of two). */
+	uint	handlers_size;
+	uint	num_handlers;
 
 	int	killme;		/* If true, world should be freed as soon
 				   as possible. */
@@ -77,13 +125,57 @@ typedef struct World_t {
 				   rendered. */
 } World;
 
+/*
+ * Which shapes a shape cast (see world_shapecast()) can hit.
+ */
+typedef struct {
+	uint		group;		/* Only shapes in this group (0 = any).*/
+	uint		handler_group;	/* Only shapes whose group has a
+					   collision handler with this group
+					   (0 = any). */
+	const Body	*ignore;	/* Skip shapes of this body. */
+} CastFilter;
+
+/*
+ * Result of a shape cast.
+ */
+typedef struct {
+	Shape	*shape;		/* Shape that was hit. */
+	double	toi;		/* Time of impact: fraction of movement. */
+	vect_f	normal;		/* Contact normal, pointing away from the hit
+				   shape. */
+} CastHit;
+
 World	*world_new(const char *name, uint step_ms, uint tree_depth);
+void	 world_set_render_alpha(World *world, uint64_t now);
 void	 world_free(World *world);
 void	 world_clear(World *world);
 void	 world_step(World *world, lua_State *L, int first_step);
 
+Group	*world_get_group(World *world, const char *name);
+Handler	*world_get_handler(const World *world, uint group_A, uint group_B);
+void	 world_set_handler(World *world, uint group_A, uint group_B,
+	     uint func_id, int priority);
+
+int	 world_lookup_tiles(const World *world, const BB *bb,
+	     QTreeObject **result, uint max_results, uint *num_results);
+int	 world_lookup_shapes(const World *world, const BB *bb,
+	     QTreeObject **result, uint max_results, uint *num_results);
+int	 world_shapecast(World *world, const Shape *s, vect_f from,
+	     vect_f delta, const CastFilter *filter, CastHit *hit);
+uint	 world_raycast(World *world, vect_f from, vect_f delta,
+	     const CastFilter *filter, CastHit *hits, uint max_hits);
+int	 world_overlap(World *world, const Shape *s, vect_f pos,
+	     const CastFilter *filter, Shape **result, uint max_results,
+	     uint *num_results);
+Shape	*world_nearest_shape(World *world, vect_f point, double max_dist,
+	     const CastFilter *filter, double *dist);
+
 Timer	*world_add_timer(World *world, double when, uint func_id);
 void	 world_add_body(World *world, Body *body);
 void	 world_remove_body(World *world, Body *body);
+void	 world_bind_path(World *world, Body *body, Path *path, float t,
+	     float speed);
+void	 world_unbind_path(World *world, Body *body);
 
 #endif /* WORLD_H */
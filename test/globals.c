@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include "game2d.h"
+#include "mem.h"
+#include "path.h"
+#include "physics.h"
+#include "qtree.h"
+#include "world.h"
+#include "globals.h"
+
+/* Same globals as in main.c. */
+World	*worlds[WORLDS_MAX];
+Camera	*cameras[CAMERAS_MAX];
+
+int	drawShapes, drawTileTree, drawShapeTree, outsideView;
+
+mem_pool mp_world, mp_camera, mp_parallax;
+mem_pool mp_shape, mp_listvect, mp_path;
+mem_pool mp_texture, mp_sprite, mp_tile, mp_animclock;
+mem_pool mp_body;
+mem_pool mp_treenode, mp_treeobjptr;
+mem_pool mp_group;
+
+uint64_t game_time;
+
+uint	*key_bind;
+float	frames_per_second;
+
+int	eapi_index;
+int	errfunc_index;
+int	callfunc_index;
+
+/*
+ * Nothing to redraw without a game window.
+ */
+void
+redraw_frame(void)
+{
+}
+
+/*
+ * No render thread to wait for.
+ */
+void
+game_quit(void)
+{
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * Memory pools, sized as in main.c.
+ */
+void
+setup_memory(void)
+{
+	mem_pool_init(&mp_world, sizeof(World), WORLDS_MAX, "World pool");
+	mem_pool_init(&mp_camera, sizeof(Camera), CAMERAS_MAX, "Camera pool");
+	mem_pool_init(&mp_parallax, sizeof(Parallax),
+	    WORLDS_MAX * WORLD_PX_PLANES_MAX, "Parallax pool");
+	
+	mem_pool_init(&mp_shape, sizeof(Shape), 4000, "Shape pool");
+	mem_pool_init(&mp_listvect, sizeof(vect_f_list), 100, "List vector pool");
+	mem_pool_init(&mp_path, sizeof(Path), 20, "Path pool");
+	
+	mem_pool_init(&mp_texture, sizeof(Texture), 100, "Texture pool");
+	mem_pool_init(&mp_sprite, sizeof(SpriteList), 1000, "SpriteList pool");
+	mem_pool_init(&mp_tile, sizeof(Tile), TILES_MAX, "Tile pool");
+	mem_pool_init(&mp_animclock, sizeof(AnimClock), 1000,
+	    "Animation clock pool");
+	mem_pool_init(&mp_body, sizeof(Body), 10000, "Body pool");
+	mem_pool_init(&mp_treenode, sizeof(QTreeNode), 20000, "Quad tree node "
+	    "pool");
+	mem_pool_init(&mp_treeobjptr, sizeof(QTreeObjectPtr), 50000,
+	    "Quad tree object pointer pool");
+	mem_pool_init(&mp_group, sizeof(Group), WORLD_GROUPS_EST,
+	    "Shape collision group pool");
+}
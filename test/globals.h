@@ -0,0 +1,14 @@
+#ifndef GLOBALS_H
+#define GLOBALS_H
+
+/*
+ * Programs that link with the engine sources but not main.c (tests,
+ * benchmarks) get the globals main.c would define from globals.c.
+ */
+
+extern int	errfunc_index;	/* Lua stack locations, set these up */
+extern int	callfunc_index;	/* before running scripts. */
+
+void	setup_memory(void);
+
+#endif /* GLOBALS_H */
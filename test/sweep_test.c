@@ -0,0 +1,149 @@
+/*
+ * Fast body sweep test: a BODY_FAST body that a step function moves across a
+ * wall is stopped at the wall and its collision handler runs, also when there
+ * are many more walls behind the first one, while one that is teleported
+ * across (body_teleport(), SetPos with teleport set) ends up on the other side
+ * without touching the wall.
+ *
+ * Script callbacks are not real Lua functions here: __CallFunc is replaced
+ * by call_func(), which acts on the function ID it is given.
+ */
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include <stdio.h>
+#include "log.h"
+#include "physics.h"
+#include "utlist.h"
+#include "world.h"
+#include "globals.h"
+
+enum {
+	FUNC_HANDLER = 1,	/* Bullet hits wall. */
+	FUNC_MOVE,		/* Step function: move bullet past the wall. */
+	FUNC_TELEPORT		/* Step function: teleport it there. */
+};
+
+static const vect_f	start = {0.0, 0.0};
+static const vect_f	target = {30000.0, 0.0};
+
+static Body		*bullet;
+static int		num_hits;
+static int		failed;
+
+#define CHECK(cond)							\
+do {									\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,	\
+		    __LINE__, #cond);					\
+		failed = 1;						\
+	}								\
+} while (0)
+
+/*
+ * Stand-in for eapi.__CallFunc(func_id, rm_bool, ...).
+ */
+static int
+call_func(lua_State *L)
+{
+	switch (lua_tointeger(L, 1)) {
+	case FUNC_HANDLER:
+		num_hits++;
+		break;
+	case FUNC_MOVE:
+		body_set_pos(bullet, target);
+		break;
+	case FUNC_TELEPORT:
+		body_teleport(bullet, target);
+		break;
+	}
+	return 0;
+}
+
+static Shape *
+add_box(Body *body, int l, int b, int r, int t, uint group)
+{
+	Shape *s;
+
+	s = shape_new();
+	s->shape_type = SHAPE_RECTANGLE;
+	bb_init(&s->shape.rect, l, b, r, t);
+	s->group = group;
+	s->body = body;
+	DL_APPEND(body->shapes, s);
+	shape_add_tree(s);
+	return s;
+}
+
+/*
+ * Put [num_walls] walls 10 pixels thick and 20 apart, starting from x = 100,
+ * and a bullet at the origin. Run one step with step function [func_id] and
+ * return where the bullet ended up.
+ */
+static vect_f
+run(lua_State *L, int func_id, int num_walls)
+{
+	World *world;
+	uint wall_g, bullet_g;
+	vect_f pos;
+	int i;
+
+	world = world_new("Sweep test", 10, 10);
+	wall_g = world_get_group(world, "Wall")->id;
+	bullet_g = world_get_group(world, "Bullet")->id;
+	world_set_handler(world, bullet_g, wall_g, FUNC_HANDLER, 0);
+
+	for (i = 0; i < num_walls; i++)
+		add_box(&world->static_body, 100 + 20*i, -50, 110 + 20*i, 50,
+		    wall_g);
+	bullet = body_new(world, start, BODY_FAST);
+	add_box(bullet, -2, -2, 2, 2, bullet_g);
+	bullet->step_func_id = func_id;
+
+	num_hits = 0;
+	world_step(world, L, 1);
+	pos = bullet->pos;
+
+	/* Teleported body is drawn where it is, not sliding over. */
+	if (func_id == FUNC_TELEPORT) {
+		CHECK(bullet->prevstep_pos.x == pos.x &&
+		    bullet->prevstep_pos.y == pos.y);
+	}
+	world_free(world);
+	return pos;
+}
+
+int
+main(void)
+{
+	lua_State *L;
+	vect_f pos;
+
+	log_open(NULL);
+	setup_memory();
+	L = luaL_newstate();
+	errfunc_index = 0;	/* No error handler. */
+	lua_pushcfunction(L, call_func);
+	callfunc_index = lua_gettop(L);
+
+	/* Moved across: stopped at the wall, handler runs. */
+	pos = run(L, FUNC_MOVE, 1);
+	CHECK(pos.x < 100.0);
+	CHECK(num_hits == 1);
+	
+	/* Same with more walls in the way than fit in a lookup array. */
+	pos = run(L, FUNC_MOVE, 1000);
+	CHECK(pos.x < 100.0);
+	CHECK(num_hits == 1);
+
+	/* Teleported across: stays where it was put, no collision. */
+	pos = run(L, FUNC_TELEPORT, 1);
+	CHECK(pos.x == target.x && pos.y == target.y);
+	CHECK(num_hits == 0);
+
+	lua_close(L);
+	printf("sweep_test: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}